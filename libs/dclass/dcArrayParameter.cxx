@@ -141,6 +141,15 @@ get_array_size() const {
   return _array_size;
 }
 
+/**
+ * Returns the range of legal element counts for this array.  Empty if any
+ * count is legal.
+ */
+const DCUnsignedIntRange &DCArrayParameter::
+get_array_size_range() const {
+  return _array_size_range;
+}
+
 /**
  * Returns the type represented by this_type[size].
  *
@@ -40,6 +40,8 @@ PUBLISHED:
   int get_array_size() const;
 
 public:
+  const DCUnsignedIntRange &get_array_size_range() const;
+
   virtual DCParameter *append_array_specification(const DCUnsignedIntRange &size);
 
   virtual int calc_num_nested_fields(size_t length_bytes) const;
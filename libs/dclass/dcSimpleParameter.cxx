@@ -288,6 +288,43 @@ get_divisor() const {
   return _divisor;
 }
 
+/**
+ * Returns the range of legal values for a signed integer type of up to 32
+ * bits, already scaled by the divisor.  Empty if any value is legal.
+ */
+const DCIntRange &DCSimpleParameter::
+get_int_range() const {
+  return _int_range;
+}
+
+/**
+ * Returns the range of legal values for an unsigned integer type of up to 32
+ * bits (or char), already scaled by the divisor; for a string or blob, the
+ * range of legal lengths.  Empty if anything is legal.
+ */
+const DCUnsignedIntRange &DCSimpleParameter::
+get_uint_range() const {
+  return _uint_range;
+}
+
+/**
+ * Returns the range of legal values for an int64 type, already scaled by
+ * the divisor.  Empty if any value is legal.
+ */
+const DCInt64Range &DCSimpleParameter::
+get_int64_range() const {
+  return _int64_range;
+}
+
+/**
+ * Returns the range of legal values for a uint64 type, already scaled by
+ * the divisor.  Empty if any value is legal.
+ */
+const DCUnsignedInt64Range &DCSimpleParameter::
+get_uint64_range() const {
+  return _uint64_range;
+}
+
 /**
  * Returns true if the type is a numeric type (and therefore can accept a
  * divisor and/or a modulus), or false if it is some string-based type.
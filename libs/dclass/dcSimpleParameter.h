@@ -47,6 +47,11 @@ public:
   bool set_divisor(unsigned int divisor);
   bool set_range(const DCDoubleRange &range);
 
+  const DCIntRange &get_int_range() const;
+  const DCUnsignedIntRange &get_uint_range() const;
+  const DCInt64Range &get_int64_range() const;
+  const DCUnsignedInt64Range &get_uint64_range() const;
+
   virtual int calc_num_nested_fields(size_t length_bytes) const;
   virtual DCPackerInterface *get_nested_field(int n) const;
 
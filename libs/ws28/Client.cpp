@@ -3,8 +3,10 @@
 
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <zlib.h>
 
 #include <array>
+#include <chrono>
 #include <string>
 #include <sstream>
 #include <cassert>
@@ -91,6 +93,84 @@ namespace detail {
 	}
 	
 	
+	std::string_view Trim(std::string_view v){
+		while(!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+		while(!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+		return v;
+	}
+	
+	// What we agreed to in a permessage-deflate offer (RFC 7692 section 7.1)
+	struct DeflateOffer {
+		bool serverNoContextTakeover = false;
+		int serverMaxWindowBits = 0; // 0 if the client didn't ask for a limit
+	};
+	
+	// Picks the first permessage-deflate offer in a Sec-WebSocket-Extensions header that we can honor.
+	// Offers with parameters we don't know, or a window smaller than zlib can do (8 bits), are declined.
+	bool ParseDeflateOffers(std::string_view header, DeflateOffer &result){
+		while(!header.empty()){
+			auto offerEnd = header.find(',');
+			auto offer = header.substr(0, offerEnd);
+			header = offerEnd == std::string_view::npos ? std::string_view() : header.substr(offerEnd + 1);
+			
+			auto nameEnd = offer.find(';');
+			if(!equalsi(Trim(offer.substr(0, nameEnd)), "permessage-deflate")) continue;
+			offer = nameEnd == std::string_view::npos ? std::string_view() : offer.substr(nameEnd + 1);
+			
+			DeflateOffer candidate;
+			bool acceptable = true;
+			
+			while(acceptable && !offer.empty()){
+				auto paramEnd = offer.find(';');
+				auto param = offer.substr(0, paramEnd);
+				offer = paramEnd == std::string_view::npos ? std::string_view() : offer.substr(paramEnd + 1);
+				
+				std::string_view value;
+				auto equals = param.find('=');
+				if(equals != std::string_view::npos){
+					value = Trim(param.substr(equals + 1));
+					if(value.size() >= 2 && value.front() == '"' && value.back() == '"'){
+						value = value.substr(1, value.size() - 2);
+					}
+					param = param.substr(0, equals);
+				}
+				param = Trim(param);
+				
+				if(equalsi(param, "server_no_context_takeover") && value.empty()){
+					candidate.serverNoContextTakeover = true;
+				}else if(equalsi(param, "client_no_context_takeover") && value.empty()){
+					// Only constrains the client; our inflater copes either way
+				}else if(equalsi(param, "client_max_window_bits")){
+					// Likewise, we always inflate with the largest window
+				}else if(equalsi(param, "server_max_window_bits")){
+					if(value.size() != 1 && value.size() != 2){
+						acceptable = false;
+						break;
+					}
+					int bits = 0;
+					for(char c : value){
+						if(c < '0' || c > '9'){
+							acceptable = false;
+							break;
+						}
+						bits = bits * 10 + (c - '0');
+					}
+					if(bits < 9 || bits > 15) acceptable = false;
+					candidate.serverMaxWindowBits = bits;
+				}else{
+					acceptable = false;
+				}
+			}
+			
+			if(acceptable){
+				result = candidate;
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
 	struct Corker {
 		Client &client;
 		
@@ -99,6 +179,35 @@ namespace detail {
 	};
 }
 
+// Per-client zlib state once permessage-deflate is negotiated
+struct Client::PerMessageDeflate {
+	z_stream deflater{};
+	z_stream inflater{};
+	bool deflaterReady;
+	bool inflaterReady;
+	bool noContextTakeover;
+	size_t minSize;
+	
+	// Scratch space, kept around between messages
+	std::vector<char> deflated;
+	std::vector<char> inflated;
+	
+	PerMessageDeflate(int level, int windowBits, bool noContextTakeover, size_t minSize)
+		: noContextTakeover(noContextTakeover), minSize(minSize){
+		// Negative window bits: raw deflate, as the extension requires
+		deflaterReady = deflateInit2(&deflater, level, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+		inflaterReady = inflateInit2(&inflater, -15) == Z_OK;
+	}
+	
+	~PerMessageDeflate(){
+		if(deflaterReady) deflateEnd(&deflater);
+		if(inflaterReady) inflateEnd(&inflater);
+	}
+	
+	PerMessageDeflate(const PerMessageDeflate &other) = delete;
+	PerMessageDeflate& operator=(const PerMessageDeflate &other) = delete;
+};
+
 struct DataFrameHeader {
 	char *data;
 	
@@ -195,6 +304,38 @@ Client::~Client(){
 	assert(!m_Socket);
 }
 
+void Client::ProcessCompressedDataFrame(uint8_t opcode, const char *data, size_t len){
+	auto &d = *m_pDeflate;
+	if(!d.inflaterReady) return Close(1011, "Decompression unavailable");
+	
+	// The sender strips this off the end of every message (RFC 7692 section 7.2.2)
+	static const unsigned char tail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+	
+	size_t maxSize = m_pServer->m_iMaxMessageSize;
+	d.inflated.resize(maxSize);
+	d.inflater.next_out = (Bytef*) d.inflated.data();
+	d.inflater.avail_out = (uInt) maxSize;
+	
+	for(int pass = 0; pass < 2; ++pass){
+		d.inflater.next_in = pass == 0 ? (Bytef*) data : (Bytef*) tail;
+		d.inflater.avail_in = pass == 0 ? (uInt) len : (uInt) sizeof(tail);
+		
+		while(d.inflater.avail_in > 0){
+			int res = inflate(&d.inflater, Z_SYNC_FLUSH);
+			if(res == Z_STREAM_END){
+				// The client finished its stream with a final block; the next message starts a new one
+				inflateReset(&d.inflater);
+				continue;
+			}
+			if(res == Z_BUF_ERROR && d.inflater.avail_out == 0) return Close(1009, "Message too large");
+			if(res != Z_OK && res != Z_BUF_ERROR) return Close(1007, "Invalid compressed data");
+			if(res == Z_BUF_ERROR) break;
+		}
+	}
+	
+	ProcessDataFrame(opcode, d.inflated.data(), maxSize - d.inflater.avail_out);
+}
+
 void Client::Destroy(){
 	if(!m_Socket) return;
 	
@@ -343,14 +484,14 @@ void Client::Write(const char *data){
 	Write(data, strlen(data));
 }
 
-void Client::WriteDataFrameHeader(uint8_t opcode, size_t len, char *headerStart){
+void Client::WriteDataFrameHeader(uint8_t opcode, size_t len, char *headerStart, bool compressed){
 	DataFrameHeader header{ headerStart };
 	
 	header.reset();
 	header.fin(true);
 	header.opcode(opcode);
 	header.mask(false);
-	header.rsv1(false);
+	header.rsv1(compressed);
 	header.rsv2(false);
 	header.rsv3(false);
 	if(len >= 126){
@@ -666,15 +807,39 @@ void Client::OnSocketData(char *data, size_t len){
 		
 		auto solvedHash = detail::base64_encode_static(hash);
 		
-		char buf[256]; // We can use up to 101 + 27 + 28 + 1 characters, and we round up just because
+		// Agree to permessage-deflate if we allow it and the client offered something we can do
+		char extensions[128] = "";
+		detail::DeflateOffer offer;
+		if(m_pServer->m_bPerMessageDeflate){
+			if(auto extensionsHeader = headers.Get("sec-websocket-extensions")){
+				if(detail::ParseDeflateOffers(*extensionsHeader, offer)){
+					int windowBits = offer.serverMaxWindowBits ? offer.serverMaxWindowBits : 15;
+					m_pDeflate = std::make_unique<PerMessageDeflate>(m_pServer->m_iDeflateLevel, windowBits, offer.serverNoContextTakeover, m_pServer->m_iDeflateMinSize);
+					
+					char windowParam[32] = "";
+					if(offer.serverMaxWindowBits){
+						snprintf(windowParam, sizeof(windowParam), "; server_max_window_bits=%d", offer.serverMaxWindowBits);
+					}
+					
+					snprintf(extensions, sizeof(extensions), "Sec-WebSocket-Extensions: permessage-deflate%s%s\r\n",
+						offer.serverNoContextTakeover ? "; server_no_context_takeover" : "",
+						windowParam
+					);
+				}
+			}
+		}
+		
+		char buf[384]; // We can use up to 101 + 27 + 28 + 127 + 1 characters, and we round up just because
 		int bufLen = snprintf(buf, sizeof(buf),
 			"HTTP/1.1 101 Switching Protocols\r\n"
 			"Upgrade: websocket\r\n"
 			"Connection: Upgrade\r\n"
 			"%s"
+			"%s"
 			"Sec-WebSocket-Accept: %s\r\n\r\n",
 			
 			sendMyVersion ? "Sec-WebSocket-Version: 13\r\n" : "",
+			extensions,
 			solvedHash.data()
 		);
 		
@@ -711,7 +876,10 @@ void Client::OnSocketData(char *data, size_t len){
 			
 			DataFrameHeader header((char*) buffer.data());
 			
-			if(header.rsv1() || header.rsv2() || header.rsv3()) return Close(1002, "Reserved bit used");
+			if(header.rsv2() || header.rsv3()) return Close(1002, "Reserved bit used");
+			
+			// RSV1 marks a compressed message, set on its first frame only (RFC 7692 section 6)
+			if(header.rsv1() && (!m_pDeflate || header.opcode() == 0 || header.opcode() >= 0x08)) return Close(1002, "Reserved bit used");
 			
 			// Clients MUST mask their headers
 			if(!header.mask()) return Close(1002, "Clients must mask their payload");
@@ -768,13 +936,18 @@ void Client::OnSocketData(char *data, size_t len){
 				ProcessDataFrame(header.opcode(), curPosition, frameLength);
 			}else if(!IsBuildingFrames() && header.fin()){
 				// Fast path, we received a whole frame and we don't need to combine it with anything
-				ProcessDataFrame(header.opcode(), curPosition, frameLength);
+				if(header.rsv1()){
+					ProcessCompressedDataFrame(header.opcode(), curPosition, frameLength);
+				}else{
+					ProcessDataFrame(header.opcode(), curPosition, frameLength);
+				}
 			}else{
 				if(IsBuildingFrames()){
 					if(header.opcode() != 0) return Close(1002, "Expected continuation frame");
 				}else{
 					if(header.opcode() == 0) return Close(1002, "Unexpected continuation frame");
 					m_iFrameOpcode = header.opcode();
+					m_bFrameCompressed = header.rsv1();
 				}
 				
 				if(m_FrameBuffer.size() + frameLength >= m_pServer->m_iMaxMessageSize) return Close(1009, "Message too large");
@@ -784,9 +957,14 @@ void Client::OnSocketData(char *data, size_t len){
 				if(header.fin()){
 					// Assemble frame
 					
-					ProcessDataFrame(m_iFrameOpcode, m_FrameBuffer.data(), m_FrameBuffer.size());
+					if(m_bFrameCompressed){
+						ProcessCompressedDataFrame(m_iFrameOpcode, m_FrameBuffer.data(), m_FrameBuffer.size());
+					}else{
+						ProcessDataFrame(m_iFrameOpcode, m_FrameBuffer.data(), m_FrameBuffer.size());
+					}
 					
 					m_iFrameOpcode = 0;
+					m_bFrameCompressed = false;
 					m_FrameBuffer.clear();
 				}
 				
@@ -927,8 +1105,48 @@ void Client::Send(const char *data, size_t len, uint8_t opcode){
 		
 		Write<2>(bufs);
 	}else{
+		bool compressed = false;
+		
+		if(m_pDeflate && m_pDeflate->deflaterReady && (opcode == 1 || opcode == 2) && len >= m_pDeflate->minSize){
+			auto &d = *m_pDeflate;
+			auto start = std::chrono::steady_clock::now();
+			
+			d.deflater.next_in = (Bytef*) data;
+			d.deflater.avail_in = (uInt) len;
+			
+			size_t outLen = 0;
+			int res;
+			do {
+				d.deflated.resize(outLen + deflateBound(&d.deflater, d.deflater.avail_in) + 16);
+				d.deflater.next_out = (Bytef*) d.deflated.data() + outLen;
+				d.deflater.avail_out = (uInt) (d.deflated.size() - outLen);
+				res = deflate(&d.deflater, Z_SYNC_FLUSH);
+				outLen = d.deflated.size() - d.deflater.avail_out;
+			} while((res == Z_OK || res == Z_BUF_ERROR) && d.deflater.avail_out == 0);
+			
+			if(res != Z_OK && res != Z_BUF_ERROR){
+				// Carry on uncompressed rather than drop the message
+				deflateEnd(&d.deflater);
+				d.deflaterReady = false;
+			}else{
+				// Strip the empty stored block the sync flush ends with (RFC 7692 section 7.2.1)
+				assert(outLen >= 4);
+				outLen -= 4;
+				if(d.noContextTakeover) deflateReset(&d.deflater);
+				
+				if(m_pServer->m_fnCompressionStats){
+					auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+					m_pServer->m_fnCompressionStats(m_pServer, len, outLen, (uint64_t) nanos);
+				}
+				
+				data = d.deflated.data();
+				len = outLen;
+				compressed = true;
+			}
+		}
+		
 		char header[MAX_HEADER_SIZE];
-		WriteDataFrameHeader(opcode, len, header);
+		WriteDataFrameHeader(opcode, len, header, compressed);
 		
 		uv_buf_t bufs[2];
 		bufs[0].base = header;
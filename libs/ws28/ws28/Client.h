@@ -42,6 +42,7 @@ namespace ws28 {
 
 		inline bool IsSecure(){ return m_pTLS != nullptr; }
 		inline bool IsUsingAlternativeProtocol(){ return m_bUsingAlternativeProtocol; }
+		inline bool IsUsingPerMessageDeflate(){ return m_pDeflate != nullptr; }
 
 		inline Server* GetServer(){ return m_pServer; }
 
@@ -51,6 +52,8 @@ namespace ws28 {
 
 	private:
 
+		struct PerMessageDeflate;
+
 		struct DataFrame {
 			uint8_t opcode;
 			std::unique_ptr<char[]> data;
@@ -63,12 +66,13 @@ namespace ws28 {
 		Client& operator=(Client &other) = delete;
 
 		size_t GetDataFrameHeaderSize(size_t len);
-		void WriteDataFrameHeader(uint8_t opcode, size_t len, char *out);
+		void WriteDataFrameHeader(uint8_t opcode, size_t len, char *out, bool compressed = false);
 		void EncryptAndWrite(const char *data, size_t len);
 
 		void OnRawSocketData(char *data, size_t len);
 		void OnSocketData(char *data, size_t len);
 		void ProcessDataFrame(uint8_t opcode, char *data, size_t len);
+		void ProcessCompressedDataFrame(uint8_t opcode, const char *data, size_t len);
 
 		void InitSecure();
 		void FlushTLS();
@@ -106,8 +110,12 @@ namespace ws28 {
 		std::vector<char> m_Buffer;
 
 		uint8_t m_iFrameOpcode = NO_FRAMES;
+		bool m_bFrameCompressed = false;
 		std::vector<char> m_FrameBuffer;
 
+		// Only set once permessage-deflate has been negotiated
+		std::unique_ptr<PerMessageDeflate> m_pDeflate;
+
 		friend class Server;
 		friend struct detail::Corker;
 		friend class std::unique_ptr<Client>;
@@ -49,6 +49,7 @@ namespace ws28 {
 		typedef void (*ClientDisconnectedFn)(Client *);
 		typedef void (*ClientDataFn)(Client *, char *data, size_t len, int opcode);
 		typedef void (*HTTPRequestFn)(HTTPRequest&, HTTPResponse&);
+		typedef void (*CompressionStatsFn)(Server *, size_t inLen, size_t outLen, uint64_t nanos);
 	public:
 
 		// Note: By default, this listens on both ipv4 and ipv6
@@ -111,6 +112,22 @@ namespace ws28 {
 		inline void SetAllowAlternativeProtocol(bool v){ m_bAllowAlternativeProtocol = v; }
 		inline bool GetAllowAlternativeProtocol(){ return m_bAllowAlternativeProtocol; }
 
+		// Enables the permessage-deflate extension (RFC 7692) for clients that offer it
+		// Text and binary messages of at least minSize bytes are sent compressed at the given zlib level,
+		// and compressed messages from the client are accepted. Never applies to the alternative protocol.
+		// Note: like SetMaxMessageSize, set this before listening
+		inline void SetPerMessageDeflate(bool v, size_t minSize = 256, int level = 6){
+			assert(m_Clients.empty());
+			m_bPerMessageDeflate = v;
+			m_iDeflateMinSize = minSize;
+			m_iDeflateLevel = level;
+		}
+		inline bool GetPerMessageDeflate() const { return m_bPerMessageDeflate; }
+
+		// This callback is called after each message we compress, with its size before and after,
+		// and how long compressing it took
+		void SetCompressionStatsCallback(CompressionStatsFn v){ m_fnCompressionStats = v; }
+
 		void Ref(){ if(m_Server) uv_ref((uv_handle_t*) m_Server.get()); }
 		void Unref(){ if(m_Server) uv_unref((uv_handle_t*) m_Server.get()); }
 
@@ -133,6 +150,9 @@ namespace ws28 {
 		void *m_pUserData = nullptr;
 		std::vector<std::shared_ptr<Client>> m_Clients;
 		bool m_bAllowAlternativeProtocol = false;
+		bool m_bPerMessageDeflate = false;
+		size_t m_iDeflateMinSize = 256;
+		int m_iDeflateLevel = 6;
 
 		CheckTCPConnectionFn m_fnCheckTCPConnection = nullptr;
 		CheckConnectionFn m_fnCheckConnection = nullptr;
@@ -141,6 +161,7 @@ namespace ws28 {
 		ClientDisconnectedFn m_fnClientDisconnected = nullptr;
 		ClientDataFn m_fnClientData = nullptr;
 		HTTPRequestFn m_fnHTTPRequest = nullptr;
+		CompressionStatsFn m_fnCompressionStats = nullptr;
 
 		size_t m_iMaxMessageSize = 16 * 1024;
 
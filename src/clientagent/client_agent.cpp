@@ -1,11 +1,17 @@
 #include "client_agent.h"
 
+#include <dcField.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 #include <algorithm>
 #include <string>
 
+#include "../net/compression.h"
 #include "../net/tcp_transport.h"
+#include "../net/tls_context.h"
+#include "../net/transport_worker.h"
+#include "../net/udp_transport.h"
+#include "../net/uring_transport.h"
 #include "../net/ws_transport.h"
 #include "../util/config.h"
 #include "../util/globals.h"
@@ -40,6 +46,69 @@ ClientAgent::ClientAgent() {
   if (auto transportParam = config["transport"]) {
     _transport = transportParam.as<std::string>();
   }
+  // UDP transport testing aid: drop this fraction of packets each way.
+  if (auto udpParam = config["udp"]) {
+    if (auto lossParam = udpParam["simulated-loss"]) {
+      _udpSimulatedLoss = lossParam.as<double>();
+    }
+  }
+  // Client stream compression (off by default; clients opt in too).
+  _compression = std::make_shared<CompressionOptions>();
+  if (auto compressionParam = config["compression"]) {
+    if (auto enabledParam = compressionParam["enabled"]) {
+      _compression->enabled = enabledParam.as<bool>();
+    }
+    if (auto thresholdParam = compressionParam["threshold"]) {
+      _compression->threshold = thresholdParam.as<size_t>();
+    }
+    if (auto levelParam = compressionParam["level"]) {
+      _compression->level = std::clamp(levelParam.as<int>(), 1, 9);
+    }
+  }
+  // TLS termination (tcp and ws transports).
+  if (auto tlsParam = config["tls"]) {
+    long sessionTimeout = 300;
+    if (auto timeoutParam = tlsParam["session-timeout"]) {
+      sessionTimeout = timeoutParam.as<long>();
+    }
+    _tls = TlsContext::Create(tlsParam["certificate"].as<std::string>(),
+                              tlsParam["private-key"].as<std::string>(),
+                              sessionTimeout, "ca");
+    if (!_tls) {
+      exit(1);  // NOLINT(concurrency-mt-unsafe)
+    }
+  }
+  // Per-client outbound batching (off by default).
+  if (auto batchingParam = config["batching"]) {
+    if (auto enabledParam = batchingParam["enabled"]) {
+      _batching = enabledParam.as<bool>();
+    }
+    if (auto intervalParam = batchingParam["flush-interval"]) {
+      _batchFlushInterval = intervalParam.as<unsigned long>();
+    }
+    if (auto maxBytesParam = batchingParam["max-bytes"]) {
+      _batchMaxBytes = maxBytesParam.as<size_t>();
+    }
+    // A batch has to fit in one Datagram to be handed across threads.
+    if (_batchMaxBytes > kMaxDgSize) {
+      spdlog::get("ca")->warn(
+          "client-agent.batching.max-bytes is capped at {}; using that",
+          kMaxDgSize);
+      _batchMaxBytes = kMaxDgSize;
+    }
+  }
+  // Client I/O threads (0 = serve every client on the main loop). These
+  // only take socket I/O off the main loop; participants stay on it.
+  if (auto threadsParam = config["io-threads"]) {
+    _threads = threadsParam.as<unsigned int>();
+#ifdef _WIN32
+    if (_threads) {
+      spdlog::get("ca")->warn(
+          "client-agent.io-threads is not supported on Windows; ignoring");
+      _threads = 0;
+    }
+#endif
+  }
 
   // Server version configuration.
   _version = config["version"].as<std::string>();
@@ -174,6 +243,12 @@ ClientAgent::ClientAgent() {
     }
   }
 
+  // Fields tagged `unreliable` in the DC file (position broadcasts and the
+  // like) go out on the transport's unreliable lane, where it has one.
+  for (int i = 0; DCField* field = g_dc_file->get_field_by_index(i); ++i) {
+    _unreliableFields.push_back(field->has_keyword("unreliable"));
+  }
+
   // Channel allocation configuration.
   auto channelsParam = config["channels"];
   _nextChannel = channelsParam["min"].as<uint64_t>();
@@ -194,35 +269,103 @@ ClientAgent::ClientAgent() {
   }
 
   // Build the transport listener based on config.
+  if (_tls && _transport == "uring") {
+    spdlog::get("ca")->warn("The uring transport can't do TLS; using tcp");
+    _transport = "tcp";
+  } else if (_tls && _transport == "udp") {
+    spdlog::get("ca")->error("client-agent.tls isn't supported over udp");
+    exit(1);  // NOLINT(concurrency-mt-unsafe)
+  }
   if (_transport == "tcp") {
-    _listener = std::make_unique<TcpTransportListener>();
+    _listener = std::make_unique<TcpTransportListener>(_compression, _tls);
   } else if (_transport == "ws") {
-    _listener = std::make_unique<WsTransportListener>();
+    _listener = std::make_unique<WsTransportListener>(_compression, _tls);
+  } else if (_transport == "udp") {
+    _listener = std::make_unique<UdpTransportListener>(_udpSimulatedLoss);
+    if (_udpSimulatedLoss > 0) {
+      spdlog::get("ca")->warn("Simulating {}% UDP packet loss",
+                              _udpSimulatedLoss * 100);
+    }
+  } else if (_transport == "uring") {
+#ifdef ARDOS_HAVE_URING
+    if (UringTransportListener::Supported("ca")) {
+      _listener = std::make_unique<UringTransportListener>();
+    }
+#else
+    spdlog::get("ca")->warn("This build has no io_uring support");
+#endif
+    if (!_listener) {
+      // Same wire protocol, so clients can't tell the difference.
+      spdlog::get("ca")->warn("Falling back to the tcp transport");
+      _transport = "tcp";
+      _listener = std::make_unique<TcpTransportListener>(_compression);
+    }
   } else {
     spdlog::get("ca")->error(
-        "Unknown transport '{}'. Supported values: tcp, ws", _transport);
+        "Unknown transport '{}'. Supported values: tcp, ws, uring, udp",
+        _transport);
     exit(1);  // NOLINT(concurrency-mt-unsafe)
   }
 
-  _listener->SetConnectionFactory(
-      [this](std::unique_ptr<ITransportConnection> conn) {
-        auto participant =
-            std::make_shared<ClientParticipant>(this, std::move(conn));
-        participant->Init();
-        _participants.insert(participant.get());
-      });
+  auto factory = [this](std::unique_ptr<ITransportConnection> conn) {
+    auto participant =
+        std::make_shared<ClientParticipant>(this, std::move(conn));
+    participant->Init();
+    _participants.insert(participant.get());
+  };
+  _listener->SetConnectionFactory(factory);
+
+  if (_threads && _transport != "tcp") {
+    spdlog::get("ca")->warn(
+        "client-agent.io-threads only applies to the tcp transport; ignoring");
+    _threads = 0;
+  }
+  for (unsigned int i = 0; i < _threads; ++i) {
+    _workers.push_back(std::make_unique<TransportWorker>("ca", i));
+  }
+
+  if (_batching) {
+    // Prepare handles run right before the loop blocks for I/O, i.e. once
+    // per iteration after every callback that could have sent something.
+    _batchFlushHandle = g_loop->resource<uvw::prepare_handle>();
+    _batchFlushHandle->on<uvw::prepare_event>(
+        [this](const uvw::prepare_event&, uvw::prepare_handle&) {
+          if (!_batchFlushInterval) {
+            FlushBatches();
+          }
+        });
+    _batchFlushHandle->start();
+
+    _batchFlushTimer = g_loop->resource<uvw::timer_handle>();
+    _batchFlushTimer->on<uvw::timer_event>(
+        [this](const uvw::timer_event&, uvw::timer_handle&) {
+          _batchTimerArmed = false;
+          FlushBatches();
+        });
+  }
 
   // Initialize metrics.
   InitMetrics();
 
-  // Start listening!
-  if (!_listener->Listen(_host, _port)) {
-    spdlog::get("ca")->error("Failed to bind {} transport on {}:{}", _transport,
-                             _host, _port);
-    exit(1);  // NOLINT(concurrency-mt-unsafe)
+  // Start listening! With I/O threads, each one binds the address itself
+  // and accepts its own share of clients.
+  if (_workers.empty()) {
+    if (!_listener->Listen(_host, _port)) {
+      spdlog::get("ca")->error("Failed to bind {} transport on {}:{}",
+                               _transport, _host, _port);
+      exit(1);  // NOLINT(concurrency-mt-unsafe)
+    }
+  } else {
+    for (const auto& worker : _workers) {
+      if (!worker->Listen(_host, _port, factory, _compression, _tls)) {
+        exit(1);  // NOLINT(concurrency-mt-unsafe)
+      }
+    }
   }
 
-  spdlog::get("ca")->info("Listening on {}:{} ({})", _host, _port, _transport);
+  spdlog::get("ca")->info("Listening on {}:{} ({}{}, {} I/O threads)",
+                          _host, _port, _transport, _tls ? " + tls" : "",
+                          _workers.size());
 }
 
 /**
@@ -373,6 +516,17 @@ unsigned long ClientAgent::GetInterestTimeout() const {
  */
 DCClass* ClientAgent::GetAvatarClass() const { return _avatarClass; }
 
+/**
+ * Returns the transport lane updates to the given field should go out on.
+ * @param fieldId
+ * @return
+ */
+Reliability ClientAgent::GetFieldReliability(const uint16_t& fieldId) const {
+  return fieldId < _unreliableFields.size() && _unreliableFields[fieldId]
+             ? Reliability::Unreliable
+             : Reliability::Reliable;
+}
+
 /**
  * Returns whether setParentingRules-driven behaviour is enabled.
  * @return
@@ -381,6 +535,53 @@ bool ClientAgent::GetParentingRulesEnabled() const {
   return _parentingRulesEnabled;
 }
 
+/**
+ * Returns whether outbound datagrams are batched per client.
+ * @return
+ */
+bool ClientAgent::GetBatchingEnabled() const { return _batching; }
+
+/**
+ * Returns the size a client's send buffer is flushed at regardless of the
+ * flush interval.
+ * @return
+ */
+size_t ClientAgent::GetBatchMaxBytes() const { return _batchMaxBytes; }
+
+/**
+ * Queues a client's send buffer to be flushed along with everyone else's.
+ * @param client
+ */
+void ClientAgent::QueueBatchFlush(
+    const std::shared_ptr<ClientParticipant>& client) {
+  _batchFlushQueue.push_back(client);
+
+  if (_batchFlushInterval && !_batchTimerArmed) {
+    _batchTimerArmed = true;
+    _batchFlushTimer->start(uvw::timer_handle::time{_batchFlushInterval},
+                            uvw::timer_handle::time{0});
+  }
+}
+
+/**
+ * Flushes the send buffers of every client queued since the last flush.
+ */
+void ClientAgent::FlushBatches() {
+  if (_batchFlushQueue.empty()) {
+    return;
+  }
+
+  // A flush can disconnect a client, which may queue more; those go next
+  // time round.
+  auto queue = std::move(_batchFlushQueue);
+  _batchFlushQueue.clear();
+  for (const auto& weak : queue) {
+    if (auto client = weak.lock()) {
+      client->FlushSendBuffer();
+    }
+  }
+}
+
 /**
  * Called when a participant connects.
  */
@@ -475,6 +676,13 @@ void ClientAgent::InitMetrics() {
           .Help("Time to complete an interest operation")
           .Register(*registry);
 
+  auto& translationHitsBuilder =
+      prometheus::BuildCounter()
+          .Name("ca_translation_reuses_total")
+          .Help("Client datagrams reused for another client instead of "
+                "being encoded again")
+          .Register(*registry);
+
   _datagramsProcessedCounter = &datagramsBuilder.Add({});
   _datagramsSizeHistogram = &datagramsSizeBuilder.Add(
       {}, prometheus::Histogram::BucketBoundaries{1, 4, 16, 64, 256, 1024, 4096,
@@ -482,12 +690,15 @@ void ClientAgent::InitMetrics() {
   _participantsGauge = &participantsBuilder.Add({});
   _freeChannelsGauge = &freeChannelsBuilder.Add({});
   _interestsTimeoutCounter = &timeoutsBuilder.Add({});
+  _translationHitsCounter = &translationHitsBuilder.Add({});
   _interestsTimeHistogram = &interestsTimeBuilder.Add(
       {}, prometheus::Histogram::BucketBoundaries{0, 0.5, 1, 1.5, 2, 2.5, 3,
                                                   3.5, 4, 4.5, 5});
 
   // Initialize free channels to our range of allocated channels.
   _freeChannelsGauge->Set((double)(_channelsMax - _nextChannel));
+
+  CompressionMetrics::Init();
 }
 
 void ClientAgent::HandleWeb(ws28::Client* client, nlohmann::json& data) {
@@ -505,11 +716,18 @@ void ClientAgent::HandleWeb(ws28::Client* client, nlohmann::json& data) {
       });
     }
 
+    // Connection count per worker loop, to show how evenly they're loaded.
+    nlohmann::json workerInfo = nlohmann::json::array();
+    for (const auto& worker : _workers) {
+      workerInfo.push_back(worker->GetConnectionCount());
+    }
+
     WebPanel::Send(client, {
                                {"type", "ca:init"},
                                {"success", true},
                                {"listenIp", _host},
                                {"listenPort", _port},
+                               {"workers", workerInfo},
 #ifdef ARDOS_USE_LEGACY_CLIENT
                                {"legacy", true},
 #else
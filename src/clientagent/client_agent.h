@@ -39,6 +39,9 @@ enum InterestMode : std::uint8_t {
 };
 
 class ClientParticipant;
+struct CompressionOptions;
+class TlsContext;
+class TransportWorker;
 
 class ClientAgent {
  public:
@@ -63,7 +66,33 @@ class ClientAgent {
   GetInterestZoneRanges() const;
   [[nodiscard]] unsigned long GetInterestTimeout() const;
   [[nodiscard]] DCClass* GetAvatarClass() const;
+  [[nodiscard]] Reliability GetFieldReliability(const uint16_t& fieldId) const;
   [[nodiscard]] bool GetParentingRulesEnabled() const;
+  [[nodiscard]] bool GetBatchingEnabled() const;
+  [[nodiscard]] size_t GetBatchMaxBytes() const;
+
+  // Returns the client-facing encoding of a server datagram that's being
+  // fanned out to several clients, calling `build` for it only the first
+  // time. The Message Director hands the same Datagram to every subscriber
+  // in turn, so remembering the last one is enough. The result is shared
+  // between clients and must not be modified.
+  template <typename Build>
+  std::shared_ptr<Datagram> TranslateOnce(
+      const std::shared_ptr<Datagram>& source, Build&& build) {
+    // Compared through the weak_ptr so a new datagram reusing a freed
+    // one's address can't hit.
+    if (_translationSource.lock() != source) {
+      _translation = build();
+      _translationSource = source;
+    } else if (_translationHitsCounter) {
+      _translationHitsCounter->Increment();
+    }
+    return _translation;
+  }
+
+  // Flushes the client's send buffer at the end of this loop iteration, or
+  // once client-agent.batching.flush-interval has passed.
+  void QueueBatchFlush(const std::shared_ptr<ClientParticipant>& client);
 
   void ParticipantJoined();
   void ParticipantLeft(ClientParticipant* client);
@@ -75,17 +104,46 @@ class ClientAgent {
 
  private:
   void InitMetrics();
+  void FlushBatches();
 
   // Owns the listen socket / WS server. Concrete type selected at boot
-  // from the client-agent.transport config option (tcp | ws). All
-  // participants on this CA share one transport; mixed transports per
-  // CA aren't supported by design (run two CAs on different ports if
-  // you need both flavours).
+  // from the client-agent.transport config option (tcp | ws | uring |
+  // udp). All participants on this CA share one transport; mixed
+  // transports per CA aren't supported by design (run two CAs on
+  // different ports if you need both flavours).
   std::unique_ptr<ITransportListener> _listener;
 
   std::string _host = "127.0.0.1";
   int _port = 6667;
   std::string _transport = "tcp";
+  // client-agent.udp.simulated-loss (udp transport only).
+  double _udpSimulatedLoss = 0.0;
+  // client-agent.compression, shared with every client connection
+  // (tcp, uring and ws).
+  std::shared_ptr<CompressionOptions> _compression;
+  // client-agent.tls (tcp and ws); null unless configured.
+  std::shared_ptr<TlsContext> _tls;
+
+  // Client I/O loops (client-agent.io-threads, tcp only). Each owns a
+  // SO_REUSEPORT listener on _host:_port and does the accepting, reading,
+  // framing and writing for the clients it accepts. ClientParticipants
+  // themselves (validation, interests, fanout), and everything they touch
+  // in the MD, stay on the main loop. Empty: _listener serves all.
+  // TODO: Move each loop's ClientParticipants onto it as well. That needs
+  // MD dispatch to be thread-safe first (see MessageDirector::_workers).
+  unsigned int _threads = 0;
+  std::vector<std::unique_ptr<TransportWorker>> _workers;
+
+  // Per-client outbound batching (client-agent.batching). Clients with
+  // something buffered are queued here until the flush handle (end of the
+  // loop iteration) or the flush timer (flush-interval > 0) runs.
+  bool _batching = false;
+  unsigned long _batchFlushInterval = 0;
+  size_t _batchMaxBytes = 16 * 1024;
+  std::vector<std::weak_ptr<ClientParticipant>> _batchFlushQueue;
+  std::shared_ptr<uvw::prepare_handle> _batchFlushHandle;
+  std::shared_ptr<uvw::timer_handle> _batchFlushTimer;
+  bool _batchTimerArmed = false;
 
   std::string _version;
   uint32_t _dcHash;
@@ -102,9 +160,15 @@ class ClientAgent {
 
   std::unordered_map<uint32_t, Uberdog> _uberdogs;
   DCClass* _avatarClass = nullptr;
+  // Indexed by DC field number; see GetFieldReliability.
+  std::vector<bool> _unreliableFields;
 
   std::unordered_set<ClientParticipant*> _participants;
 
+  // See TranslateOnce.
+  std::weak_ptr<Datagram> _translationSource;
+  std::shared_ptr<Datagram> _translation;
+
   uint64_t _nextChannel;
   uint64_t _channelsMax;
   std::queue<uint64_t> _freedChannels;
@@ -118,6 +182,7 @@ class ClientAgent {
   prometheus::Gauge* _freeChannelsGauge = nullptr;
   prometheus::Counter* _interestsTimeoutCounter = nullptr;
   prometheus::Histogram* _interestsTimeHistogram = nullptr;
+  prometheus::Counter* _translationHitsCounter = nullptr;
 };
 
 }  // namespace Ardos
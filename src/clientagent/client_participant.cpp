@@ -128,8 +128,10 @@ void ClientParticipant::Shutdown() {
   auto self = weak_from_this().lock();
 
   // Close the transport. Idempotent; further OnTransport* callbacks
-  // become no-ops via the connection's internal closed flag.
+  // become no-ops via the connection's internal closed flag. Anything still
+  // batched (an eject, say) goes out first.
   if (_transport) {
+    WriteSendBuffer();
     _transport->Close();
   }
 
@@ -188,8 +190,7 @@ void ClientParticipant::Shutdown() {
     spdlog::get("ca")->debug("Client: {} exited, deleting session object: {}",
                              _channel, doId);
 
-    auto dg = std::make_shared<Datagram>(doId, _channel,
-                                         STATESERVER_OBJECT_DELETE_RAM);
+    auto dg = Datagram::Create(doId, _channel, STATESERVER_OBJECT_DELETE_RAM);
     dg->AddUint32(doId);
     PublishDatagram(dg);
   }
@@ -222,7 +223,7 @@ void ClientParticipant::Shutdown() {
  * @param code
  */
 void ClientParticipant::OnTransportMessage(const uint8_t* data, size_t len) {
-  auto dg = std::make_shared<Datagram>(data, len);
+  auto dg = Datagram::Create(data, len);
   HandleClientDatagram(dg);
 }
 
@@ -236,11 +237,82 @@ void ClientParticipant::OnTransportDisconnect() {
   Shutdown();
 }
 
-void ClientParticipant::SendDatagram(const std::shared_ptr<Datagram>& dg) {
+void ClientParticipant::SendDatagram(const std::shared_ptr<Datagram>& dg,
+                                     Reliability r) {
   if (_disconnected || !_transport) {
     return;
   }
-  _transport->Send(dg->GetData(), dg->Size());
+
+  if (!_clientAgent->GetBatchingEnabled()) {
+    // Shared rather than copied where the transport can (worker loops);
+    // nothing touches a datagram once it's been sent.
+    _transport->SendDatagram(dg, r);
+    return;
+  }
+
+  const size_t framedSize = sizeof(uint16_t) + dg->Size();
+  const size_t maxBytes = _clientAgent->GetBatchMaxBytes();
+  if (_sendBuffer.size() + framedSize > maxBytes) {
+    WriteSendBuffer();
+  }
+
+  // Unreliable datagrams have their own lane on transports that have one,
+  // and anything too big for a batch goes alone; either way, after what's
+  // already buffered so nothing overtakes it on the stream transports.
+  if (r == Reliability::Unreliable || framedSize > maxBytes) {
+    WriteSendBuffer();
+    _transport->Send(dg->GetData(), dg->Size(), r);
+    return;
+  }
+
+  const uint16_t size = dg->Size();
+  const auto* prefix = reinterpret_cast<const uint8_t*>(&size);
+  _sendBuffer.insert(_sendBuffer.end(), prefix, prefix + sizeof(uint16_t));
+  _sendBuffer.insert(_sendBuffer.end(), dg->GetData(),
+                     dg->GetData() + dg->Size());
+
+  if (!_sendFlushQueued) {
+    _sendFlushQueued = true;
+    _clientAgent->QueueBatchFlush(
+        std::static_pointer_cast<ClientParticipant>(shared_from_this()));
+  }
+}
+
+/**
+ * Flushes the send buffer on the ClientAgent's behalf.
+ */
+void ClientParticipant::FlushSendBuffer() {
+  _sendFlushQueued = false;
+  WriteSendBuffer();
+}
+
+/**
+ * Sends everything buffered by SendDatagram as a single transport write.
+ */
+void ClientParticipant::WriteSendBuffer() {
+  if (_sendBuffer.empty()) {
+    return;
+  }
+
+  if (!_sendSpare.empty()) {
+    // We're being called back from inside the SendBatch below (an eject
+    // on disconnect, say), which still has the spare. Send this on its own.
+    auto buffer = std::move(_sendBuffer);
+    _sendBuffer.clear();
+    if (_transport) {
+      _transport->SendBatch(buffer.data(), buffer.size());
+    }
+    return;
+  }
+
+  // Swap rather than move, so both buffers keep their capacity from one
+  // flush to the next. Anything sent while the transport has the spare
+  // starts the next batch.
+  std::swap(_sendBuffer, _sendSpare);
+  if (_transport) {
+    _transport->SendBatch(_sendSpare.data(), _sendSpare.size());
+  }
+  _sendSpare.clear();
 }
 
 /**
@@ -321,12 +393,11 @@ void ClientParticipant::HandleDatagram(const std::shared_ptr<Datagram>& dg) {
       SubscribeChannel(_channel);
       break;
     }
-    case CLIENTAGENT_SEND_DATAGRAM: {
-      auto forwardDg = std::make_shared<Datagram>();
-      forwardDg->AddData(dgi.GetRemainingBytes());
-      SendDatagram(forwardDg);
+    case CLIENTAGENT_SEND_DATAGRAM:
+      // Forwarded as a slice of the AI's datagram; nothing is copied until
+      // the transport writes it out.
+      SendDatagram(dgi.GetRemainingView().ToDatagram());
       break;
-    }
     case CLIENTAGENT_OPEN_CHANNEL:
       SubscribeChannel(dgi.GetUint64());
       break;
@@ -410,7 +481,7 @@ void ClientParticipant::HandleDatagram(const std::shared_ptr<Datagram>& dg) {
       break;
     }
     case CLIENTAGENT_GET_NETWORK_ADDRESS: {
-      auto resp = std::make_shared<Datagram>(
+      auto resp = Datagram::Create(
           sender, _channel, CLIENTAGENT_GET_NETWORK_ADDRESS_RESP);
       resp->AddUint32(dgi.GetUint32());  // Context.
       resp->AddString(GetRemoteAddress().ip);
@@ -722,7 +793,7 @@ void ClientParticipant::SendDisconnect(const uint16_t& reason,
            : spdlog::get("ca")->warn("Ejecting client: '{}': {} - {}", _channel,
                                      reason, message);
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_EJECT);
   dg->AddUint16(reason);
   dg->AddString(message);
@@ -801,7 +872,7 @@ DCClass* ClientParticipant::LookupObject(const uint32_t& doId) {
 }
 
 void ClientParticipant::HandleRemoveObject(const uint32_t& doId) {
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_OBJECT_LEAVING);
   dg->AddUint32(doId);
   SendDatagram(dg);
@@ -814,7 +885,7 @@ void ClientParticipant::HandleRemoveOwnership(const uint32_t& doId) {
     _avatarZone = INVALID_DO_ID;
   }
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_OBJECT_LEAVING_OWNER);
   dg->AddUint32(doId);
   SendDatagram(dg);
@@ -855,7 +926,7 @@ void ClientParticipant::HandleObjectEntrance(DatagramIterator& dgi,
 void ClientParticipant::HandleAddObject(
     const uint32_t& doId, const uint32_t& parentId, const uint32_t& zoneId,
     const uint16_t& dcId, DatagramIterator& dgi, const bool& other) {
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(other ? CLIENT_ENTER_OBJECT_REQUIRED_OTHER
                       : CLIENT_ENTER_OBJECT_REQUIRED);
   spdlog::get("ca")->debug("Sending entry of object: {} to client: {}", doId,
@@ -870,7 +941,7 @@ void ClientParticipant::HandleAddObject(
   dg->AddLocation(parentId, zoneId);
   dg->AddUint16(dcId);
 #endif
-  dg->AddData(dgi.GetRemainingBytes());
+  dg->AddData(dgi.GetRemainingView());
   SendDatagram(dg);
 }
 
@@ -890,22 +961,32 @@ bool ClientParticipant::TryQueuePending(const uint32_t& doId,
 void ClientParticipant::HandleSetField(const uint32_t& doId,
                                        const uint16_t& fieldId,
                                        DatagramIterator& dgi) {
-  auto dg = std::make_shared<Datagram>();
-  dg->AddUint16(CLIENT_OBJECT_SET_FIELD);
-  dg->AddUint32(doId);
-  dg->AddUint16(fieldId);
-  dg->AddData(dgi.GetRemainingBytes());
-  SendDatagram(dg);
+  // Every client seeing the object gets the same bytes; the first one to
+  // get here builds them for the rest.
+  auto dg = _clientAgent->TranslateOnce(dgi.GetUnderlyingDatagram(), [&] {
+    auto out = Datagram::Create();
+    out->AddUint16(CLIENT_OBJECT_SET_FIELD);
+    out->AddUint32(doId);
+    out->AddUint16(fieldId);
+    out->AddData(dgi.GetRemainingView());
+    return out;
+  });
+  // Updates to `unreliable` fields may be dropped or skipped over in
+  // transit; the next one supersedes them anyway.
+  SendDatagram(dg, _clientAgent->GetFieldReliability(fieldId));
 }
 
 void ClientParticipant::HandleSetFields(const uint32_t& doId,
                                         const uint16_t& numFields,
                                         DatagramIterator& dgi) {
-  auto dg = std::make_shared<Datagram>();
-  dg->AddUint16(CLIENT_OBJECT_SET_FIELDS);
-  dg->AddUint32(doId);
-  dg->AddUint16(numFields);
-  dg->AddData(dgi.GetRemainingBytes());
+  auto dg = _clientAgent->TranslateOnce(dgi.GetUnderlyingDatagram(), [&] {
+    auto out = Datagram::Create();
+    out->AddUint16(CLIENT_OBJECT_SET_FIELDS);
+    out->AddUint32(doId);
+    out->AddUint16(numFields);
+    out->AddData(dgi.GetRemainingView());
+    return out;
+  });
   SendDatagram(dg);
 }
 
@@ -929,7 +1010,7 @@ void ClientParticipant::HandleAddOwnership(
     }
   }
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   spdlog::get("ca")->debug("Sending owner entry of object: {} to client: {}",
                            doId, _channel);
 #ifdef ARDOS_USE_LEGACY_CLIENT
@@ -947,7 +1028,7 @@ void ClientParticipant::HandleAddOwnership(
   dg->AddLocation(parentId, zoneId);
   dg->AddUint16(dcId);
 #endif
-  dg->AddData(dgi.GetRemainingBytes());
+  dg->AddData(dgi.GetRemainingView());
   SendDatagram(dg);
 }
 
@@ -980,7 +1061,7 @@ void ClientParticipant::HandleChangeLocation(const uint32_t& doId,
     }
   }
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_OBJECT_LOCATION);
   dg->AddUint32(doId);
   dg->AddLocation(newParent, newZone);
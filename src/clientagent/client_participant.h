@@ -103,6 +103,10 @@ class ClientParticipant final : public ITransportHandler,
   [[nodiscard]] uint32_t GetAvatarParent() const { return _avatarParent; }
   [[nodiscard]] uint32_t GetAvatarZone() const { return _avatarZone; }
 
+  // Hands everything buffered by SendDatagram to the transport in one go.
+  // Called by the ClientAgent when batching is enabled.
+  void FlushSendBuffer();
+
  private:
   static uint64_t now_ms() { return uv_hrtime() / 1000000; }
 
@@ -120,7 +124,9 @@ class ClientParticipant final : public ITransportHandler,
   // Outbound helper -- centralises every CLIENT_* send through the
   // transport so the existing callers don't need to know whether they're
   // talking to TCP or WS.
-  void SendDatagram(const std::shared_ptr<Datagram>& dg);
+  void SendDatagram(const std::shared_ptr<Datagram>& dg,
+                    Reliability r = Reliability::Reliable);
+  void WriteSendBuffer();
 
   void SendDisconnect(const uint16_t& reason, const std::string& message,
                       const bool& security = false);
@@ -232,6 +238,14 @@ class ClientParticipant final : public ITransportHandler,
   // closed connection.
   bool _disconnected = false;
 
+  // Datagrams waiting for the next batch flush (client-agent.batching),
+  // framed back to back as [uint16 length][payload]. WriteSendBuffer swaps
+  // in the spare (empty outside of a write), so neither is reallocated once
+  // it's grown.
+  std::vector<uint8_t> _sendBuffer;
+  std::vector<uint8_t> _sendSpare;
+  bool _sendFlushQueued = false;
+
   uint64_t _channel;
   uint64_t _allocatedChannel;
 
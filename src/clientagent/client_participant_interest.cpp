@@ -193,8 +193,8 @@ void ClientParticipant::AddInterest(Interest& i, const uint32_t& context,
                                     newZones, caller);
   _pendingInterests[requestContext] = iop;
 
-  auto dg = std::make_shared<Datagram>(i.parent, _channel,
-                                       STATESERVER_OBJECT_GET_ZONES_OBJECTS);
+  auto dg = Datagram::Create(i.parent, _channel,
+                             STATESERVER_OBJECT_GET_ZONES_OBJECTS);
   dg->AddUint32(requestContext);
   dg->AddUint32(i.parent);
   dg->AddUint16(newZones.size());
@@ -224,8 +224,7 @@ void ClientParticipant::NotifyInterestDone(const uint16_t& interestId,
     return;
   }
 
-  auto dg = std::make_shared<Datagram>(caller, _channel,
-                                       CLIENTAGENT_DONE_INTEREST_RESP);
+  auto dg = Datagram::Create(caller, _channel, CLIENTAGENT_DONE_INTEREST_RESP);
   dg->AddUint64(_channel);
   dg->AddUint16(interestId);
   PublishDatagram(dg);
@@ -236,8 +235,8 @@ void ClientParticipant::NotifyInterestDone(const InterestOperation* iop) {
     return;
   }
 
-  auto dg = std::make_shared<Datagram>(iop->_callers, _channel,
-                                       CLIENTAGENT_DONE_INTEREST_RESP);
+  auto dg = Datagram::Create(iop->_callers, _channel,
+                             CLIENTAGENT_DONE_INTEREST_RESP);
   dg->AddUint64(_channel);
   dg->AddUint16(iop->_interestId);
   PublishDatagram(dg);
@@ -253,7 +252,7 @@ void ClientParticipant::HandleInterestDone(const uint16_t& interestId,
     return;
   }
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_DONE_INTEREST_RESP);
 #ifdef ARDOS_USE_LEGACY_CLIENT
   dg->AddUint16(interestId);
@@ -269,7 +268,7 @@ void ClientParticipant::HandleAddInterest(const Interest& i,
                                           const uint32_t& context) {
   const bool multiple = i.zones.size() != 1;
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(multiple ? CLIENT_ADD_INTEREST_MULTIPLE : CLIENT_ADD_INTEREST);
   dg->AddUint32(context);
   dg->AddUint16(i.id);
@@ -285,7 +284,7 @@ void ClientParticipant::HandleAddInterest(const Interest& i,
 
 void ClientParticipant::HandleRemoveInterest(const uint16_t& interestId,
                                              const uint32_t& context) {
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_REMOVE_INTEREST);
   dg->AddUint32(context);
   dg->AddUint16(interestId);
@@ -385,8 +384,7 @@ void ClientParticipant::RequestParentClass(const uint32_t& parentId) {
       uvw::timer_handle::time{_clientAgent->GetInterestTimeout()},
       uvw::timer_handle::time{0});
 
-  auto dg = std::make_shared<Datagram>(parentId, _channel,
-                                       STATESERVER_OBJECT_GET_CLASS);
+  auto dg = Datagram::Create(parentId, _channel, STATESERVER_OBJECT_GET_CLASS);
   dg->AddUint32(context);
   PublishDatagram(dg);
 }
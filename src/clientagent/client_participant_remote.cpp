@@ -1,5 +1,6 @@
 #include <dcField.h>
 
+#include "../net/field_validator.h"
 #include "../net/message_types.h"
 #include "../util/logger.h"
 #include "client_participant.h"
@@ -116,7 +117,7 @@ void ClientParticipant::HandlePreHello(DatagramIterator& dgi) {
 
   _authState = AUTH_STATE_ANONYMOUS;
 
-  auto dg = std::make_shared<Datagram>();
+  auto dg = Datagram::Create();
   dg->AddUint16(CLIENT_HELLO_RESP);
   SendDatagram(dg);
 #endif  // ARDOS_USE_LEGACY_CLIENT
@@ -175,8 +176,7 @@ void ClientParticipant::HandleLoginLegacy(DatagramIterator& dgi) {
 
   // We've got a matching version and hash, send off the login request to the
   // configured shim UberDOG!
-  auto dg = std::make_shared<Datagram>(authShim, _channel,
-                                       STATESERVER_OBJECT_SET_FIELD);
+  auto dg = Datagram::Create(authShim, _channel, STATESERVER_OBJECT_SET_FIELD);
   dg->AddUint32(authShim);
   dg->AddUint16(authField->get_number());
   dg->AddString(loginToken);
@@ -312,8 +312,12 @@ void ClientParticipant::HandleClientObjectUpdateField(DatagramIterator& dgi) {
   std::vector<uint8_t> data;
   dgi.UnpackField(field, data);
 
-  // Validate the field ranges (int16(0-200), etc.)
-  if (!field->validate_ranges(data)) {
+  // Validate the field ranges (int16(0-200), etc.), through the compiled
+  // checks if the field has them.
+  const FieldValidator* validator = FieldValidator::For(field);
+  const bool valid = validator ? validator->Validate(data.data(), data.size())
+                               : field->validate_ranges(data);
+  if (!valid) {
     SendDisconnect(CLIENT_DISCONNECT_FIELD_CONSTRAINT,
                    std::format("Client violated field constraints for "
                                "field: {} of class: {} (DoId: {})",
@@ -351,8 +355,8 @@ void ClientParticipant::HandleClientObjectUpdateField(DatagramIterator& dgi) {
       }
 
       // Send it off to the configured chat shim UberDOG.
-      auto dg = std::make_shared<Datagram>(chatShim, _channel,
-                                           STATESERVER_OBJECT_SET_FIELD);
+      auto dg = Datagram::Create(chatShim, _channel,
+                                 STATESERVER_OBJECT_SET_FIELD);
       dg->AddUint32(chatShim);
       dg->AddUint16(chatField->get_number());
       // Send the clients avatar parentId/zoneId.
@@ -370,8 +374,7 @@ void ClientParticipant::HandleClientObjectUpdateField(DatagramIterator& dgi) {
 #endif  // ARDOS_USE_LEGACY_CLIENT
 
   // Forward the field update to the state server.
-  auto dg =
-      std::make_shared<Datagram>(doId, _channel, STATESERVER_OBJECT_SET_FIELD);
+  auto dg = Datagram::Create(doId, _channel, STATESERVER_OBJECT_SET_FIELD);
   dg->AddUint32(doId);
   dg->AddUint16(fieldId);
   dg->AddData(data);
@@ -420,8 +423,7 @@ void ClientParticipant::HandleClientObjectLocation(DatagramIterator& dgi) {
       doId, parentId, zoneId);
 
   // Update the object's location with the state server.
-  auto dg = std::make_shared<Datagram>(doId, _channel,
-                                       STATESERVER_OBJECT_SET_LOCATION);
+  auto dg = Datagram::Create(doId, _channel, STATESERVER_OBJECT_SET_LOCATION);
   dg->AddLocation(parentId, zoneId);
   PublishDatagram(dg);
 }
@@ -325,8 +325,7 @@ void DatabaseServer::HandleCreate(DatagramIterator& dgi,
 void DatabaseServer::HandleCreateDone(const uint64_t& channel,
                                       const uint32_t& context,
                                       const uint32_t& doId) {
-  auto dg = std::make_shared<Datagram>(channel, _channel,
-                                       DBSERVER_CREATE_OBJECT_RESP);
+  auto dg = Datagram::Create(channel, _channel, DBSERVER_CREATE_OBJECT_RESP);
   dg->AddUint32(context);
   dg->AddUint32(doId);
   PublishDatagram(dg);
@@ -438,8 +437,7 @@ void DatabaseServer::HandleGetAll(DatagramIterator& dgi,
     return;
   }
 
-  auto dg = std::make_shared<Datagram>(sender, _channel,
-                                       DBSERVER_OBJECT_GET_ALL_RESP);
+  auto dg = Datagram::Create(sender, _channel, DBSERVER_OBJECT_GET_ALL_RESP);
   dg->AddUint32(context);
   dg->AddBool(true);
   dg->AddUint16(dcClass->get_number());
@@ -595,7 +593,7 @@ void DatabaseServer::HandleGetField(DatagramIterator& dgi,
     return;
   }
 
-  auto dg = std::make_shared<Datagram>(sender, _channel, responseType);
+  auto dg = Datagram::Create(sender, _channel, responseType);
   dg->AddUint32(ctx);
   dg->AddBool(true);
   if (multiple) {
@@ -1021,7 +1019,7 @@ void DatabaseServer::HandleSetFieldEquals(DatagramIterator& dgi,
 
   // One or more fields failed to validate, notify the sender.
   if (!failedFields.empty()) {
-    auto dg = std::make_shared<Datagram>(sender, _channel, responseType);
+    auto dg = Datagram::Create(sender, _channel, responseType);
     dg->AddUint32(ctx);
     dg->AddBool(false);
     if (multiple) {
@@ -1086,7 +1084,7 @@ void DatabaseServer::HandleSetFieldEquals(DatagramIterator& dgi,
                              bsoncxx::to_json(fieldBuilder.view()));
 
     // Success! Notify the sender.
-    auto dg = std::make_shared<Datagram>(sender, _channel, responseType);
+    auto dg = Datagram::Create(sender, _channel, responseType);
     dg->AddUint32(ctx);
     dg->AddBool(true);
     PublishDatagram(dg);
@@ -1105,7 +1103,7 @@ void DatabaseServer::HandleSetFieldEquals(DatagramIterator& dgi,
 void DatabaseServer::HandleContextFailure(const MessageTypes& type,
                                           const uint64_t& channel,
                                           const uint32_t& context) {
-  auto dg = std::make_shared<Datagram>(channel, _channel, type);
+  auto dg = Datagram::Create(channel, _channel, type);
   dg->AddUint32(context);
   dg->AddBool(false);
   PublishDatagram(dg);
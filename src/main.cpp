@@ -1,6 +1,8 @@
 #include <spdlog/spdlog.h>
 
 #include "messagedirector/message_director.h"
+#include "net/field_plan.h"
+#include "net/field_validator.h"
 #include "util/config.h"
 #include "util/globals.h"
 #include "util/logger.h"
@@ -47,6 +49,11 @@ int main(int argc, char* argv[]) {
 
   spdlog::debug("Computed DC hash: {}", g_dc_file->get_hash());
 
+  // Flatten field layouts for DatagramIterator, and range constraints for
+  // validating client updates.
+  FieldPlan::CompileAll();
+  FieldValidator::CompileAll();
+
   // Setup main event loop.
   g_main_thread_id = std::this_thread::get_id();
   g_loop = uvw::loop::get_default();
@@ -0,0 +1,920 @@
+#include "amqp_backend.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+#include "../net/address_utils.h"
+#include "../net/datagram_iterator.h"
+#include "../util/globals.h"
+#include "../util/metrics.h"
+#include "message_director.h"
+
+namespace Ardos {
+
+AmqpBackend::AmqpBackend(const YAML::Node& config) {
+  _connectHandle = g_loop->resource<uvw::tcp_handle>();
+
+  // Prepare handles run right before the loop blocks for I/O, i.e. once
+  // per iteration after every callback that could have published.
+  _flushHandle = g_loop->resource<uvw::prepare_handle>();
+  _flushHandle->on<uvw::prepare_event>(
+      [this](const uvw::prepare_event&, uvw::prepare_handle&) { Flush(); });
+
+  // RabbitMQ configuration.
+  if (auto hostParam = config["rabbitmq-host"]) {
+    _host = hostParam.as<std::string>();
+  }
+  if (auto portParam = config["rabbitmq-port"]) {
+    _port = portParam.as<int>();
+  }
+  if (auto userParam = config["rabbitmq-user"]) {
+    _user = userParam.as<std::string>();
+  }
+  if (auto passParam = config["rabbitmq-password"]) {
+    _password = passParam.as<std::string>();
+  }
+
+  // Remote-interest tracking (skip the broker for local-only traffic).
+  if (auto interestParam = config["remote-interest"]) {
+    _trackRemoteInterest = interestParam.as<bool>();
+  }
+  if (auto timeoutParam = config["remote-interest-sync-timeout"]) {
+    _interestSyncTimeout = timeoutParam.as<unsigned int>();
+  }
+  if (auto heartbeatParam = config["remote-interest-heartbeat"]) {
+    _interestHeartbeatInterval = heartbeatParam.as<unsigned int>();
+    if (_interestHeartbeatInterval == 0) {
+      spdlog::get("md")->error(
+          "message-director.remote-interest-heartbeat must be positive");
+      exit(1);  // NOLINT(concurrency-mt-unsafe)
+    }
+  }
+
+  // Unbind batch window (0 = unbind immediately). Binds are never held.
+  if (auto windowParam = config["binding-window"]) {
+    _bindingWindow = windowParam.as<unsigned int>();
+  }
+
+  _bindingTimer = g_loop->resource<uvw::timer_handle>();
+  _bindingTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle&) {
+        _bindingTimerArmed = false;
+        FlushUnbinds();
+      });
+
+  _connectHandle->on<uvw::error_event>(
+      [](const uvw::error_event& event, uvw::tcp_handle&) {
+        // Just die on error, the message director always needs a connection to
+        // RabbitMQ.
+        spdlog::get("md")->error("Socket error: {}", event.what());
+        exit(1);  // NOLINT(concurrency-mt-unsafe)
+      });
+
+  _connectHandle->on<uvw::connect_event>(
+      [this](const uvw::connect_event&, uvw::tcp_handle& tcp) {
+        // Authenticate with the RabbitMQ cluster.
+        _connection =
+            new AMQP::Connection(this, AMQP::Login(_user, _password), "/");
+        // Start reading from the socket.
+        _connectHandle->read();
+      });
+
+  _connectHandle->on<uvw::data_event>(
+      [this](const uvw::data_event& event, uvw::tcp_handle&) {
+        // We've received bytes from RabbitMQ. The buffer may contain zero
+        // or more complete frames followed by a partial frame. AMQP-CPP
+        // does no buffering of its own:
+        //
+        //   * parse() returns the number of bytes consumed (i.e. the
+        //     prefix length of complete frames it was able to decode).
+        //   * Whatever it didn't consume is the start of the next frame
+        //     and must be re-presented unchanged on the next call,
+        //     prepended to any newly-arrived bytes.
+        //
+        // See:
+        // https://github.com/CopernicaMarketingSoftware/AMQP-CPP#parsing-incoming-data
+        const char* data = event.data.get();
+        const size_t size = event.length;
+
+        // Nothing carried over: parse straight out of the socket buffer
+        // and keep only the trailing partial frame, if any.
+        if (_frameBuffer.empty()) {
+          const size_t parsed = ParseFrames(data, size);
+          _frameBuffer.insert(_frameBuffer.end(), data + parsed, data + size);
+          return;
+        }
+
+        _frameBuffer.insert(_frameBuffer.end(), data, data + size);
+        const size_t parsed =
+            ParseFrames(_frameBuffer.data(), _frameBuffer.size());
+        // One shift of the leftover per read rather than one per frame.
+        _frameBuffer.erase(_frameBuffer.begin(),
+                           // parse() can't return more than size:
+                           // NOLINTNEXTLINE(bugprone-narrowing-conversions)
+                           _frameBuffer.begin() + parsed);
+      });
+
+  InitMetrics();
+}
+
+/**
+ * Hands every complete frame in `data` to AMQP-CPP, which dispatches
+ * consumed messages with bodies pointing into it.
+ * @param data
+ * @param size
+ * @return The number of bytes parsed; the rest is a partial frame.
+ */
+size_t AmqpBackend::ParseFrames(const char* data, size_t size) {
+  size_t parsed = 0;
+  while (parsed < size) {
+    const size_t processed = _connection->parse(data + parsed, size - parsed);
+    if (processed == 0) {
+      // Partial frame; wait for more bytes before retrying.
+      break;
+    }
+    parsed += processed;
+  }
+  return parsed;
+}
+
+void AmqpBackend::Start(std::function<void()> onReady) {
+  _onReady = std::move(onReady);
+  _connectHandle->connect(AddressUtils::resolve_host(g_loop, _host, _port),
+                          _port);
+}
+
+std::string AmqpBackend::BuildChannelRoutingKey(uint64_t channel) {
+  // Runs for every publish, so format into the stack instead of building
+  // and concatenating a string per word. Each word is at most 20 digits.
+  constexpr std::string_view kPrefix = "chan.";
+  std::array<char, kPrefix.size() +
+                       (std::size(kChannelPrefixShifts) + 1) * 21>
+      key;
+  char* const end = key.data() + key.size();
+  char* out = std::ranges::copy(kPrefix, key.data()).out;
+  for (unsigned int shift : kChannelPrefixShifts) {
+    out = std::to_chars(out, end, channel >> shift).ptr;
+    *out++ = '.';
+  }
+  out = std::to_chars(out, end, channel).ptr;
+  return {key.data(), out};
+}
+
+/**
+ * Pattern matching every channel in the 2^shift-aligned block starting at
+ * `start`: the prefix words down to `shift` are fixed, the finer ones and
+ * the channel itself are wildcards.
+ * @param start
+ * @param shift
+ * @return
+ */
+std::string AmqpBackend::BuildBlockRoutingPattern(uint64_t start,
+                                                  unsigned int shift) {
+  std::string pattern = "chan.";
+  for (unsigned int prefix : kChannelPrefixShifts) {
+    pattern += prefix >= shift ? std::to_string(start >> prefix) : "*";
+    pattern += ".";
+  }
+  return pattern + "*";
+}
+
+/**
+ * Tiles [min, max] with the fewest aligned blocks, widening the range out
+ * to whole 2^kChannelBucketShift buckets first. Each step takes the
+ * coarsest block that starts at the current position and still fits.
+ * @param min
+ * @param max
+ * @return
+ */
+std::vector<std::string> AmqpBackend::BuildRangeRoutingPatterns(uint64_t min,
+                                                                uint64_t max) {
+  std::vector<std::string> patterns;
+
+  // Work in buckets so the arithmetic can't overflow at the top of the
+  // channel space.
+  uint64_t bucket = min >> kChannelBucketShift;
+  const uint64_t lastBucket = max >> kChannelBucketShift;
+  while (bucket <= lastBucket) {
+    unsigned int shift = kChannelBucketShift;
+    for (unsigned int prefix : kChannelPrefixShifts) {
+      const uint64_t span = uint64_t{1} << (prefix - kChannelBucketShift);
+      if (bucket % span == 0 && lastBucket - bucket >= span - 1) {
+        shift = prefix;
+        break;
+      }
+    }
+
+    patterns.push_back(
+        BuildBlockRoutingPattern(bucket << kChannelBucketShift, shift));
+    bucket += uint64_t{1} << (shift - kChannelBucketShift);
+  }
+
+  return patterns;
+}
+
+void AmqpBackend::BindChannel(uint64_t channel) {
+  QueueBinding(BuildChannelRoutingKey(channel), true);
+
+  if (_trackRemoteInterest) {
+    _localInterest.AddChannel(channel);
+    QueueChannelInterest(channel, true);
+  }
+}
+
+void AmqpBackend::UnbindChannel(uint64_t channel) {
+  QueueBinding(BuildChannelRoutingKey(channel), false);
+
+  if (_trackRemoteInterest) {
+    _localInterest.RemoveChannel(channel);
+    QueueChannelInterest(channel, false);
+  }
+}
+
+void AmqpBackend::BindRange(uint64_t min, uint64_t max) {
+  // Bind the blocks covering this range. Over-delivery at the edges
+  // (channels inside the end blocks but outside [min, max]) never matches
+  // the range index and is dropped on receipt.
+  auto patterns = BuildRangeRoutingPatterns(min, max);
+  for (const auto& pattern : patterns) {
+    if (_rangeBindings[pattern]++ == 0) {
+      QueueBinding(pattern, true);
+    }
+  }
+
+  if (_trackRemoteInterest) {
+    _localInterest.AddRange(min, max);
+    QueueRangeInterest(min, max, true);
+  }
+
+  spdlog::get("md")->trace("Bind range [{}, {}] ({} patterns)", min, max,
+                           patterns.size());
+}
+
+void AmqpBackend::UnbindRange(uint64_t min, uint64_t max) {
+  // Release each block this range was holding. We only unbind from RabbitMQ
+  // once the per-block ref count drops to zero, so overlapping ranges from
+  // other subscribers keep their bindings alive.
+  for (const auto& pattern : BuildRangeRoutingPatterns(min, max)) {
+    if (--_rangeBindings[pattern] == 0) {
+      _rangeBindings.erase(pattern);
+      QueueBinding(pattern, false);
+    }
+  }
+
+  if (_trackRemoteInterest) {
+    _localInterest.RemoveRange(min, max);
+    QueueRangeInterest(min, max, false);
+  }
+}
+
+/**
+ * Binds `key` now, or queues its unbind for the next batch. Callers
+ * ref-count their keys, so calls for a key alternate between bind and
+ * unbind; a bind that arrives while the unbind is still pending just
+ * cancels it, as the broker never dropped the binding.
+ * @param key
+ * @param bind
+ */
+void AmqpBackend::QueueBinding(const std::string& key, bool bind) {
+  if (bind) {
+    if (_pendingUnbinds.erase(key)) {
+      if (_cancelledBindingsCounter) {
+        _cancelledBindingsCounter->Increment(2);
+      }
+      if (_pendingBindingsGauge) {
+        _pendingBindingsGauge->Set((double)_pendingUnbinds.size());
+      }
+      return;
+    }
+
+    // Subscribers expect traffic (a reply to the request they send next,
+    // say) as soon as they've subscribed, so this can't wait.
+    _globalChannel->bindQueue(kGlobalExchange, _localQueue, key);
+    if (_appliedBindsCounter) {
+      _appliedBindsCounter->Increment();
+    }
+    return;
+  }
+
+  _pendingUnbinds.insert(key);
+  if (_bindingWindow == 0) {
+    FlushUnbinds();
+    return;
+  }
+
+  if (_pendingBindingsGauge) {
+    _pendingBindingsGauge->Set((double)_pendingUnbinds.size());
+  }
+
+  if (!_bindingTimerArmed) {
+    _bindingTimerArmed = true;
+    _bindingTimer->start(uvw::timer_handle::time{_bindingWindow},
+                         uvw::timer_handle::time{0});
+  }
+}
+
+/**
+ * Sends the broker every unbind still pending. They all go out in the same
+ * socket write at the end of this loop iteration.
+ */
+void AmqpBackend::FlushUnbinds() {
+  for (const auto& key : _pendingUnbinds) {
+    _globalChannel->unbindQueue(kGlobalExchange, _localQueue, key);
+    if (_appliedUnbindsCounter) {
+      _appliedUnbindsCounter->Increment();
+    }
+  }
+
+  spdlog::get("md")->trace("Applied {} unbind(s)", _pendingUnbinds.size());
+
+  _pendingUnbinds.clear();
+  if (_pendingBindingsGauge) {
+    _pendingBindingsGauge->Set(0);
+  }
+}
+
+void AmqpBackend::Describe(nlohmann::json& info) const {
+  info["backend"] = "amqp";
+  info["connectIp"] = _host;
+  info["connectPort"] = _port;
+}
+
+/**
+ *  Method that is called by AMQP-CPP when data has to be sent over the
+ *  network. You must implement this method and send the data over a
+ *  socket that is connected with RabbitMQ.
+ *
+ *  Note that the AMQP library does no buffering by itself. This means
+ *  that this method should always send out all data or do the buffering
+ *  itself.
+ *
+ *  @param  connection      The connection that created this output
+ *  @param  buffer          Data to send
+ *  @param  size            Size of the buffer
+ */
+void AmqpBackend::onData(AMQP::Connection* connection, const char* buffer,
+                         const size_t size) {
+  // Coalesce everything produced during this loop iteration into one
+  // socket write; see Flush().
+  _sendBuffer.insert(_sendBuffer.end(), buffer, buffer + size);
+
+  ScheduleFlush();
+}
+
+/**
+ *  Method that is called when the login attempt succeeded. After this method
+ *  is called, the connection is ready to use, and the RabbitMQ server is
+ *  ready to receive instructions.
+ *
+ *  @param  connection      The connection that can now be used
+ */
+void AmqpBackend::onReady(AMQP::Connection* connection) {
+  // Resize our frame buffer to the max frame length.
+  // This prevents buffer re-sizing at runtime.
+  _frameBuffer.reserve(connection->maxFrame());
+
+  // Create our "global" exchange.
+  _globalChannel = new AMQP::Channel(_connection);
+  _globalChannel->declareExchange(kGlobalExchange, AMQP::topic)
+      .onSuccess([this]() {
+        // Create our local queue.
+        // This queue is specific to this process, and will be automatically
+        // deleted once it goes offline.
+        _globalChannel->declareQueue(AMQP::exclusive)
+            .onSuccess([this](const std::string& name, int msgCount,
+                              int consumerCount) {
+              _localQueue = name;
+
+              StartConsuming();
+
+              if (_trackRemoteInterest) {
+                StartInterestTracking();
+              }
+
+              spdlog::get("md")->debug("Local Queue: {}", _localQueue);
+
+              _onReady();
+            })
+            .onError([](const char* message) {
+              spdlog::get("md")->error("Failed to declare local queue: {}",
+                                       message);
+              exit(1);  // NOLINT(concurrency-mt-unsafe)
+            });
+      })
+      .onError([](const char* message) {
+        spdlog::get("md")->error("Failed to declare global exchange: {}",
+                                 message);
+        exit(1);  // NOLINT(concurrency-mt-unsafe)
+      });
+}
+
+/**
+ *  When the connection ends up in an error state this method is called.
+ *  This happens when data comes in that does not match the AMQP protocol,
+ *  or when an error message was sent by the server to the client.
+ *
+ *  After this method is called, the connection no longer is in a valid
+ *  state and can no longer be used.
+ *
+ *  @param  connection      The connection that entered the error state
+ *  @param  message         Error message
+ */
+void AmqpBackend::onError(AMQP::Connection* connection, const char* message) {
+  // The connection is dead at this point.
+  // Log out an exception and shut everything down.
+  spdlog::get("md")->error("RabbitMQ error: {}", message);
+  exit(1);  // NOLINT(concurrency-mt-unsafe)
+}
+
+/**
+ *  Method that is called when the AMQP connection was closed.
+ *
+ *  This is the counter part of a call to Connection::close() and it confirms
+ *  that the connection was _correctly_ closed. Note that this only applies
+ *  to the AMQP connection, the underlying TCP connection is not managed by
+ *  AMQP-CPP and is still active.
+ *
+ *  @param  connection      The connection that was closed and that is now
+ * unusable
+ */
+void AmqpBackend::onClosed(AMQP::Connection* connection) {
+  _connectHandle->close();
+}
+
+/**
+ * Queues a datagram for the broker. Consecutive datagrams for the same
+ * recipients are bundled into a single AMQP message; a run ends at the
+ * first datagram for other recipients (RabbitMQ only preserves ordering per
+ * publish, so merging across an interleaved one could reorder traffic for a
+ * queue bound to both), or once the bundle reaches kMaxBundleSize.
+ * @param dg
+ * @param headerSize
+ */
+void AmqpBackend::Publish(const std::shared_ptr<Datagram>& dg,
+                          size_t headerSize) {
+  if (!HasRemoteInterest(dg, headerSize)) {
+    if (_localOnlyCounter) {
+      _localOnlyCounter->Increment();
+    }
+    return;
+  }
+
+  const size_t framedSize = sizeof(uint16_t) + dg->Size();
+  const bool sameRun =
+      _bundleHead && _bundleHeaderSize == headerSize &&
+      std::memcmp(_bundleHead->GetData(), dg->GetData(), headerSize) == 0 &&
+      _bundleBody.size() + framedSize <= kMaxBundleSize;
+  if (!sameRun) {
+    PublishBundle();
+    _bundleHead = dg;
+    _bundleHeaderSize = headerSize;
+  }
+
+  const uint16_t size = dg->Size();
+  const auto* sizeBytes = reinterpret_cast<const char*>(&size);
+  const auto* data = reinterpret_cast<const char*>(dg->GetData());
+  _bundleBody.insert(_bundleBody.end(), sizeBytes, sizeBytes + sizeof(size));
+  _bundleBody.insert(_bundleBody.end(), data, data + size);
+  ++_bundleCount;
+
+  ScheduleFlush();
+}
+
+/**
+ * Publishes the pending bundle under its recipients' routing keys. A lone
+ * datagram goes out as a plain message.
+ */
+void AmqpBackend::PublishBundle() {
+  if (!_bundleHead) {
+    return;
+  }
+
+  // A peer that gets a datagram from us may answer on a channel we've just
+  // subscribed to, and would skip the broker if it hadn't heard about that
+  // yet. Pending removes can wait for Flush.
+  if (_pendingInterestAdds) {
+    PublishPendingInterest();
+  }
+
+  // Route on the first recipient and list the rest as BCC keys. RabbitMQ
+  // routes on those as well, but still delivers at most one copy to each
+  // queue (and strips the header on the way); receiving MDs dispatch on
+  // the datagram's own recipient list.
+  DatagramIterator dgi(_bundleHead);
+  uint8_t channels = dgi.GetUint8();
+  std::string routingKey = BuildChannelRoutingKey(dgi.GetUint64());
+  AMQP::Array otherKeys;
+  for (uint8_t i = 1; i < channels; ++i) {
+    otherKeys.push_back(
+        AMQP::LongString(BuildChannelRoutingKey(dgi.GetUint64())));
+  }
+
+  const char* body = _bundleBody.data();
+  size_t bodySize = _bundleBody.size();
+  if (_bundleCount == 1) {
+    body += sizeof(uint16_t);
+    bodySize -= sizeof(uint16_t);
+  }
+
+  // Tag every publish with our local queue name. The broker fans the message
+  // out to every bound queue including our own; the consume callback drops
+  // copies carrying this appID since we already delivered them in-process.
+  AMQP::Envelope envelope(body, bodySize);
+  envelope.setAppID(_localQueue);
+  if (_bundleCount > 1) {
+    envelope.setType(kBundleType);
+  }
+  if (channels > 1) {
+    envelope.setHeaders(AMQP::Table().set("BCC", otherKeys));
+  }
+  _globalChannel->publish(kGlobalExchange, routingKey, envelope);
+
+  _bundleHead.reset();
+  _bundleBody.clear();
+  _bundleCount = 0;
+}
+
+void AmqpBackend::ScheduleFlush() {
+  if (!_flushScheduled) {
+    _flushScheduled = true;
+    _flushHandle->start();
+  }
+}
+
+/**
+ * Runs once per loop iteration while there's something to send: announces
+ * pending interest changes, publishes the pending bundle and hands the
+ * accumulated AMQP frames to the socket in a single write.
+ */
+void AmqpBackend::Flush() {
+  PublishPendingInterest();
+  PublishBundle();
+
+  if (!_sendBuffer.empty()) {
+    // uvw takes ownership of what it writes, so hand it an exact-size copy
+    // and keep _sendBuffer (and its capacity) for the next iteration.
+    const size_t size = _sendBuffer.size();
+    // runtime-sized buffer for uvw write:
+    // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+    auto out = std::unique_ptr<char[]>(new char[size]);
+    std::memcpy(out.get(), _sendBuffer.data(), size);
+    _sendBuffer.clear();
+    _connectHandle->write(std::move(out), static_cast<unsigned int>(size));
+  }
+
+  _flushHandle->stop();
+  _flushScheduled = false;
+}
+
+/**
+ * Checks the recipients of a datagram against what the other MDs have told
+ * us they're bound to.
+ * @param dg
+ * @param headerSize
+ * @return
+ */
+bool AmqpBackend::HasRemoteInterest(const std::shared_ptr<Datagram>& dg,
+                                    size_t headerSize) const {
+  if (!_trackRemoteInterest || !_interestSynced) {
+    return true;
+  }
+
+  // The header was validated by PublishDatagram: a count, then channels.
+  const uint8_t* data = dg->GetData();
+  for (size_t offset = 1; offset + sizeof(uint64_t) <= headerSize;
+       offset += sizeof(uint64_t)) {
+    uint64_t channel;
+    std::memcpy(&channel, data + offset, sizeof(channel));
+    if (_remoteInterest.Contains(channel)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Binds the interest routing key and asks every other MD for a snapshot of
+ * its bindings. Publishes aren't filtered until the sync timeout expires,
+ * by which point the snapshots should all have arrived.
+ */
+void AmqpBackend::StartInterestTracking() {
+  _globalChannel->bindQueue(kGlobalExchange, _localQueue, kInterestRoutingKey);
+
+  Datagram hello;
+  LocalInterest::Append(hello, InterestOp::Hello);
+  PublishInterest(kGlobalExchange, kInterestRoutingKey, hello);
+
+  _interestSyncTimer = g_loop->resource<uvw::timer_handle>();
+  _interestSyncTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle& timer) {
+        _interestSynced = true;
+        timer.close();
+
+        spdlog::get("md")->debug("Tracking interest of {} peer MD(s)",
+                                 _remoteInterest.PeerCount());
+      });
+  _interestSyncTimer->start(uvw::timer_handle::time{_interestSyncTimeout},
+                            uvw::timer_handle::time{0});
+
+  _interestHeartbeatTimer = g_loop->resource<uvw::timer_handle>();
+  _interestHeartbeatTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle&) {
+        SendInterestHeartbeat();
+      });
+  _interestHeartbeatTimer->start(
+      uvw::timer_handle::time{_interestHeartbeatInterval},
+      uvw::timer_handle::time{_interestHeartbeatInterval});
+}
+
+/**
+ * Tells every other MD we're still up, and removes the interest of any
+ * peer that's gone quiet for longer than its TTL. A peer that was only
+ * slow re-sends everything once we ask it again (see HandleInterest).
+ */
+void AmqpBackend::SendInterestHeartbeat() {
+  Datagram heartbeat;
+  LocalInterest::Append(heartbeat, InterestOp::Heartbeat);
+  PublishInterest(kGlobalExchange, kInterestRoutingKey, heartbeat);
+
+  const uint64_t now = g_loop->now().count();
+  const uint64_t ttl =
+      uint64_t{_interestHeartbeatInterval} * kInterestPeerTtlHeartbeats;
+  for (auto it = _interestPeersSeen.begin();
+       it != _interestPeersSeen.end();) {
+    if (now - it->second <= ttl) {
+      ++it;
+      continue;
+    }
+
+    spdlog::get("md")->debug("Dropping interest of silent peer MD {}",
+                             it->first);
+    _remoteInterest.Remove(it->first);
+    it = _interestPeersSeen.erase(it);
+  }
+}
+
+/**
+ * Applies interest updates published by another MD, answering a Hello
+ * with a snapshot of our own bindings.
+ * @param message
+ */
+void AmqpBackend::HandleInterest(const AMQP::Message& message) {
+  if (!_trackRemoteInterest || !message.hasAppID()) {
+    return;
+  }
+
+  const std::string& peer = message.appID();
+  auto dg = Datagram::View(reinterpret_cast<const uint8_t*>(message.body()),
+                           message.bodySize());
+
+  // Anything but a Hello (a new MD, bound to nothing yet) or a snapshot
+  // from a peer we don't know means we missed, or dropped, what it told us
+  // before. Ask it for a snapshot; that resets whatever we apply now.
+  const bool isNew =
+      _interestPeersSeen.insert_or_assign(peer, g_loop->now().count()).second;
+  if (isNew && message.bodySize() != 0) {
+    const auto op =
+        static_cast<InterestOp>(static_cast<uint8_t>(message.body()[0]));
+    if (op != InterestOp::Hello && op != InterestOp::Reset) {
+      Datagram hello;
+      LocalInterest::Append(hello, InterestOp::Hello);
+      PublishInterest("", peer, hello);
+    }
+  }
+
+  bool hello;
+  try {
+    hello = _remoteInterest.Apply(peer, dg);
+  } catch (const DatagramIteratorEOF&) {
+    spdlog::get("md")->warn("Received a truncated interest update from {}",
+                            peer);
+    return;
+  }
+
+  if (hello) {
+    SendInterestSnapshot(peer);
+  }
+}
+
+/**
+ * Sends `peer` everything we're bound to, straight to its queue through
+ * the default exchange.
+ * @param peer
+ */
+void AmqpBackend::SendInterestSnapshot(const std::string& peer) {
+  // The snapshot already includes our pending changes; announce them first
+  // so `peer` doesn't apply them a second time on top of it.
+  PublishPendingInterest();
+
+  _localInterest.Snapshot(
+      [this, &peer](const Datagram& dg) { PublishInterest("", peer, dg); });
+}
+
+/**
+ * Queues a change to a channel binding for the next announcement. Binds and
+ * unbinds of a channel alternate, so one still pending is the opposite of
+ * this one, and the two cancel out.
+ * @param channel
+ * @param add
+ */
+void AmqpBackend::QueueChannelInterest(uint64_t channel, bool add) {
+  auto [it, inserted] = _pendingChannelInterest.try_emplace(channel, add);
+  if (!inserted) {
+    _pendingChannelInterest.erase(it);
+    return;
+  }
+
+  _pendingInterestAdds |= add;
+  ScheduleFlush();
+}
+
+/**
+ * Queues a change to a range binding for the next announcement. Ranges
+ * aren't ref-counted by the caller, so we keep the net number of adds per
+ * range and drop it once they've cancelled out.
+ * @param min
+ * @param max
+ * @param add
+ */
+void AmqpBackend::QueueRangeInterest(uint64_t min, uint64_t max, bool add) {
+  auto it = _pendingRangeInterest.try_emplace({min, max}, 0).first;
+  it->second += add ? 1 : -1;
+  if (it->second == 0) {
+    _pendingRangeInterest.erase(it);
+    return;
+  }
+
+  _pendingInterestAdds |= add;
+  ScheduleFlush();
+}
+
+/**
+ * Tells every other MD about the interest changes queued since the last
+ * announcement, in as few messages as they fit in (normally one).
+ */
+void AmqpBackend::PublishPendingInterest() {
+  _pendingInterestAdds = false;
+  if (_pendingChannelInterest.empty() && _pendingRangeInterest.empty()) {
+    return;
+  }
+
+  Datagram update;
+  auto flushIfFull = [&]() {
+    if (update.Size() + kMaxInterestUpdateSize > kMaxDgSize) {
+      PublishInterest(kGlobalExchange, kInterestRoutingKey, update);
+      update.Clear();
+    }
+  };
+
+  for (const auto& [channel, add] : _pendingChannelInterest) {
+    flushIfFull();
+    LocalInterest::Append(
+        update, add ? InterestOp::AddChannel : InterestOp::RemoveChannel,
+        channel);
+  }
+  for (const auto& [range, net] : _pendingRangeInterest) {
+    const auto op = net > 0 ? InterestOp::AddRange : InterestOp::RemoveRange;
+    for (int i = 0; i < std::abs(net); ++i) {
+      flushIfFull();
+      LocalInterest::Append(update, op, range.first, range.second);
+    }
+  }
+  PublishInterest(kGlobalExchange, kInterestRoutingKey, update);
+
+  _pendingChannelInterest.clear();
+  _pendingRangeInterest.clear();
+}
+
+/**
+ * Publishes a batch of interest updates, either to every MD or (through the
+ * default exchange) to a single peer's queue.
+ * @param exchange
+ * @param routingKey
+ * @param dg
+ */
+void AmqpBackend::PublishInterest(const std::string& exchange,
+                                  const std::string& routingKey,
+                                  const Datagram& dg) {
+  AMQP::Envelope envelope(reinterpret_cast<const char*>(dg.GetData()),
+                          (size_t)dg.Size());
+  envelope.setAppID(_localQueue);
+  envelope.setType(kInterestType);
+  _globalChannel->publish(exchange, routingKey, envelope);
+}
+
+/**
+ * Initializes metrics collection for the AMQP backend.
+ */
+void AmqpBackend::InitMetrics() {
+  // Make sure we want to collect metrics on this cluster.
+  if (!Metrics::Instance()->WantMetrics()) {
+    return;
+  }
+
+  auto registry = Metrics::Instance()->GetRegistry();
+
+  auto& localOnlyBuilder =
+      prometheus::BuildCounter()
+          .Name("md_local_only_datagrams_total")
+          .Help("Number of datagrams not published to RabbitMQ because no "
+                "other MD was bound to their recipients")
+          .Register(*registry);
+
+  auto& pendingBindingsBuilder =
+      prometheus::BuildGauge()
+          .Name("md_pending_bindings_size")
+          .Help("Number of unbinds waiting for the batch window")
+          .Register(*registry);
+
+  auto& cancelledBindingsBuilder =
+      prometheus::BuildCounter()
+          .Name("md_cancelled_bindings_total")
+          .Help("Number of binding changes dropped because a bind cancelled "
+                "an unbind still waiting for the batch window")
+          .Register(*registry);
+
+  auto& appliedBindingsBuilder =
+      prometheus::BuildCounter()
+          .Name("md_applied_bindings_total")
+          .Help("Number of binding changes sent to RabbitMQ")
+          .Register(*registry);
+
+  _localOnlyCounter = &localOnlyBuilder.Add({});
+  _pendingBindingsGauge = &pendingBindingsBuilder.Add({});
+  _cancelledBindingsCounter = &cancelledBindingsBuilder.Add({});
+  _appliedBindsCounter = &appliedBindingsBuilder.Add({{"op", "bind"}});
+  _appliedUnbindsCounter = &appliedBindingsBuilder.Add({{"op", "unbind"}});
+}
+
+/**
+ * Start consuming messages from RabbitMQ.
+ * Messages are handed to the Message Director for local dispatch.
+ */
+void AmqpBackend::StartConsuming() {
+  // Consume in no-ack mode: the broker treats messages as acknowledged the
+  // moment they're delivered, which removes a round-trip per message and
+  // noticeably improves throughput. Trade-off: if this process dies mid-handle
+  // the in-flight message is lost, but the MD holds no durable state worth
+  // recovering -- the whole cluster re-converges on restart.
+  _globalChannel->consume(_localQueue, AMQP::noack)
+      .onSuccess([this](const std::string& tag) { _consumeTag = tag; })
+      .onReceived([this](const AMQP::Message& message, uint64_t deliveryTag,
+                         bool redelivered) {
+        // Drop loopback copies. PublishDatagram tags every outgoing message
+        // with our local queue name and delivers synchronously in-process;
+        // the broker still fans the message out to us, so ignore that copy.
+        if (message.hasAppID() && message.appID() == _localQueue) {
+          return;
+        }
+
+        if (message.hasType() && message.type() == kInterestType) {
+          HandleInterest(message);
+          return;
+        }
+
+        if (!message.hasType() || message.type() != kBundleType) {
+          MessageDirector::Instance()->DeliverRemote(
+              reinterpret_cast<const uint8_t*>(message.body()),
+              message.bodySize());
+          return;
+        }
+
+        // Unpack a bundle of length-prefixed datagrams.
+        const auto* data = reinterpret_cast<const uint8_t*>(message.body());
+        size_t remaining = message.bodySize();
+        while (remaining >= sizeof(uint16_t)) {
+          uint16_t size;
+          std::memcpy(&size, data, sizeof(size));
+          data += sizeof(size);
+          remaining -= sizeof(size);
+          if (size > remaining) {
+            break;
+          }
+
+          MessageDirector::Instance()->DeliverRemote(data, size);
+          data += size;
+          remaining -= size;
+        }
+
+        if (remaining) {
+          spdlog::get("md")->warn("Received a truncated bundle on {}",
+                                  message.routingkey());
+        }
+      })
+      .onCancelled([](const std::string& consumerTag) {
+        spdlog::get("md")->error("Channel consuming cancelled unexpectedly.");
+      })
+      .onError([](const char* message) {
+        spdlog::get("md")->error("Received error: {}", message);
+      });
+}
+
+}  // namespace Ardos
@@ -0,0 +1,206 @@
+#ifndef ARDOS_AMQP_BACKEND_H
+#define ARDOS_AMQP_BACKEND_H
+
+#include <amqpcpp.h>
+#include <prometheus/counter.h>
+#include <prometheus/gauge.h>
+#include <yaml-cpp/yaml.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <uvw.hpp>
+#include <vector>
+
+#include "remote_interest.h"
+#include "routing_backend.h"
+
+namespace Ardos {
+
+const std::string kGlobalExchange = "global-exchange";
+
+// AMQP message type of a bundle: consecutive datagrams for the same
+// recipients, each prefixed with its uint16 length.
+const std::string kBundleType = "bundle";
+// Bundles are published early once they'd grow past this many bytes.
+constexpr size_t kMaxBundleSize = 64 * 1024;
+
+// Routing key and AMQP message type of the interest updates MDs exchange
+// when message-director.remote-interest is enabled.
+const std::string kInterestRoutingKey = "interest";
+const std::string kInterestType = "interest";
+// Heartbeats a peer may miss before we drop its interest.
+constexpr unsigned int kInterestPeerTtlHeartbeats = 3;
+
+// Channel routing keys carry a word for each of these prefixes of the
+// channel, coarsest first, followed by the channel itself:
+//
+//   chan.<ch >> 60>.<ch >> 56>. ... .<ch >> 20>.<ch >> 16>.<ch>
+//
+// A range subscription binds the largest aligned blocks that tile it; a
+// block at level `shift` matches on the words down to its own prefix and
+// wildcards the rest. Any range takes at most 15 blocks per level at each
+// end, so a 200M-channel range is a few dozen bindings instead of one per
+// 65,536 channels. Blocks at the range edges may stick out past
+// [min, max]; the local range index drops that over-delivery.
+//
+// Every MD in a cluster must agree on this scheme.
+constexpr unsigned int kChannelPrefixShifts[] = {60, 56, 52, 48, 44, 40,
+                                                 36, 32, 28, 24, 20, 16};
+// Finest prefix: the smallest block a range binding can use.
+constexpr unsigned int kChannelBucketShift = 16;
+
+// Routes through a RabbitMQ topic exchange. Each MD consumes from its own
+// exclusive queue, bound to the routing keys of the channels and ranges it
+// has subscribers for.
+class AmqpBackend final : public RoutingBackend,
+                          public AMQP::ConnectionHandler {
+ public:
+  explicit AmqpBackend(const YAML::Node& config);
+
+  void Start(std::function<void()> onReady) override;
+
+  void BindChannel(uint64_t channel) override;
+  void UnbindChannel(uint64_t channel) override;
+  void BindRange(uint64_t min, uint64_t max) override;
+  void UnbindRange(uint64_t min, uint64_t max) override;
+
+  // Queues `dg` for RabbitMQ. Everything queued during a loop iteration
+  // goes out just before the loop next waits for I/O.
+  void Publish(const std::shared_ptr<Datagram>& dg, size_t headerSize) override;
+
+  void Describe(nlohmann::json& info) const override;
+
+  void onData(AMQP::Connection* connection, const char* buffer,
+              size_t size) override;
+  void onReady(AMQP::Connection* connection) override;
+  void onError(AMQP::Connection* connection, const char* message) override;
+  void onClosed(AMQP::Connection* connection) override;
+
+  static std::string BuildChannelRoutingKey(uint64_t channel);
+  static std::string BuildBlockRoutingPattern(uint64_t start,
+                                              unsigned int shift);
+  // Binding patterns for the aligned blocks that cover [min, max].
+  static std::vector<std::string> BuildRangeRoutingPatterns(uint64_t min,
+                                                            uint64_t max);
+
+ private:
+  void InitMetrics();
+
+  void StartConsuming();
+  // Parses as many whole frames from `data` as it holds.
+  size_t ParseFrames(const char* data, size_t size);
+
+  // Binds right away, or queues an unbind for the next batch. A bind for a
+  // key whose unbind is still pending cancels it instead.
+  void QueueBinding(const std::string& key, bool bind);
+  // Sends every pending unbind.
+  void FlushUnbinds();
+
+  // Publishes the pending bundle, if any.
+  void PublishBundle();
+  void ScheduleFlush();
+  // End of a loop iteration: publishes the pending bundle and writes out
+  // everything AMQP-CPP produced since the last flush.
+  void Flush();
+
+  void StartInterestTracking();
+  // Announces we're still up and removes peers we haven't heard from
+  // within their TTL.
+  void SendInterestHeartbeat();
+  void HandleInterest(const AMQP::Message& message);
+  void SendInterestSnapshot(const std::string& peer);
+  // Queue a change to our bindings for the next announcement. A change
+  // that undoes one still pending cancels it instead.
+  void QueueChannelInterest(uint64_t channel, bool add);
+  void QueueRangeInterest(uint64_t min, uint64_t max, bool add);
+  // Announces every pending interest change.
+  void PublishPendingInterest();
+  void PublishInterest(const std::string& exchange,
+                       const std::string& routingKey, const Datagram& dg);
+  // False if every recipient of `dg` is known to be local-only.
+  [[nodiscard]] bool HasRemoteInterest(const std::shared_ptr<Datagram>& dg,
+                                       size_t headerSize) const;
+
+  std::function<void()> _onReady;
+
+  std::shared_ptr<uvw::tcp_handle> _connectHandle;
+  std::shared_ptr<uvw::prepare_handle> _flushHandle;
+  bool _flushScheduled = false;
+  AMQP::Connection* _connection = nullptr;
+  AMQP::Channel* _globalChannel = nullptr;
+  std::string _localQueue;
+  std::string _consumeTag;
+  std::vector<char> _frameBuffer;
+
+  // RabbitMQ connect info.
+  std::string _host = "127.0.0.1";
+  int _port = 5672;
+  std::string _user = "guest";
+  std::string _password = "guest";
+
+  // Ref-counted range bindings, keyed by pattern. Overlapping range
+  // subscriptions may share blocks; we only unbind from RabbitMQ when the
+  // count hits zero.
+  std::unordered_map<std::string, unsigned int> _rangeBindings;
+
+  // Routing keys or patterns waiting out the batch window to be unbound.
+  // Binds never wait (anything published before the broker has them would
+  // be lost), but a subscriber that leaves and rejoins a channel within the
+  // window still costs nothing: the rejoin just drops the pending unbind.
+  std::unordered_set<std::string> _pendingUnbinds;
+  unsigned int _bindingWindow = 10;
+  std::shared_ptr<uvw::timer_handle> _bindingTimer;
+  bool _bindingTimerArmed = false;
+
+  // Outgoing bundle: a run of consecutive publishes for the same recipient
+  // list, routed by the header of the first. Runs end at the first publish
+  // for other recipients so nothing is reordered for a queue bound to both.
+  std::shared_ptr<Datagram> _bundleHead;
+  size_t _bundleHeaderSize = 0;
+  size_t _bundleCount = 0;
+  std::vector<char> _bundleBody;
+
+  // Remote-interest tracking. Until the sync timeout has passed we can't be
+  // sure every peer has sent its snapshot, so everything is published.
+  // With tracking off, _localInterest stays empty and nothing is announced.
+  bool _trackRemoteInterest = false;
+  bool _interestSynced = false;
+  unsigned int _interestSyncTimeout = 2000;
+  std::shared_ptr<uvw::timer_handle> _interestSyncTimer;
+  LocalInterest _localInterest;
+  RemoteInterest _remoteInterest;
+
+  // Our queue is exclusive, so a peer that's gone is never coming back
+  // under the same name. Every MD sends a Heartbeat each interval, and a
+  // peer silent for kInterestPeerTtlHeartbeats of them is removed. Keyed by
+  // peer queue, in g_loop milliseconds.
+  unsigned int _interestHeartbeatInterval = 5000;
+  std::shared_ptr<uvw::timer_handle> _interestHeartbeatTimer;
+  std::unordered_map<std::string, uint64_t> _interestPeersSeen;
+
+  // Interest changes not yet announced. Flush publishes them once per loop
+  // iteration, or PublishBundle does first if there's an add among them,
+  // so peers hear about a subscription before anything we send after it.
+  // Channels map to true for an add; ranges to their net number of adds.
+  std::unordered_map<uint64_t, bool> _pendingChannelInterest;
+  std::map<std::pair<uint64_t, uint64_t>, int> _pendingRangeInterest;
+  bool _pendingInterestAdds = false;
+
+  // AMQP-CPP output waiting for the end of the loop iteration. Cleared,
+  // not released, by Flush so it keeps its capacity.
+  std::vector<char> _sendBuffer;
+
+  prometheus::Counter* _localOnlyCounter = nullptr;
+  prometheus::Gauge* _pendingBindingsGauge = nullptr;
+  prometheus::Counter* _cancelledBindingsCounter = nullptr;
+  prometheus::Counter* _appliedBindsCounter = nullptr;
+  prometheus::Counter* _appliedUnbindsCounter = nullptr;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_AMQP_BACKEND_H
@@ -0,0 +1,108 @@
+#include "channel_index.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Ardos {
+
+/**
+ * splitmix64 finalizer. Channels are usually allocated sequentially, so
+ * the raw value would cluster badly under a power-of-two mask.
+ * @param key
+ * @return
+ */
+uint64_t ChannelIndex::Hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return key;
+}
+
+size_t ChannelIndex::Probe(uint64_t key) const {
+  const size_t mask = _slots.size() - 1;
+  size_t i = Hash(key) & mask;
+  while (_slots[i].used && _slots[i].key != key) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+const ChannelIndex::SubscriberList* ChannelIndex::Find(uint64_t key) const {
+  if (_size == 0) {
+    return nullptr;
+  }
+
+  const Slot& slot = _slots[Probe(key)];
+  return slot.used ? &slot.subscribers : nullptr;
+}
+
+void ChannelIndex::Insert(uint64_t key, uint32_t subscriber) {
+  // Keep the load factor at or below 1/2.
+  if ((_size + 1) * 2 > _slots.size()) {
+    Grow();
+  }
+
+  Slot& slot = _slots[Probe(key)];
+  if (!slot.used) {
+    slot.used = true;
+    slot.key = key;
+    ++_size;
+  }
+  slot.subscribers.push_back(subscriber);
+}
+
+void ChannelIndex::Erase(uint64_t key, uint32_t subscriber) {
+  if (_size == 0) {
+    return;
+  }
+
+  size_t hole = Probe(key);
+  Slot& slot = _slots[hole];
+  if (!slot.used) {
+    return;
+  }
+
+  auto& list = slot.subscribers;
+  auto it = std::ranges::find(list, subscriber);
+  if (it == list.end()) {
+    return;
+  }
+  // Order within a list doesn't matter; swap-remove.
+  *it = list.back();
+  list.pop_back();
+  if (!list.empty()) {
+    return;
+  }
+
+  // Last subscriber gone: drop the key and shift any displaced entries
+  // back so every probe chain stays unbroken.
+  const size_t mask = _slots.size() - 1;
+  size_t next = (hole + 1) & mask;
+  while (_slots[next].used) {
+    const size_t home = Hash(_slots[next].key) & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      _slots[hole] = std::move(_slots[next]);
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+
+  _slots[hole].used = false;
+  _slots[hole].subscribers.clear();
+  --_size;
+}
+
+void ChannelIndex::Grow() {
+  std::vector<Slot> old = std::move(_slots);
+  _slots = std::vector<Slot>(old.empty() ? kInitialCapacity : old.size() * 2);
+
+  for (auto& slot : old) {
+    if (slot.used) {
+      _slots[Probe(slot.key)] = std::move(slot);
+    }
+  }
+}
+
+}  // namespace Ardos
@@ -0,0 +1,54 @@
+#ifndef ARDOS_CHANNEL_INDEX_H
+#define ARDOS_CHANNEL_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Ardos {
+
+// Flat, open-addressed map from a channel to the ids of the subscribers
+// listening on it. Lookups probe one contiguous array and hand back the
+// id list in place, so routing a datagram never touches the heap; only
+// Insert/Erase allocate. Linear probing with backward-shift deletion keeps
+// probe chains short without tombstones.
+//
+// A subscriber may be listed more than once under the same key. Each
+// Insert is undone by exactly one Erase, and dispatch dedupes with
+// per-delivery generation stamps.
+class ChannelIndex {
+ public:
+  using SubscriberList = std::vector<uint32_t>;
+
+  // Returns the subscribers listed under `key`, or nullptr if none.
+  [[nodiscard]] const SubscriberList* Find(uint64_t key) const;
+
+  void Insert(uint64_t key, uint32_t subscriber);
+  void Erase(uint64_t key, uint32_t subscriber);
+
+  // Number of distinct keys.
+  [[nodiscard]] size_t Size() const { return _size; }
+
+ private:
+  struct Slot {
+    uint64_t key = 0;
+    bool used = false;
+    SubscriberList subscribers;
+  };
+
+  // Index of the slot holding `key`, or of the empty slot ending its probe
+  // chain. Requires a non-empty table.
+  [[nodiscard]] size_t Probe(uint64_t key) const;
+  void Grow();
+
+  static uint64_t Hash(uint64_t key);
+
+  static constexpr size_t kInitialCapacity = 16;
+
+  std::vector<Slot> _slots;
+  size_t _size = 0;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_CHANNEL_INDEX_H
@@ -9,74 +9,44 @@
 
 namespace Ardos {
 
-// We use this to keep track of which channels we have opened with RabbitMQ.
-// Once a channel reaches a subscriber count of 0, we let RabbitMQ know that
-// we no longer wish to be routed messages about it.
+// We use this to keep track of which channels we have bound with the routing
+// backend. Once a channel reaches a subscriber count of 0, we let the backend
+// know that we no longer wish to be routed messages about it.
 std::unordered_map<uint64_t, unsigned int> ChannelSubscriber::_globalChannels =
     std::unordered_map<uint64_t, unsigned int>();
-std::unordered_map<uint64_t, unsigned int> ChannelSubscriber::_globalBuckets =
-    std::unordered_map<uint64_t, unsigned int>();
-std::unordered_map<uint64_t,
-                   std::unordered_set<std::shared_ptr<ChannelSubscriber>>>
-    ChannelSubscriber::_channelIndex;
-std::unordered_map<uint64_t,
-                   std::unordered_set<std::shared_ptr<ChannelSubscriber>>>
-    ChannelSubscriber::_bucketIndex;
-
-std::string ChannelSubscriber::BuildChannelRoutingKey(uint64_t channel) {
-  return "chan." + std::to_string(channel >> kChannelBucketShift) + "." +
-         std::to_string(channel);
-}
-
-std::string ChannelSubscriber::BuildBucketRoutingPattern(uint64_t bucket) {
-  return "chan." + std::to_string(bucket) + ".*";
-}
-
-uint64_t ChannelSubscriber::ChannelFromRoutingKey(
-    const std::string& routingKey) {
-  auto lastDot = routingKey.rfind('.');
-  if (lastDot == std::string::npos) {
-    return std::stoull(routingKey);
-  }
-  return std::stoull(routingKey.substr(lastDot + 1));
-}
+ChannelIndex ChannelSubscriber::_channelIndex;
+RangeIndex ChannelSubscriber::_rangeIndex;
 
 ChannelSubscriber::ChannelSubscriber() {
   // MD registration happens in Init() -- shared_from_this() not valid here.
-  _globalChannel = MessageDirector::Instance()->GetGlobalChannel();
-  _localQueue = MessageDirector::Instance()->GetLocalQueue();
+  _backend = MessageDirector::Instance()->GetBackend();
 }
 
 void ChannelSubscriber::Init() {
-  auto self = shared_from_this();
-  MessageDirector::Instance()->AddSubscriber(self);
+  // Assigns _subscriberId.
+  MessageDirector::Instance()->AddSubscriber(shared_from_this());
 
   // Backfill the routing-key index with any subscriptions that landed
   // during construction (subclass ctors may call SubscribeChannel/
-  // SubscribeRange before shared_from_this is valid, in which case the
-  // SubscribeChannel call skipped its index update).
+  // SubscribeRange before we have an id, in which case the call skipped
+  // its index update).
   for (uint64_t channel : _localChannels) {
-    _channelIndex[channel].insert(self);
+    _channelIndex.Insert(channel, _subscriberId);
   }
   for (const auto& [lo, hi] : _localRanges) {
-    uint64_t minBucket = lo >> kChannelBucketShift;
-    uint64_t maxBucket = hi >> kChannelBucketShift;
-    for (uint64_t bucket = minBucket; bucket <= maxBucket; ++bucket) {
-      _bucketIndex[bucket].insert(self);
-    }
+    _rangeIndex.Insert(lo, hi, _subscriberId);
   }
 }
 
 void ChannelSubscriber::Shutdown() {
-  // Anchor self for the duration of the method. RemoveSubscriber and
-  // each UnsubscribeChannel/Range below drops a shared_ptr ref; without
-  // this pin the last drop would destroy `this` inside the erase. Null
-  // when called from a destructor (indexes already drained, loops no-op).
+  // Anchor self for the duration of the method. RemoveSubscriber below
+  // drops the MD's owning ref; without this pin that drop would destroy
+  // `this` mid-method. Null when called from a destructor (indexes
+  // already drained, loops no-op).
   auto self = weak_from_this().lock();
 
-  MessageDirector::Instance()->RemoveSubscriber(this);
-
-  // Cleanup our local channel subscriptions.
+  // Cleanup our local channel subscriptions. These still need our id to
+  // find our index entries, so they go before RemoveSubscriber.
   while (!_localChannels.empty()) {
     uint64_t channel = *_localChannels.begin();
     UnsubscribeChannel(channel);
@@ -87,6 +57,8 @@ void ChannelSubscriber::Shutdown() {
     auto range = _localRanges.back();
     UnsubscribeRange(range.first, range.second);
   }
+
+  MessageDirector::Instance()->RemoveSubscriber(this);
 }
 
 void ChannelSubscriber::SubscribeChannel(const uint64_t& channel) {
@@ -96,23 +68,21 @@ void ChannelSubscriber::SubscribeChannel(const uint64_t& channel) {
   }
 
   // Update the dispatch index so DeliverLocally / onReceived can find us
-  // by channel without walking _subscribers. weak_from_this().lock()
-  // returns null when called from a ctor (no shared_ptr exists yet);
-  // Init() will backfill in that case.
-  if (auto self = weak_from_this().lock()) {
-    _channelIndex[channel].insert(self);
+  // by channel without walking _subscribers. We have no id yet when
+  // called from a ctor; Init() will backfill in that case.
+  if (_subscriberId != kNoSubscriberId) {
+    _channelIndex.Insert(channel, _subscriberId);
   }
 
-  // If the channel is already bound at the broker (another subscriber in
-  // this process is listening), just bump the refcount.
+  // If the channel is already bound (another subscriber in this process is
+  // listening), just bump the refcount.
   if (_globalChannels.contains(channel)) {
     _globalChannels[channel]++;
     return;
   }
 
-  // Otherwise, open the channel with RabbitMQ.
-  _globalChannel->bindQueue(kGlobalExchange, _localQueue,
-                            BuildChannelRoutingKey(channel));
+  // Otherwise, bind the channel with the routing backend...
+  _backend->BindChannel(channel);
 
   // ... and register it as a newly opened global channel.
   _globalChannels[channel] = 1;
@@ -126,32 +96,19 @@ void ChannelSubscriber::UnsubscribeChannel(const uint64_t& channel) {
     return;
   }
 
-  // Remove ourselves from the dispatch index. Use find-by-pointer because
-  // we may not be able to obtain a shared_ptr (Shutdown can run from the
-  // destructor, where weak_from_this() is expired); the entry is keyed
-  // on shared_ptr identity though, so we have to scan.
-  if (auto idxIt = _channelIndex.find(channel); idxIt != _channelIndex.end()) {
-    auto& set = idxIt->second;
-    for (auto it = set.begin(); it != set.end(); ++it) {
-      if (it->get() == this) {
-        set.erase(it);
-        break;
-      }
-    }
-    if (set.empty()) {
-      _channelIndex.erase(idxIt);
-    }
+  // Remove ourselves from the dispatch index.
+  if (_subscriberId != kNoSubscriberId) {
+    _channelIndex.Erase(channel, _subscriberId);
   }
 
   // We can safely assume the channel exists in a global context.
   _globalChannels[channel]--;
 
-  // If we have 0 current listeners for this channel, let RabbitMQ know we no
-  // longer care about it.
+  // If we have 0 current listeners for this channel, let the backend know we
+  // no longer care about it.
   if (!_globalChannels[channel]) {
     _globalChannels.erase(channel);
-    _globalChannel->unbindQueue(kGlobalExchange, _localQueue,
-                                BuildChannelRoutingKey(channel));
+    _backend->UnbindChannel(channel);
   }
 }
 
@@ -165,30 +122,15 @@ void ChannelSubscriber::SubscribeRange(const uint64_t& min,
 
   _localRanges.push_back(range);
 
-  uint64_t minBucket = min >> kChannelBucketShift;
-  uint64_t maxBucket = max >> kChannelBucketShift;
-
-  // Index ourselves on every bucket the range overlaps. Same shared_ptr
-  // pattern as SubscribeChannel -- Init() backfills when the call lands
-  // before shared_from_this is valid.
-  if (auto self = weak_from_this().lock()) {
-    for (uint64_t bucket = minBucket; bucket <= maxBucket; ++bucket) {
-      _bucketIndex[bucket].insert(self);
-    }
+  // Same pattern as SubscribeChannel -- Init() backfills when the call
+  // lands before we have an id.
+  if (_subscriberId != kNoSubscriberId) {
+    _rangeIndex.Insert(min, max, _subscriberId);
   }
 
-  // Bind every bucket that overlaps this range. Over-delivery at the edges
-  // (channels inside the end buckets but outside [min, max]) is dropped by
-  // the client-side WithinLocalRange filter.
-  for (uint64_t bucket = minBucket; bucket <= maxBucket; ++bucket) {
-    if (_globalBuckets[bucket]++ == 0) {
-      _globalChannel->bindQueue(kGlobalExchange, _localQueue,
-                                BuildBucketRoutingPattern(bucket));
-    }
-  }
-
-  spdlog::get("md")->trace("Subscribe range [{}, {}] (buckets {}..{})", min,
-                           max, minBucket, maxBucket);
+  // The backend may bind more than [min, max]; over-delivery never matches
+  // the range index and is dropped on receipt.
+  _backend->BindRange(min, max);
 }
 
 void ChannelSubscriber::UnsubscribeRange(const uint64_t& min,
@@ -202,76 +144,37 @@ void ChannelSubscriber::UnsubscribeRange(const uint64_t& min,
 
   _localRanges.erase(position);
 
-  uint64_t minBucket = min >> kChannelBucketShift;
-  uint64_t maxBucket = max >> kChannelBucketShift;
-
-  // Drop ourselves from the bucket index for every bucket this range
-  // touched. Scan-by-pointer because Shutdown may run from the destructor
-  // (weak_from_this expired); the entry is keyed by shared_ptr identity
-  // so we have to find ourselves the hard way. Only the matching buckets
-  // are scanned -- typically a small constant.
-  for (uint64_t bucket = minBucket; bucket <= maxBucket; ++bucket) {
-    auto idxIt = _bucketIndex.find(bucket);
-    if (idxIt == _bucketIndex.end()) {
-      continue;
-    }
-    auto& set = idxIt->second;
-    for (auto it = set.begin(); it != set.end(); ++it) {
-      if (it->get() == this) {
-        set.erase(it);
-        break;
-      }
-    }
-    if (set.empty()) {
-      _bucketIndex.erase(idxIt);
-    }
+  // Entries are counted, so another of our ranges overlapping this one
+  // keeps its own coverage.
+  if (_subscriberId != kNoSubscriberId) {
+    _rangeIndex.Erase(min, max, _subscriberId);
   }
 
-  // Release each bucket this range was holding. We only unbind from RabbitMQ
-  // once the per-bucket ref count drops to zero, so overlapping ranges from
-  // other subscribers keep their bindings alive.
-  for (uint64_t bucket = minBucket; bucket <= maxBucket; ++bucket) {
-    if (--_globalBuckets[bucket] == 0) {
-      _globalBuckets.erase(bucket);
-      _globalChannel->unbindQueue(kGlobalExchange, _localQueue,
-                                  BuildBucketRoutingPattern(bucket));
-    }
-  }
+  _backend->UnbindRange(min, max);
 }
 
 void ChannelSubscriber::PublishDatagram(const std::shared_ptr<Datagram>& dg) {
   DatagramIterator dgi(dg);
 
-  // Tag every publish with our local queue name. The broker fans the message
-  // out to every bound queue including our own; the consume callback drops
-  // copies carrying this appID since we already delivered them in-process.
-  std::string localQueue = MessageDirector::Instance()->GetLocalQueue();
-
+  // Step over the whole recipient list up front, so a truncated header
+  // throws before anything has been delivered or published.
   uint8_t channels = dgi.GetUint8();
-  for (uint8_t i = 0; i < channels; ++i) {
-    uint64_t channel = dgi.GetUint64();
-    std::string routingKey = BuildChannelRoutingKey(channel);
-
-    spdlog::get("md")->trace("Publish chan={} bucket={} size={}B", channel,
-                             channel >> kChannelBucketShift, dg->Size());
-
-    // Deliver to in-process subscribers. Avoids the subscribe-then-publish
-    // race (async bindQueue not yet live) and skips the broker round-trip
-    // for traffic that never needed to leave this MD. DeliverLocally no-ops
-    // when nothing in this MD could match.
-    MessageDirector::Instance()->DeliverLocally(routingKey, dg);
-
-    AMQP::Envelope envelope(reinterpret_cast<const char*>(dg->GetData()),
-                            (size_t)dg->Size());
-    envelope.setAppID(localQueue);
-    _globalChannel->publish(kGlobalExchange, routingKey, envelope);
+  if (!channels) {
+    return;
   }
-}
+  uint64_t firstChannel = dgi.GetUint64();
+  dgi.Skip((channels - 1) * sizeof(uint64_t));
+
+  spdlog::get("md")->trace("Publish chan={} recipients={} size={}B",
+                           firstChannel, channels, dg->Size());
+
+  // Deliver to in-process subscribers. Avoids the subscribe-then-publish
+  // race (async bind not yet live) and skips the backend round-trip for
+  // traffic that never needed to leave this MD. DeliverLocally no-ops when
+  // nothing in this MD could match.
+  MessageDirector::Instance()->DeliverLocally(dg);
 
-bool ChannelSubscriber::WithinLocalRange(uint64_t channel) {
-  return std::ranges::any_of(_localRanges, [channel](auto i) {
-    return channel >= i.first && channel <= i.second;
-  });
+  _backend->Publish(dg, dgi.Tell());
 }
 
 }  // namespace Ardos
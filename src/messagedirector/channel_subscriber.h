@@ -1,23 +1,24 @@
 #ifndef ARDOS_CHANNEL_SUBSCRIBER_H
 #define ARDOS_CHANNEL_SUBSCRIBER_H
 
-#include <amqpcpp.h>
-
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "../net/datagram.h"
+#include "channel_index.h"
+#include "range_index.h"
+#include "routing_backend.h"
 
 namespace Ardos {
 
 using ChannelRange = std::pair<uint64_t, uint64_t>;
 
-// Channels are bucketed by their upper bits so that range subscriptions can be
-// expressed as a small number of topic bindings of the form `chan.<bucket>.*`
-// rather than one binding per channel. With a 16-bit shift, each bucket covers
-// 65,536 channels, so a 200M-channel range is ~3,050 bindings.
-constexpr unsigned int kChannelBucketShift = 16;
+// Id of a subscriber that isn't (or is no longer) registered with the MD.
+constexpr uint32_t kNoSubscriberId = UINT32_MAX;
 
 class ChannelSubscriber
     : public std::enable_shared_from_this<ChannelSubscriber> {
@@ -55,39 +56,29 @@ class ChannelSubscriber
   virtual void HandleDatagram(const std::shared_ptr<Datagram>& dg) = 0;
 
  private:
-  // True if `channel` falls inside one of our subscribed ranges. The MD's
-  // bucket index narrows dispatch to range subscribers whose bucket
-  // matches; this is the per-subscriber range check that filters out
-  // over-delivery at the bucket edges.
-  bool WithinLocalRange(uint64_t channel);
-
-  static std::string BuildChannelRoutingKey(uint64_t channel);
-  static std::string BuildBucketRoutingPattern(uint64_t bucket);
-  static uint64_t ChannelFromRoutingKey(const std::string& routingKey);
-
   // A static map of globally registered channels (refcount).
   static std::unordered_map<uint64_t, unsigned int> _globalChannels;
-  // Ref-counted bucket bindings. Multiple range subscriptions may overlap on
-  // the same bucket; we only unbind from RabbitMQ when the count hits zero.
-  static std::unordered_map<uint64_t, unsigned int> _globalBuckets;
-
-  // Routing-key dispatch index: channel/bucket -> subscribers, so
-  // DeliverLocally is O(matching subscribers) instead of O(all
-  // subscribers). Maintained by Subscribe/UnsubscribeChannel/Range.
-  static std::unordered_map<
-      uint64_t, std::unordered_set<std::shared_ptr<ChannelSubscriber>>>
-      _channelIndex;
-  static std::unordered_map<
-      uint64_t, std::unordered_set<std::shared_ptr<ChannelSubscriber>>>
-      _bucketIndex;
+
+  // Dispatch indexes: channel -> subscriber ids, and the exact segment map
+  // of every subscribed range, so DeliverLocally is O(matching
+  // subscribers) instead of O(all subscribers). Maintained by
+  // Subscribe/UnsubscribeChannel/Range.
+  static ChannelIndex _channelIndex;
+  static RangeIndex _rangeIndex;
+
+  // Slot in the MD's subscriber table, assigned by AddSubscriber. The
+  // dispatch index refers to subscribers by this id.
+  uint32_t _subscriberId = kNoSubscriberId;
+  // Generation of the last delivery that reached us; lets dispatch dedupe
+  // a subscriber matched through several index entries without a set.
+  uint64_t _dispatchStamp = 0;
 
   // Channels this ChannelSubscriber is listening to. Hot-path membership
   // check for every delivered message, hence unordered_set.
   std::unordered_set<uint64_t> _localChannels;
   std::vector<ChannelRange> _localRanges;
 
-  AMQP::Channel* _globalChannel;
-  std::string _localQueue;
+  RoutingBackend* _backend;
 };
 
 }  // namespace Ardos
@@ -8,8 +8,8 @@
 
 namespace Ardos {
 
-MDParticipant::MDParticipant(const std::shared_ptr<uvw::tcp_handle>& socket)
-    : NetworkClient(socket) {
+MDParticipant::MDParticipant(std::unique_ptr<ITransportConnection> transport)
+    : _transport(std::move(transport)) {
   auto address = GetRemoteAddress();
   spdlog::get("md")->info("Participant connected from {}:{}", address.ip,
                           address.port);
@@ -17,6 +17,18 @@ MDParticipant::MDParticipant(const std::shared_ptr<uvw::tcp_handle>& socket)
   MessageDirector::Instance()->ParticipantJoined();
 }
 
+void MDParticipant::Init() {
+  ChannelSubscriber::Init();  // AddSubscriber(shared_from_this())
+
+  // Bind ourselves as the transport's handler via a weak_ptr. Aliasing
+  // constructor reuses the ChannelSubscriber control block under a
+  // different typed pointer.
+  auto base = shared_from_this();
+  auto self = std::shared_ptr<ITransportHandler>(
+      base, static_cast<ITransportHandler*>(this));
+  _transport->SetHandler(std::weak_ptr<ITransportHandler>(self));
+}
+
 MDParticipant::~MDParticipant() {
   // Call shutdown just in-case (most likely redundant.)
   Shutdown();
@@ -31,9 +43,13 @@ void MDParticipant::Shutdown() {
   if (_disconnected) {
     return;
   }
+  _disconnected = true;
 
-  // Kill the network connection.
-  NetworkClient::Shutdown();
+  // Kill the network connection. Idempotent; further OnTransport*
+  // callbacks become no-ops via the connection's internal closed flag.
+  if (_transport) {
+    _transport->Close();
+  }
 
   spdlog::get("md")->debug("Routing {} post-remove(s) for '{}'",
                            _postRemoves.size(), _connName);
@@ -58,16 +74,21 @@ void MDParticipant::Shutdown() {
   ChannelSubscriber::Shutdown();
 }
 
+void MDParticipant::OnTransportMessage(const uint8_t* data, size_t len) {
+  HandleClientDatagram(Datagram::Create(data, len));
+}
+
+void MDParticipant::OnTransportDatagram(const std::shared_ptr<Datagram>& dg) {
+  HandleClientDatagram(dg);
+}
+
 /**
  * Handles socket disconnect events.
- * @param code
  */
-void MDParticipant::HandleDisconnect(uv_errno_t code) {
+void MDParticipant::OnTransportDisconnect() {
   auto address = GetRemoteAddress();
-
-  auto errorEvent = uvw::error_event{(int)code};
-  spdlog::get("md")->info("Lost connection from '{}' ({}:{}): {}", _connName,
-                          address.ip, address.port, errorEvent.what());
+  spdlog::get("md")->info("Lost connection from '{}' ({}:{})", _connName,
+                          address.ip, address.port);
 
   Shutdown();
 }
@@ -129,10 +150,14 @@ void MDParticipant::HandleClientDatagram(const std::shared_ptr<Datagram>& dg) {
 }
 
 void MDParticipant::HandleDatagram(const std::shared_ptr<Datagram>& dg) {
+  if (_disconnected) {
+    return;
+  }
+
   spdlog::get("md")->trace("MDP '{}' forwarding {}B to socket", _connName,
                            dg->Size());
   // Forward messages from the MD to the connected participant.
-  SendDatagram(dg);
+  _transport->SendDatagram(dg);
 }
 
 }  // namespace Ardos
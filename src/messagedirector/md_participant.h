@@ -2,19 +2,26 @@
 #define ARDOS_MD_PARTICIPANT_H
 
 #include <memory>
-#include <uvw.hpp>
 
 #include "../net/datagram.h"
-#include "../net/network_client.h"
+#include "../net/transport.h"
 #include "channel_subscriber.h"
 
 namespace Ardos {
 
-class MDParticipant final : public NetworkClient, public ChannelSubscriber {
+class MDParticipant final : public ITransportHandler, public ChannelSubscriber {
  public:
-  explicit MDParticipant(const std::shared_ptr<uvw::tcp_handle>& socket);
+  explicit MDParticipant(std::unique_ptr<ITransportConnection> transport);
   ~MDParticipant() override;
 
+  // Registers with the MessageDirector and binds the transport handler.
+  // Must be called immediately after construction so shared_from_this()
+  // works.
+  void Init() override;
+
+  [[nodiscard]] TransportEndpoint GetRemoteAddress() const {
+    return _transport ? _transport->RemoteEndpoint() : TransportEndpoint{};
+  }
   [[nodiscard]] std::string GetName() const { return _connName; }
   [[nodiscard]] std::vector<std::shared_ptr<Datagram>> GetPostRemoves() const {
     return _postRemoves;
@@ -22,10 +29,15 @@ class MDParticipant final : public NetworkClient, public ChannelSubscriber {
 
  private:
   void Shutdown() override;
-  void HandleDisconnect(uv_errno_t code) override;
-  void HandleClientDatagram(const std::shared_ptr<Datagram>& dg) override;
+  void OnTransportMessage(const uint8_t* data, size_t len) override;
+  void OnTransportDatagram(const std::shared_ptr<Datagram>& dg) override;
+  void OnTransportDisconnect() override;
+  void HandleClientDatagram(const std::shared_ptr<Datagram>& dg);
   void HandleDatagram(const std::shared_ptr<Datagram>& dg) override;
 
+  std::unique_ptr<ITransportConnection> _transport;
+  bool _disconnected = false;
+
   std::string _connName = "Unnamed Participant";
   std::vector<std::shared_ptr<Datagram>> _postRemoves;
 };
@@ -0,0 +1,525 @@
+#include "mesh_backend.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../net/address_utils.h"
+#include "../net/datagram_iterator.h"
+#include "../net/tcp_transport.h"
+#include "../util/globals.h"
+#include "message_director.h"
+
+namespace Ardos {
+
+namespace {
+
+// Most a link leaves queued in its transport at once. Well under the TCP
+// transport's write backlog limit, which would otherwise drop the link.
+constexpr size_t kLinkPaceBytes = size_t{1} * 1024 * 1024;
+// Most a link holds back on top of that before we give up on the peer.
+constexpr size_t kMaxLinkBacklogBytes = size_t{256} * 1024 * 1024;
+
+}  // namespace
+
+MeshBackend::Link::Link(MeshBackend* mesh,
+                        std::unique_ptr<ITransportConnection> transport,
+                        std::string address)
+    : dialed(!address.empty()),
+      address(std::move(address)),
+      _mesh(mesh),
+      _transport(std::move(transport)) {}
+
+void MeshBackend::Link::Init() { _transport->SetHandler(weak_from_this()); }
+
+void MeshBackend::Link::Send(MeshFrame kind, const uint8_t* data,
+                             size_t len) {
+  if (overflowed) {
+    return;
+  }
+
+  const size_t size = sizeof(uint8_t) + len;
+  std::vector<uint8_t>* frame = &_sendBuffer;
+  // Anything behind a backlog has to wait its turn to stay in order.
+  const bool hold =
+      !_backlog.empty() || _transport->QueuedBytes() + size > kLinkPaceBytes;
+  if (hold) {
+    if (_backlogBytes + size > kMaxLinkBacklogBytes) {
+      // We're likely inside Broadcast or Publish; don't close from here.
+      spdlog::get("md")->warn(
+          "Mesh peer '{}' exceeded {}B link backlog; dropping link", peer,
+          kMaxLinkBacklogBytes);
+      overflowed = true;
+      return;
+    }
+    frame = &_backlog.emplace_back();
+    _backlogBytes += size;
+  }
+
+  frame->resize(size);
+  (*frame)[0] = static_cast<uint8_t>(kind);
+  if (len != 0) {
+    std::memcpy(frame->data() + sizeof(uint8_t), data, len);
+  }
+  if (!hold) {
+    _transport->Send(frame->data(), frame->size());
+  }
+}
+
+void MeshBackend::Link::Pump() {
+  while (!_backlog.empty()) {
+    if (_transport->QueuedBytes() + _backlog.front().size() > kLinkPaceBytes) {
+      return;
+    }
+
+    auto frame = std::move(_backlog.front());
+    _backlog.pop_front();
+    _backlogBytes -= frame.size();
+    _transport->Send(frame.data(), frame.size());
+  }
+}
+
+void MeshBackend::Link::OnTransportMessage(const uint8_t* data, size_t len) {
+  _mesh->HandleFrame(this, data, len);
+}
+
+void MeshBackend::Link::OnTransportDrain() {
+  if (!overflowed) {
+    Pump();
+  }
+}
+
+void MeshBackend::Link::OnTransportDisconnect() { _mesh->HandleLinkLost(this); }
+
+MeshBackend::MeshBackend(const YAML::Node& config) {
+  _listenHandle = g_loop->resource<uvw::tcp_handle>();
+  _redialTimer = g_loop->resource<uvw::timer_handle>();
+
+  // Listen configuration.
+  if (auto hostParam = config["host"]) {
+    _host = hostParam.as<std::string>();
+  }
+  if (auto portParam = config["port"]) {
+    _port = portParam.as<int>();
+  }
+
+  // Peers know us by this name; it defaults to our listen address, which
+  // won't do if that's a wildcard.
+  _name = _host + ":" + std::to_string(_port);
+  if (auto nameParam = config["name"]) {
+    _name = nameParam.as<std::string>();
+  }
+
+  if (auto peersParam = config["peers"]) {
+    for (const auto& peer : peersParam) {
+      _peers.emplace_back(peer["host"].as<std::string>(),
+                          peer["port"].as<int>());
+    }
+  }
+  if (auto redialParam = config["redial-interval"]) {
+    _redialInterval = redialParam.as<unsigned int>();
+  }
+  if (auto syncParam = config["sync-timeout"]) {
+    _syncTimeout = syncParam.as<unsigned int>();
+  }
+
+  _listenHandle->on<uvw::error_event>(
+      [](const uvw::error_event& event, uvw::tcp_handle&) {
+        spdlog::get("md")->error("Mesh listen error: {}", event.what());
+        exit(1);  // NOLINT(concurrency-mt-unsafe)
+      });
+
+  _listenHandle->on<uvw::listen_event>(
+      [this](const uvw::listen_event&, uvw::tcp_handle& srv) {
+        std::shared_ptr<uvw::tcp_handle> client =
+            srv.parent().resource<uvw::tcp_handle>();
+        srv.accept(*client);
+
+        AddLink(std::make_unique<TcpTransportConnection>(client, "md"), "");
+      });
+
+  _redialTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle&) {
+        _closedLinks.clear();
+
+        std::vector<Link*> overflowed;
+        for (const auto& [link, owner] : _links) {
+          if (link->overflowed) {
+            overflowed.push_back(link);
+          }
+        }
+        for (Link* link : overflowed) {
+          CloseLink(link);
+        }
+
+        for (const auto& [host, port] : _peers) {
+          Dial(host, port);
+        }
+      });
+
+  _listenHandle->bind(_host, _port);
+}
+
+void MeshBackend::Start(std::function<void()> onReady) {
+  _listenHandle->listen();
+
+  for (const auto& [host, port] : _peers) {
+    Dial(host, port);
+  }
+  _redialTimer->start(uvw::timer_handle::time{_redialInterval},
+                      uvw::timer_handle::time{_redialInterval});
+
+  spdlog::get("md")->info("Mesh node '{}' listening on {}:{} ({} peers)",
+                          _name, _host, _port, _peers.size());
+
+  // Our roles shouldn't start publishing until we know which peers are
+  // subscribed to what, or their traffic would go nowhere. Peers that are
+  // down hold us up until the sync timeout at most.
+  _onReady = std::move(onReady);
+  _syncTimer = g_loop->resource<uvw::timer_handle>();
+  _syncTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle&) {
+        spdlog::get("md")->warn(
+            "Mesh peers not synced after {}ms; starting with {} of them",
+            _syncTimeout, _peerLinks.size());
+        FinishSync();
+      });
+  _syncTimer->start(uvw::timer_handle::time{_syncTimeout},
+                    uvw::timer_handle::time{0});
+  CheckSynced();
+}
+
+void MeshBackend::BindChannel(uint64_t channel) {
+  _localInterest.AddChannel(channel);
+
+  Datagram update;
+  LocalInterest::Append(update, InterestOp::AddChannel, channel);
+  Broadcast(update);
+}
+
+void MeshBackend::UnbindChannel(uint64_t channel) {
+  _localInterest.RemoveChannel(channel);
+
+  Datagram update;
+  LocalInterest::Append(update, InterestOp::RemoveChannel, channel);
+  Broadcast(update);
+}
+
+void MeshBackend::BindRange(uint64_t min, uint64_t max) {
+  _localInterest.AddRange(min, max);
+
+  Datagram update;
+  LocalInterest::Append(update, InterestOp::AddRange, min, max);
+  Broadcast(update);
+}
+
+void MeshBackend::UnbindRange(uint64_t min, uint64_t max) {
+  _localInterest.RemoveRange(min, max);
+
+  Datagram update;
+  LocalInterest::Append(update, InterestOp::RemoveRange, min, max);
+  Broadcast(update);
+}
+
+/**
+ * Sends a datagram once to every peer subscribed to any of its recipients.
+ * @param dg
+ * @param headerSize
+ */
+void MeshBackend::Publish(const std::shared_ptr<Datagram>& dg,
+                          size_t headerSize) {
+  _matchedPeers.clear();
+
+  // The header was validated by PublishDatagram: a count, then channels.
+  const uint8_t* data = dg->GetData();
+  for (size_t offset = 1; offset + sizeof(uint64_t) <= headerSize;
+       offset += sizeof(uint64_t)) {
+    uint64_t channel;
+    std::memcpy(&channel, data + offset, sizeof(channel));
+    _remoteInterest.CollectPeers(channel, _matchedPeers);
+  }
+
+  if (_matchedPeers.empty()) {
+    return;
+  }
+
+  std::ranges::sort(_matchedPeers);
+  auto duplicates = std::ranges::unique(_matchedPeers);
+  _matchedPeers.erase(duplicates.begin(), duplicates.end());
+
+  for (uint32_t id : _matchedPeers) {
+    if (id < _linksById.size() && _linksById[id]) {
+      _linksById[id]->Send(MeshFrame::Datagram, data, dg->Size());
+    }
+  }
+}
+
+void MeshBackend::Describe(nlohmann::json& info) const {
+  nlohmann::json peers = nlohmann::json::array();
+  for (const auto& [peer, link] : _peerLinks) {
+    peers.push_back(peer);
+  }
+
+  info["backend"] = "mesh";
+  info["meshName"] = _name;
+  info["meshIp"] = _host;
+  info["meshPort"] = _port;
+  info["meshPeers"] = peers;
+}
+
+/**
+ * Connects to a configured peer, unless we already have a link to it (or
+ * one on the way).
+ * @param host
+ * @param port
+ */
+void MeshBackend::Dial(const std::string& host, int port) {
+  std::string address = host + ":" + std::to_string(port);
+  if (address == _name || !_dialed.insert(address).second) {
+    return;
+  }
+
+  auto socket = g_loop->resource<uvw::tcp_handle>();
+
+  socket->on<uvw::error_event>(
+      [this, address](const uvw::error_event& event, uvw::tcp_handle& tcp) {
+        // Not up yet; the redial timer will try again.
+        spdlog::get("md")->debug("Couldn't reach mesh peer {}: {}", address,
+                                 event.what());
+        _dialed.erase(address);
+        tcp.close();
+      });
+
+  socket->on<uvw::connect_event>(
+      [this, address, weak = std::weak_ptr<uvw::tcp_handle>(socket)](
+          const uvw::connect_event&, uvw::tcp_handle&) {
+        if (auto tcp = weak.lock()) {
+          AddLink(std::make_unique<TcpTransportConnection>(tcp, "md"),
+                  address);
+        }
+      });
+
+  socket->connect(AddressUtils::resolve_host(g_loop, host, port), port);
+}
+
+/**
+ * Takes on a freshly connected link and introduces ourselves over it.
+ * @param transport
+ * @param address
+ */
+void MeshBackend::AddLink(std::unique_ptr<ITransportConnection> transport,
+                          const std::string& address) {
+  auto link = std::make_shared<Link>(this, std::move(transport), address);
+  link->Init();
+  _links[link.get()] = link;
+
+  Datagram hello;
+  hello.AddString(_name);
+  link->Send(MeshFrame::Hello, hello.GetData(), hello.Size());
+}
+
+/**
+ * Handles a frame received over a mesh link.
+ * @param link
+ * @param data
+ * @param len
+ */
+void MeshBackend::HandleFrame(Link* link, const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  const auto kind = static_cast<MeshFrame>(data[0]);
+  const uint8_t* payload = data + sizeof(uint8_t);
+  const size_t payloadSize = len - sizeof(uint8_t);
+
+  if (kind == MeshFrame::Hello) {
+    std::string peer;
+    try {
+      DatagramIterator dgi(Datagram::View(payload, payloadSize));
+      peer = dgi.GetString();
+    } catch (const DatagramIteratorEOF&) {
+      spdlog::get("md")->warn("Received a truncated mesh hello");
+      CloseLink(link);
+      return;
+    }
+
+    HandleHello(link, peer);
+    return;
+  }
+
+  // Anything else only counts on the live link for an identified peer;
+  // a duplicate we're collapsing may still have frames in flight.
+  auto live = _peerLinks.find(link->peer);
+  if (live == _peerLinks.end() || live->second != link) {
+    return;
+  }
+
+  switch (kind) {
+    case MeshFrame::Datagram:
+      MessageDirector::Instance()->DeliverRemote(payload, payloadSize);
+      break;
+    case MeshFrame::Interest:
+      try {
+        _remoteInterest.Apply(link->peer,
+                              Datagram::View(payload, payloadSize));
+      } catch (const DatagramIteratorEOF&) {
+        spdlog::get("md")->warn(
+            "Received a truncated interest update from mesh peer '{}'",
+            link->peer);
+      }
+      break;
+    case MeshFrame::Synced:
+      link->synced = true;
+      CheckSynced();
+      break;
+    default:
+      spdlog::get("md")->warn("Received unknown frame {} from mesh peer '{}'",
+                              static_cast<int>(kind), link->peer);
+      break;
+  }
+}
+
+/**
+ * Identifies a link. If we already have one to the same peer (both ends
+ * dialed each other), both MDs keep the one dialed by the lower-named node
+ * and close the other. The survivor gets a snapshot of our bindings.
+ * @param link
+ * @param peer
+ */
+void MeshBackend::HandleHello(Link* link, const std::string& peer) {
+  if (!link->peer.empty()) {
+    spdlog::get("md")->warn("Mesh peer '{}' sent a second hello", link->peer);
+    return;
+  }
+
+  if (peer == _name) {
+    // One of our configured peers is us. Keep its address marked as dialed
+    // so we don't try again, and don't wait on it to sync.
+    _selfAddresses.insert(link->address);
+    link->address.clear();
+    CloseLink(link);
+    CheckSynced();
+    return;
+  }
+
+  link->peer = peer;
+
+  const std::string& lowerName = std::min(_name, peer);
+  auto dialedByLower = [&](const Link* l) {
+    return (l->dialed ? _name : peer) == lowerName;
+  };
+
+  auto existing = _peerLinks.find(peer);
+  if (existing != _peerLinks.end()) {
+    Link* other = existing->second;
+    // Prefer the newer link unless only the older one follows the rule: an
+    // MD that restarted may well redial before we notice the old link die.
+    if (dialedByLower(other) && !dialedByLower(link)) {
+      if (other->address.empty()) {
+        other->address = std::move(link->address);
+      }
+      link->address.clear();
+      CloseLink(link);
+      return;
+    }
+
+    if (link->address.empty()) {
+      link->address = std::move(other->address);
+    }
+    other->address.clear();
+    CloseLink(other);
+  }
+
+  _peerLinks[peer] = link;
+  const uint32_t id = _remoteInterest.PeerId(peer);
+  if (_linksById.size() <= id) {
+    _linksById.resize(id + 1);
+  }
+  _linksById[id] = link;
+
+  _localInterest.Snapshot([link](const Datagram& dg) {
+    link->Send(MeshFrame::Interest, dg.GetData(), dg.Size());
+  });
+  link->Send(MeshFrame::Synced, nullptr, 0);
+
+  spdlog::get("md")->info("Mesh link up with '{}'", peer);
+
+  // A synced link may have just taken over a configured address.
+  CheckSynced();
+}
+
+/**
+ * Finishes startup if every configured peer (other than us) is linked up
+ * and has sent its whole snapshot.
+ */
+void MeshBackend::CheckSynced() {
+  if (!_onReady) {
+    return;
+  }
+
+  for (const auto& [host, port] : _peers) {
+    std::string address = host + ":" + std::to_string(port);
+    if (address == _name || _selfAddresses.contains(address)) {
+      continue;
+    }
+    const bool synced = std::ranges::any_of(_peerLinks, [&](const auto& live) {
+      return live.second->address == address && live.second->synced;
+    });
+    if (!synced) {
+      return;
+    }
+  }
+
+  FinishSync();
+}
+
+void MeshBackend::FinishSync() {
+  _syncTimer->close();
+  auto onReady = std::move(_onReady);
+  _onReady = nullptr;
+  onReady();
+}
+
+void MeshBackend::CloseLink(Link* link) {
+  link->Close();
+  HandleLinkLost(link);
+}
+
+/**
+ * Forgets a link that's gone down. If it was the live link for its peer,
+ * so is everything that peer told us it was subscribed to.
+ * @param link
+ */
+void MeshBackend::HandleLinkLost(Link* link) {
+  auto it = _links.find(link);
+  if (it == _links.end()) {
+    return;
+  }
+
+  if (!link->address.empty()) {
+    _dialed.erase(link->address);
+  }
+
+  auto live = _peerLinks.find(link->peer);
+  if (live != _peerLinks.end() && live->second == link) {
+    _peerLinks.erase(live);
+    _linksById[_remoteInterest.PeerId(link->peer)] = nullptr;
+    _remoteInterest.Forget(link->peer);
+
+    spdlog::get("md")->info("Lost mesh link to '{}'", link->peer);
+  }
+
+  // We're likely inside one of the link's own transport callbacks.
+  _closedLinks.push_back(std::move(it->second));
+  _links.erase(it);
+}
+
+void MeshBackend::Broadcast(const Datagram& update) {
+  for (const auto& [peer, link] : _peerLinks) {
+    link->Send(MeshFrame::Interest, update.GetData(), update.Size());
+  }
+}
+
+}  // namespace Ardos
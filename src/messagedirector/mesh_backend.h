@@ -0,0 +1,158 @@
+#ifndef ARDOS_MESH_BACKEND_H
+#define ARDOS_MESH_BACKEND_H
+
+#include <yaml-cpp/yaml.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <uvw.hpp>
+#include <vector>
+
+#include "../net/transport.h"
+#include "remote_interest.h"
+#include "routing_backend.h"
+
+namespace Ardos {
+
+// Frames exchanged over a mesh link, each a one-byte kind followed by its
+// payload. A link's first frame is always a Hello carrying the sender's
+// node name.
+enum class MeshFrame : uint8_t {
+  Hello = 0,
+  Datagram = 1,
+  // A batch of InterestOp updates, as for AMQP remote-interest tracking.
+  Interest = 2,
+  // Follows the last batch of the snapshot sent when a link comes up.
+  Synced = 3,
+};
+
+// Routes over direct TCP links between MDs, no broker involved. Every MD
+// listens on message-director.mesh and dials the peers it lists (both ends
+// may list each other; duplicate links are collapsed). Links exchange
+// interest snapshots on connect and incremental updates afterwards, so a
+// publish goes straight to the MDs with matching subscribers and nowhere
+// else. Start holds onReady until every configured peer's snapshot is in,
+// or the sync timeout runs out, as AmqpBackend's remote-interest sync
+// window does.
+class MeshBackend final : public RoutingBackend {
+ public:
+  explicit MeshBackend(const YAML::Node& config);
+
+  void Start(std::function<void()> onReady) override;
+
+  void BindChannel(uint64_t channel) override;
+  void UnbindChannel(uint64_t channel) override;
+  void BindRange(uint64_t min, uint64_t max) override;
+  void UnbindRange(uint64_t min, uint64_t max) override;
+
+  void Publish(const std::shared_ptr<Datagram>& dg, size_t headerSize) override;
+
+  void Describe(nlohmann::json& info) const override;
+
+ private:
+  // One connection to another MD, dialed or accepted.
+  class Link final : public ITransportHandler,
+                     public std::enable_shared_from_this<Link> {
+   public:
+    Link(MeshBackend* mesh, std::unique_ptr<ITransportConnection> transport,
+         std::string address);
+
+    // Binds the transport to this link. Must be called once, right after
+    // construction, so weak_from_this() is valid.
+    void Init();
+
+    // Sends a frame, or queues it behind the backlog if the transport
+    // already holds kLinkPaceBytes.
+    void Send(MeshFrame kind, const uint8_t* data, size_t len);
+    void Close() { _transport->Close(); }
+
+    void OnTransportMessage(const uint8_t* data, size_t len) override;
+    void OnTransportDrain() override;
+    void OnTransportDisconnect() override;
+
+    // Name from the peer's Hello; empty until it arrives.
+    std::string peer;
+    // True if we dialed this link, false if we accepted it.
+    bool dialed;
+    // Configured address this link stands for while it's up, so it isn't
+    // redialed. Empty for accepted links (unless a dialed duplicate was
+    // collapsed into it).
+    std::string address;
+    // Backlog grew past kMaxLinkBacklogBytes; the redial tick closes it.
+    bool overflowed = false;
+    // The peer's whole snapshot has arrived over this link.
+    bool synced = false;
+
+   private:
+    // Hands backlogged frames to the transport until it holds
+    // kLinkPaceBytes again.
+    void Pump();
+
+    MeshBackend* _mesh;
+    std::unique_ptr<ITransportConnection> _transport;
+    std::vector<uint8_t> _sendBuffer;
+    // Frames waiting for the transport to drain, in send order. A snapshot
+    // of a large binding set is far more than the transport will queue,
+    // so it's fed to the socket a share at a time from here.
+    std::deque<std::vector<uint8_t>> _backlog;
+    size_t _backlogBytes = 0;
+  };
+
+  void Dial(const std::string& host, int port);
+  void AddLink(std::unique_ptr<ITransportConnection> transport,
+               const std::string& address);
+
+  void HandleFrame(Link* link, const uint8_t* data, size_t len);
+  void HandleHello(Link* link, const std::string& peer);
+  // Calls onReady once every configured peer has a synced link.
+  void CheckSynced();
+  void FinishSync();
+  // Closes a link ourselves; the transport doesn't report that back.
+  void CloseLink(Link* link);
+  void HandleLinkLost(Link* link);
+
+  // Sends an interest update to every connected peer.
+  void Broadcast(const Datagram& update);
+
+  std::string _name;
+  std::string _host = "127.0.0.1";
+  int _port = 7200;
+  // Configured peers, each redialed while it has no link.
+  std::vector<std::pair<std::string, int>> _peers;
+  unsigned int _redialInterval = 1000;
+  unsigned int _syncTimeout = 2000;
+
+  std::shared_ptr<uvw::tcp_handle> _listenHandle;
+  std::shared_ptr<uvw::timer_handle> _redialTimer;
+  // Startup only: onReady is held (non-null) until the peers are synced or
+  // _syncTimer fires.
+  std::function<void()> _onReady;
+  std::shared_ptr<uvw::timer_handle> _syncTimer;
+
+  // Every open link, and the live one for each identified peer.
+  std::unordered_map<Link*, std::shared_ptr<Link>> _links;
+  std::unordered_map<std::string, Link*> _peerLinks;
+  // Links closed from inside their own transport callbacks, released on the
+  // next redial tick once those callbacks have unwound.
+  std::vector<std::shared_ptr<Link>> _closedLinks;
+  // Live links indexed by RemoteInterest peer id (null while down).
+  std::vector<Link*> _linksById;
+  // Addresses with a link in progress or up; the rest get redialed.
+  std::unordered_set<std::string> _dialed;
+  // Configured addresses that turned out to be us.
+  std::unordered_set<std::string> _selfAddresses;
+
+  LocalInterest _localInterest;
+  RemoteInterest _remoteInterest;
+
+  // Publish scratch: peer ids matched by a datagram's recipients.
+  std::vector<uint32_t> _matchedPeers;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_MESH_BACKEND_H
@@ -3,18 +3,30 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
 
 #include "../clientagent/client_agent.h"
 #ifdef ARDOS_WANT_DB_SERVER
 #include "../database/database_server.h"
 #endif
-#include "../net/address_utils.h"
+#include "../net/datagram_iterator.h"
+#include "../net/datagram_pool.h"
+#include "../net/message_types.h"
+#include "../net/shm_transport.h"
+#include "../net/tcp_transport.h"
+#include "../net/transport_worker.h"
 #include "../stateserver/database_state_server.h"
 #include "../util/config.h"
 #include "../util/logger.h"
 #include "../util/metrics.h"
 #include "../web/web_panel.h"
+#include "amqp_backend.h"
 #include "md_participant.h"
+#include "mesh_backend.h"
+#include "msgtype_metrics.h"
 
 namespace Ardos {
 
@@ -31,7 +43,6 @@ MessageDirector* MessageDirector::Instance() {
 MessageDirector::MessageDirector() {
   spdlog::info("Starting Message Director component...");
 
-  _connectHandle = g_loop->resource<uvw::tcp_handle>();
   _listenHandle = g_loop->resource<uvw::tcp_handle>();
 
   auto config = Config::Instance()->GetNode("message-director");
@@ -51,20 +62,21 @@ MessageDirector::MessageDirector() {
     _port = portParam.as<int>();
   }
 
-  // RabbitMQ configuration.
-  if (auto hostParam = config["rabbitmq-host"]) {
-    _rHost = hostParam.as<std::string>();
-  }
-  if (auto portParam = config["rabbitmq-port"]) {
-    _rPort = portParam.as<int>();
-  }
-  std::string user = "guest";
-  if (auto userParam = config["rabbitmq-user"]) {
-    user = userParam.as<std::string>();
-  }
-  std::string password = "guest";
-  if (auto passParam = config["rabbitmq-password"]) {
-    password = passParam.as<std::string>();
+  // Participant I/O threads (0 = serve every participant on the main loop).
+  // These only take socket I/O off the main loop; routing and dispatch
+  // stay on it.
+  if (auto threadsParam = config["io-threads"]) {
+    auto threads = threadsParam.as<unsigned int>();
+#ifdef _WIN32
+    if (threads) {
+      spdlog::get("md")->warn(
+          "message-director.io-threads is not supported on Windows; ignoring");
+      threads = 0;
+    }
+#endif
+    for (unsigned int i = 0; i < threads; ++i) {
+      _workers.push_back(std::make_unique<TransportWorker>("md", i));
+    }
   }
 
   // Socket events.
@@ -73,222 +85,199 @@ MessageDirector::MessageDirector() {
         std::shared_ptr<uvw::tcp_handle> client =
             srv.parent().resource<uvw::tcp_handle>();
         srv.accept(*client);
-
-        // Create a new client for this connected participant.
-        auto participant = std::make_shared<MDParticipant>(client);
-        participant->Init();
-        _participants.insert(participant.get());
+        AcceptParticipant(client);
       });
 
-  _connectHandle->on<uvw::error_event>(
-      [](const uvw::error_event& event, uvw::tcp_handle&) {
-        // Just die on error, the message director always needs a connection to
-        // RabbitMQ.
-        spdlog::get("md")->error("Socket error: {}", event.what());
+  // Unix domain socket and shared-memory listeners, alongside TCP.
+  if (auto listenParam = config["listen"]) {
+    for (const auto& addressParam : listenParam) {
+      auto address = addressParam.as<std::string>();
+      if (address.starts_with("shm:") && address.size() > 4) {
+#ifdef __linux__
+        // Bound in StartRoles, along with the rest.
+        _shmListen.push_back(address.substr(4));
+        _localListen.push_back(address);
+#else
+        spdlog::get("md")->error(
+            "shm: listen addresses are only supported on Linux");
         exit(1);  // NOLINT(concurrency-mt-unsafe)
-      });
-
-  _connectHandle->on<uvw::connect_event>(
-      [this, user, password](const uvw::connect_event&, uvw::tcp_handle& tcp) {
-        // Authenticate with the RabbitMQ cluster.
-        _connection =
-            new AMQP::Connection(this, AMQP::Login(user, password), "/");
-        // Start reading from the socket.
-        _connectHandle->read();
-      });
-
-  _connectHandle->on<uvw::data_event>(
-      [this](const uvw::data_event& event, uvw::tcp_handle&) {
-        // We've received bytes from RabbitMQ. The buffer may contain zero
-        // or more complete frames followed by a partial frame. AMQP-CPP
-        // does no buffering of its own:
-        //
-        //   * parse() returns the number of bytes consumed (i.e. the
-        //     prefix length of complete frames it was able to decode).
-        //   * Whatever it didn't consume is the start of the next frame
-        //     and must be re-presented unchanged on the next call,
-        //     prepended to any newly-arrived bytes.
-        //
-        // See:
-        // https://github.com/CopernicaMarketingSoftware/AMQP-CPP#parsing-incoming-data
-        _frameBuffer.insert(_frameBuffer.end(), event.data.get(),
-                            event.data.get() + event.length);
-
-        while (!_frameBuffer.empty()) {
-          const size_t processed =
-              _connection->parse(_frameBuffer.data(), _frameBuffer.size());
-          if (processed == 0) {
-            // Partial frame; wait for more bytes before retrying.
-            break;
-          }
-          _frameBuffer.erase(_frameBuffer.begin(),
-                             // parse() can't return more than size:
-                             // NOLINTNEXTLINE(bugprone-narrowing-conversions)
-                             _frameBuffer.begin() + processed);
-        }
-      });
+#endif
+      } else {
+        ListenUnix(address);
+      }
+    }
+  }
 
   // Initialize metrics.
   InitMetrics();
 
+  // Routing backend configuration.
+  std::string backend = "amqp";
+  if (auto backendParam = config["backend"]) {
+    backend = backendParam.as<std::string>();
+  }
+  if (backend == "amqp") {
+    _backend = std::make_unique<AmqpBackend>(config);
+  } else if (backend == "mesh") {
+    if (!config["mesh"]) {
+      spdlog::get("md")->error(
+          "message-director.backend is mesh but no mesh section was given");
+      exit(1);  // NOLINT(concurrency-mt-unsafe)
+    }
+    _backend = std::make_unique<MeshBackend>(config["mesh"]);
+  } else {
+    spdlog::get("md")->error("Unknown message-director.backend: {}", backend);
+    exit(1);  // NOLINT(concurrency-mt-unsafe)
+  }
+
   // Start connecting/listening!
   _listenHandle->bind(_host, _port);
-  _connectHandle->connect(AddressUtils::resolve_host(g_loop, _rHost, _rPort),
-                          _rPort);
+  _backend->Start([this]() { StartRoles(); });
 }
 
 /**
- * Returns the "global" channel used for routing messages.
- * @return
+ * Binds a listener for co-located participants on a Unix domain socket.
+ * `address` is unix:/path for a socket file (a stale one left behind by a
+ * previous run is replaced) or unix:@name for a Linux abstract socket.
+ * @param address
  */
-AMQP::Channel* MessageDirector::GetGlobalChannel() const {
-  return _globalChannel;
+void MessageDirector::ListenUnix(const std::string& address) {
+  static constexpr std::string_view kPrefix = "unix:";
+  if (!address.starts_with(kPrefix) || address.size() == kPrefix.size()) {
+    spdlog::get("md")->error(
+        "Invalid message-director.listen address: {} (expected unix: or "
+        "shm: followed by a path or @name; TCP is configured with "
+        "host/port)",
+        address);
+    exit(1);  // NOLINT(concurrency-mt-unsafe)
+  }
+
+  std::string name = address.substr(kPrefix.size());
+  if (name.front() == '@') {
+    name.front() = '\0';
+  } else {
+    std::error_code ec;
+    if (std::filesystem::is_socket(name, ec)) {
+      std::filesystem::remove(name, ec);
+    }
+  }
+
+  auto handle = g_loop->resource<uvw::pipe_handle>();
+  handle->on<uvw::listen_event>(
+      [this](const uvw::listen_event&, uvw::pipe_handle& srv) {
+        std::shared_ptr<uvw::pipe_handle> client =
+            srv.parent().resource<uvw::pipe_handle>();
+        srv.accept(*client);
+        AcceptParticipant(client);
+      });
+
+  if (int err = handle->bind(name); err != 0) {
+    spdlog::get("md")->error("Failed to bind {}: {}", address,
+                             uv_strerror(err));
+    exit(1);  // NOLINT(concurrency-mt-unsafe)
+  }
+
+  _unixListenHandles.push_back(std::move(handle));
+  _localListen.push_back(address);
 }
 
 /**
- * Returns the local messaging queue for this message director.
- * @return
+ * Sets up a newly accepted participant. Its socket's I/O goes to the least
+ * busy worker loop, if we have any; routing stays on this loop either way.
+ * @param client
  */
-std::string MessageDirector::GetLocalQueue() const { return _localQueue; }
+template <typename Handle>
+void MessageDirector::AcceptParticipant(const std::shared_ptr<Handle>& client) {
+  std::unique_ptr<ITransportConnection> transport;
+  if (!_workers.empty()) {
+    auto worker = std::ranges::min_element(
+        _workers, {}, [](const auto& w) { return w->GetConnectionCount(); });
+    transport = (*worker)->Adopt(client);
+  }
+  if (!transport) {
+    transport =
+        std::make_unique<StreamTransportConnection<Handle>>(client, "md");
+  }
+
+  AddParticipant(std::move(transport));
+}
 
 /**
- *  Method that is called by AMQP-CPP when data has to be sent over the
- *  network. You must implement this method and send the data over a
- *  socket that is connected with RabbitMQ.
- *
- *  Note that the AMQP library does no buffering by itself. This means
- *  that this method should always send out all data or do the buffering
- *  itself.
- *
- *  @param  connection      The connection that created this output
- *  @param  buffer          Data to send
- *  @param  size            Size of the buffer
+ * Creates a participant around a connected transport.
+ * @param transport
  */
-void MessageDirector::onData(AMQP::Connection* connection, const char* buffer,
-                             const size_t size) {
-  // runtime-sized buffer for uvw write:
-  // NOLINTNEXTLINE(modernize-avoid-c-arrays)
-  auto sendBuffer = std::unique_ptr<char[]>(new char[size]);
-  if (size != 0) {
-    std::memcpy(sendBuffer.get(), buffer, size);
-  }
-  _connectHandle->write(std::move(sendBuffer), size);
+void MessageDirector::AddParticipant(
+    std::unique_ptr<ITransportConnection> transport) {
+  auto participant = std::make_shared<MDParticipant>(std::move(transport));
+  participant->Init();
+  _participants.insert(participant.get());
 }
 
 /**
- *  Method that is called when the login attempt succeeded. After this method
- *  is called, the connection is ready to use, and the RabbitMQ server is
- *  ready to receive instructions.
- *
- *  @param  connection      The connection that can now be used
+ * Starts up the configured roles and begins accepting participants. Called
+ * by the routing backend once it's ready to take bindings and publishes.
  */
-void MessageDirector::onReady(AMQP::Connection* connection) {
-  // Resize our frame buffer to the max frame length.
-  // This prevents buffer re-sizing at runtime.
-  _frameBuffer.reserve(connection->maxFrame());
-
-  // Create our "global" exchange.
-  _globalChannel = new AMQP::Channel(_connection);
-  _globalChannel->declareExchange(kGlobalExchange, AMQP::topic)
-      .onSuccess([this]() {
-        // Create our local queue.
-        // This queue is specific to this process, and will be automatically
-        // deleted once it goes offline.
-        _globalChannel->declareQueue(AMQP::exclusive)
-            .onSuccess([this](const std::string& name, int msgCount,
-                              int consumerCount) {
-              _localQueue = name;
-
-              StartConsuming();
-
-              // TODO: We should probably have a callback for role startup to
-              // happen in main.
-
-              // Startup configured roles. ChannelSubscriber subclasses get
-              // the make_shared + Init() factory dance; ClientAgent is the
-              // only role that isn't a ChannelSubscriber.
-              if (Config::Instance()->GetBool("want-state-server")) {
-                _stateServer = std::make_shared<StateServer>();
-                _stateServer->Init();
-              }
-
-              if (Config::Instance()->GetBool("want-client-agent")) {
-                _clientAgent = std::make_unique<ClientAgent>();
-              }
-
-              if (Config::Instance()->GetBool("want-database")) {
+void MessageDirector::StartRoles() {
+  // TODO: We should probably have a callback for role startup to happen in
+  // main.
+
+  // Startup configured roles. ChannelSubscriber subclasses get the
+  // make_shared + Init() factory dance; ClientAgent is the only role that
+  // isn't a ChannelSubscriber.
+  if (Config::Instance()->GetBool("want-state-server")) {
+    _stateServer = std::make_shared<StateServer>();
+    _stateServer->Init();
+  }
+
+  if (Config::Instance()->GetBool("want-client-agent")) {
+    _clientAgent = std::make_unique<ClientAgent>();
+  }
+
+  if (Config::Instance()->GetBool("want-database")) {
 #ifdef ARDOS_WANT_DB_SERVER
-                _db = std::make_shared<DatabaseServer>();
-                _db->Init();
+    _db = std::make_shared<DatabaseServer>();
+    _db->Init();
 #else
-                spdlog::get("md")->error(
-                    "want-database was set to true but Ardos was "
-                    "built without ARDOS_WANT_DB_SERVER");
-                exit(1);  // NOLINT(concurrency-mt-unsafe)
+    spdlog::get("md")->error(
+        "want-database was set to true but Ardos was "
+        "built without ARDOS_WANT_DB_SERVER");
+    exit(1);  // NOLINT(concurrency-mt-unsafe)
 #endif
-              }
-
-              if (Config::Instance()->GetBool("want-db-state-server")) {
-                _dbss = std::make_shared<DatabaseStateServer>();
-                _dbss->Init();
-              }
-
-              if (Config::Instance()->GetBool("want-web-panel")) {
-                _webPanel = std::make_unique<WebPanel>();
-              }
-
-              // Start listening for incoming connections.
-              _listenHandle->listen();
-
-              spdlog::get("md")->debug("Local Queue: {}", _localQueue);
-              spdlog::get("md")->info("Listening on {}:{}", _host, _port);
-            })
-            .onError([](const char* message) {
-              spdlog::get("md")->error("Failed to declare local queue: {}",
-                                       message);
-              exit(1);  // NOLINT(concurrency-mt-unsafe)
-            });
-      })
-      .onError([](const char* message) {
-        spdlog::get("md")->error("Failed to declare global exchange: {}",
-                                 message);
-        exit(1);  // NOLINT(concurrency-mt-unsafe)
-      });
-}
+  }
 
-/**
- *  When the connection ends up in an error state this method is called.
- *  This happens when data comes in that does not match the AMQP protocol,
- *  or when an error message was sent by the server to the client.
- *
- *  After this method is called, the connection no longer is in a valid
- *  state and can no longer be used.
- *
- *  @param  connection      The connection that entered the error state
- *  @param  message         Error message
- */
-void MessageDirector::onError(AMQP::Connection* connection,
-                              const char* message) {
-  // The connection is dead at this point.
-  // Log out an exception and shut everything down.
-  spdlog::get("md")->error("RabbitMQ error: {}", message);
-  exit(1);  // NOLINT(concurrency-mt-unsafe)
-}
+  if (Config::Instance()->GetBool("want-db-state-server")) {
+    _dbss = std::make_shared<DatabaseStateServer>();
+    _dbss->Init();
+  }
 
-/**
- *  Method that is called when the AMQP connection was closed.
- *
- *  This is the counter part of a call to Connection::close() and it confirms
- *  that the connection was _correctly_ closed. Note that this only applies
- *  to the AMQP connection, the underlying TCP connection is not managed by
- *  AMQP-CPP and is still active.
- *
- *  @param  connection      The connection that was closed and that is now
- * unusable
- */
-void MessageDirector::onClosed(AMQP::Connection* connection) {
-  _connectHandle->close();
-  _listenHandle->close();
+  if (Config::Instance()->GetBool("want-web-panel")) {
+    _webPanel = std::make_unique<WebPanel>();
+  }
+
+  // Start listening for incoming connections.
+  _listenHandle->listen();
+  for (const auto& handle : _unixListenHandles) {
+    handle->listen();
+  }
+#ifdef __linux__
+  for (const auto& path : _shmListen) {
+    auto listener = std::make_unique<ShmTransportListener>("md");
+    listener->SetConnectionFactory(
+        [this](std::unique_ptr<ITransportConnection> transport) {
+          AddParticipant(std::move(transport));
+        });
+    if (!listener->Listen(path, 0)) {
+      exit(1);  // NOLINT(concurrency-mt-unsafe)
+    }
+    _shmListeners.push_back(std::move(listener));
+  }
+#endif
+  for (const auto& address : _localListen) {
+    spdlog::get("md")->info("Listening on {}", address);
+  }
+
+  spdlog::get("md")->info("Listening on {}:{} ({} I/O threads)", _host,
+                          _port, _workers.size());
 }
 
 /**
@@ -296,7 +285,18 @@ void MessageDirector::onClosed(AMQP::Connection* connection) {
  */
 void MessageDirector::AddSubscriber(
     std::shared_ptr<ChannelSubscriber> subscriber) {
-  _subscribers.insert(std::move(subscriber));
+  uint32_t id;
+  if (!_freeSubscriberIds.empty()) {
+    id = _freeSubscriberIds.back();
+    _freeSubscriberIds.pop_back();
+  } else {
+    id = static_cast<uint32_t>(_subscribers.size());
+    _subscribers.emplace_back();
+  }
+
+  subscriber->_subscriberId = id;
+  _subscribers[id] = std::move(subscriber);
+  ++_subscriberCount;
 
   if (_subscribersGauge) {
     _subscribersGauge->Increment();
@@ -304,74 +304,162 @@ void MessageDirector::AddSubscriber(
 }
 
 /**
- * Removes a channel subscriber. Drops the MD's owning reference; if no other
- * shared_ptr holds it (e.g. a dispatch snapshot), the destructor runs now.
+ * Removes a channel subscriber. Drops the MD's owning reference; if nothing
+ * else holds it, the destructor runs now -- unless a dispatch is in
+ * progress, in which case the reference (and the id) are held until the
+ * outermost dispatch returns.
  *
  * Takes a raw pointer because ChannelSubscriber::Shutdown may be invoked
  * from the destructor as a safety net, at which point shared_from_this()
- * is no longer valid. Walking the set comparing by ::get() identity is
- * O(N) but only hit on subscriber teardown, not in the dispatch path.
+ * is no longer valid.
  */
 void MessageDirector::RemoveSubscriber(ChannelSubscriber* subscriber) {
-  auto it = std::ranges::find_if(_subscribers, [subscriber](const auto& p) {
-    return p.get() == subscriber;
-  });
-  if (it == _subscribers.end()) {
+  const uint32_t id = subscriber->_subscriberId;
+  if (id >= _subscribers.size() || _subscribers[id].get() != subscriber) {
     return;
   }
 
-  _subscribers.erase(it);
+  subscriber->_subscriberId = kNoSubscriberId;
+  --_subscriberCount;
   if (_subscribersGauge) {
     _subscribersGauge->Decrement();
   }
+
+  if (_dispatchDepth > 0) {
+    _deferredRemovals.emplace_back(id, std::move(_subscribers[id]));
+    return;
+  }
+
+  // Move the reference out before dropping it: the destructor may well
+  // re-enter AddSubscriber/RemoveSubscriber.
+  auto released = std::move(_subscribers[id]);
+  _freeSubscriberIds.push_back(id);
 }
 
 /**
  * Synchronously dispatches a datagram to in-process subscribers, bypassing
- * RabbitMQ. Used by ChannelSubscriber::PublishDatagram so a subscribe-then-
- * publish on the same channel doesn't race the async bindQueue, and so
- * same-process traffic skips the broker round-trip entirely.
+ * the routing backend. Used by ChannelSubscriber::PublishDatagram so a
+ * subscribe-then-publish on the same channel doesn't race an async bind, and
+ * so same-process traffic skips the round-trip entirely.
+ */
+void MessageDirector::DeliverLocally(const std::shared_ptr<Datagram>& dg) {
+  Dispatch(dg);
+}
+
+/**
+ * Looks up the subscribers interested in any of the datagram's recipient
+ * channels and hands it to each of them once. Allocation-free once the
+ * scratch vectors have warmed up: the index lookups return lists in place,
+ * dedup is a generation stamp on each subscriber, and matched subscribers
+ * are held by raw pointer (removals are deferred for the duration, see
+ * RemoveSubscriber).
+ * @param dg
+ * @return
  */
-void MessageDirector::DeliverLocally(const std::string& routingKey,
-                                     const std::shared_ptr<Datagram>& dg) {
-  uint64_t channel = ChannelSubscriber::ChannelFromRoutingKey(routingKey);
-  uint64_t bucket = channel >> kChannelBucketShift;
-
-  // Point subs hit _channelIndex directly; range subs are indexed by
-  // bucket and need WithinLocalRange to filter over-delivery at bucket
-  // edges. unordered_set dedupes subscribers carrying both a point sub
-  // and a covering range.
-  std::unordered_set<std::shared_ptr<ChannelSubscriber>> interested;
-
-  if (auto it = ChannelSubscriber::_channelIndex.find(channel);
-      it != ChannelSubscriber::_channelIndex.end()) {
-    interested.insert(it->second.begin(), it->second.end());
-  }
-  if (auto it = ChannelSubscriber::_bucketIndex.find(bucket);
-      it != ChannelSubscriber::_bucketIndex.end()) {
-    for (const auto& sub : it->second) {
-      if (sub->WithinLocalRange(channel)) {
-        interested.insert(sub);
+size_t MessageDirector::Dispatch(const std::shared_ptr<Datagram>& dg) {
+  if (_dispatchScratch.size() <= _dispatchDepth) {
+    _dispatchScratch.emplace_back();
+  }
+  auto& matched = _dispatchScratch[_dispatchDepth];
+  // Left over if a truncated header threw out of a previous pass.
+  matched.clear();
+
+  // A subscriber may be listed under several recipients, under both
+  // indexes, or twice in one; stamping it with this delivery's generation
+  // dedupes without a set.
+  const uint64_t stamp = ++_dispatchStamp;
+  auto match = [&](uint32_t id) {
+    ChannelSubscriber* sub = _subscribers[id].get();
+    if (sub == nullptr || sub->_dispatchStamp == stamp) {
+      return;
+    }
+    sub->_dispatchStamp = stamp;
+    matched.push_back(sub);
+  };
+
+  DatagramIterator dgi(dg);
+  uint8_t channels = dgi.GetUint8();
+  for (uint8_t i = 0; i < channels; ++i) {
+    uint64_t channel = dgi.GetUint64();
+
+    // Both indexes are exact: the range index only lists subscribers whose
+    // ranges really contain `channel`, whatever the backend bound.
+    if (const auto* pointSubs =
+            ChannelSubscriber::_channelIndex.Find(channel)) {
+      for (uint32_t id : *pointSubs) {
+        match(id);
+      }
+    }
+    if (const auto* rangeSubs = ChannelSubscriber::_rangeIndex.Find(channel)) {
+      for (uint32_t id : *rangeSubs) {
+        match(id);
       }
     }
   }
 
-  if (interested.empty()) {
-    return;
+  // Per-msgtype accounting. The msgtype follows the sender, right after
+  // the recipients we just read.
+  uint16_t msgType = RESERVED_MSG_TYPE;
+  if (dgi.GetRemainingSize() >= sizeof(uint64_t) + sizeof(uint16_t)) {
+    std::memcpy(&msgType, dg->GetData() + dgi.Tell() + sizeof(uint64_t),
+                sizeof(msgType));
   }
+  const bool timed =
+      _msgTypeMetrics && _msgTypeMetrics->Record(msgType, dg->Size());
 
-  spdlog::get("md")->trace(
-      "DeliverLocally chan={} bucket={} matched={} subs={}", channel, bucket,
-      interested.size(), _subscribers.size());
+  if (matched.empty()) {
+    return 0;
+  }
 
-  // Snapshot into a vector. Shared_ptr copies keep every iterated
-  // subscriber alive across the loop even if a handler triggers
-  // RemoveSubscriber or UnsubscribeChannel for one of its peers.
-  std::vector<std::shared_ptr<ChannelSubscriber>> snapshot(interested.begin(),
-                                                           interested.end());
-  for (const auto& subscriber : snapshot) {
+  spdlog::get("md")->trace("Dispatch recipients={} matched={} subs={}",
+                           channels, matched.size(), _subscriberCount);
+
+  // Handlers may unsubscribe or remove any subscriber (including
+  // themselves), so everything is gathered before the first call and
+  // removals are deferred until the outermost dispatch unwinds.
+  struct DepthGuard {
+    MessageDirector* md;
+    std::vector<ChannelSubscriber*>& matched;
+    ~DepthGuard() {
+      matched.clear();
+      if (--md->_dispatchDepth == 0) {
+        md->ReleaseDeferredSubscribers();
+      }
+    }
+  };
+  ++_dispatchDepth;
+  DepthGuard guard{this, matched};
+
+  const auto start = timed ? std::chrono::steady_clock::now()
+                           : std::chrono::steady_clock::time_point{};
+
+  for (ChannelSubscriber* subscriber : matched) {
     subscriber->HandleDatagram(dg);
   }
+
+  if (timed) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    _msgTypeMetrics->RecordDispatchTime(
+        msgType,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+  return matched.size();
+}
+
+/**
+ * Drops the references held back by RemoveSubscriber during dispatch and
+ * recycles their ids.
+ */
+void MessageDirector::ReleaseDeferredSubscribers() {
+  while (!_deferredRemovals.empty()) {
+    // Swap out first: destructors may remove further subscribers.
+    auto released = std::move(_deferredRemovals);
+    _deferredRemovals.clear();
+    for (const auto& entry : released) {
+      _freeSubscriberIds.push_back(entry.first);
+    }
+  }
 }
 
 /**
@@ -437,100 +525,60 @@ void MessageDirector::InitMetrics() {
                                                   16384, 65536});
   _subscribersGauge = &subscribersBuilder.Add({});
   _participantsGauge = &participantsBuilder.Add({});
+
+  _msgTypeMetrics = std::make_shared<MsgTypeMetrics>();
+  Metrics::Instance()->RegisterCollectable(_msgTypeMetrics);
+
+  DatagramPool::InitMetrics();
 }
 
 /**
- * Start consuming messages from RabbitMQ.
- * Messages are handled by each Channel Subscriber.
+ * Dispatches one datagram received from another MD to our local
+ * subscribers.
+ * @param data
+ * @param size
  */
-void MessageDirector::StartConsuming() {
-  // Consume in no-ack mode: the broker treats messages as acknowledged the
-  // moment they're delivered, which removes a round-trip per message and
-  // noticeably improves throughput. Trade-off: if this process dies mid-handle
-  // the in-flight message is lost, but the MD holds no durable state worth
-  // recovering -- the whole cluster re-converges on restart.
-  _globalChannel->consume(_localQueue, AMQP::noack)
-      .onSuccess([this](const std::string& tag) { _consumeTag = tag; })
-      .onReceived([this](const AMQP::Message& message, uint64_t deliveryTag,
-                         bool redelivered) {
-        // Drop loopback copies. PublishDatagram tags every outgoing message
-        // with our local queue name and delivers synchronously in-process;
-        // the broker still fans the message out to us, so ignore that copy.
-        if (message.hasAppID() && message.appID() == _localQueue) {
-          return;
-        }
-
-        // Increment observed datagrams metric.
-        if (_datagramsObservedCounter) {
-          _datagramsObservedCounter->Increment();
-        }
-
-        // First, check if we have at least one channel subscriber listening to
-        // the channel in this cluster. The topic exchange should only deliver
-        // messages matching one of our bindings, but keep the check as a
-        // safety net against spurious deliveries.
-        uint64_t channel =
-            ChannelSubscriber::ChannelFromRoutingKey(message.routingkey());
-        uint64_t bucket = channel >> kChannelBucketShift;
-        if (!ChannelSubscriber::_globalChannels.contains(channel) &&
-            !ChannelSubscriber::_globalBuckets.contains(bucket)) {
-          return;
-        }
-
-        // Increment processed datagrams metric.
-        if (_datagramsProcessedCounter) {
-          _datagramsProcessedCounter->Increment();
-        }
-
-        // Datagram size metrics.
-        if (_datagramsSizeHistogram) {
-          _datagramsSizeHistogram->Observe((double)message.bodySize());
-        }
-
-        // We should only need to create one shared datagram for all
-        // subscribers.
-        auto dg = std::make_shared<Datagram>(
-            reinterpret_cast<const uint8_t*>(message.body()),
-            message.bodySize());
-
-        // Look up interested subscribers via the routing-key index. Same
-        // shape as DeliverLocally: point subs by channel, range subs by
-        // bucket (filtered by WithinLocalRange because a bucket spans
-        // channels outside any given [min, max]). unordered_set dedupes
-        // the rare case where a subscriber has both flavors covering
-        // this channel.
-        std::unordered_set<std::shared_ptr<ChannelSubscriber>> interested;
-        if (auto it = ChannelSubscriber::_channelIndex.find(channel);
-            it != ChannelSubscriber::_channelIndex.end()) {
-          interested.insert(it->second.begin(), it->second.end());
-        }
-        if (auto it = ChannelSubscriber::_bucketIndex.find(bucket);
-            it != ChannelSubscriber::_bucketIndex.end()) {
-          for (const auto& sub : it->second) {
-            if (sub->WithinLocalRange(channel)) {
-              interested.insert(sub);
-            }
-          }
-        }
-        if (interested.empty()) {
-          return;
-        }
-
-        // Snapshot into a vector. Shared_ptr copies keep every iterated
-        // subscriber alive across the loop even if a handler triggers
-        // RemoveSubscriber or UnsubscribeChannel.
-        std::vector<std::shared_ptr<ChannelSubscriber>> snapshot(
-            interested.begin(), interested.end());
-        for (const auto& subscriber : snapshot) {
-          subscriber->HandleDatagram(dg);
-        }
-      })
-      .onCancelled([](const std::string& consumerTag) {
-        spdlog::get("md")->error("Channel consuming cancelled unexpectedly.");
-      })
-      .onError([](const char* message) {
-        spdlog::get("md")->error("Received error: {}", message);
-      });
+void MessageDirector::DeliverRemote(const uint8_t* data, size_t size) {
+  // Increment observed datagrams metric.
+  if (_datagramsObservedCounter) {
+    _datagramsObservedCounter->Increment();
+  }
+
+  // One view over the backend's buffer serves every subscriber; nothing is
+  // copied unless a handler holds on to it (below).
+  auto dg = Datagram::View(data, size);
+
+  // Dispatch on the datagram's own recipient list rather than the routing
+  // key: a multi-recipient publish reaches us once however many of its
+  // channels we're bound to. Range bindings cover whole blocks, so the
+  // backend may also hand us channels just outside our ranges; the exact
+  // indexes match nothing for those.
+  size_t delivered = 0;
+  try {
+    delivered = Dispatch(dg);
+  } catch (const DatagramIteratorEOF&) {
+    spdlog::get("md")->warn("Received a truncated datagram from a peer MD");
+  }
+
+  // The backend reuses `data` once we return. Any handler that kept the
+  // datagram (queued it for later, say) gets a copy of the bytes now.
+  if (dg.use_count() > 1) {
+    dg->Own();
+  }
+
+  if (!delivered) {
+    return;
+  }
+
+  // Increment processed datagrams metric.
+  if (_datagramsProcessedCounter) {
+    _datagramsProcessedCounter->Increment();
+  }
+
+  // Datagram size metrics.
+  if (_datagramsSizeHistogram) {
+    _datagramsSizeHistogram->Observe((double)size);
+  }
 }
 
 void MessageDirector::HandleWeb(ws28::Client* client, nlohmann::json& data) {
@@ -546,15 +594,17 @@ void MessageDirector::HandleWeb(ws28::Client* client, nlohmann::json& data) {
     });
   }
 
-  WebPanel::Send(client, {
-                             {"type", "md"},
-                             {"success", true},
-                             {"listenIp", _host},
-                             {"listenPort", _port},
-                             {"connectIp", _rHost},
-                             {"connectPort", _rPort},
-                             {"participants", participantInfo},
-                         });
+  nlohmann::json info = {
+      {"type", "md"},
+      {"success", true},
+      {"listenIp", _host},
+      {"listenPort", _port},
+      {"listenLocal", _localListen},
+      {"participants", participantInfo},
+  };
+  _backend->Describe(info);
+
+  WebPanel::Send(client, info);
 }
 
 }  // namespace Ardos
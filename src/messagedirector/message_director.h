@@ -1,24 +1,30 @@
 #ifndef ARDOS_MESSAGE_DIRECTOR_H
 #define ARDOS_MESSAGE_DIRECTOR_H
 
-#include <amqpcpp.h>
 #include <prometheus/counter.h>
 #include <prometheus/gauge.h>
 #include <prometheus/histogram.h>
 #include <ws28/Client.h>
 
+#include <deque>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include <string>
 #include <unordered_set>
 #include <uvw.hpp>
+#include <vector>
 
-namespace Ardos {
+#include "../net/transport.h"
+#include "routing_backend.h"
 
-const std::string kGlobalExchange = "global-exchange";
+namespace Ardos {
 
 class ChannelSubscriber;
 class Datagram;
 class MDParticipant;
+class MsgTypeMetrics;
+
+class TransportWorker;
 
 class StateServer;
 class ClientAgent;
@@ -26,28 +32,25 @@ class DatabaseServer;
 class DatabaseStateServer;
 class WebPanel;
 
-class MessageDirector : public AMQP::ConnectionHandler {
+class MessageDirector {
  public:
   static MessageDirector* Instance();
 
-  [[nodiscard]] AMQP::Channel* GetGlobalChannel() const;
-  [[nodiscard]] std::string GetLocalQueue() const;
-
-  void onData(AMQP::Connection* connection, const char* buffer,
-              size_t size) override;
-  void onReady(AMQP::Connection* connection) override;
-  void onError(AMQP::Connection* connection, const char* message) override;
-  void onClosed(AMQP::Connection* connection) override;
+  // Carries datagrams and bindings between this MD and the rest of the
+  // cluster (message-director.backend).
+  [[nodiscard]] RoutingBackend* GetBackend() const { return _backend.get(); }
 
+  // Takes an owning reference and assigns the subscriber its id.
   void AddSubscriber(std::shared_ptr<ChannelSubscriber> subscriber);
   // Raw-pointer overload: callable from ChannelSubscriber::~ at a point
-  // where shared_from_this() is no longer valid. Walks _subscribers and
-  // erases the matching shared_ptr by .get() identity. O(N) but only hit
-  // on subscriber teardown.
+  // where shared_from_this() is no longer valid. O(1) via the
+  // subscriber's id.
   void RemoveSubscriber(ChannelSubscriber* subscriber);
 
-  void DeliverLocally(const std::string& routingKey,
-                      const std::shared_ptr<Datagram>& dg);
+  void DeliverLocally(const std::shared_ptr<Datagram>& dg);
+  // Dispatches a datagram the backend received from another MD. `data` only
+  // needs to stay valid for the duration of the call.
+  void DeliverRemote(const uint8_t* data, size_t size);
 
   void ParticipantJoined();
   void ParticipantLeft(MDParticipant* participant);
@@ -73,7 +76,23 @@ class MessageDirector : public AMQP::ConnectionHandler {
 
   void InitMetrics();
 
-  void StartConsuming();
+  // Starts the configured roles and begins accepting participants, once
+  // the backend is connected.
+  void StartRoles();
+
+  // Binds a Unix domain socket listener for message-director.listen.
+  void ListenUnix(const std::string& address);
+  // Wraps an accepted participant socket (TCP or Unix) in a transport,
+  // served by the least busy worker loop if we have any.
+  template <typename Handle>
+  void AcceptParticipant(const std::shared_ptr<Handle>& client);
+  void AddParticipant(std::unique_ptr<ITransportConnection> transport);
+
+  // Hands `dg` once to every local subscriber of any of its recipient
+  // channels and returns how many there were. Shared by DeliverLocally and
+  // DeliverRemote.
+  size_t Dispatch(const std::shared_ptr<Datagram>& dg);
+  void ReleaseDeferredSubscribers();
 
   static MessageDirector* _instance;
 
@@ -85,29 +104,55 @@ class MessageDirector : public AMQP::ConnectionHandler {
   std::shared_ptr<DatabaseStateServer> _dbss;
   std::unique_ptr<WebPanel> _webPanel;
 
-  std::unordered_set<std::shared_ptr<ChannelSubscriber>> _subscribers;
+  // Owning references to every registered subscriber, indexed by
+  // subscriber id. Ids of removed subscribers are recycled through
+  // _freeSubscriberIds.
+  std::vector<std::shared_ptr<ChannelSubscriber>> _subscribers;
+  std::vector<uint32_t> _freeSubscriberIds;
+  size_t _subscriberCount = 0;
+
+  // Dispatch state. Handlers can publish, so dispatch nests; each level
+  // gathers its matches into its own reusable scratch vector (a deque so
+  // growing it doesn't move the outer levels). Subscribers removed while
+  // any level is running are parked in _deferredRemovals so the raw
+  // pointers in those scratch vectors stay valid, and are released once
+  // the outermost dispatch returns.
+  uint64_t _dispatchStamp = 0;
+  size_t _dispatchDepth = 0;
+  std::deque<std::vector<ChannelSubscriber*>> _dispatchScratch;
+  std::vector<std::pair<uint32_t, std::shared_ptr<ChannelSubscriber>>>
+      _deferredRemovals;
+
   std::unordered_set<MDParticipant*> _participants;
 
-  std::shared_ptr<uvw::tcp_handle> _connectHandle;
+  // Optional participant I/O threads. When configured, accepted participant
+  // sockets are adopted by the least busy worker and the main loop only
+  // sees their decoded datagrams. Routing, dispatch and participant state
+  // are all still handled on the main loop.
+  // TODO: Shard Dispatch by channel across these loops. That needs
+  // ChannelSubscriber and the in-process roles to be thread-aware first.
+  std::vector<std::unique_ptr<TransportWorker>> _workers;
+
+  std::unique_ptr<RoutingBackend> _backend;
+
   std::shared_ptr<uvw::tcp_handle> _listenHandle;
-  AMQP::Connection* _connection;
-  AMQP::Channel* _globalChannel{};
-  std::string _localQueue;
-  std::string _consumeTag;
-  std::vector<char> _frameBuffer;
+  // Extra Unix domain socket and shared-memory listeners, for participants
+  // on this host.
+  std::vector<std::shared_ptr<uvw::pipe_handle>> _unixListenHandles;
+  std::vector<std::string> _shmListen;
+  std::vector<std::unique_ptr<ITransportListener>> _shmListeners;
 
   // Listen info.
   std::string _host = "127.0.0.1";
   int _port = 7100;
-  // RabbitMQ connect info.
-  std::string _rHost = "127.0.0.1";
-  int _rPort = 5672;
+  std::vector<std::string> _localListen;
 
   prometheus::Counter* _datagramsObservedCounter = nullptr;
   prometheus::Counter* _datagramsProcessedCounter = nullptr;
   prometheus::Histogram* _datagramsSizeHistogram = nullptr;
   prometheus::Gauge* _subscribersGauge = nullptr;
   prometheus::Gauge* _participantsGauge = nullptr;
+  std::shared_ptr<MsgTypeMetrics> _msgTypeMetrics;
 };
 
 }  // namespace Ardos
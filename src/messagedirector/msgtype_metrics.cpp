@@ -0,0 +1,112 @@
+#include "msgtype_metrics.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+namespace Ardos {
+
+MsgTypeMetrics::MsgTypeMetrics()
+    : _traffic(new Traffic[kMsgTypeCount]),
+      _timing(new std::atomic<Timing*>[kMsgTypeCount]) {
+  for (size_t i = 0; i < kMsgTypeCount; ++i) {
+    _timing[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+MsgTypeMetrics::~MsgTypeMetrics() {
+  for (size_t i = 0; i < kMsgTypeCount; ++i) {
+    delete _timing[i].load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Adds a sampled dispatch time to the histogram of `msgType`.
+ * @param msgType
+ * @param nanos
+ */
+void MsgTypeMetrics::RecordDispatchTime(uint16_t msgType, uint64_t nanos) {
+  Timing* timing = _timing[msgType].load(std::memory_order_relaxed);
+  if (timing == nullptr) {
+    timing = new Timing();
+    // Publish the fully constructed histogram to the collector.
+    _timing[msgType].store(timing, std::memory_order_release);
+  }
+
+  const size_t bucket =
+      std::ranges::lower_bound(kDispatchBuckets, nanos) -
+      kDispatchBuckets.begin();
+  auto bump = [](std::atomic<uint64_t>& value, uint64_t by) {
+    value.store(value.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+  };
+  bump(timing->buckets[bucket], 1);
+  bump(timing->sumNanos, nanos);
+  bump(timing->samples, 1);
+}
+
+/**
+ * Builds the metric families for a scrape. Runs on the exposer's thread;
+ * counts may be a datagram or two apart from each other, never torn.
+ * @return
+ */
+std::vector<prometheus::MetricFamily> MsgTypeMetrics::Collect() const {
+  prometheus::MetricFamily datagrams{
+      .name = "md_msgtype_datagrams_total",
+      .help = "Number of datagrams dispatched, by message type",
+      .type = prometheus::MetricType::Counter};
+  prometheus::MetricFamily bytes{
+      .name = "md_msgtype_bytes_total",
+      .help = "Bytes of datagrams dispatched, by message type",
+      .type = prometheus::MetricType::Counter};
+  prometheus::MetricFamily dispatch{
+      .name = "md_msgtype_dispatch_seconds",
+      .help = "Time spent dispatching a datagram to local subscribers, by "
+              "message type (sampled)",
+      .type = prometheus::MetricType::Histogram};
+
+  for (size_t msgType = 0; msgType < kMsgTypeCount; ++msgType) {
+    const uint64_t count =
+        _traffic[msgType].datagrams.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+
+    const std::vector<prometheus::ClientMetric::Label> labels = {
+        {.name = "msgtype", .value = std::to_string(msgType)}};
+
+    prometheus::ClientMetric metric;
+    metric.label = labels;
+    metric.counter.value = (double)count;
+    datagrams.metric.push_back(metric);
+
+    metric.counter.value =
+        (double)_traffic[msgType].bytes.load(std::memory_order_relaxed);
+    bytes.metric.push_back(metric);
+
+    const Timing* timing = _timing[msgType].load(std::memory_order_acquire);
+    if (timing == nullptr) {
+      continue;
+    }
+
+    prometheus::ClientMetric histogram;
+    histogram.label = labels;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < timing->buckets.size(); ++i) {
+      cumulative += timing->buckets[i].load(std::memory_order_relaxed);
+      histogram.histogram.bucket.push_back(
+          {.cumulative_count = cumulative,
+           .upper_bound = i < kDispatchBuckets.size()
+                              ? (double)kDispatchBuckets[i] / 1e9
+                              : std::numeric_limits<double>::infinity()});
+    }
+    histogram.histogram.sample_count = cumulative;
+    histogram.histogram.sample_sum =
+        (double)timing->sumNanos.load(std::memory_order_relaxed) / 1e9;
+    dispatch.metric.push_back(histogram);
+  }
+
+  return {datagrams, bytes, dispatch};
+}
+
+}  // namespace Ardos
@@ -0,0 +1,73 @@
+#ifndef ARDOS_MSGTYPE_METRICS_H
+#define ARDOS_MSGTYPE_METRICS_H
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Ardos {
+
+// Per-message-type MD traffic: datagram and byte counts for every msgtype
+// dispatched, plus a dispatch-time histogram sampled from every
+// kTimingSampleInterval-th datagram of each type.
+//
+// Counts live in a flat table indexed by msgtype and are only ever written
+// from the main loop, so recording is a couple of plain (relaxed) stores
+// with no locking or lookups. Prometheus reads them through Collect() on
+// its own thread when scraped; types never seen are left out.
+class MsgTypeMetrics final : public prometheus::Collectable {
+ public:
+  static constexpr uint64_t kTimingSampleInterval = 16;
+  // Dispatch-time bucket bounds, in nanoseconds.
+  static constexpr std::array<uint64_t, 9> kDispatchBuckets = {
+      1'000,     4'000,     16'000,     64'000,    256'000,
+      1'000'000, 4'000'000, 16'000'000, 64'000'000};
+
+  MsgTypeMetrics();
+  ~MsgTypeMetrics() override;
+
+  // Counts one datagram of `msgType`. Returns true if its dispatch should be
+  // timed and handed to RecordDispatchTime.
+  bool Record(uint16_t msgType, size_t size) {
+    Traffic& traffic = _traffic[msgType];
+    const uint64_t count = traffic.datagrams.load(std::memory_order_relaxed);
+    traffic.datagrams.store(count + 1, std::memory_order_relaxed);
+    traffic.bytes.store(traffic.bytes.load(std::memory_order_relaxed) + size,
+                        std::memory_order_relaxed);
+    return count % kTimingSampleInterval == 0;
+  }
+
+  void RecordDispatchTime(uint16_t msgType, uint64_t nanos);
+
+  [[nodiscard]] std::vector<prometheus::MetricFamily> Collect() const override;
+
+ private:
+  struct Traffic {
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> bytes{0};
+  };
+
+  struct Timing {
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> sumNanos{0};
+    // Per-bucket (not cumulative) counts; the last is +Inf.
+    std::array<std::atomic<uint64_t>, kDispatchBuckets.size() + 1> buckets{};
+  };
+
+  static constexpr size_t kMsgTypeCount = UINT16_MAX + 1;
+
+  std::unique_ptr<Traffic[]> _traffic;
+  // Allocated on a type's first timed dispatch, then never freed before we
+  // are, so the collector can read them without further coordination.
+  std::unique_ptr<std::atomic<Timing*>[]> _timing;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_MSGTYPE_METRICS_H
@@ -0,0 +1,99 @@
+#include "range_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace Ardos {
+
+const RangeIndex::SubscriberList* RangeIndex::Find(uint64_t channel) const {
+  auto it = _segments.upper_bound(channel);
+  if (it == _segments.begin()) {
+    return nullptr;
+  }
+
+  --it;
+  return it->second.empty() ? nullptr : &it->second;
+}
+
+RangeIndex::SegmentMap::iterator RangeIndex::Split(uint64_t at) {
+  auto it = _segments.upper_bound(at);
+  if (it == _segments.begin()) {
+    // Before every known segment: that space is uncovered.
+    return _segments.emplace_hint(it, at, SubscriberList{});
+  }
+
+  auto prev = std::prev(it);
+  if (prev->first == at) {
+    return prev;
+  }
+  // The new segment inherits the coverage of the one it was cut from.
+  return _segments.emplace_hint(it, at, prev->second);
+}
+
+void RangeIndex::Insert(uint64_t min, uint64_t max, uint32_t subscriber) {
+  if (min > max) {
+    return;
+  }
+
+  auto first = Split(min);
+  auto last = max == std::numeric_limits<uint64_t>::max() ? _segments.end()
+                                                          : Split(max + 1);
+
+  for (auto it = first; it != last; ++it) {
+    auto& list = it->second;
+    list.insert(std::ranges::upper_bound(list, subscriber), subscriber);
+  }
+
+  Coalesce(first, last);
+}
+
+void RangeIndex::Erase(uint64_t min, uint64_t max, uint32_t subscriber) {
+  if (min > max) {
+    return;
+  }
+
+  auto first = Split(min);
+  auto last = max == std::numeric_limits<uint64_t>::max() ? _segments.end()
+                                                          : Split(max + 1);
+
+  for (auto it = first; it != last; ++it) {
+    auto& list = it->second;
+    if (auto pos = std::ranges::lower_bound(list, subscriber);
+        pos != list.end() && *pos == subscriber) {
+      list.erase(pos);
+    }
+  }
+
+  Coalesce(first, last);
+}
+
+void RangeIndex::Coalesce(SegmentMap::iterator first,
+                          SegmentMap::iterator last) {
+  // Widen by one on each side: the segment before the edit may now match
+  // its first segment, and the one starting at `last` its final segment.
+  if (first != _segments.begin()) {
+    --first;
+  }
+  auto stop = last == _segments.end() ? last : std::next(last);
+
+  auto it = first;
+  while (true) {
+    auto next = std::next(it);
+    if (next == stop || next == _segments.end()) {
+      break;
+    }
+    if (next->second == it->second) {
+      _segments.erase(next);
+    } else {
+      it = next;
+    }
+  }
+
+  // Leading uncovered segments say nothing Find doesn't already assume.
+  while (!_segments.empty() && _segments.begin()->second.empty()) {
+    _segments.erase(_segments.begin());
+  }
+}
+
+}  // namespace Ardos
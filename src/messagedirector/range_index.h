@@ -0,0 +1,52 @@
+#ifndef ARDOS_RANGE_INDEX_H
+#define ARDOS_RANGE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace Ardos {
+
+// Sorted map of disjoint channel segments to the ids of the subscribers
+// whose ranges cover them. Each key is the first channel of a segment that
+// runs up to the next key; segments no range covers hold an empty list.
+//
+// Matching a channel is one O(log n) lookup that hands back the list in
+// place. Adding or removing a range splits at most two segments, then
+// updates every segment already inside it: O(log n + s) for s covered
+// segments, not O(log n). Its cost follows how many other ranges' edges
+// fall inside it, not its width, so a range spanning hundreds of millions
+// of channels over an otherwise empty index is still a few map operations.
+// Adjacent segments left with identical lists are merged back together.
+//
+// Like ChannelIndex, a subscriber can appear more than once in a list
+// (overlapping ranges); each Insert is undone by exactly one Erase.
+class RangeIndex {
+ public:
+  using SubscriberList = std::vector<uint32_t>;
+
+  // Subscribers whose ranges contain `channel`, or nullptr if none.
+  [[nodiscard]] const SubscriberList* Find(uint64_t channel) const;
+
+  void Insert(uint64_t min, uint64_t max, uint32_t subscriber);
+  void Erase(uint64_t min, uint64_t max, uint32_t subscriber);
+
+  // Number of segments currently tracked.
+  [[nodiscard]] size_t Size() const { return _segments.size(); }
+
+ private:
+  using SegmentMap = std::map<uint64_t, SubscriberList>;
+
+  // Makes `at` the start of a segment and returns it.
+  SegmentMap::iterator Split(uint64_t at);
+  // Merges equal neighbours from the segment before `first` through the
+  // one starting at `last`.
+  void Coalesce(SegmentMap::iterator first, SegmentMap::iterator last);
+
+  SegmentMap _segments;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_RANGE_INDEX_H
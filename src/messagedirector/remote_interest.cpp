@@ -0,0 +1,181 @@
+#include "remote_interest.h"
+
+#include <algorithm>
+
+#include "../net/datagram_iterator.h"
+
+namespace Ardos {
+
+void LocalInterest::AddChannel(uint64_t channel) { _channels.insert(channel); }
+
+void LocalInterest::RemoveChannel(uint64_t channel) {
+  _channels.erase(channel);
+}
+
+void LocalInterest::AddRange(uint64_t min, uint64_t max) {
+  _ranges.emplace_back(min, max);
+}
+
+void LocalInterest::RemoveRange(uint64_t min, uint64_t max) {
+  auto position = std::ranges::find(_ranges, std::make_pair(min, max));
+  if (position != _ranges.end()) {
+    _ranges.erase(position);
+  }
+}
+
+void LocalInterest::Snapshot(
+    const std::function<void(const Datagram&)>& emit) const {
+  Datagram snapshot;
+  Append(snapshot, InterestOp::Reset);
+  auto flushIfFull = [&]() {
+    if (snapshot.Size() + kMaxInterestUpdateSize > kMaxDgSize) {
+      emit(snapshot);
+      snapshot.Clear();
+    }
+  };
+
+  for (uint64_t channel : _channels) {
+    flushIfFull();
+    Append(snapshot, InterestOp::AddChannel, channel);
+  }
+  for (const auto& [min, max] : _ranges) {
+    flushIfFull();
+    Append(snapshot, InterestOp::AddRange, min, max);
+  }
+
+  emit(snapshot);
+}
+
+void LocalInterest::Append(Datagram& dg, InterestOp op) {
+  dg.AddUint8(static_cast<uint8_t>(op));
+}
+
+void LocalInterest::Append(Datagram& dg, InterestOp op, uint64_t channel) {
+  dg.AddUint8(static_cast<uint8_t>(op));
+  dg.AddUint64(channel);
+}
+
+void LocalInterest::Append(Datagram& dg, InterestOp op, uint64_t min,
+                           uint64_t max) {
+  dg.AddUint8(static_cast<uint8_t>(op));
+  dg.AddUint64(min);
+  dg.AddUint64(max);
+}
+
+bool RemoteInterest::Apply(const std::string& peer,
+                           const std::shared_ptr<Datagram>& dg) {
+  const uint32_t id = PeerId(peer);
+  Peer& state = _peers[id];
+
+  bool hello = false;
+  DatagramIterator dgi(dg);
+  while (dgi.GetRemainingSize()) {
+    switch (static_cast<InterestOp>(dgi.GetUint8())) {
+      case InterestOp::Hello:
+        hello = true;
+        break;
+      case InterestOp::Reset:
+        Reset(id);
+        break;
+      case InterestOp::Heartbeat:
+        break;
+      case InterestOp::AddChannel: {
+        uint64_t channel = dgi.GetUint64();
+        if (state.channels.insert(channel).second) {
+          _channels.Insert(channel, id);
+        }
+        break;
+      }
+      case InterestOp::RemoveChannel: {
+        uint64_t channel = dgi.GetUint64();
+        if (state.channels.erase(channel)) {
+          _channels.Erase(channel, id);
+        }
+        break;
+      }
+      case InterestOp::AddRange: {
+        uint64_t min = dgi.GetUint64();
+        uint64_t max = dgi.GetUint64();
+        state.ranges.emplace_back(min, max);
+        _ranges.Insert(min, max, id);
+        break;
+      }
+      case InterestOp::RemoveRange: {
+        uint64_t min = dgi.GetUint64();
+        uint64_t max = dgi.GetUint64();
+        auto position =
+            std::ranges::find(state.ranges, std::make_pair(min, max));
+        if (position != state.ranges.end()) {
+          state.ranges.erase(position);
+          _ranges.Erase(min, max, id);
+        }
+        break;
+      }
+      default:
+        // Unknown op: we can't tell how long it is, so drop the rest.
+        return hello;
+    }
+  }
+
+  return hello;
+}
+
+bool RemoteInterest::Contains(uint64_t channel) const {
+  return _channels.Find(channel) || _ranges.Find(channel);
+}
+
+void RemoteInterest::CollectPeers(uint64_t channel,
+                                  std::vector<uint32_t>& peers) const {
+  if (const auto* ids = _channels.Find(channel)) {
+    peers.insert(peers.end(), ids->begin(), ids->end());
+  }
+  if (const auto* ids = _ranges.Find(channel)) {
+    peers.insert(peers.end(), ids->begin(), ids->end());
+  }
+}
+
+void RemoteInterest::Forget(const std::string& peer) {
+  if (auto it = _peerIds.find(peer); it != _peerIds.end()) {
+    Reset(it->second);
+  }
+}
+
+void RemoteInterest::Remove(const std::string& peer) {
+  if (auto it = _peerIds.find(peer); it != _peerIds.end()) {
+    Reset(it->second);
+    _freeIds.push_back(it->second);
+    _peerIds.erase(it);
+  }
+}
+
+uint32_t RemoteInterest::PeerId(const std::string& peer) {
+  auto it = _peerIds.find(peer);
+  if (it != _peerIds.end()) {
+    return it->second;
+  }
+
+  uint32_t id;
+  if (!_freeIds.empty()) {
+    id = _freeIds.back();
+    _freeIds.pop_back();
+  } else {
+    id = static_cast<uint32_t>(_peers.size());
+    _peers.emplace_back();
+  }
+  _peerIds.emplace(peer, id);
+  return id;
+}
+
+void RemoteInterest::Reset(uint32_t id) {
+  Peer& state = _peers[id];
+  for (uint64_t channel : state.channels) {
+    _channels.Erase(channel, id);
+  }
+  for (const auto& [min, max] : state.ranges) {
+    _ranges.Erase(min, max, id);
+  }
+  state.channels.clear();
+  state.ranges.clear();
+}
+
+}  // namespace Ardos
@@ -0,0 +1,109 @@
+#ifndef ARDOS_REMOTE_INTEREST_H
+#define ARDOS_REMOTE_INTEREST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../net/datagram.h"
+#include "channel_index.h"
+#include "range_index.h"
+
+namespace Ardos {
+
+// Interest updates MDs publish to each other, each op followed by its
+// channel (or min/max for ranges). A Hello asks every peer for a snapshot,
+// which starts with a Reset of everything that peer told us before. A
+// Heartbeat carries nothing; it only tells peers the sender is still up.
+enum class InterestOp : uint8_t {
+  Hello = 0,
+  Reset = 1,
+  AddChannel = 2,
+  RemoveChannel = 3,
+  AddRange = 4,
+  RemoveRange = 5,
+  Heartbeat = 6,
+};
+
+// Largest single update: an op and two channels.
+constexpr size_t kMaxInterestUpdateSize =
+    sizeof(uint8_t) + 2 * sizeof(uint64_t);
+
+// What this MD is bound to, kept by a routing backend so it can describe
+// itself to its peers.
+class LocalInterest {
+ public:
+  void AddChannel(uint64_t channel);
+  void RemoveChannel(uint64_t channel);
+  void AddRange(uint64_t min, uint64_t max);
+  void RemoveRange(uint64_t min, uint64_t max);
+
+  // Encodes a Reset followed by every binding, split into as many
+  // datagrams as it takes, and hands each to `emit`.
+  void Snapshot(const std::function<void(const Datagram&)>& emit) const;
+
+  // Encode a single update.
+  static void Append(Datagram& dg, InterestOp op);
+  static void Append(Datagram& dg, InterestOp op, uint64_t channel);
+  static void Append(Datagram& dg, InterestOp op, uint64_t min, uint64_t max);
+
+ private:
+  std::unordered_set<uint64_t> _channels;
+  std::vector<std::pair<uint64_t, uint64_t>> _ranges;
+};
+
+// What the other MDs in the cluster are subscribed to, as far as they've
+// told us. Peers are identified by whatever name the backend knows them by
+// (AMQP queue, mesh node). An MD that dies without saying so keeps its
+// interest here until its backend notices (a mesh link drops, AMQP
+// heartbeats stop) and removes it; until then it only costs us publishes
+// nobody reads -- never a lost datagram.
+class RemoteInterest {
+ public:
+  // Applies a batch of updates from `peer`. Returns true if the batch
+  // contained a Hello. Throws DatagramIteratorEOF on a truncated batch
+  // (anything before the truncation is still applied).
+  bool Apply(const std::string& peer, const std::shared_ptr<Datagram>& dg);
+
+  // True if any peer is subscribed to `channel`, directly or by range.
+  [[nodiscard]] bool Contains(uint64_t channel) const;
+
+  // Appends the id of every peer subscribed to `channel` to `peers`.
+  // Ids may repeat.
+  void CollectPeers(uint64_t channel, std::vector<uint32_t>& peers) const;
+
+  // Drops everything `peer` told us, e.g. once we've lost our link to it.
+  void Forget(const std::string& peer);
+  // Forgets `peer` for good, freeing its id for reuse by a new peer.
+  void Remove(const std::string& peer);
+
+  // Stable id of `peer`, as handed out by CollectPeers.
+  uint32_t PeerId(const std::string& peer);
+
+  [[nodiscard]] size_t PeerCount() const { return _peerIds.size(); }
+
+ private:
+  struct Peer {
+    std::unordered_set<uint64_t> channels;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  };
+
+  void Reset(uint32_t id);
+
+  std::unordered_map<std::string, uint32_t> _peerIds;
+  std::vector<Peer> _peers;
+  std::vector<uint32_t> _freeIds;
+
+  ChannelIndex _channels;
+  RangeIndex _ranges;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_REMOTE_INTEREST_H
@@ -0,0 +1,49 @@
+#ifndef ARDOS_ROUTING_BACKEND_H
+#define ARDOS_ROUTING_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+namespace Ardos {
+
+class Datagram;
+
+// Carries datagrams between this MD and the rest of the cluster. The
+// MessageDirector delivers to its own subscribers itself; a backend only
+// ships what other processes might want, and hands whatever they send us
+// to MessageDirector::DeliverRemote.
+//
+// Implementations: AmqpBackend (RabbitMQ topic exchange) and MeshBackend
+// (direct MD-to-MD links). Selected by message-director.backend.
+class RoutingBackend {
+ public:
+  virtual ~RoutingBackend() = default;
+
+  // Connects to the cluster and calls `onReady` once bindings and
+  // publishes may be issued. Backends log and exit if they can't start.
+  virtual void Start(std::function<void()> onReady) = 0;
+
+  // A channel gained its first local subscriber, or lost its last one.
+  virtual void BindChannel(uint64_t channel) = 0;
+  virtual void UnbindChannel(uint64_t channel) = 0;
+
+  // A local subscriber added or removed a range. Ranges aren't ref-counted
+  // by the caller; each BindRange is undone by exactly one UnbindRange.
+  virtual void BindRange(uint64_t min, uint64_t max) = 0;
+  virtual void UnbindRange(uint64_t min, uint64_t max) = 0;
+
+  // Ships a datagram that has already been delivered locally. `headerSize`
+  // is the length of its (already validated) recipient list.
+  virtual void Publish(const std::shared_ptr<Datagram>& dg,
+                       size_t headerSize) = 0;
+
+  // Adds backend details to the MD's web panel info.
+  virtual void Describe(nlohmann::json& info) const = 0;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_ROUTING_BACKEND_H
@@ -0,0 +1,125 @@
+#include "compression.h"
+
+#include <prometheus/counter.h>
+
+#include <array>
+
+#include "../util/metrics.h"
+
+namespace Ardos {
+
+DeflateStream::DeflateStream(int level) {
+  // Negative window bits: raw deflate, no zlib header or checksum.
+  _ok = deflateInit2(&_stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+DeflateStream::~DeflateStream() {
+  if (_ok) {
+    deflateEnd(&_stream);
+  }
+}
+
+/**
+ * Compresses a buffer onto the end of the stream.
+ * @param data
+ * @param len
+ * @param out
+ * @return
+ */
+bool DeflateStream::Compress(const uint8_t* data, size_t len,
+                             std::vector<uint8_t>& out) {
+  if (!_ok) {
+    return false;
+  }
+
+  _stream.next_in = const_cast<Bytef*>(data);
+  _stream.avail_in = static_cast<uInt>(len);
+
+  // Sync flush output can outgrow deflateBound by a few bytes; loop until
+  // zlib stops filling the space we give it.
+  do {
+    const size_t offset = out.size();
+    const size_t room = deflateBound(&_stream, _stream.avail_in) + 16;
+    out.resize(offset + room);
+    _stream.next_out = out.data() + offset;
+    _stream.avail_out = static_cast<uInt>(room);
+
+    const int res = deflate(&_stream, Z_SYNC_FLUSH);
+    out.resize(offset + room - _stream.avail_out);
+    if (res != Z_OK && res != Z_BUF_ERROR) {
+      deflateEnd(&_stream);
+      _ok = false;
+      return false;
+    }
+  } while (_stream.avail_out == 0);
+
+  return true;
+}
+
+namespace CompressionMetrics {
+
+namespace {
+
+struct Counters {
+  prometheus::Counter* inputBytes = nullptr;
+  prometheus::Counter* outputBytes = nullptr;
+  prometheus::Counter* seconds = nullptr;
+};
+
+std::array<Counters, 2> counters;
+
+}  // namespace
+
+/**
+ * Registers the compression counters, if metrics are enabled.
+ */
+void Init() {
+  if (!Metrics::Instance()->WantMetrics()) {
+    return;
+  }
+
+  auto registry = Metrics::Instance()->GetRegistry();
+
+  auto& bytesBuilder = prometheus::BuildCounter()
+                           .Name("ca_compression_bytes_total")
+                           .Help("Bytes fed to and produced by client "
+                                 "compression")
+                           .Register(*registry);
+  auto& secondsBuilder = prometheus::BuildCounter()
+                             .Name("ca_compression_seconds_total")
+                             .Help("Time spent compressing client traffic")
+                             .Register(*registry);
+
+  const std::array<const char*, 2> names = {"tcp", "ws"};
+  for (size_t i = 0; i < names.size(); ++i) {
+    counters[i].inputBytes =
+        &bytesBuilder.Add({{"transport", names[i]}, {"direction", "in"}});
+    counters[i].outputBytes =
+        &bytesBuilder.Add({{"transport", names[i]}, {"direction", "out"}});
+    counters[i].seconds = &secondsBuilder.Add({{"transport", names[i]}});
+  }
+}
+
+/**
+ * Records one compressed write.
+ * @param transport
+ * @param inputBytes
+ * @param outputBytes
+ * @param elapsed
+ */
+void Record(Transport transport, size_t inputBytes, size_t outputBytes,
+            std::chrono::steady_clock::duration elapsed) {
+  const auto& c = counters[static_cast<size_t>(transport)];
+  if (!c.inputBytes) {
+    return;
+  }
+
+  c.inputBytes->Increment(static_cast<double>(inputBytes));
+  c.outputBytes->Increment(static_cast<double>(outputBytes));
+  c.seconds->Increment(std::chrono::duration<double>(elapsed).count());
+}
+
+}  // namespace CompressionMetrics
+
+}  // namespace Ardos
@@ -0,0 +1,60 @@
+#ifndef ARDOS_COMPRESSION_H
+#define ARDOS_COMPRESSION_H
+
+#include <zlib.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Ardos {
+
+// client-agent.compression. Clients opt in per connection (see
+// StreamTransportConnection for tcp, permessage-deflate for ws); these
+// settings only decide whether we agree to and how hard we try.
+struct CompressionOptions {
+  bool enabled = false;
+  // Writes smaller than this many bytes are sent uncompressed.
+  size_t threshold = 256;
+  // zlib level, 1 (fastest) to 9 (smallest).
+  int level = 6;
+};
+
+// One connection's outbound deflate stream. The history carries over from
+// one write to the next, so each client effectively gets its own
+// dictionary of the class layouts and field values it has been sent.
+class DeflateStream {
+ public:
+  explicit DeflateStream(int level);
+  ~DeflateStream();
+
+  DeflateStream(const DeflateStream&) = delete;
+  DeflateStream& operator=(const DeflateStream&) = delete;
+
+  // Appends `len` bytes of raw deflate to `out`, sync-flushed so the peer
+  // can decode everything up to here. Returns false if zlib gave up, after
+  // which the stream is unusable.
+  bool Compress(const uint8_t* data, size_t len, std::vector<uint8_t>& out);
+
+ private:
+  z_stream _stream{};
+  bool _ok;
+};
+
+// Client compression counters, labelled by transport. Safe to call from
+// any thread once the ClientAgent has set them up; no-ops without metrics.
+namespace CompressionMetrics {
+
+enum class Transport : uint8_t { Tcp, Ws };
+
+// Main thread, before any client connects.
+void Init();
+void Record(Transport transport, size_t inputBytes, size_t outputBytes,
+            std::chrono::steady_clock::duration elapsed);
+
+}  // namespace CompressionMetrics
+
+}  // namespace Ardos
+
+#endif  // ARDOS_COMPRESSION_H
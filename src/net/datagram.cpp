@@ -1,21 +1,24 @@
 #include "datagram.h"
 
+#include <algorithm>
 #include <cstring>
 #include <format>
 
 namespace Ardos {
 
 Datagram::Datagram()
-    : _buf(new uint8_t[kMinDgSize]), _bufOffset(0), _bufLength(kMinDgSize) {}
+    : _buf(_inline), _bufOffset(0), _bufLength(kMinDgSize) {}
 
 Datagram::Datagram(const uint8_t* data, const size_t& size)
-    : _buf(new uint8_t[size]), _bufOffset(size), _bufLength(size) {
+    : _buf(_inline), _bufOffset(0), _bufLength(kMinDgSize) {
+  Reserve(size);
   std::memcpy(_buf, data, size);
+  _bufOffset = size;
 }
 
 Datagram::Datagram(const uint64_t& toChannel, const uint64_t& fromChannel,
                    const uint16_t& msgType)
-    : _buf(new uint8_t[kMinDgSize]), _bufOffset(0), _bufLength(kMinDgSize) {
+    : _buf(_inline), _bufOffset(0), _bufLength(kMinDgSize) {
   AddUint8(1);
   AddUint64(toChannel);
   AddUint64(fromChannel);
@@ -24,7 +27,7 @@ Datagram::Datagram(const uint64_t& toChannel, const uint64_t& fromChannel,
 
 Datagram::Datagram(const std::unordered_set<uint64_t>& toChannels,
                    const uint64_t& fromChannel, const uint16_t& msgType)
-    : _buf(new uint8_t[kMinDgSize]), _bufOffset(0), _bufLength(kMinDgSize) {
+    : _buf(_inline), _bufOffset(0), _bufLength(kMinDgSize) {
   AddUint8(toChannels.size());
   for (const auto& channel : toChannels) {
     AddUint64(channel);
@@ -33,7 +36,60 @@ Datagram::Datagram(const std::unordered_set<uint64_t>& toChannels,
   AddUint16(msgType);
 }
 
-Datagram::~Datagram() { delete[] _buf; }
+Datagram::Datagram(BorrowTag, const uint8_t* data, size_t size)
+    // Never written through while borrowed; see EnsureLength.
+    : _buf(const_cast<uint8_t*>(data)),
+      _bufOffset(size),
+      _bufLength(size),
+      _borrowed(true) {}
+
+Datagram::Datagram(BorrowTag, const DatagramView& view) : Datagram() {
+  Adopt(view);
+}
+
+Datagram::~Datagram() { ReleaseBuffer(); }
+
+/**
+ * Returns a datagram reading `size` bytes at `data` in place.
+ * @param data
+ * @param size
+ * @return
+ */
+std::shared_ptr<Datagram> Datagram::View(const uint8_t* data, size_t size) {
+  return Create(BorrowTag{}, data, size);
+}
+
+/**
+ * Returns a datagram reading the bytes of `view` in place.
+ * @param view
+ * @return
+ */
+std::shared_ptr<Datagram> Datagram::Slice(const DatagramView& view) {
+  return Create(BorrowTag{}, view);
+}
+
+/**
+ * Takes a private copy of a borrowed buffer, e.g. before a view outlives the
+ * bytes it was reading.
+ */
+void Datagram::Own() {
+  if (!_borrowed) {
+    return;
+  }
+
+  // Keep the parent (if any) alive until the bytes are copied out of it.
+  const uint8_t* borrowed = GetData();
+  const auto parent = std::move(_parent);
+  const size_t size = _bufOffset;
+
+  _borrowed = false;
+  _buf = _inline;
+  _bufOffset = 0;
+  _bufLength = kMinDgSize;
+  Reserve(size);
+  std::memcpy(_buf, borrowed, size);
+  _bufOffset = size;
+}
 
 /**
  * Clears this datagram of data ready for rewriting.
@@ -45,6 +101,28 @@ void Datagram::Clear() {
   _bufOffset = 0;
 }
 
+/**
+ * Grows the buffer to hold at least `length` bytes.
+ * @param length
+ */
+void Datagram::Reserve(size_t length) {
+  // Never write into borrowed bytes.
+  Own();
+
+  // Not capped at kMaxDgSize: received datagrams can be a couple of bytes
+  // longer than anything we'd build. The Add methods check the limit.
+  if (length <= _bufLength) {
+    return;
+  }
+
+  auto* newBuf = DatagramPool::Allocate(length);
+  std::memcpy(newBuf, _buf, _bufOffset);
+
+  ReleaseBuffer();
+  _buf = newBuf;
+  _bufLength = DatagramPool::CapacityFor(length);
+}
+
 /**
  * Returns the number of bytes added to this datagram.
  * @return
@@ -55,7 +133,9 @@ uint16_t Datagram::Size() const { return _bufOffset; }
  * Returns the underlying data pointer for this datagram.
  * @return
  */
-const uint8_t* Datagram::GetData() const { return _buf; }
+const uint8_t* Datagram::GetData() const {
+  return _parent ? _parent->GetData() + _parentOffset : _buf;
+}
 
 /**
  * Returns the bytes packed into this datagram.
@@ -227,6 +307,27 @@ void Datagram::AddData(const std::shared_ptr<Datagram>& v) {
   }
 }
 
+/**
+ * Adds the bytes of a view to the end of this datagram.
+ * @param v
+ */
+void Datagram::AddData(const DatagramView& v) {
+  if (v.Empty()) {
+    return;
+  }
+
+  // Nothing of our own yet: read the view's bytes in place. They only get
+  // copied if something is added after them.
+  if (_bufOffset == 0) {
+    Adopt(v);
+    return;
+  }
+
+  EnsureLength(v.Size());
+  std::memcpy(_buf + _bufOffset, v.GetData(), v.Size());
+  _bufOffset += v.Size();
+}
+
 /**
  * Adds raw binary data directly to the end of this datagram.
  * @param data
@@ -249,6 +350,9 @@ void Datagram::AddLocation(const uint32_t& parentId, const uint32_t& zoneId) {
 }
 
 void Datagram::EnsureLength(const size_t& length) {
+  // Never write into borrowed bytes.
+  Own();
+
   // Make sure we don't overflow.
   size_t newOffset = _bufOffset + length;
   if (newOffset > kMaxDgSize) {
@@ -256,19 +360,63 @@ void Datagram::EnsureLength(const size_t& length) {
                                        _bufOffset, newOffset));
   }
 
-  // Do we need to resize the buffer?
+  // Do we need to resize the buffer? Size classes double, so a datagram
+  // built up a field at a time is only copied a handful of times.
   if (newOffset > _bufLength) {
-    const size_t newLength = _bufLength + kMinDgSize + length;
+    Reserve(newOffset);
+  }
+}
 
-    // Copy our old buffer into a new one.
-    auto* tempBuf = new uint8_t[newLength];
-    std::memcpy(tempBuf, _buf, _bufLength);
+void Datagram::Adopt(const DatagramView& view) {
+  ReleaseBuffer();
+  _buf = nullptr;
+  _bufOffset = view._size;
+  _bufLength = view._size;
+  _borrowed = true;
+  _parent = view._dg;
+  _parentOffset = view._offset;
+
+  // Point straight at whoever holds the bytes rather than chaining through
+  // another slice.
+  if (_parent && _parent->_parent) {
+    _parentOffset += _parent->_parentOffset;
+    _parent = _parent->_parent;
+  }
+}
 
-    // Clear out the old buffer and assign the new one.
-    delete[] _buf;
-    _buf = tempBuf;
-    _bufLength = newLength;
+void Datagram::ReleaseBuffer() {
+  if (!_borrowed && _buf != _inline) {
+    DatagramPool::Release(_buf, _bufLength);
   }
 }
 
+DatagramView::DatagramView(std::shared_ptr<const Datagram> dg, size_t offset,
+                           size_t size)
+    : _dg(std::move(dg)), _offset(offset), _size(size) {}
+
+/**
+ * Returns a pointer to the first byte of this view.
+ * @return
+ */
+const uint8_t* DatagramView::GetData() const {
+  return _dg ? _dg->GetData() + _offset : nullptr;
+}
+
+/**
+ * Returns a datagram of just the bytes in this view.
+ * @return
+ */
+std::shared_ptr<Datagram> DatagramView::ToDatagram() const {
+  return Datagram::Slice(*this);
+}
+
+/**
+ * Returns a copy of the bytes in this view.
+ * @return
+ */
+std::vector<uint8_t> DatagramView::GetBytes() const {
+  std::vector<uint8_t> data(GetData(), GetData() + _size);
+  return data;
+}
+
 }  // namespace Ardos
\ No newline at end of file
@@ -6,8 +6,11 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "datagram_pool.h"
+
 namespace Ardos {
 
 // Max amount of data we can have is an uint16 (65k bytes)
@@ -16,6 +19,9 @@ constexpr size_t kMaxDgSize = 0xffff - 2;
 // 128 bytes seems like a good minimum datagram size.
 constexpr size_t kMinDgSize = 0x80;
 
+static_assert(kMinDgSize == size_t{1} << DatagramPool::kMinClassShift);
+static_assert(kMaxDgSize <= DatagramPool::kMaxClassSize);
+
 /**
  * A DatagramOverflow is an exception which occurs when an Add<value> method is
  * called which would increase the size of the datagram past kMaxDgSize
@@ -27,6 +33,38 @@ class DatagramOverflow final : public std::runtime_error {
       : std::runtime_error(what) {}
 };
 
+class Datagram;
+
+/**
+ * A run of bytes inside a datagram that shares the datagram's buffer, and
+ * keeps the datagram alive, instead of copying the bytes out.
+ *
+ * The bytes are looked up through the datagram on every access, so a view
+ * stays valid if the datagram grows or Own()s a borrowed buffer; it does
+ * not survive the datagram being cleared and rewritten.
+ */
+class DatagramView {
+ public:
+  DatagramView() = default;
+  DatagramView(std::shared_ptr<const Datagram> dg, size_t offset,
+               size_t size);
+
+  [[nodiscard]] const uint8_t* GetData() const;
+  [[nodiscard]] size_t Size() const { return _size; }
+  [[nodiscard]] bool Empty() const { return _size == 0; }
+
+  // A datagram of just these bytes, sharing them rather than copying.
+  [[nodiscard]] std::shared_ptr<Datagram> ToDatagram() const;
+  [[nodiscard]] std::vector<uint8_t> GetBytes() const;
+
+ private:
+  friend class Datagram;
+
+  std::shared_ptr<const Datagram> _dg;
+  size_t _offset = 0;
+  size_t _size = 0;
+};
+
 /**
  * An ordered list of data elements, formatted in memory for transmission over
  * a socket or writing to a data file.
@@ -39,8 +77,17 @@ class DatagramOverflow final : public std::runtime_error {
  *
  * A Datagram is itself headerless; it is simply a collection of data
  * elements.
+ *
+ * The first kMinDgSize bytes are stored inline, so most datagrams never
+ * allocate a separate buffer; bigger ones grow through DatagramPool size
+ * classes, doubling each time.
  */
 class Datagram {
+  // Lets View construct through std::allocate_shared.
+  struct BorrowTag {
+    explicit BorrowTag() = default;
+  };
+
  public:
   Datagram();
   Datagram(const uint8_t* data, const size_t& size);
@@ -48,9 +95,38 @@ class Datagram {
            const uint16_t& msgType);
   Datagram(const std::unordered_set<uint64_t>& toChannels,
            const uint64_t& fromChannel, const uint16_t& msgType);
+  Datagram(BorrowTag, const uint8_t* data, size_t size);
+  Datagram(BorrowTag, const DatagramView& view);
   ~Datagram();
 
+  Datagram(const Datagram&) = delete;
+  Datagram& operator=(const Datagram&) = delete;
+
+  // Constructs a shared datagram in a single pooled allocation (object,
+  // inline buffer and reference count together). Use this over
+  // std::make_shared.
+  template <typename... Args>
+  static std::shared_ptr<Datagram> Create(Args&&... args) {
+    return std::allocate_shared<Datagram>(DatagramPool::Allocator<Datagram>(),
+                                          std::forward<Args>(args)...);
+  }
+
+  // Wraps `size` bytes at `data` without copying them. The caller must keep
+  // the bytes alive and unchanged until the view is destroyed or has been
+  // made to Own() them. Adding to a view copies it first.
+  static std::shared_ptr<Datagram> View(const uint8_t* data, size_t size);
+  // A datagram reading the bytes of `view` in place, holding its parent
+  // datagram. Like View, it's copied before anything is added to it.
+  static std::shared_ptr<Datagram> Slice(const DatagramView& view);
+
+  // Copies a borrowed buffer into one this datagram owns. No-op otherwise.
+  void Own();
+  [[nodiscard]] bool IsBorrowed() const { return _borrowed; }
+
   void Clear();
+  // Makes room for `length` bytes in total, so a datagram whose final size
+  // is known up front is never copied while it's built.
+  void Reserve(size_t length);
 
   [[nodiscard]] uint16_t Size() const;
   [[nodiscard]] const uint8_t* GetData() const;
@@ -78,16 +154,29 @@ class Datagram {
 
   void AddData(const std::vector<uint8_t>& v);
   void AddData(const std::shared_ptr<Datagram>& v);
+  // Shares the view's bytes instead of copying them if this datagram is
+  // still empty.
+  void AddData(const DatagramView& v);
   void AddData(const uint8_t* data, const uint32_t& length);
 
   void AddLocation(const uint32_t& parentId, const uint32_t& zoneId);
 
  private:
   void EnsureLength(const size_t& length);
+  // Becomes a borrowed slice of `view`'s bytes.
+  void Adopt(const DatagramView& view);
+  // Frees _buf, if it's a pooled buffer of our own.
+  void ReleaseBuffer();
 
   uint8_t* _buf;
   size_t _bufOffset;
   size_t _bufLength;
+  // True while our bytes are someone else's: those at _buf, or at
+  // _parentOffset in _parent if that's set.
+  bool _borrowed = false;
+  std::shared_ptr<const Datagram> _parent;
+  size_t _parentOffset = 0;
+  uint8_t _inline[kMinDgSize];
 };
 
 }  // namespace Ardos
@@ -0,0 +1,125 @@
+#include "datagram_builder.h"
+
+#include <format>
+
+namespace Ardos {
+
+DatagramBuilder::DatagramBuilder() = default;
+
+DatagramBuilder::DatagramBuilder(const uint64_t& toChannel,
+                                 const uint64_t& fromChannel,
+                                 const uint16_t& msgType)
+    : _inline(toChannel, fromChannel, msgType) {
+  ExtendInline();
+}
+
+DatagramBuilder::DatagramBuilder(const std::unordered_set<uint64_t>& toChannels,
+                                 const uint64_t& fromChannel,
+                                 const uint16_t& msgType)
+    : _inline(toChannels, fromChannel, msgType) {
+  ExtendInline();
+}
+
+void DatagramBuilder::AddUint8(const uint8_t& v) {
+  _inline.AddUint8(v);
+  ExtendInline();
+}
+
+void DatagramBuilder::AddUint16(const uint16_t& v) {
+  _inline.AddUint16(v);
+  ExtendInline();
+}
+
+void DatagramBuilder::AddUint32(const uint32_t& v) {
+  _inline.AddUint32(v);
+  ExtendInline();
+}
+
+void DatagramBuilder::AddUint64(const uint64_t& v) {
+  _inline.AddUint64(v);
+  ExtendInline();
+}
+
+void DatagramBuilder::AddLocation(const uint32_t& parentId,
+                                  const uint32_t& zoneId) {
+  _inline.AddLocation(parentId, zoneId);
+  ExtendInline();
+}
+
+/**
+ * Appends a reference to the contents of `v`.
+ * @param v
+ */
+void DatagramBuilder::AddData(const std::vector<uint8_t>& v) {
+  AddData(v.data(), v.size());
+}
+
+/**
+ * Appends a reference to the bytes of `v`. The view itself doesn't have to
+ * outlive the builder, but the datagram it looks into does.
+ * @param v
+ */
+void DatagramBuilder::AddData(const DatagramView& v) {
+  AddData(v.GetData(), v.Size());
+}
+
+/**
+ * Appends a reference to `length` bytes at `data`.
+ * @param data
+ * @param length
+ */
+void DatagramBuilder::AddData(const uint8_t* data, const size_t& length) {
+  if (!length) {
+    return;
+  }
+
+  // Fail here, like Datagram's Add methods would, rather than in Finish().
+  if (_size + length > kMaxDgSize) {
+    throw DatagramOverflow(std::format("Datagram exceeded max size! {} => {}",
+                                       _size, _size + length));
+  }
+
+  _segments.push_back({.data = data, .length = length});
+  _size += length;
+}
+
+/**
+ * Lays the segments out, in order, in a datagram allocated at its final
+ * size.
+ * @return
+ */
+std::shared_ptr<Datagram> DatagramBuilder::Finish() const {
+  auto dg = Datagram::Create();
+  dg->Reserve(_size);
+
+  const uint8_t* inlineData = _inline.GetData();
+  for (const auto& segment : _segments) {
+    if (segment.data) {
+      dg->AddData(segment.data, segment.length);
+    } else {
+      dg->AddData(inlineData, segment.length);
+      inlineData += segment.length;
+    }
+  }
+
+  return dg;
+}
+
+void DatagramBuilder::ExtendInline() {
+  const size_t added = _inline.Size() - _inlineSeen;
+  _inlineSeen = _inline.Size();
+
+  // Back-to-back values share a segment.
+  if (_segments.empty() || _segments.back().data) {
+    _segments.push_back({.data = nullptr, .length = 0});
+  }
+  _segments.back().length += added;
+  _size += added;
+
+  if (_size > kMaxDgSize) {
+    throw DatagramOverflow(std::format("Datagram exceeded max size! {} => {}",
+                                       _size - added, _size));
+  }
+}
+
+}  // namespace Ardos
@@ -0,0 +1,72 @@
+#ifndef ARDOS_DATAGRAM_BUILDER_H
+#define ARDOS_DATAGRAM_BUILDER_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "datagram.h"
+
+namespace Ardos {
+
+/**
+ * Composes a datagram out of small values written as they're added (the
+ * header, ids, counts) and larger payloads that are only referenced where
+ * they already live, such as stored field values or views into a received
+ * datagram.
+ *
+ * Nothing is laid out until Finish(), which allocates the datagram at its
+ * final size and copies each segment into it once. A large generate is
+ * therefore never regrown or staged through an intermediate buffer on its
+ * way to PublishDatagram.
+ *
+ * Referenced bytes must stay alive and unchanged until Finish() returns.
+ * A message with a single payload after its header is cheaper built as a
+ * reserved Datagram directly; the segment list only pays off with several.
+ */
+class DatagramBuilder {
+ public:
+  DatagramBuilder();
+  DatagramBuilder(const uint64_t& toChannel, const uint64_t& fromChannel,
+                  const uint16_t& msgType);
+  DatagramBuilder(const std::unordered_set<uint64_t>& toChannels,
+                  const uint64_t& fromChannel, const uint16_t& msgType);
+
+  DatagramBuilder(const DatagramBuilder&) = delete;
+  DatagramBuilder& operator=(const DatagramBuilder&) = delete;
+
+  void AddUint8(const uint8_t& v);
+  void AddUint16(const uint16_t& v);
+  void AddUint32(const uint32_t& v);
+  void AddUint64(const uint64_t& v);
+  void AddLocation(const uint32_t& parentId, const uint32_t& zoneId);
+
+  // Reference, rather than copy, the bytes to append.
+  void AddData(const std::vector<uint8_t>& v);
+  void AddData(const DatagramView& v);
+  void AddData(const uint8_t* data, const size_t& length);
+
+  [[nodiscard]] size_t Size() const { return _size; }
+
+  [[nodiscard]] std::shared_ptr<Datagram> Finish() const;
+
+ private:
+  struct Segment {
+    // Null for a run of _inline.
+    const uint8_t* data;
+    size_t length;
+  };
+
+  // Accounts for whatever was just written to _inline.
+  void ExtendInline();
+
+  Datagram _inline;
+  size_t _inlineSeen = 0;
+  std::vector<Segment> _segments;
+  size_t _size = 0;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_DATAGRAM_BUILDER_H
@@ -178,15 +178,33 @@ std::vector<uint8_t> DatagramIterator::GetData(const size_t& size) {
 }
 
 /**
- * Reads a blob of binary data from the datagram and returns a new datagram.
+ * Reads a blob of data from the datagram without copying it.
  * @return
  */
-std::shared_ptr<Datagram> DatagramIterator::GetDatagram() {
+DatagramView DatagramIterator::GetBlobView() {
   const uint16_t length = GetUint16();
-  EnsureLength(length);
-  auto dg = std::make_shared<Datagram>(_dg->GetData() + _offset, length);
-  _offset += length;
-  return dg;
+  return GetDataView(length);
+}
+
+/**
+ * Reads a size-specified blob of data from the datagram without copying it.
+ * @param size
+ * @return
+ */
+DatagramView DatagramIterator::GetDataView(const size_t& size) {
+  EnsureLength(size);
+  DatagramView view(_dg, _offset, size);
+  _offset += size;
+  return view;
+}
+
+/**
+ * Reads a blob of binary data from the datagram and returns it as a
+ * datagram sharing our buffer.
+ * @return
+ */
+std::shared_ptr<Datagram> DatagramIterator::GetDatagram() {
+  return GetBlobView().ToDatagram();
 }
 
 /**
@@ -204,11 +222,31 @@ std::shared_ptr<Datagram> DatagramIterator::GetUnderlyingDatagram() {
  */
 void DatagramIterator::UnpackField(const DCPackerInterface* field,
                                    std::vector<uint8_t>& buffer) {
+  // Fields are kept packed exactly as they arrived, length tags and all, so
+  // a planned field is unpacked by skipping it and copying what it covered.
+  if (const FieldPlan* plan = FieldPlan::For(field)) {
+    const size_t start = _offset;
+    SkipPlan(*plan);
+    buffer.insert(buffer.end(), _dg->GetData() + start,
+                  _dg->GetData() + _offset);
+    return;
+  }
+
+  WalkUnpackField(field, buffer);
+}
+
+/**
+ * Unpacks a field by walking its type tree, for fields without a plan.
+ * @param field
+ * @param buffer
+ */
+void DatagramIterator::WalkUnpackField(const DCPackerInterface* field,
+                                       std::vector<uint8_t>& buffer) {
   // If the field has a fixed size in bytes (int, uint, float, etc.)
   // we can unpack data directly using that size.
   if (field->has_fixed_byte_size()) {
-    std::vector<uint8_t> data = GetData(field->get_fixed_byte_size());
-    buffer.insert(buffer.end(), data.begin(), data.end());
+    const DatagramView data = GetDataView(field->get_fixed_byte_size());
+    buffer.insert(buffer.end(), data.GetData(), data.GetData() + data.Size());
     return;
   }
 
@@ -241,15 +279,15 @@ void DatagramIterator::UnpackField(const DCPackerInterface* field,
     }
 
     // Unpack field data into the buffer.
-    std::vector<uint8_t> data = GetData(length);
-    buffer.insert(buffer.end(), data.begin(), data.end());
+    const DatagramView data = GetDataView(length);
+    buffer.insert(buffer.end(), data.GetData(), data.GetData() + data.Size());
     return;
   }
 
   // Otherwise, if the field is non-atomic, process each nested field.
   const int numNested = field->get_num_nested_fields();
   for (int i = 0; i < numNested; ++i) {
-    UnpackField(field->get_nested_field(i), buffer);
+    WalkUnpackField(field->get_nested_field(i), buffer);
   }
 }
 
@@ -298,6 +336,53 @@ void DatagramIterator::SeekPayload() {
  * @param field
  */
 void DatagramIterator::SkipField(const DCPackerInterface* field) {
+  if (const FieldPlan* plan = FieldPlan::For(field)) {
+    SkipPlan(*plan);
+    return;
+  }
+
+  WalkSkipField(field);
+}
+
+/**
+ * Skips over a field laid out by `plan`: one bounds check per fixed run
+ * (and its segment's length tag), and one per segment.
+ * @param plan
+ */
+void DatagramIterator::SkipPlan(const FieldPlan& plan) {
+  for (const auto& step : plan.GetSteps()) {
+    EnsureLength(step.fixed + step.lengthBytes);
+    _offset += step.fixed;
+
+    size_t length;
+    switch (step.lengthBytes) {
+      case 0:
+        continue;
+      case 2: {
+        uint16_t lengthTag;
+        std::memcpy(&lengthTag, _dg->GetData() + _offset, sizeof(lengthTag));
+        length = lengthTag;
+        break;
+      }
+      default: {
+        uint32_t lengthTag;
+        std::memcpy(&lengthTag, _dg->GetData() + _offset, sizeof(lengthTag));
+        length = lengthTag;
+        break;
+      }
+    }
+
+    _offset += step.lengthBytes;
+    EnsureLength(length);
+    _offset += length;
+  }
+}
+
+/**
+ * Skips a field by walking its type tree, for fields without a plan.
+ * @param field
+ */
+void DatagramIterator::WalkSkipField(const DCPackerInterface* field) {
   // If the field has a fixed size in bytes (int, uint, float, etc.)
   // we can use that as our offset.
   if (field->has_fixed_byte_size()) {
@@ -334,7 +419,7 @@ void DatagramIterator::SkipField(const DCPackerInterface* field) {
   // Otherwise, if the field is non-atomic, skip each nested field.
   const int numNested = field->get_num_nested_fields();
   for (int i = 0; i < numNested; ++i) {
-    SkipField(field->get_nested_field(i));
+    WalkSkipField(field->get_nested_field(i));
   }
 }
 
@@ -357,6 +442,14 @@ std::vector<uint8_t> DatagramIterator::GetRemainingBytes() {
   return data;
 }
 
+/**
+ * Returns the remaining bytes to be read, without copying them.
+ * @return
+ */
+DatagramView DatagramIterator::GetRemainingView() {
+  return GetDataView(GetRemainingSize());
+}
+
 void DatagramIterator::EnsureLength(const size_t& length) const {
   // Make sure we don't overflow reading.
   if (_offset > _dg->Size() || length > (_dg->Size() - _offset)) {
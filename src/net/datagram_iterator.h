@@ -7,6 +7,7 @@
 #include <stdexcept>
 
 #include "datagram.h"
+#include "field_plan.h"
 
 namespace Ardos {
 
@@ -52,9 +53,14 @@ class DatagramIterator {
   std::string GetString();
   std::vector<uint8_t> GetBlob();
   std::vector<uint8_t> GetData(const size_t& size);
+  // Zero-copy versions of the above: views share the datagram's buffer.
+  DatagramView GetBlobView();
+  DatagramView GetDataView(const size_t& size);
+  // A length-prefixed blob as a datagram of its own, sharing our buffer.
   std::shared_ptr<Datagram> GetDatagram();
   std::shared_ptr<Datagram> GetUnderlyingDatagram();
 
+  // Planned fields (see FieldPlan) are read without walking their types.
   void UnpackField(const DCPackerInterface* field,
                    std::vector<uint8_t>& buffer);
 
@@ -67,8 +73,13 @@ class DatagramIterator {
 
   [[nodiscard]] size_t GetRemainingSize() const;
   std::vector<uint8_t> GetRemainingBytes();
+  DatagramView GetRemainingView();
 
  private:
+  void WalkUnpackField(const DCPackerInterface* field,
+                       std::vector<uint8_t>& buffer);
+  void WalkSkipField(const DCPackerInterface* field);
+  void SkipPlan(const FieldPlan& plan);
   void EnsureLength(const size_t& length) const;
 
   std::shared_ptr<Datagram> _dg;
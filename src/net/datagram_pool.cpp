@@ -0,0 +1,232 @@
+#include "datagram_pool.h"
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../util/metrics.h"
+
+namespace Ardos {
+
+namespace {
+
+// One thread's share of a size class's numbers. Only that thread writes
+// them (a relaxed load and store, never a read-modify-write, so the hot
+// path doesn't bounce cache lines between cores); the collector adds up
+// every thread's. A buffer released on another thread than the one that
+// allocated it leaves one thread's `live` high and the other's negative,
+// which cancels out in the sum.
+struct ClassStats {
+  // Buffers handed out and not yet released.
+  std::atomic<int64_t> live{0};
+  // Buffers sitting in this thread's free list.
+  std::atomic<int64_t> cached{0};
+  // Allocations served from a free list, and from the heap.
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
+
+using ThreadStats = std::array<ClassStats, DatagramPool::kClassCount>;
+
+// Every thread's stats. Kept after the thread exits, so the totals still
+// add up.
+struct StatsRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadStats>> threads;
+};
+
+StatsRegistry& Registry() {
+  // Never destroyed: threads may still release buffers during exit.
+  static auto* registry = new StatsRegistry();
+  return *registry;
+}
+
+ThreadStats& LocalStats() {
+  thread_local ThreadStats* local = [] {
+    auto& registry = Registry();
+    std::lock_guard lock(registry.mutex);
+    return registry.threads.emplace_back(std::make_unique<ThreadStats>())
+        .get();
+  }();
+  return *local;
+}
+
+template <typename T>
+void Bump(std::atomic<T>& counter, T delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
+
+size_t ClassIndex(size_t capacity) {
+  return std::countr_zero(capacity) - DatagramPool::kMinClassShift;
+}
+
+// Set once this thread's cache has been torn down, so buffers released by
+// later thread_local/static destructors go straight back to the heap.
+thread_local bool cacheGone = false;
+
+struct ThreadCache {
+  std::array<std::vector<uint8_t*>, DatagramPool::kClassCount> free;
+
+  ~ThreadCache() {
+    ThreadStats& stats = LocalStats();
+    for (size_t i = 0; i < free.size(); ++i) {
+      for (uint8_t* buf : free[i]) {
+        ::operator delete(buf);
+      }
+      Bump(stats[i].cached, -static_cast<int64_t>(free[i].size()));
+    }
+    cacheGone = true;
+  }
+};
+
+thread_local ThreadCache cache;
+
+class PoolMetrics final : public prometheus::Collectable {
+ public:
+  [[nodiscard]] std::vector<prometheus::MetricFamily> Collect()
+      const override {
+    prometheus::MetricFamily buffers{
+        .name = "datagram_pool_buffers",
+        .help = "Pooled datagram buffers, by size class and state",
+        .type = prometheus::MetricType::Gauge};
+    prometheus::MetricFamily allocations{
+        .name = "datagram_pool_allocations_total",
+        .help = "Datagram buffer allocations, by size class and whether a "
+                "cached buffer was reused",
+        .type = prometheus::MetricType::Counter};
+
+    struct Totals {
+      int64_t live = 0;
+      int64_t cached = 0;
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+    };
+    std::array<Totals, DatagramPool::kClassCount> totals{};
+    {
+      auto& registry = Registry();
+      std::lock_guard lock(registry.mutex);
+      for (const auto& thread : registry.threads) {
+        for (size_t i = 0; i < totals.size(); ++i) {
+          const ClassStats& stats = (*thread)[i];
+          totals[i].live += stats.live.load(std::memory_order_relaxed);
+          totals[i].cached += stats.cached.load(std::memory_order_relaxed);
+          totals[i].hits += stats.hits.load(std::memory_order_relaxed);
+          totals[i].misses += stats.misses.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < totals.size(); ++i) {
+      const std::string size =
+          std::to_string(size_t{1} << (DatagramPool::kMinClassShift + i));
+
+      prometheus::ClientMetric metric;
+      metric.label = {{.name = "class", .value = size},
+                      {.name = "state", .value = "live"}};
+      metric.gauge.value = (double)totals[i].live;
+      buffers.metric.push_back(metric);
+
+      metric.label[1].value = "cached";
+      metric.gauge.value = (double)totals[i].cached;
+      buffers.metric.push_back(metric);
+
+      prometheus::ClientMetric counter;
+      counter.label = {{.name = "class", .value = size},
+                       {.name = "reused", .value = "true"}};
+      counter.counter.value = (double)totals[i].hits;
+      allocations.metric.push_back(counter);
+
+      counter.label[1].value = "false";
+      counter.counter.value = (double)totals[i].misses;
+      allocations.metric.push_back(counter);
+    }
+
+    return {buffers, allocations};
+  }
+};
+
+}  // namespace
+
+/**
+ * Takes a buffer for `size` bytes, from this thread's free list for its
+ * class if there is one.
+ * @param size
+ * @return
+ */
+uint8_t* DatagramPool::Allocate(size_t size) {
+  const size_t capacity = CapacityFor(size);
+  if (capacity > kMaxClassSize) {
+    return static_cast<uint8_t*>(::operator new(capacity));
+  }
+
+  const size_t index = ClassIndex(capacity);
+  ClassStats& classStats = LocalStats()[index];
+  Bump(classStats.live, int64_t{1});
+
+  if (!cacheGone) {
+    auto& freeList = cache.free[index];
+    if (!freeList.empty()) {
+      uint8_t* buf = freeList.back();
+      freeList.pop_back();
+      Bump(classStats.cached, int64_t{-1});
+      Bump(classStats.hits, uint64_t{1});
+      return buf;
+    }
+  }
+
+  Bump(classStats.misses, uint64_t{1});
+  return static_cast<uint8_t*>(::operator new(capacity));
+}
+
+/**
+ * Returns a buffer to this thread's free list for its class, or to the heap
+ * if the list is full.
+ * @param buf
+ * @param size
+ */
+void DatagramPool::Release(uint8_t* buf, size_t size) {
+  const size_t capacity = CapacityFor(size);
+  if (capacity > kMaxClassSize) {
+    ::operator delete(buf);
+    return;
+  }
+
+  const size_t index = ClassIndex(capacity);
+  ClassStats& classStats = LocalStats()[index];
+  Bump(classStats.live, int64_t{-1});
+
+  if (!cacheGone) {
+    auto& freeList = cache.free[index];
+    if (freeList.size() < kCacheBytesPerClass / capacity) {
+      freeList.push_back(buf);
+      Bump(classStats.cached, int64_t{1});
+      return;
+    }
+  }
+
+  ::operator delete(buf);
+}
+
+/**
+ * Exposes the pool's occupancy, if metrics are enabled.
+ */
+void DatagramPool::InitMetrics() {
+  if (!Metrics::Instance()->WantMetrics()) {
+    return;
+  }
+
+  // The exposer only holds a weak reference.
+  static auto collectable = std::make_shared<PoolMetrics>();
+  Metrics::Instance()->RegisterCollectable(collectable);
+}
+
+}  // namespace Ardos
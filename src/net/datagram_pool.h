@@ -0,0 +1,74 @@
+#ifndef ARDOS_DATAGRAM_POOL_H
+#define ARDOS_DATAGRAM_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Ardos {
+
+// Recycles datagram buffers (and the Datagram objects themselves, see
+// Datagram::Create) by power-of-two size class, from 128 bytes up to the
+// 64 KiB class that holds kMaxDgSize.
+//
+// Each thread keeps its own free lists, so taking and returning a buffer
+// never locks or touches another thread's memory. A buffer freed on a
+// different thread than the one that allocated it (e.g. a datagram decoded
+// on a worker loop and released on the main loop) simply joins the freeing
+// thread's lists. Each list holds at most kCacheBytesPerClass bytes; past
+// that, buffers go back to the heap.
+//
+// Occupancy (buffers in use and cached, by class) and hit rates are
+// exported through metrics once InitMetrics has run.
+class DatagramPool {
+ public:
+  static constexpr size_t kMinClassShift = 7;
+  static constexpr size_t kClassCount = 10;
+  static constexpr size_t kMaxClassSize =
+      size_t{1} << (kMinClassShift + kClassCount - 1);
+  static constexpr size_t kCacheBytesPerClass = 256 * 1024;
+
+  // Returns a buffer of CapacityFor(size) bytes.
+  static uint8_t* Allocate(size_t size);
+  // Returns a buffer from Allocate. `size` only needs to have the same
+  // CapacityFor as the one it was allocated with.
+  static void Release(uint8_t* buf, size_t size);
+
+  // The size class `size` rounds up to. Sizes past the largest class
+  // aren't pooled and are allocated exactly.
+  static constexpr size_t CapacityFor(size_t size) {
+    size_t capacity = size_t{1} << kMinClassShift;
+    while (capacity < size && capacity < kMaxClassSize) {
+      capacity <<= 1;
+    }
+    return capacity < size ? size : capacity;
+  }
+
+  // Main thread, once metrics are up.
+  static void InitMetrics();
+
+  // Standard allocator over the pool, for std::allocate_shared.
+  template <typename T>
+  struct Allocator {
+    using value_type = T;
+
+    Allocator() = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) {}  // NOLINT(google-explicit-constructor)
+
+    T* allocate(size_t n) {
+      return reinterpret_cast<T*>(Allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+      Release(reinterpret_cast<uint8_t*>(p), n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const Allocator<U>&) const {
+      return true;
+    }
+  };
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_DATAGRAM_POOL_H
@@ -0,0 +1,126 @@
+#include "field_plan.h"
+
+#include <dcField.h>
+#include <spdlog/spdlog.h>
+
+#include "../util/globals.h"
+
+namespace Ardos {
+
+namespace {
+
+// Past this, a field (say, a big fixed array of strings) is cheaper to walk
+// than to keep a plan for.
+constexpr size_t kMaxSteps = 256;
+
+// Indexed by DC field number.
+std::vector<FieldPlan> plans;
+
+}  // namespace
+
+/**
+ * Plans every numbered field in the loaded DC files.
+ */
+void FieldPlan::CompileAll() {
+  plans.clear();
+
+  size_t walked = 0;
+  for (int i = 0;; ++i) {
+    DCField* field = g_dc_file->get_field_by_index(i);
+    if (!field) {
+      break;
+    }
+
+    FieldPlan plan;
+    if (plan.Compile(field)) {
+      plan._field = field;
+    } else {
+      plan._steps.clear();
+      ++walked;
+    }
+    plans.push_back(std::move(plan));
+  }
+
+  spdlog::debug("Compiled layouts for {} DC fields ({} walked)",
+                plans.size() - walked, walked);
+}
+
+/**
+ * Returns the plan for `field`, if it has one.
+ * @param field
+ * @return
+ */
+const FieldPlan* FieldPlan::For(const DCPackerInterface* field) {
+  const DCField* dcField = field->as_field();
+  if (!dcField) {
+    return nullptr;
+  }
+
+  const int number = dcField->get_number();
+  if (number < 0 || (size_t)number >= plans.size()) {
+    return nullptr;
+  }
+
+  // Parameters nested in a struct are fields too, but aren't numbered in
+  // the file; make sure this is the field the number belongs to.
+  const FieldPlan& plan = plans[number];
+  return plan._field == field ? &plan : nullptr;
+}
+
+/**
+ * Appends the layout of `field` to this plan, the same way
+ * DatagramIterator would walk it.
+ * @param field
+ * @return False if the layout can't be planned.
+ */
+bool FieldPlan::Compile(const DCPackerInterface* field) {
+  if (field->has_fixed_byte_size()) {
+    AddFixed(field->get_fixed_byte_size());
+    return true;
+  }
+
+  const size_t lengthBytes = field->get_num_length_bytes();
+  if (lengthBytes) {
+    if (lengthBytes != 2 && lengthBytes != 4) {
+      return false;
+    }
+    AddSegment(lengthBytes);
+    return _steps.size() <= kMaxSteps;
+  }
+
+  // A switch's layout depends on its key, and a variable nested field count
+  // on the data.
+  const int numNested = field->get_num_nested_fields();
+  if (field->as_switch_parameter() || numNested < 0) {
+    return false;
+  }
+
+  for (int i = 0; i < numNested; ++i) {
+    if (!Compile(field->get_nested_field(i))) {
+      return false;
+    }
+  }
+
+  return _steps.size() <= kMaxSteps;
+}
+
+void FieldPlan::AddFixed(const size_t& size) {
+  if (!size) {
+    return;
+  }
+
+  // Extends the run we're in, unless it already ended in a segment.
+  if (_steps.empty() || _steps.back().lengthBytes) {
+    _steps.push_back({.fixed = 0, .lengthBytes = 0});
+  }
+  _steps.back().fixed += size;
+}
+
+void FieldPlan::AddSegment(const uint8_t& lengthBytes) {
+  if (_steps.empty() || _steps.back().lengthBytes) {
+    _steps.push_back({.fixed = 0, .lengthBytes = 0});
+  }
+  _steps.back().lengthBytes = lengthBytes;
+}
+
+}  // namespace Ardos
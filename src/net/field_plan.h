@@ -0,0 +1,55 @@
+#ifndef ARDOS_FIELD_PLAN_H
+#define ARDOS_FIELD_PLAN_H
+
+#include <dcPackerInterface.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Ardos {
+
+/**
+ * The wire layout of a DC field, flattened once at DC load so that
+ * DatagramIterator can skip or unpack it with a short loop instead of
+ * walking the field's type tree on every call.
+ *
+ * A plan is a list of steps. Each step is a run of fixed-size bytes (every
+ * adjacent int, float, fixed array etc. merged together), optionally
+ * followed by a length-prefixed segment (a string, blob or variable
+ * array), so reading one costs a single bounds check plus one for the
+ * segment.
+ *
+ * Fields whose layout depends on the data itself (switches, or anything
+ * whose plan would be unreasonably long) get no plan and are walked as
+ * before.
+ */
+class FieldPlan {
+ public:
+  struct Step {
+    uint32_t fixed;
+    // Size of the segment's length tag: 0 (no segment), 2 or 4.
+    uint8_t lengthBytes;
+  };
+
+  // Plans every field in g_dc_file. Main thread, once the DC files have
+  // been read and before anything starts reading datagrams; plans are
+  // read-only (and safe to share between threads) from then on.
+  static void CompileAll();
+
+  // The plan for `field`, or nullptr if it has to be walked.
+  static const FieldPlan* For(const DCPackerInterface* field);
+
+  [[nodiscard]] const std::vector<Step>& GetSteps() const { return _steps; }
+
+ private:
+  bool Compile(const DCPackerInterface* field);
+  void AddFixed(const size_t& size);
+  void AddSegment(const uint8_t& lengthBytes);
+
+  const DCPackerInterface* _field = nullptr;
+  std::vector<Step> _steps;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_FIELD_PLAN_H
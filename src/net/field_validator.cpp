@@ -0,0 +1,489 @@
+#include "field_validator.h"
+
+#include <dcArrayParameter.h>
+#include <dcAtomicField.h>
+#include <dcSimpleParameter.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../util/globals.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ARDOS_VALIDATOR_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Ardos {
+
+namespace {
+
+// Indexed by DC field number.
+std::vector<FieldValidator> validators;
+
+template <typename T>
+T Load(const uint8_t* data) {
+  T v;
+  std::memcpy(&v, data, sizeof(T));
+  return v;
+}
+
+template <typename T>
+void ScalarMinMax(const uint8_t* data, size_t count, T& min, T& max) {
+  for (size_t i = 0; i < count; ++i) {
+    const T v = Load<T>(data + i * sizeof(T));
+    min = std::min(min, v);
+    max = std::max(max, v);
+  }
+}
+
+#ifdef ARDOS_VALIDATOR_SIMD
+
+enum class Simd { kNone, kSse41, kAvx2 };
+
+Simd DetectSimd() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return Simd::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return Simd::kSse41;
+  }
+  return Simd::kNone;
+}
+
+const Simd simd = DetectSimd();
+
+// Lane-wise min/max for each integer type, in 256-bit (AVX2) and 128-bit
+// (SSE4.1) registers.
+template <typename T>
+struct Lanes;
+
+#define ARDOS_DEFINE_LANES(T, suffix)                                  \
+  template <>                                                          \
+  struct Lanes<T> {                                                    \
+    [[gnu::target("avx2")]] static __m256i Min(__m256i a, __m256i b) { \
+      return _mm256_min_##suffix(a, b);                                \
+    }                                                                  \
+    [[gnu::target("avx2")]] static __m256i Max(__m256i a, __m256i b) { \
+      return _mm256_max_##suffix(a, b);                                \
+    }                                                                  \
+    [[gnu::target("sse4.1")]] static __m128i Min(__m128i a,            \
+                                                 __m128i b) {          \
+      return _mm_min_##suffix(a, b);                                   \
+    }                                                                  \
+    [[gnu::target("sse4.1")]] static __m128i Max(__m128i a,            \
+                                                 __m128i b) {          \
+      return _mm_max_##suffix(a, b);                                   \
+    }                                                                  \
+  };
+
+ARDOS_DEFINE_LANES(int8_t, epi8)
+ARDOS_DEFINE_LANES(uint8_t, epu8)
+ARDOS_DEFINE_LANES(int16_t, epi16)
+ARDOS_DEFINE_LANES(uint16_t, epu16)
+ARDOS_DEFINE_LANES(int32_t, epi32)
+ARDOS_DEFINE_LANES(uint32_t, epu32)
+
+#undef ARDOS_DEFINE_LANES
+
+// Folds whole vectors of values into min/max, and returns how many values
+// that covered; the caller finishes the tail.
+template <typename T>
+[[gnu::target("avx2")]] size_t VectorMinMaxAvx2(const uint8_t* data,
+                                                size_t count, T& min,
+                                                T& max) {
+  constexpr size_t kPerVector = sizeof(__m256i) / sizeof(T);
+  const size_t vectors = count / kPerVector;
+  if (!vectors) {
+    return 0;
+  }
+
+  const auto* in = reinterpret_cast<const __m256i*>(data);
+  __m256i lo = _mm256_loadu_si256(in);
+  __m256i hi = lo;
+  for (size_t i = 1; i < vectors; ++i) {
+    const __m256i v = _mm256_loadu_si256(in + i);
+    lo = Lanes<T>::Min(lo, v);
+    hi = Lanes<T>::Max(hi, v);
+  }
+
+  T lanes[kPerVector];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), lo);
+  min = std::min(min, *std::min_element(lanes, lanes + kPerVector));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), hi);
+  max = std::max(max, *std::max_element(lanes, lanes + kPerVector));
+
+  return vectors * kPerVector;
+}
+
+template <typename T>
+[[gnu::target("sse4.1")]] size_t VectorMinMaxSse41(const uint8_t* data,
+                                                   size_t count, T& min,
+                                                   T& max) {
+  constexpr size_t kPerVector = sizeof(__m128i) / sizeof(T);
+  const size_t vectors = count / kPerVector;
+  if (!vectors) {
+    return 0;
+  }
+
+  const auto* in = reinterpret_cast<const __m128i*>(data);
+  __m128i lo = _mm_loadu_si128(in);
+  __m128i hi = lo;
+  for (size_t i = 1; i < vectors; ++i) {
+    const __m128i v = _mm_loadu_si128(in + i);
+    lo = Lanes<T>::Min(lo, v);
+    hi = Lanes<T>::Max(hi, v);
+  }
+
+  T lanes[kPerVector];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), lo);
+  min = std::min(min, *std::min_element(lanes, lanes + kPerVector));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), hi);
+  max = std::max(max, *std::max_element(lanes, lanes + kPerVector));
+
+  return vectors * kPerVector;
+}
+
+#endif  // ARDOS_VALIDATOR_SIMD
+
+// The smallest and largest of `count` (at least one) packed values.
+template <typename T>
+void MinMax(const uint8_t* data, size_t count, T& min, T& max) {
+  min = max = Load<T>(data);
+
+  size_t done = 0;
+#ifdef ARDOS_VALIDATOR_SIMD
+  // There are no 64-bit min/max instructions short of AVX-512.
+  if constexpr (sizeof(T) < sizeof(uint64_t)) {
+    if (simd == Simd::kAvx2) {
+      done = VectorMinMaxAvx2<T>(data, count, min, max);
+    } else if (simd == Simd::kSse41) {
+      done = VectorMinMaxSse41<T>(data, count, min, max);
+    }
+  }
+#endif
+
+  ScalarMinMax<T>(data + done * sizeof(T), count - done, min, max);
+}
+
+template <typename W>
+bool InRanges(const std::vector<std::pair<W, W>>& ranges, const W& v) {
+  if (ranges.empty()) {
+    return true;
+  }
+  return std::any_of(ranges.begin(), ranges.end(), [&v](const auto& range) {
+    return v >= range.first && v <= range.second;
+  });
+}
+
+// Checks `count` packed values of type T against ranges over their widened
+// type W.
+template <typename T, typename W>
+bool CheckValues(const uint8_t* data, const size_t& count,
+                 const std::vector<std::pair<W, W>>& ranges) {
+  if (ranges.empty() || !count) {
+    return true;
+  }
+
+  // One range (the usual case) only needs the extremes.
+  if (ranges.size() == 1) {
+    T min, max;
+    MinMax<T>(data, count, min, max);
+    return (W)min >= ranges[0].first && (W)max <= ranges[0].second;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (!InRanges<W>(ranges, (W)Load<T>(data + i * sizeof(T)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckSigned(const uint8_t* data, const size_t& count,
+                 const uint8_t& width,
+                 const std::vector<std::pair<int64_t, int64_t>>& ranges) {
+  switch (width) {
+    case 1:
+      return CheckValues<int8_t>(data, count, ranges);
+    case 2:
+      return CheckValues<int16_t>(data, count, ranges);
+    case 4:
+      return CheckValues<int32_t>(data, count, ranges);
+    default:
+      return CheckValues<int64_t>(data, count, ranges);
+  }
+}
+
+bool CheckUnsigned(const uint8_t* data, const size_t& count,
+                   const uint8_t& width,
+                   const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+  switch (width) {
+    case 1:
+      return CheckValues<uint8_t>(data, count, ranges);
+    case 2:
+      return CheckValues<uint16_t>(data, count, ranges);
+    case 4:
+      return CheckValues<uint32_t>(data, count, ranges);
+    default:
+      return CheckValues<uint64_t>(data, count, ranges);
+  }
+}
+
+template <typename W, typename N>
+std::vector<std::pair<W, W>> CopyRanges(const DCNumericRange<N>& range) {
+  std::vector<std::pair<W, W>> ranges;
+  for (int i = 0; i < range.get_num_ranges(); ++i) {
+    ranges.emplace_back((W)range.get_min(i), (W)range.get_max(i));
+  }
+  return ranges;
+}
+
+}  // namespace
+
+/**
+ * Compiles validators for every numbered field in the loaded DC files.
+ */
+void FieldValidator::CompileAll() {
+  validators.clear();
+
+  size_t fallback = 0;
+  for (int i = 0;; ++i) {
+    DCField* field = g_dc_file->get_field_by_index(i);
+    if (!field) {
+      break;
+    }
+
+    FieldValidator validator;
+    bool compiled = false;
+    if (const DCAtomicField* atomic = field->as_atomic_field()) {
+      compiled = true;
+      for (int j = 0; compiled && j < atomic->get_num_elements(); ++j) {
+        compiled = validator.Compile(atomic->get_element(j));
+      }
+    } else if (const DCParameter* param = field->as_parameter()) {
+      compiled = validator.Compile(param);
+    }
+
+    if (compiled) {
+      validator._field = field;
+    } else {
+      validator._checks.clear();
+      ++fallback;
+    }
+    validators.push_back(std::move(validator));
+  }
+
+  spdlog::debug("Compiled range validators for {} DC fields ({} use DCPacker)",
+                validators.size() - fallback, fallback);
+}
+
+/**
+ * Returns the validator for `field`, if it has one.
+ * @param field
+ * @return
+ */
+const FieldValidator* FieldValidator::For(const DCField* field) {
+  const int number = field->get_number();
+  if (number < 0 || (size_t)number >= validators.size()) {
+    return nullptr;
+  }
+
+  const FieldValidator& validator = validators[number];
+  return validator._field == field ? &validator : nullptr;
+}
+
+/**
+ * Checks `size` bytes of packed field data against the field's constraints,
+ * and that they hold exactly one value of it.
+ * @param data
+ * @param size
+ * @return
+ */
+bool FieldValidator::Validate(const uint8_t* data, size_t size) const {
+  size_t p = 0;
+  for (const auto& check : _checks) {
+    size_t count = check.count;
+    if (check.lengthBytes) {
+      if (check.lengthBytes > size - p) {
+        return false;
+      }
+      const size_t length = check.lengthBytes == 2 ? Load<uint16_t>(data + p)
+                                                   : Load<uint32_t>(data + p);
+      p += check.lengthBytes;
+
+      // A tagged array has to hold a whole number of elements.
+      if (length % check.width) {
+        return false;
+      }
+      count = length / check.width;
+      if (!InRanges<uint64_t>(check.sizes, count)) {
+        return false;
+      }
+    }
+
+    const size_t bytes = count * check.width;
+    if (bytes > size - p) {
+      return false;
+    }
+
+    if (check.op == Check::Op::kSigned &&
+        !CheckSigned(data + p, count, check.width, check.signedRanges)) {
+      return false;
+    }
+    if (check.op == Check::Op::kUnsigned &&
+        !CheckUnsigned(data + p, count, check.width, check.unsignedRanges)) {
+      return false;
+    }
+
+    p += bytes;
+  }
+
+  return p == size;
+}
+
+/**
+ * Appends the checks for one parameter, mirroring what DCPacker's
+ * unpack_validate would do with it.
+ * @param param
+ * @return False if the parameter can't be compiled.
+ */
+bool FieldValidator::Compile(const DCParameter* param) {
+  // Without constraints, DCPacker only skips over it.
+  if (!param->has_range_limits()) {
+    if (param->has_fixed_byte_size()) {
+      AddSkip(param->get_fixed_byte_size());
+      return true;
+    }
+
+    const size_t lengthBytes = param->get_num_length_bytes();
+    if (lengthBytes != 2 && lengthBytes != 4) {
+      return false;
+    }
+    _checks.push_back({.op = Check::Op::kSegment,
+                       .width = 1,
+                       .lengthBytes = (uint8_t)lengthBytes});
+    return true;
+  }
+
+  if (const DCSimpleParameter* simple = param->as_simple_parameter()) {
+    switch (simple->get_type()) {
+      case ST_string:
+      case ST_blob:
+      case ST_blob32: {
+        // DCPacker doesn't check fixed-length strings against their range.
+        const size_t lengthBytes = simple->get_num_length_bytes();
+        if (!lengthBytes) {
+          AddSkip(simple->get_fixed_byte_size());
+          return true;
+        }
+        _checks.push_back(
+            {.op = Check::Op::kSegment,
+             .width = 1,
+             .lengthBytes = (uint8_t)lengthBytes,
+             .sizes = CopyRanges<uint64_t>(simple->get_uint_range())});
+        return true;
+      }
+      default:
+        return CompileInteger(simple, 1, 0, {});
+    }
+  }
+
+  if (const DCArrayParameter* array = param->as_array_parameter()) {
+    const size_t lengthBytes = array->get_num_length_bytes();
+    if (!lengthBytes) {
+      // A fixed number of elements; its size range can't fail.
+      return array->get_array_size() >= 0 &&
+             CompileInteger(array->get_element_type(),
+                            array->get_array_size(), 0, {});
+    }
+    if (lengthBytes != 2 && lengthBytes != 4) {
+      return false;
+    }
+    return CompileInteger(
+        array->get_element_type(), 0, lengthBytes,
+        CopyRanges<uint64_t>(array->get_array_size_range()));
+  }
+
+  // Structs, switches and the like.
+  return false;
+}
+
+/**
+ * Appends a check of `count` integers of `element`'s type, or of a tagged
+ * array of them if `lengthBytes` is set.
+ * @param element
+ * @param count
+ * @param lengthBytes
+ * @param sizes The legal element counts of a tagged array.
+ * @return False if `element` isn't a plain integer type.
+ */
+bool FieldValidator::CompileInteger(const DCParameter* element,
+                                    const size_t& count,
+                                    const uint8_t& lengthBytes,
+                                    Ranges<uint64_t> sizes) {
+  const DCSimpleParameter* simple = element->as_simple_parameter();
+  if (!simple) {
+    return false;
+  }
+
+  Check check{.op = Check::Op::kSigned,
+              .lengthBytes = lengthBytes,
+              .count = count,
+              .sizes = std::move(sizes)};
+  switch (simple->get_type()) {
+    case ST_int8:
+    case ST_int16:
+    case ST_int32:
+      check.width = simple->get_fixed_byte_size();
+      check.signedRanges = CopyRanges<int64_t>(simple->get_int_range());
+      break;
+    case ST_int64:
+      check.width = 8;
+      check.signedRanges = CopyRanges<int64_t>(simple->get_int64_range());
+      break;
+    case ST_char:
+    case ST_uint8:
+    case ST_uint16:
+    case ST_uint32:
+      check.op = Check::Op::kUnsigned;
+      check.width = simple->get_fixed_byte_size();
+      check.unsignedRanges = CopyRanges<uint64_t>(simple->get_uint_range());
+      break;
+    case ST_uint64:
+      check.op = Check::Op::kUnsigned;
+      check.width = 8;
+      check.unsignedRanges = CopyRanges<uint64_t>(simple->get_uint64_range());
+      break;
+    default:
+      // Floats, and the legacy int8array-style types.
+      return false;
+  }
+
+  // Unconstrained single values are just bytes to skip.
+  if (!lengthBytes && check.signedRanges.empty() &&
+      check.unsignedRanges.empty()) {
+    AddSkip(count * check.width);
+    return true;
+  }
+
+  _checks.push_back(std::move(check));
+  return true;
+}
+
+void FieldValidator::AddSkip(const size_t& size) {
+  if (!size) {
+    return;
+  }
+
+  // Extends the check before it if that's a skip too.
+  if (!_checks.empty() && _checks.back().op == Check::Op::kSkip) {
+    _checks.back().count += size;
+    return;
+  }
+  _checks.push_back({.op = Check::Op::kSkip, .width = 1, .count = size});
+}
+
+}  // namespace Ardos
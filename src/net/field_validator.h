@@ -0,0 +1,81 @@
+#ifndef ARDOS_FIELD_VALIDATOR_H
+#define ARDOS_FIELD_VALIDATOR_H
+
+#include <dcField.h>
+#include <dcParameter.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Ardos {
+
+/**
+ * A DC field's range constraints (int16(0-200), string(0-32), uint8[0-50]
+ * and so on), compiled once at DC load into a list of checks that run
+ * straight over the packed bytes, instead of through a DCPacker one element
+ * at a time.
+ *
+ * Arrays of fixed-width integers with a single legal range are checked with
+ * SIMD min/max scans (AVX2 or SSE4.1, picked at runtime; scalar elsewhere),
+ * so a large inventory or coordinate array costs a few instructions per 32
+ * bytes.
+ *
+ * Validate agrees with DCField::validate_ranges. Fields it can't express
+ * (molecular fields, switches, structs or floats with ranges, nested
+ * arrays) get no validator, and callers fall back to validate_ranges.
+ */
+class FieldValidator {
+ public:
+  // Compiles validators for every field in g_dc_file. Main thread, once the
+  // DC files have been read and before anything validates fields; they're
+  // read-only (and safe to share between threads) from then on.
+  static void CompileAll();
+
+  // The validator for `field`, or nullptr if it has to use validate_ranges.
+  static const FieldValidator* For(const DCField* field);
+
+  [[nodiscard]] bool Validate(const uint8_t* data, size_t size) const;
+
+ private:
+  // Inclusive [min, max] pairs; a value is legal if it falls in any of
+  // them, and anything is legal if there are none.
+  template <typename T>
+  using Ranges = std::vector<std::pair<T, T>>;
+
+  struct Check {
+    enum class Op : uint8_t {
+      // `count` bytes that aren't checked.
+      kSkip,
+      // A string or blob: `lengthBytes` tag, then that many bytes. The
+      // length is checked against `sizes`.
+      kSegment,
+      // `count` integers of `width` bytes, or if `lengthBytes` is set, a
+      // tagged array of them whose element count is checked against
+      // `sizes`. Each value is checked against `signedRanges` or
+      // `unsignedRanges`.
+      kSigned,
+      kUnsigned,
+    };
+
+    Op op;
+    uint8_t width = 0;
+    uint8_t lengthBytes = 0;
+    size_t count = 0;
+    Ranges<uint64_t> sizes;
+    Ranges<int64_t> signedRanges;
+    Ranges<uint64_t> unsignedRanges;
+  };
+
+  bool Compile(const DCParameter* param);
+  bool CompileInteger(const DCParameter* element, const size_t& count,
+                      const uint8_t& lengthBytes, Ranges<uint64_t> sizes);
+  void AddSkip(const size_t& size);
+
+  const DCField* _field = nullptr;
+  std::vector<Check> _checks;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_FIELD_VALIDATOR_H
@@ -0,0 +1,263 @@
+#ifndef ARDOS_SHM_CLIENT_H
+#define ARDOS_SHM_CLIENT_H
+
+// Participant (AI/UD) side of the MD's shared-memory transport, for
+// processes on the MD's own host. Header-only and dependent only on
+// shm_ring.h and Linux system headers, so it can be dropped into an AI
+// server's build as-is. Not thread-safe: drive it from one thread.
+//
+//   Ardos::ShmClient md;
+//   md.Connect("/run/ardos/md-shm.sock");  // message-director.listen
+//   md.Send(dg, len);
+//   md.Poll([](const uint8_t* data, size_t len) { ... }, -1);
+//
+// Datagrams are the same payloads as on TCP, minus the length prefix.
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include "shm_ring.h"
+
+namespace Ardos {
+
+class ShmClient {
+ public:
+  ShmClient() = default;
+  ~ShmClient() { Close(); }
+
+  ShmClient(const ShmClient&) = delete;
+  ShmClient& operator=(const ShmClient&) = delete;
+
+  // Creates a segment with `ringBytes` (a power of two, at least
+  // kShmMinRingBytes) in each direction
+  // and hands it to the MD listening on `path` ("@name" for an abstract
+  // socket). Returns false, with errno set, on failure.
+  bool Connect(const std::string& path, uint64_t ringBytes = 1 << 20) {
+    Close();
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (!ShmValidRingBytes(ringBytes) || path.empty() ||
+        path.size() >= sizeof(addr.sun_path)) {
+      errno = EINVAL;
+      return false;
+    }
+
+    _segmentSize = ShmSegmentSize(ringBytes);
+    const int memFd =
+        memfd_create("ardos-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memFd < 0) {
+      return false;
+    }
+    // The MD won't map a segment that could shrink under it.
+    void* mapped = MAP_FAILED;
+    if (ftruncate(memFd, static_cast<off_t>(_segmentSize)) == 0 &&
+        fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK) == 0) {
+      mapped = mmap(nullptr, _segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    memFd, 0);
+    }
+    if (mapped == MAP_FAILED) {
+      ::close(memFd);
+      return false;
+    }
+
+    // A fresh memfd is zero-filled, which is already a valid empty ring.
+    _segment = static_cast<ShmSegmentHeader*>(mapped);
+    _segment->magic = kShmMagic;
+    _segment->version = kShmVersion;
+    _segment->ringBytes = ringBytes;
+    _outbound = ShmSegmentRing(_segment, ringBytes, false);
+    _inbound = ShmSegmentRing(_segment, ringBytes, true);
+
+    _serverWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    _clientWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    _controlFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    socklen_t addrLen = offsetof(sockaddr_un, sun_path) + path.size();
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    if (path.front() == '@') {
+      addr.sun_path[0] = '\0';
+    } else {
+      ++addrLen;
+    }
+
+    const bool ok =
+        _serverWake >= 0 && _clientWake >= 0 && _controlFd >= 0 &&
+        connect(_controlFd, reinterpret_cast<sockaddr*>(&addr), addrLen) ==
+            0 &&
+        SendDescriptors(memFd);
+    const int savedErrno = errno;
+    // The MD has its own reference now (or never will).
+    ::close(memFd);
+    if (!ok) {
+      Close();
+      errno = savedErrno;
+      return false;
+    }
+    return true;
+  }
+
+  // Queues one datagram (at most kShmMaxRecord bytes) for the MD, waiting
+  // while its ring is full. Returns false if the MD has gone away (or
+  // broke the ring).
+  bool Send(const uint8_t* data, size_t len) {
+    if (_controlFd < 0 || len > kShmMaxRecord) {
+      return false;
+    }
+
+    const auto length = static_cast<uint32_t>(len);
+    while (!_outbound.TryWrite(data, length)) {
+      _outbound.SetWriterWaiting();
+      if (_outbound.TryWrite(data, length)) {
+        break;
+      }
+      if (_outbound.Corrupt() || !Wait(-1)) {
+        return false;
+      }
+    }
+
+    if (_outbound.TakeReaderWaiting()) {
+      Signal(_serverWake);
+    }
+    return true;
+  }
+
+  // Calls `onDatagram(const uint8_t* data, size_t len)` for every datagram
+  // the MD has sent, first waiting up to `timeoutMs` (-1: forever) if there
+  // are none. `data` is only valid during the call. Returns how many were
+  // handled, or -1 if the MD has gone away.
+  template <typename F>
+  int Poll(F&& onDatagram, int timeoutMs) {
+    if (_controlFd < 0) {
+      return -1;
+    }
+
+    bool waited = false;
+    while (true) {
+      const int handled = Drain(onDatagram);
+      if (handled != 0 || waited || timeoutMs == 0) {
+        return handled;
+      }
+      if (!_inbound.PrepareSleep()) {
+        continue;  // something raced in
+      }
+      if (!Wait(timeoutMs)) {
+        return -1;
+      }
+      waited = true;
+    }
+  }
+
+  // Becomes readable when Poll (or a blocked Send) has something to do, for
+  // callers that multiplex the MD with other descriptors.
+  [[nodiscard]] int GetWakeFd() const { return _clientWake; }
+
+  void Close() {
+    for (int* fd : {&_controlFd, &_serverWake, &_clientWake}) {
+      if (*fd >= 0) {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
+    if (_segment != nullptr) {
+      munmap(_segment, _segmentSize);
+      _segment = nullptr;
+    }
+  }
+
+ private:
+  bool SendDescriptors(int memFd) {
+    const std::array<int, 3> fds = {memFd, _serverWake, _clientWake};
+    char byte = 0;
+    iovec iov{.iov_base = &byte, .iov_len = sizeof(byte)};
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> ctrl{};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.data();
+    msg.msg_controllen = ctrl.size();
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+
+    return sendmsg(_controlFd, &msg, MSG_NOSIGNAL) == 1;
+  }
+
+  template <typename F>
+  int Drain(F& onDatagram) {
+    int handled = 0;
+    const uint8_t* data;
+    uint32_t len;
+    while (_inbound.Peek(&data, &len)) {
+      onDatagram(data, static_cast<size_t>(len));
+      _inbound.Consume(len);
+      ++handled;
+    }
+    if (_inbound.Corrupt()) {
+      Close();
+      return -1;
+    }
+    if (handled && _inbound.TakeWriterWaiting()) {
+      Signal(_serverWake);
+    }
+    return handled;
+  }
+
+  // Sleeps until our eventfd fires or `timeoutMs` passes. Returns false
+  // (and closes) if the MD hung up.
+  bool Wait(int timeoutMs) {
+    std::array<pollfd, 2> fds = {
+        pollfd{.fd = _clientWake, .events = POLLIN, .revents = 0},
+        pollfd{.fd = _controlFd, .events = POLLIN, .revents = 0}};
+    if (poll(fds.data(), fds.size(), timeoutMs) < 0 && errno != EINTR) {
+      Close();
+      return false;
+    }
+    if (fds[1].revents) {
+      // The MD never writes to the control socket, so this is a hang-up.
+      Close();
+      return false;
+    }
+    if (fds[0].revents & POLLIN) {
+      uint64_t count;
+      (void)!read(_clientWake, &count, sizeof(count));
+    }
+    return true;
+  }
+
+  static void Signal(int eventFd) {
+    const uint64_t one = 1;
+    (void)!write(eventFd, &one, sizeof(one));
+  }
+
+  int _controlFd = -1;
+  int _serverWake = -1;
+  int _clientWake = -1;
+  ShmSegmentHeader* _segment = nullptr;
+  size_t _segmentSize = 0;
+  // AI->MD and MD->AI.
+  ShmRing _outbound;
+  ShmRing _inbound;
+};
+
+}  // namespace Ardos
+
+#endif  // __linux__
+
+#endif  // ARDOS_SHM_CLIENT_H
@@ -0,0 +1,222 @@
+#ifndef ARDOS_SHM_RING_H
+#define ARDOS_SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Ardos {
+
+// Layout and ring logic shared by both ends of the shm participant transport
+// (ShmTransportConnection on the MD, ShmClient on the AI). Deliberately free
+// of any other Ardos, libuv or OS dependency so the AI side can include it
+// on its own.
+//
+// A segment is a ShmSegmentHeader followed by the data of two byte rings of
+// `ringBytes` each: first the AI->MD ring, then the MD->AI one. Each ring
+// holds records of [uint32 length][payload], padded to 8 bytes; a length of
+// kShmWrapMarker pads out the rest of the ring so no record ever wraps.
+//
+// Positions only ever grow and are reduced modulo the ring size on access.
+// Each side sleeps on its own eventfd and sets readerWaiting / writerWaiting
+// first, so the other side only makes the wakeup syscall for a peer that's
+// actually asleep (waiting for data or for space, respectively).
+
+inline constexpr uint32_t kShmMagic = 0x41524453;  // "ARDS"
+inline constexpr uint32_t kShmVersion = 1;
+inline constexpr uint64_t kShmMaxRingBytes = uint64_t{64} * 1024 * 1024;
+inline constexpr uint32_t kShmMaxRecord = 0xFFFF;
+inline constexpr uint32_t kShmWrapMarker = 0xFFFFFFFF;
+
+// Ring space taken by a record with a `len` byte payload.
+inline constexpr uint64_t ShmRecordSize(uint32_t len) {
+  return (sizeof(uint32_t) + len + 7) & ~uint64_t{7};
+}
+
+// Small enough rings would never fit the largest records, which would then
+// block everything queued behind them. Even an empty ring may have to pad
+// out up to a record's worth at its end first, so it takes two.
+inline constexpr uint64_t kShmMinRingBytes = 256 * 1024;
+static_assert(kShmMinRingBytes >= 2 * ShmRecordSize(kShmMaxRecord));
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+struct ShmRingHeader {
+  // Consumer side.
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint32_t> readerWaiting;
+  // Producer side.
+  alignas(64) std::atomic<uint64_t> tail;
+  std::atomic<uint32_t> writerWaiting;
+};
+
+struct ShmSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t ringBytes;
+  ShmRingHeader toServer;
+  ShmRingHeader toClient;
+};
+
+// Fixed so non-C++ clients (e.g. the Python test harness) can lay it out.
+static_assert(sizeof(ShmRingHeader) == 128);
+static_assert(sizeof(ShmSegmentHeader) == 320);
+
+inline constexpr uint64_t ShmSegmentSize(uint64_t ringBytes) {
+  return sizeof(ShmSegmentHeader) + 2 * ringBytes;
+}
+
+inline constexpr bool ShmValidRingBytes(uint64_t ringBytes) {
+  return ringBytes >= kShmMinRingBytes && ringBytes <= kShmMaxRingBytes &&
+         (ringBytes & (ringBytes - 1)) == 0;
+}
+
+// One direction of a segment. Exactly one process may call the producer
+// methods and exactly one (other) process the consumer ones.
+class ShmRing {
+ public:
+  ShmRing() = default;
+  ShmRing(ShmRingHeader* header, uint8_t* data, uint64_t capacity)
+      : _header(header), _data(data), _capacity(capacity),
+        _mask(capacity - 1) {}
+
+  // Producer. Appends one record, or returns false if it doesn't fit or
+  // the consumer moved `head` somewhere it can't be (Corrupt() then
+  // reports true and the ring is unusable).
+  bool TryWrite(const uint8_t* data, uint32_t len) {
+    const uint64_t record = ShmRecordSize(len);
+    uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+    const uint64_t head = _header->head.load(std::memory_order_acquire);
+    // `head` is only ever as trustworthy as the consumer; past `tail` the
+    // free space below would wrap around and let us write off the end.
+    if (tail - head > _capacity) {
+      _corrupt = true;
+      return false;
+    }
+    const uint64_t toEnd = _capacity - (tail & _mask);
+    const uint64_t pad = toEnd < record ? toEnd : 0;
+    if (_capacity - (tail - head) < pad + record) {
+      return false;
+    }
+
+    if (pad) {
+      StoreLength(tail, kShmWrapMarker);
+      tail += pad;
+    }
+    StoreLength(tail, len);
+    std::memcpy(_data + (tail & _mask) + sizeof(uint32_t), data, len);
+    _header->tail.store(tail + record, std::memory_order_seq_cst);
+    return true;
+  }
+
+  // Producer, after a batch of writes. Returns true (once) if the consumer
+  // is asleep and has to be woken.
+  bool TakeReaderWaiting() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return _header->readerWaiting.load(std::memory_order_relaxed) &&
+           _header->readerWaiting.exchange(0, std::memory_order_acq_rel);
+  }
+
+  // Producer, when TryWrite failed: asks the consumer to wake us once it
+  // frees space. Retry the write afterwards in case it already did.
+  void SetWriterWaiting() {
+    _header->writerWaiting.store(1, std::memory_order_seq_cst);
+  }
+
+  // Consumer. Points `data`/`len` at the next record without consuming
+  // it. Returns false if the ring is empty or the producer wrote something
+  // malformed (Corrupt() then reports true and the ring is unusable).
+  bool Peek(const uint8_t** data, uint32_t* len) {
+    uint64_t head = _header->head.load(std::memory_order_relaxed);
+    const uint64_t tail = _header->tail.load(std::memory_order_acquire);
+    if (tail - head > _capacity) {
+      _corrupt = true;
+      return false;
+    }
+    if (head == tail) {
+      return false;
+    }
+
+    uint32_t length = LoadLength(head);
+    if (length == kShmWrapMarker) {
+      head += _capacity - (head & _mask);
+      _header->head.store(head, std::memory_order_release);
+      if (head == tail) {
+        _corrupt = true;
+        return false;
+      }
+      length = LoadLength(head);
+    }
+
+    if (length > kShmMaxRecord || ShmRecordSize(length) > tail - head ||
+        ShmRecordSize(length) > _capacity - (head & _mask)) {
+      _corrupt = true;
+      return false;
+    }
+
+    *data = _data + (head & _mask) + sizeof(uint32_t);
+    *len = length;
+    return true;
+  }
+
+  // Consumer. Releases the record returned by the last Peek.
+  void Consume(uint32_t len) {
+    const uint64_t head = _header->head.load(std::memory_order_relaxed);
+    _header->head.store(head + ShmRecordSize(len), std::memory_order_seq_cst);
+  }
+
+  // Consumer, after a batch of Consumes. Returns true (once) if the
+  // producer is waiting for space and has to be woken.
+  bool TakeWriterWaiting() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return _header->writerWaiting.load(std::memory_order_relaxed) &&
+           _header->writerWaiting.exchange(0, std::memory_order_acq_rel);
+  }
+
+  // Consumer, with the ring drained. Flags us as asleep and returns true if
+  // we may wait on our eventfd, or false if data raced in (keep reading).
+  bool PrepareSleep() {
+    _header->readerWaiting.store(1, std::memory_order_seq_cst);
+    if (_header->head.load(std::memory_order_seq_cst) !=
+        _header->tail.load(std::memory_order_seq_cst)) {
+      _header->readerWaiting.store(0, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  [[nodiscard]] bool Corrupt() const { return _corrupt; }
+
+ private:
+  void StoreLength(uint64_t pos, uint32_t len) {
+    std::memcpy(_data + (pos & _mask), &len, sizeof(len));
+  }
+
+  [[nodiscard]] uint32_t LoadLength(uint64_t pos) const {
+    uint32_t len;
+    std::memcpy(&len, _data + (pos & _mask), sizeof(len));
+    return len;
+  }
+
+  ShmRingHeader* _header = nullptr;
+  uint8_t* _data = nullptr;
+  uint64_t _capacity = 0;
+  uint64_t _mask = 0;
+  bool _corrupt = false;
+};
+
+// The MD->AI (`toClient` true) or AI->MD ring of a mapped segment.
+// `ringBytes` is passed in rather than read back from the header, so the MD
+// keeps using the size it validated even if the AI rewrites it later.
+inline ShmRing ShmSegmentRing(ShmSegmentHeader* segment, uint64_t ringBytes,
+                              bool toClient) {
+  auto* data = reinterpret_cast<uint8_t*>(segment) + sizeof(ShmSegmentHeader);
+  return toClient ? ShmRing(&segment->toClient, data + ringBytes, ringBytes)
+                  : ShmRing(&segment->toServer, data, ringBytes);
+}
+
+}  // namespace Ardos
+
+#endif  // ARDOS_SHM_RING_H
@@ -0,0 +1,482 @@
+#include "shm_transport.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+
+#include "../util/globals.h"
+
+namespace Ardos {
+
+ShmTransportConnection::ShmTransportConnection(
+    int controlFd, ShmSegmentHeader* segment, size_t segmentSize,
+    uint64_t ringBytes, int serverWake, int clientWake, std::string path,
+    std::string logName)
+    : _controlFd(controlFd),
+      _segment(segment),
+      _segmentSize(segmentSize),
+      _inbound(ShmSegmentRing(segment, ringBytes, false)),
+      _outbound(ShmSegmentRing(segment, ringBytes, true)),
+      _serverWake(serverWake),
+      _clientWake(clientWake),
+      _logName(std::move(logName)),
+      _endpoint({.ip = std::move(path)}) {
+  // The control socket only ever carries a hang-up from here on.
+  _controlPoll = g_loop->resource<uvw::poll_handle>(_controlFd);
+  _controlPoll->on<uvw::poll_event>(
+      [this, alive = _alive](const uvw::poll_event&, uvw::poll_handle&) {
+        if (!*alive || _closed) {
+          return;
+        }
+        std::array<char, 64> buf{};
+        const ssize_t n = recv(_controlFd, buf.data(), buf.size(), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+          HandleClose();
+        }
+      });
+  _controlPoll->start(uvw::poll_handle::poll_event_flags::READABLE);
+
+  _wakePoll = g_loop->resource<uvw::poll_handle>(_serverWake);
+  _wakePoll->on<uvw::poll_event>(
+      [this, alive = _alive](const uvw::poll_event&, uvw::poll_handle&) {
+        if (!*alive || _closed) {
+          return;
+        }
+        HandleWake();
+      });
+  _wakePoll->start(uvw::poll_handle::poll_event_flags::READABLE);
+
+  // Anything the participant wrote before we were ready.
+  Signal(_serverWake);
+}
+
+ShmTransportConnection::~ShmTransportConnection() {
+  Close();
+  *_alive = false;
+}
+
+void ShmTransportConnection::SetHandler(std::weak_ptr<ITransportHandler> h) {
+  _handler = std::move(h);
+}
+
+void ShmTransportConnection::Send(const uint8_t* data, size_t len,
+                                  Reliability /*r*/) {
+  if (_closed || _failed) {
+    return;
+  }
+
+  // Same limit as the TCP framing, so a participant can move between
+  // transports without noticing.
+  if (len > kShmMaxRecord) {
+    spdlog::get(_logName)->error(
+        "Shm transport refusing oversized datagram ({}B > {}B max)", len,
+        kShmMaxRecord);
+    return;
+  }
+
+  if (_overflow.empty() &&
+      _outbound.TryWrite(data, static_cast<uint32_t>(len))) {
+    if (_outbound.TakeReaderWaiting()) {
+      Signal(_clientWake);
+    }
+    return;
+  }
+  if (_outbound.Corrupt()) {
+    Fail();
+    return;
+  }
+
+  if (_overflowBytes + len > kHighWaterBytes) {
+    spdlog::get(_logName)->warn(
+        "Shm transport: participant on {} exceeded {}B backlog; "
+        "disconnecting",
+        _endpoint.ip, kHighWaterBytes);
+    Fail();
+    return;
+  }
+
+  // The participant is a full ring behind. Park the datagram and have it
+  // wake us once it's made room.
+  _overflow.emplace_back(data, data + len);
+  _overflowBytes += len;
+  FlushOverflow();
+}
+
+void ShmTransportConnection::Close() {
+  if (_closed) {
+    return;
+  }
+  _closed = true;
+
+  _overflow.clear();
+  _overflowBytes = 0;
+
+  // Stopping the polls is synchronous, so the descriptors can go right
+  // away; the handles themselves are released once libuv is done with
+  // them.
+  _controlPoll->close();
+  _wakePoll->close();
+  ::close(_controlFd);
+  ::close(_serverWake);
+  ::close(_clientWake);
+  munmap(_segment, _segmentSize);
+}
+
+TransportEndpoint ShmTransportConnection::RemoteEndpoint() const {
+  return _endpoint;
+}
+
+TransportEndpoint ShmTransportConnection::LocalEndpoint() const {
+  return _endpoint;
+}
+
+void ShmTransportConnection::HandleClose() {
+  if (_closed) {
+    return;
+  }
+  Close();
+
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportDisconnect();
+  }
+}
+
+void ShmTransportConnection::Fail() {
+  if (_failed) {
+    return;
+  }
+  _failed = true;
+
+  if (_outbound.Corrupt()) {
+    spdlog::get(_logName)->warn(
+        "Shm transport: participant on {} corrupted its ring; "
+        "disconnecting",
+        _endpoint.ip);
+  }
+
+  _overflow.clear();
+  _overflowBytes = 0;
+  Signal(_serverWake);
+}
+
+void ShmTransportConnection::HandleWake() {
+  uint64_t count;
+  while (read(_serverWake, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+
+  if (_failed) {
+    HandleClose();
+    return;
+  }
+
+  FlushOverflow();
+  if (_failed) {
+    return;
+  }
+  DrainInbound();
+}
+
+void ShmTransportConnection::DrainInbound() {
+  // Handlers may close (or destroy) us mid-drain.
+  auto alive = _alive;
+
+  size_t drained = 0;
+  while (true) {
+    const uint8_t* data;
+    uint32_t len;
+    if (!_inbound.Peek(&data, &len)) {
+      if (_inbound.Corrupt()) {
+        spdlog::get(_logName)->warn(
+            "Shm transport: participant on {} corrupted its ring; "
+            "disconnecting",
+            _endpoint.ip);
+        HandleClose();
+        return;
+      }
+      if (_inbound.PrepareSleep()) {
+        return;
+      }
+      continue;
+    }
+
+    if (++drained > kMaxDrain) {
+      // Give the rest of the loop a turn; we'll be straight back.
+      Signal(_serverWake);
+      return;
+    }
+
+    if (auto handler = _handler.lock()) {
+      handler->OnTransportMessage(data, len);
+    }
+    if (!*alive || _closed) {
+      return;
+    }
+
+    _inbound.Consume(len);
+    if (_inbound.TakeWriterWaiting()) {
+      Signal(_clientWake);
+    }
+  }
+}
+
+void ShmTransportConnection::FlushOverflow() {
+  bool wrote = false;
+  while (!_overflow.empty()) {
+    const auto& front = _overflow.front();
+    if (!_outbound.TryWrite(front.data(),
+                            static_cast<uint32_t>(front.size()))) {
+      if (_outbound.Corrupt()) {
+        Fail();
+        return;
+      }
+      // Ask to be woken, then look again in case space freed up before
+      // the participant could see the flag.
+      _outbound.SetWriterWaiting();
+      if (!_outbound.TryWrite(front.data(),
+                              static_cast<uint32_t>(front.size()))) {
+        if (_outbound.Corrupt()) {
+          Fail();
+          return;
+        }
+        break;
+      }
+    }
+    _overflowBytes -= front.size();
+    _overflow.pop_front();
+    wrote = true;
+  }
+
+  if (wrote && _outbound.TakeReaderWaiting()) {
+    Signal(_clientWake);
+  }
+}
+
+void ShmTransportConnection::Signal(int eventFd) {
+  const uint64_t one = 1;
+  // EAGAIN only means the counter is saturated, i.e. already signalled.
+  while (write(eventFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+}
+
+ShmTransportListener::ShmTransportListener(std::string logName)
+    : _logName(std::move(logName)) {}
+
+ShmTransportListener::~ShmTransportListener() {
+  for (const auto& [fd, poll] : _pending) {
+    poll->close();
+    ::close(fd);
+  }
+  if (_listenPoll) {
+    _listenPoll->close();
+  }
+  if (_listenFd >= 0) {
+    ::close(_listenFd);
+  }
+}
+
+void ShmTransportListener::SetConnectionFactory(ConnectionFactory factory) {
+  _factory = std::move(factory);
+}
+
+bool ShmTransportListener::Listen(const std::string& path, int /*port*/) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    spdlog::get(_logName)->error("Invalid shm listen path: {}", path);
+    return false;
+  }
+
+  // "@name" is an abstract socket: a leading NUL and no file.
+  socklen_t addrLen = offsetof(sockaddr_un, sun_path) + path.size();
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  if (path.front() == '@') {
+    addr.sun_path[0] = '\0';
+  } else {
+    // Replace a stale socket file left behind by a previous run.
+    std::error_code ec;
+    if (std::filesystem::is_socket(path, ec)) {
+      std::filesystem::remove(path, ec);
+    }
+    ++addrLen;
+  }
+
+  _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_listenFd < 0 ||
+      bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0 ||
+      listen(_listenFd, SOMAXCONN) != 0) {
+    spdlog::get(_logName)->error("Failed to listen on shm:{}: {}", path,
+                                 std::strerror(errno));
+    return false;
+  }
+  _path = path;
+
+  _listenPoll = g_loop->resource<uvw::poll_handle>(_listenFd);
+  _listenPoll->on<uvw::poll_event>(
+      [this](const uvw::poll_event&, uvw::poll_handle&) { HandleAccept(); });
+  _listenPoll->start(uvw::poll_handle::poll_event_flags::READABLE);
+  return true;
+}
+
+void ShmTransportListener::HandleAccept() {
+  while (true) {
+    const int fd = accept4(_listenFd, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        spdlog::get(_logName)->warn("Shm transport accept failed: {}",
+                                    std::strerror(errno));
+      }
+      return;
+    }
+
+    auto poll = g_loop->resource<uvw::poll_handle>(fd);
+    poll->on<uvw::poll_event>(
+        [this, fd](const uvw::poll_event&, uvw::poll_handle&) {
+          HandleHandshake(fd);
+        });
+    poll->start(uvw::poll_handle::poll_event_flags::READABLE);
+    _pending.emplace(fd, std::move(poll));
+  }
+}
+
+/**
+ * Reads a pending participant's descriptors, validates and maps its
+ * segment, and hands the resulting connection to the factory.
+ * @param fd
+ */
+void ShmTransportListener::HandleHandshake(int fd) {
+  static constexpr size_t kFdCount = 3;
+
+  char byte;
+  iovec iov{.iov_base = &byte, .iov_len = sizeof(byte)};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * kFdCount)> ctrl{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl.data();
+  msg.msg_controllen = ctrl.size();
+
+  const ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+
+  std::array<int, kFdCount> fds{-1, -1, -1};
+  size_t received = 0;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < count; ++i) {
+      int received_fd;
+      std::memcpy(&received_fd, CMSG_DATA(cmsg) + i * sizeof(int),
+                  sizeof(int));
+      if (received < kFdCount) {
+        fds[received++] = received_fd;
+      } else {
+        ::close(received_fd);
+      }
+    }
+  }
+
+  auto fail = [&](const char* reason) {
+    spdlog::get(_logName)->warn("Rejected shm participant on {}: {}", _path,
+                                reason);
+    for (int received_fd : fds) {
+      if (received_fd >= 0) {
+        ::close(received_fd);
+      }
+    }
+    DropPending(fd);
+  };
+
+  if (n <= 0) {
+    fail("hung up before handshake");
+    return;
+  }
+  if (received != kFdCount || (msg.msg_flags & MSG_CTRUNC)) {
+    fail("expected a memfd and two eventfds");
+    return;
+  }
+
+  // The participant keeps its own descriptor for the segment. Unless it's
+  // sealed against shrinking, the participant could truncate it under our
+  // mapping and have our next ring access fault with SIGBUS.
+  const int seals = fcntl(fds[0], F_GET_SEALS);
+  if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+    fail("segment isn't sealed against shrinking");
+    return;
+  }
+
+  struct stat st {};
+  if (fstat(fds[0], &st) != 0 ||
+      static_cast<uint64_t>(st.st_size) < ShmSegmentSize(kShmMinRingBytes) ||
+      static_cast<uint64_t>(st.st_size) > ShmSegmentSize(kShmMaxRingBytes)) {
+    fail("bad segment size");
+    return;
+  }
+
+  const auto segmentSize = static_cast<size_t>(st.st_size);
+  void* mapped = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fds[0], 0);
+  if (mapped == MAP_FAILED) {
+    fail("couldn't map segment");
+    return;
+  }
+  // The mapping keeps the segment alive on its own.
+  ::close(fds[0]);
+  fds[0] = -1;
+
+  auto* segment = static_cast<ShmSegmentHeader*>(mapped);
+  const uint64_t ringBytes = segment->ringBytes;
+  if (segment->magic != kShmMagic || segment->version != kShmVersion ||
+      !ShmValidRingBytes(ringBytes) ||
+      ShmSegmentSize(ringBytes) > segmentSize) {
+    munmap(mapped, segmentSize);
+    fail("bad segment header");
+    return;
+  }
+
+  // We never block on these, whatever the participant asked for.
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+  fcntl(fds[2], F_SETFL, fcntl(fds[2], F_GETFL) | O_NONBLOCK);
+
+  // The connection watches the socket from here on. Stopping our poll frees
+  // the descriptor up for its own straight away.
+  if (auto it = _pending.find(fd); it != _pending.end()) {
+    it->second->close();
+    _pending.erase(it);
+  }
+
+  auto transport = std::make_unique<ShmTransportConnection>(
+      fd, segment, segmentSize, ringBytes, fds[1], fds[2], _path, _logName);
+  if (_factory) {
+    _factory(std::move(transport));
+  }
+}
+
+void ShmTransportListener::DropPending(int fd) {
+  if (auto it = _pending.find(fd); it != _pending.end()) {
+    it->second->close();
+    _pending.erase(it);
+  }
+  ::close(fd);
+}
+
+}  // namespace Ardos
+
+#endif  // __linux__
@@ -0,0 +1,115 @@
+#ifndef ARDOS_SHM_TRANSPORT_H
+#define ARDOS_SHM_TRANSPORT_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <uvw.hpp>
+#include <vector>
+
+#include "shm_ring.h"
+#include "transport.h"
+
+namespace Ardos {
+
+// Shared-memory connection to a participant on the MD's own host (Linux
+// only). The participant (see shm_client.h) creates the segment and two
+// eventfds and passes them over a Unix socket to ShmTransportListener;
+// datagrams then move through the segment's rings with no syscalls while
+// both sides are busy. The Unix socket stays open purely as a liveness
+// signal: either side hanging up ends the connection.
+//
+// Runs on the main loop only; message-director.io-threads doesn't apply.
+class ShmTransportConnection final : public ITransportConnection {
+ public:
+  // Takes ownership of the descriptors and the mapped segment.
+  ShmTransportConnection(int controlFd, ShmSegmentHeader* segment,
+                         size_t segmentSize, uint64_t ringBytes,
+                         int serverWake, int clientWake, std::string path,
+                         std::string logName);
+  ~ShmTransportConnection() override;
+
+  void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
+  void Send(const uint8_t* data, size_t len,
+            Reliability r = Reliability::Reliable) override;
+  void Close() override;
+  [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
+  [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
+
+ private:
+  void HandleClose();
+  // Stops all traffic after a transport-level failure, and has HandleWake
+  // tell the handler on the next loop iteration rather than from inside
+  // the Send that failed.
+  void Fail();
+  // Our eventfd fired: the participant wrote datagrams, freed ring space,
+  // or both.
+  void HandleWake();
+  void DrainInbound();
+  // Moves parked datagrams into the outbound ring as space allows.
+  void FlushOverflow();
+  static void Signal(int eventFd);
+
+  int _controlFd;
+  std::shared_ptr<uvw::poll_handle> _controlPoll;
+  std::shared_ptr<uvw::poll_handle> _wakePoll;
+  ShmSegmentHeader* _segment;
+  size_t _segmentSize;
+  // AI->MD and MD->AI.
+  ShmRing _inbound;
+  ShmRing _outbound;
+  int _serverWake;
+  int _clientWake;
+
+  std::string _logName;
+  std::weak_ptr<ITransportHandler> _handler;
+  TransportEndpoint _endpoint;
+
+  // Datagrams that didn't fit the outbound ring, bounded by kHighWaterBytes
+  // like the TCP write queue.
+  std::deque<std::vector<uint8_t>> _overflow;
+  size_t _overflowBytes = 0;
+  static constexpr size_t kHighWaterBytes = size_t{4} * 1024 * 1024;  // 4 MiB
+
+  // Inbound datagrams handled per wakeup before yielding to the loop.
+  static constexpr size_t kMaxDrain = 1024;
+
+  bool _closed = false;
+  // Failed, with OnTransportDisconnect still owed to the handler.
+  bool _failed = false;
+
+  // Same late-callback guard as TcpTransportConnection.
+  std::shared_ptr<bool> _alive = std::make_shared<bool>(true);
+};
+
+// Accepts shm participants on a Unix socket path ("@name" for a Linux
+// abstract socket). Each connection's first message must carry the
+// segment's memfd and the MD's and participant's eventfds, in that order;
+// the segment is validated and mapped before the connection is handed to
+// the factory. The port passed to Listen is ignored.
+class ShmTransportListener final : public ITransportListener {
+ public:
+  explicit ShmTransportListener(std::string logName = "md");
+  ~ShmTransportListener() override;
+
+  void SetConnectionFactory(ConnectionFactory factory) override;
+  bool Listen(const std::string& path, int port) override;
+
+ private:
+  void HandleAccept();
+  void HandleHandshake(int fd);
+  void DropPending(int fd);
+
+  std::string _logName;
+  std::string _path;
+  int _listenFd = -1;
+  std::shared_ptr<uvw::poll_handle> _listenPoll;
+  // Accepted sockets that haven't sent their descriptors yet.
+  std::unordered_map<int, std::shared_ptr<uvw::poll_handle>> _pending;
+  ConnectionFactory _factory;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_SHM_TRANSPORT_H
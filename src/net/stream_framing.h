@@ -0,0 +1,121 @@
+#ifndef ARDOS_STREAM_FRAMING_H
+#define ARDOS_STREAM_FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Ardos {
+
+// Read side of the [uint16 LE length][payload] framing shared by the
+// stream transports (TcpTransportConnection and UringTransportConnection).
+class StreamFramer {
+ public:
+  // With `negotiate`, a one-byte first message is a compression request
+  // (see TcpTransportConnection), which IsNegotiation picks out.
+  explicit StreamFramer(bool negotiate) : _negotiating(negotiate) {}
+
+  // Splits bytes read from the socket into messages and hands each to
+  // `onMessage(data, len)`, keeping any partial one for the next read.
+  // `onMessage` returns false once the connection has gone away under it
+  // (it may have been destroyed along with this framer), which stops the
+  // split without touching the framer again.
+  template <typename OnMessage>
+  void Feed(const uint8_t* data, size_t size, OnMessage&& onMessage) {
+    // Fast path: a single complete datagram in this chunk and no
+    // accumulator state. Avoids the buffer copy.
+    if (_buffer.empty() && size >= sizeof(uint16_t)) {
+      uint16_t dgSize;
+      std::memcpy(&dgSize, data, sizeof(dgSize));
+      if (dgSize == size - sizeof(uint16_t)) {
+        onMessage(data + sizeof(uint16_t), dgSize);
+        return;
+      }
+    }
+
+    _buffer.insert(_buffer.end(), data, data + size);
+
+    // Consume whole messages from the front, then drop them all at once.
+    size_t offset = 0;
+    while (_buffer.size() - offset >= sizeof(uint16_t)) {
+      uint16_t dgSize;
+      std::memcpy(&dgSize, _buffer.data() + offset, sizeof(dgSize));
+      if (_buffer.size() - offset < sizeof(uint16_t) + dgSize) {
+        break;  // partial; wait for more bytes
+      }
+
+      const uint8_t* message = _buffer.data() + offset + sizeof(uint16_t);
+      offset += sizeof(uint16_t) + dgSize;
+      if (!onMessage(message, dgSize)) {
+        return;
+      }
+    }
+    _buffer.erase(_buffer.begin(),
+                  _buffer.begin() + static_cast<ptrdiff_t>(offset));
+  }
+
+  // True for the first message if it's a compression request, which the
+  // transport answers instead of delivering. False for everything else.
+  bool IsNegotiation(size_t len) {
+    if (!_negotiating) {
+      return false;
+    }
+    _negotiating = false;
+    return len == 1;
+  }
+
+ private:
+  std::vector<uint8_t> _buffer;
+  // Still waiting for the first message.
+  bool _negotiating;
+};
+
+// Close bookkeeping shared by the stream transports. Close() is silent.
+// Fail() closes too, but leaves OnTransportDisconnect owed to the handler:
+// the transport pays it from the loop once the socket's done, never from
+// inside the call that failed.
+class StreamCloseState {
+ public:
+  [[nodiscard]] bool Closed() const { return _closed; }
+  // Closed by Fail(), with OnTransportDisconnect still owed.
+  [[nodiscard]] bool Failed() const { return _failed; }
+
+  // A local Close(). False if already closed.
+  bool Close() {
+    if (_closed) {
+      return false;
+    }
+    _closed = true;
+    return true;
+  }
+
+  // A transport-level failure. False if already closed.
+  bool Fail() {
+    if (_closed) {
+      return false;
+    }
+    _closed = true;
+    _failed = true;
+    return true;
+  }
+
+  // The socket's done: the peer hung up, it errored, or a Fail() has gone
+  // through. True if the handler still has to be told.
+  bool Finish() {
+    if (_closed && !_failed) {
+      return false;
+    }
+    _closed = true;
+    _failed = false;
+    return true;
+  }
+
+ private:
+  bool _closed = false;
+  bool _failed = false;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_STREAM_FRAMING_H
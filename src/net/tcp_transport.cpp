@@ -1,68 +1,95 @@
 #include "tcp_transport.h"
 
 #include <spdlog/spdlog.h>
+#include <ws28/TLS.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <limits>
+#include <type_traits>
 
 #include "../util/globals.h"
+#include "tls_context.h"
 
 namespace Ardos {
 
-TcpTransportConnection::TcpTransportConnection(
-    std::shared_ptr<uvw::tcp_handle> socket)
-    : _socket(std::move(socket)) {
-  _socket->no_delay(true);
-  _socket->keep_alive(true, uvw::tcp_handle::time{60});
+template <typename Handle>
+StreamTransportConnection<Handle>::StreamTransportConnection(
+    std::shared_ptr<Handle> socket, std::string logName,
+    std::shared_ptr<const CompressionOptions> compression,
+    std::shared_ptr<const TlsContext> tls)
+    : _socket(std::move(socket)),
+      _logName(std::move(logName)),
+      _framer(compression != nullptr),
+      _compression(std::move(compression)),
+      _tlsContext(std::move(tls)) {
+  if (_tlsContext) {
+    _tls = std::make_unique<ws28::TLS>(_tlsContext->Get());
+  }
 
-  auto remote = _socket->peer();
-  auto local = _socket->sock();
-  _remoteEndpoint = {.ip = remote.ip,
-                     .port = static_cast<uint16_t>(remote.port)};
-  _localEndpoint = {.ip = local.ip, .port = static_cast<uint16_t>(local.port)};
+  if constexpr (std::is_same_v<Handle, uvw::tcp_handle>) {
+    _socket->no_delay(true);
+    _socket->keep_alive(true, uvw::tcp_handle::time{60});
+
+    auto remote = _socket->peer();
+    auto local = _socket->sock();
+    _remoteEndpoint = {.ip = remote.ip,
+                       .port = static_cast<uint16_t>(remote.port)};
+    _localEndpoint = {.ip = local.ip,
+                      .port = static_cast<uint16_t>(local.port)};
+  } else {
+    // Unix sockets have a path rather than an address. The connecting side
+    // is usually unnamed, so report the listener's path for both ends.
+    _localEndpoint = {.ip = _socket->sock()};
+    _remoteEndpoint = {.ip = _socket->peer()};
+    if (_remoteEndpoint.ip.empty()) {
+      _remoteEndpoint.ip = _localEndpoint.ip;
+    }
+  }
 
   // Wire libuv events. Every lambda captures `_alive` so a late-firing
   // event after this connection has been closed becomes a no-op rather
   // than dereferencing freed memory (uvw close() is async).
-  _socket->on<uvw::error_event>(
-      [this, alive = _alive](const uvw::error_event& event, uvw::tcp_handle&) {
+  _socket->template on<uvw::error_event>(
+      [this, alive = _alive](const uvw::error_event& event, Handle&) {
         if (!*alive) {
           return;
         }
         HandleClose(event.code());
       });
 
-  _socket->on<uvw::end_event>(
-      [this, alive = _alive](const uvw::end_event&, uvw::tcp_handle&) {
+  _socket->template on<uvw::end_event>(
+      [this, alive = _alive](const uvw::end_event&, Handle&) {
         if (!*alive) {
           return;
         }
         HandleClose(UV_EOF);
       });
 
-  _socket->on<uvw::close_event>(
-      [this, alive = _alive](const uvw::close_event&, uvw::tcp_handle&) {
+  _socket->template on<uvw::close_event>(
+      [this, alive = _alive](const uvw::close_event&, Handle&) {
         if (!*alive) {
           return;
         }
         HandleClose(UV_EOF);
       });
 
-  _socket->on<uvw::data_event>(
-      [this, alive = _alive](const uvw::data_event& event, uvw::tcp_handle&) {
-        if (!*alive || _closed) {
+  _socket->template on<uvw::data_event>(
+      [this, alive = _alive](const uvw::data_event& event, Handle&) {
+        if (!*alive || _state.Closed()) {
           return;
         }
         HandleData(event.data, event.length);
       });
 
-  _socket->on<uvw::write_event>(
-      [this, alive = _alive](const uvw::write_event&, uvw::tcp_handle&) {
+  _socket->template on<uvw::write_event>(
+      [this, alive = _alive](const uvw::write_event&, Handle&) {
         if (!*alive) {
           return;
         }
         _isWriting = false;
-        if (_closed) {
+        if (_state.Closed()) {
           // Drop anything still queued — the connection is going away.
           _writeQueue.clear();
           _queuedBytes = 0;
@@ -73,12 +100,20 @@ TcpTransportConnection::TcpTransportConnection(
           return;
         }
         PumpWrite();
+        // Nothing left behind the write in flight (if any): let a handler
+        // pacing a bulk send queue its next share.
+        if (_writeQueue.empty() && !_state.Closed()) {
+          if (auto handler = _handler.lock()) {
+            handler->OnTransportDrain();
+          }
+        }
       });
 
   _socket->read();
 }
 
-TcpTransportConnection::~TcpTransportConnection() {
+template <typename Handle>
+StreamTransportConnection<Handle>::~StreamTransportConnection() {
   Close();
   // Force-close even if a write was in flight; the pending write callback
   // will fire async but *_alive = false makes it no-op.
@@ -89,63 +124,225 @@ TcpTransportConnection::~TcpTransportConnection() {
   *_alive = false;
 }
 
-void TcpTransportConnection::SetHandler(std::weak_ptr<ITransportHandler> h) {
+template <typename Handle>
+void StreamTransportConnection<Handle>::SetHandler(
+    std::weak_ptr<ITransportHandler> h) {
   _handler = std::move(h);
 }
 
-void TcpTransportConnection::Send(const uint8_t* data, size_t len,
-                                  Reliability /*r*/) {
+template <typename Handle>
+void StreamTransportConnection<Handle>::Send(const uint8_t* data, size_t len,
+                                             Reliability /*r*/) {
   // TCP is always reliable; the hint is ignored.
-  if (_closed || _socket == nullptr) {
+  if (_state.Closed() || _socket == nullptr) {
     return;
   }
 
   // Framing prefix is uint16; larger payloads would wrap and corrupt.
   if (len > std::numeric_limits<uint16_t>::max()) {
-    spdlog::get("ca")->error(
+    spdlog::get(_logName)->error(
         "TCP transport refusing oversized datagram ({}B > {}B max)", len,
         std::numeric_limits<uint16_t>::max());
     return;
   }
 
-  const size_t sendSize = sizeof(uint16_t) + len;
-
-  if (_queuedBytes + sendSize > kHighWaterBytes) {
-    spdlog::get("ca")->warn(
-        "TCP transport: client {}:{} exceeded {}B write backlog; disconnecting",
-        _remoteEndpoint.ip, _remoteEndpoint.port, kHighWaterBytes);
-    Close();
+  uint8_t* out = Reserve(sizeof(uint16_t) + len);
+  if (out == nullptr) {
     return;
   }
 
-  // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw write
-  auto sendBuffer = std::unique_ptr<char[]>(new char[sendSize]);
   const auto dgSize = static_cast<uint16_t>(len);
-  std::memcpy(sendBuffer.get(), &dgSize, sizeof(uint16_t));
-  std::memcpy(sendBuffer.get() + sizeof(uint16_t), data, len);
+  std::memcpy(out, &dgSize, sizeof(uint16_t));
+  std::memcpy(out + sizeof(uint16_t), data, len);
 
-  _writeQueue.push_back({std::move(sendBuffer), sendSize});
-  _queuedBytes += sendSize;
+  PumpWrite();
+}
+
+template <typename Handle>
+void StreamTransportConnection<Handle>::SendBatch(const uint8_t* data,
+                                                  size_t len) {
+  // Already framed the way we'd frame it; write it as it is.
+  if (_state.Closed() || _socket == nullptr || len == 0) {
+    return;
+  }
+
+  uint8_t* out = Reserve(len);
+  if (out == nullptr) {
+    return;
+  }
+  std::memcpy(out, data, len);
 
   PumpWrite();
 }
 
-void TcpTransportConnection::PumpWrite() {
-  if (_isWriting || _writeQueue.empty() || _socketClosed) {
+template <typename Handle>
+uint8_t* StreamTransportConnection<Handle>::Reserve(size_t size) {
+  if (_queuedBytes + size > kHighWaterBytes) {
+    spdlog::get(_logName)->warn(
+        "TCP transport: client {}:{} exceeded {}B write backlog; disconnecting",
+        _remoteEndpoint.ip, _remoteEndpoint.port, kHighWaterBytes);
+    Fail();
+    return nullptr;
+  }
+
+  // Frame into the newest queued slab, doubling it (up to kWriteSlabBytes)
+  // if it's short of room. New slabs are sized for just this write: if the
+  // socket's idle it goes straight out, and otherwise the slab only grows
+  // as far as what actually piles up behind the write in flight.
+  if (!_writeQueue.empty() &&
+      _writeQueue.back().capacity - _writeQueue.back().size < size) {
+    auto& back = _writeQueue.back();
+    const size_t needed = back.size + size;
+    // A slab wrapped differently from what we'd queue now (the answer to a
+    // compression request, see HandleNegotiation) stays sealed.
+    if (needed <= kWriteSlabBytes && back.encode == (_deflate != nullptr)) {
+      const size_t capacity =
+          std::min(std::max(back.capacity * 2, needed), kWriteSlabBytes);
+      // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+      std::unique_ptr<char[]> grown(new char[capacity]);
+      std::memcpy(grown.get(), back.buf.get(), back.size);
+      back.buf = std::move(grown);
+      back.capacity = capacity;
+    }
+  }
+  if (_writeQueue.empty() ||
+      _writeQueue.back().capacity - _writeQueue.back().size < size) {
+    // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+    _writeQueue.push_back({std::unique_ptr<char[]>(new char[size]), 0, size,
+                           _deflate != nullptr});
+  }
+
+  auto& slab = _writeQueue.back();
+  auto* out = reinterpret_cast<uint8_t*>(slab.buf.get() + slab.size);
+  slab.size += size;
+  _queuedBytes += size;
+  return out;
+}
+
+template <typename Handle>
+void StreamTransportConnection<Handle>::PumpWrite() {
+  if (_isWriting || _socketClosed || (_writeQueue.empty() && !_tls)) {
+    return;
+  }
+
+  if (!_writeQueue.empty()) {
+    auto front = std::move(_writeQueue.front());
+    _writeQueue.pop_front();
+    _queuedBytes -= front.size;
+    if (front.encode && !EncodeSlab(front.buf, front.size)) {
+      return;
+    }
+    if (!_tls) {
+      _isWriting = true;
+      _socket->write(std::move(front.buf), front.size);
+      return;
+    }
+    // Held as plaintext until the handshake is done.
+    if (!_tls->Write(front.buf.get(), front.size)) {
+      spdlog::get(_logName)->warn(
+          "TCP transport: TLS failure for client {}:{}; disconnecting",
+          _remoteEndpoint.ip, _remoteEndpoint.port);
+      Fail();
+      return;
+    }
+  }
+
+  // Records go out in the order OpenSSL produced them, so handshake
+  // messages (e.g. session tickets) never overtake data sealed after them.
+  // ws28 hands over everything pending as one chunk (it only splits it if
+  // the callback writes more), so that's copied once, straight into a
+  // write of its exact size.
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+  std::unique_ptr<char[]> out;
+  size_t size = 0;
+  _tls->ForEachPendingWrite([&out, &size](const char* data, size_t len) {
+    // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+    std::unique_ptr<char[]> joined(new char[size + len]);
+    if (size != 0) {
+      std::memcpy(joined.get(), out.get(), size);
+    }
+    std::memcpy(joined.get() + size, data, len);
+    out = std::move(joined);
+    size += len;
+  });
+  if (size == 0) {
     return;
   }
-  auto front = std::move(_writeQueue.front());
-  _writeQueue.pop_front();
-  _queuedBytes -= front.size;
   _isWriting = true;
-  _socket->write(std::move(front.buf), front.size);
+  _socket->write(std::move(out), size);
 }
 
-void TcpTransportConnection::Close() {
-  if (_closed) {
+template <typename Handle>
+void StreamTransportConnection<Handle>::Fail() {
+  // Unlike Close(), the handler has to hear about this so it tears down
+  // (unsubscribes, routes post-removes) instead of lingering with a dead
+  // transport. We're likely inside one of its own Sends though, so leave
+  // that to HandleClose once the socket's closed.
+  if (!_state.Fail()) {
+    return;
+  }
+
+  // Nothing more is going out, so don't wait on a write in flight either.
+  _writeQueue.clear();
+  _queuedBytes = 0;
+  if (!_socketClosed) {
+    _socket->close();
+    _socketClosed = true;
+  }
+}
+
+template <typename Handle>
+// NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+bool StreamTransportConnection<Handle>::EncodeSlab(
+    std::unique_ptr<char[]>& buf, size_t& size) {
+  constexpr size_t kBlockHeader = sizeof(uint8_t) + sizeof(uint16_t);
+  constexpr size_t kMaxBlock = std::numeric_limits<uint16_t>::max();
+
+  const auto* data = reinterpret_cast<const uint8_t*>(buf.get());
+  uint8_t kind = 0;
+  if (size >= _compression->threshold) {
+    const auto start = std::chrono::steady_clock::now();
+    _compressBuffer.clear();
+    if (!_deflate->Compress(data, size, _compressBuffer)) {
+      spdlog::get(_logName)->error(
+          "TCP transport: compression failed for client {}:{}; "
+          "disconnecting",
+          _remoteEndpoint.ip, _remoteEndpoint.port);
+      Fail();
+      return false;
+    }
+    CompressionMetrics::Record(CompressionMetrics::Transport::Tcp, size,
+                               _compressBuffer.size(),
+                               std::chrono::steady_clock::now() - start);
+    data = _compressBuffer.data();
+    size = _compressBuffer.size();
+    kind = 1;
+  }
+
+  // Split into blocks of at most kMaxBlock bytes each.
+  const size_t blocks = (size + kMaxBlock - 1) / kMaxBlock;
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+  std::unique_ptr<char[]> out(new char[size + blocks * kBlockHeader]);
+  size_t written = 0;
+  for (size_t offset = 0; offset < size;) {
+    const auto len = static_cast<uint16_t>(std::min(size - offset, kMaxBlock));
+    out[written] = static_cast<char>(kind);
+    std::memcpy(out.get() + written + 1, &len, sizeof(uint16_t));
+    std::memcpy(out.get() + written + kBlockHeader, data + offset, len);
+    written += kBlockHeader + len;
+    offset += len;
+  }
+
+  buf = std::move(out);
+  size = written;
+  return true;
+}
+
+template <typename Handle>
+void StreamTransportConnection<Handle>::Close() {
+  if (!_state.Close()) {
     return;
   }
-  _closed = true;
 
   // Abandon anything queued; we're not going to flush it.
   _writeQueue.clear();
@@ -159,19 +356,25 @@ void TcpTransportConnection::Close() {
   }
 }
 
-TransportEndpoint TcpTransportConnection::RemoteEndpoint() const {
+template <typename Handle>
+TransportEndpoint StreamTransportConnection<Handle>::RemoteEndpoint()
+    const {
   return _remoteEndpoint;
 }
 
-TransportEndpoint TcpTransportConnection::LocalEndpoint() const {
+template <typename Handle>
+TransportEndpoint StreamTransportConnection<Handle>::LocalEndpoint()
+    const {
   return _localEndpoint;
 }
 
-void TcpTransportConnection::HandleClose(int /*err*/) {
-  if (_closed) {
+template <typename Handle>
+void StreamTransportConnection<Handle>::HandleClose(int /*err*/) {
+  // Already closed, unless it was Fail() and the handler is still to be
+  // told.
+  if (!_state.Finish()) {
     return;
   }
-  _closed = true;
   _socketClosed = true;
 
   if (auto handler = _handler.lock()) {
@@ -179,48 +382,86 @@ void TcpTransportConnection::HandleClose(int /*err*/) {
   }
 }
 
+template <typename Handle>
 // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> from uvw read
-void TcpTransportConnection::HandleData(const std::unique_ptr<char[]>& data,
-                                        size_t size) {
-  // Fast path: a single complete datagram in this chunk and no
-  // accumulator state. Avoids the buffer copy.
-  if (_readBuffer.empty() && size >= sizeof(uint16_t)) {
-    uint16_t dgSize;
-    std::memcpy(&dgSize, data.get(), sizeof(dgSize));
-    if (dgSize == size - sizeof(uint16_t)) {
-      DeliverMessage(
-          reinterpret_cast<const uint8_t*>(data.get() + sizeof(uint16_t)),
-          dgSize);
-      return;
-    }
+void StreamTransportConnection<Handle>::HandleData(
+    const std::unique_ptr<char[]>& data, size_t size) {
+  if (!_tls) {
+    HandlePlaintext(reinterpret_cast<const uint8_t*>(data.get()), size);
+    return;
   }
 
-  _readBuffer.insert(_readBuffer.end(), data.get(), data.get() + size);
-  ProcessBuffer();
+  const bool ok =
+      _tls->ReceivedData(data.get(), size, [this](const char* plain,
+                                                  size_t len) {
+        if (!_state.Closed()) {
+          HandlePlaintext(reinterpret_cast<const uint8_t*>(plain), len);
+        }
+      });
+  if (_state.Closed()) {
+    return;
+  }
+  // The empty write seals anything queued before the handshake finished.
+  if (!ok || !_tls->Write(nullptr, 0)) {
+    spdlog::get(_logName)->debug(
+        "TCP transport: TLS handshake failed for client {}:{}",
+        _remoteEndpoint.ip, _remoteEndpoint.port);
+    Fail();
+    return;
+  }
+  PumpWrite();
 }
 
-void TcpTransportConnection::ProcessBuffer() {
-  while (_readBuffer.size() > sizeof(uint16_t)) {
-    uint16_t dgSize;
-    std::memcpy(&dgSize, _readBuffer.data(), sizeof(dgSize));
-    if (_readBuffer.size() < dgSize + sizeof(uint16_t)) {
-      return;  // partial; wait for more bytes
-    }
+template <typename Handle>
+void StreamTransportConnection<Handle>::HandlePlaintext(const uint8_t* data,
+                                                        size_t size) {
+  // Handlers may close (or destroy) us mid-read.
+  _framer.Feed(data, size,
+               [this, alive = _alive](const uint8_t* message, size_t len) {
+                 DeliverMessage(message, len);
+                 return *alive && !_state.Closed();
+               });
+}
 
-    DeliverMessage(_readBuffer.data() + sizeof(uint16_t), dgSize);
-    _readBuffer.erase(_readBuffer.begin(),
-                      _readBuffer.begin() + sizeof(uint16_t) + dgSize);
+template <typename Handle>
+void StreamTransportConnection<Handle>::DeliverMessage(const uint8_t* data,
+                                                       size_t len) {
+  if (_framer.IsNegotiation(len)) {
+    HandleNegotiation(data);
+    return;
   }
-}
 
-void TcpTransportConnection::DeliverMessage(const uint8_t* data, size_t len) {
   if (auto handler = _handler.lock()) {
     handler->OnTransportMessage(data, len);
   }
 }
 
-TcpTransportListener::TcpTransportListener()
-    : _listenHandle(g_loop->resource<uvw::tcp_handle>()) {}
+template <typename Handle>
+void StreamTransportConnection<Handle>::HandleNegotiation(
+    const uint8_t* data) {
+  constexpr uint8_t kDeflate = 1;
+  const uint8_t chosen =
+      data[0] == kDeflate && _compression->enabled ? kDeflate : 0;
+  Send(&chosen, sizeof(chosen));
+  if (chosen == kDeflate && !_state.Closed()) {
+    // The answer itself goes out uncompressed: seal its slab so everything
+    // after it starts a new one.
+    if (!_writeQueue.empty()) {
+      _writeQueue.back().capacity = _writeQueue.back().size;
+    }
+    _deflate = std::make_unique<DeflateStream>(_compression->level);
+  }
+}
+
+template class StreamTransportConnection<uvw::tcp_handle>;
+template class StreamTransportConnection<uvw::pipe_handle>;
+
+TcpTransportListener::TcpTransportListener(
+    std::shared_ptr<const CompressionOptions> compression,
+    std::shared_ptr<const TlsContext> tls)
+    : _listenHandle(g_loop->resource<uvw::tcp_handle>()),
+      _compression(std::move(compression)),
+      _tls(std::move(tls)) {}
 
 void TcpTransportListener::SetConnectionFactory(ConnectionFactory factory) {
   _factory = std::move(factory);
@@ -235,7 +476,8 @@ bool TcpTransportListener::Listen(const std::string& host, int port) {
         std::shared_ptr<uvw::tcp_handle> client =
             srv.parent().resource<uvw::tcp_handle>();
         srv.accept(*client);
-        _factory(std::make_unique<TcpTransportConnection>(std::move(client)));
+        _factory(std::make_unique<TcpTransportConnection>(
+            std::move(client), "ca", _compression, _tls));
       });
 
   _listenHandle->bind(host, port);
@@ -7,21 +7,54 @@
 #include <uvw.hpp>
 #include <vector>
 
+#include "compression.h"
+#include "stream_framing.h"
 #include "transport.h"
 
+namespace ws28 {
+class TLS;
+}  // namespace ws28
+
 namespace Ardos {
 
-// libuv-backed TCP connection. Frames protocol datagrams over the byte
-// stream as [uint16 LE length][payload].
-class TcpTransportConnection final : public ITransportConnection {
+class TlsContext;
+
+// libuv-backed stream connection. Frames protocol datagrams over the byte
+// stream as [uint16 LE length][payload]. Shared by the Client Agent and
+// the Message Director's participant listener; `logName` picks which
+// role's logger transport warnings go to. `Handle` is uvw::tcp_handle for
+// TCP or uvw::pipe_handle for Unix domain sockets (see the aliases below).
+//
+// Given `compression` options (client connections only), the peer may ask
+// for a compressed server->client stream by making its very first message
+// a single byte naming the method: 0 for none, 1 for deflate. No real
+// message is that short. We answer with a single byte too, naming the
+// method we picked (0 whenever compression is disabled). After a 1, every
+// byte we send is wrapped in blocks of
+//   [uint8 kind][uint16 LE length][bytes]
+// where kind 0 carries the framed stream as is and kind 1 carries the next
+// piece of one raw deflate stream (RFC 1951, sync-flushed at the end of
+// each block), which inflates to the framed stream. Writes under the
+// threshold go out as kind 0. What the client sends stays uncompressed.
+//
+// Given a `tls` context, the whole stream (compression negotiation and
+// all) runs inside TLS, with OpenSSL working on memory buffers so libuv
+// still does the socket I/O. Clients that don't speak TLS are dropped.
+template <typename Handle>
+class StreamTransportConnection final : public ITransportConnection {
  public:
-  explicit TcpTransportConnection(std::shared_ptr<uvw::tcp_handle> socket);
-  ~TcpTransportConnection() override;
+  explicit StreamTransportConnection(
+      std::shared_ptr<Handle> socket, std::string logName = "ca",
+      std::shared_ptr<const CompressionOptions> compression = nullptr,
+      std::shared_ptr<const TlsContext> tls = nullptr);
+  ~StreamTransportConnection() override;
 
   void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
   void Send(const uint8_t* data, size_t len,
             Reliability r = Reliability::Reliable) override;
+  void SendBatch(const uint8_t* data, size_t len) override;
   void Close() override;
+  [[nodiscard]] size_t QueuedBytes() const override { return _queuedBytes; }
   [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
   [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
 
@@ -29,30 +62,64 @@ class TcpTransportConnection final : public ITransportConnection {
   void HandleClose(int err);
   // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> from uvw read
   void HandleData(const std::unique_ptr<char[]>& data, size_t size);
-  void ProcessBuffer();
+  // Frames decrypted (or plain) bytes read from the socket.
+  void HandlePlaintext(const uint8_t* data, size_t size);
   void DeliverMessage(const uint8_t* data, size_t len);
+  // Answers the compression request that opened the stream.
+  void HandleNegotiation(const uint8_t* data);
+  // Replaces a slab queued after compression was agreed with its blocks.
+  // Returns false (after disconnecting) if zlib fails.
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
+  bool EncodeSlab(std::unique_ptr<char[]>& buf, size_t& size);
+  // Makes room for `size` more bytes at the end of the write queue and
+  // returns where to put them, or nullptr (after disconnecting) if that
+  // would take the backlog past kHighWaterBytes.
+  uint8_t* Reserve(size_t size);
   // Issues the next queued write, if any, when no write is in flight.
+  // Under TLS that's whatever OpenSSL has produced so far (handshake
+  // records included), after encrypting the next queued slab.
   void PumpWrite();
+  // Tears down after a transport-level failure. The handler is told from
+  // the loop once the socket has closed, never from inside the call that
+  // failed.
+  void Fail();
 
-  std::shared_ptr<uvw::tcp_handle> _socket;
+  std::shared_ptr<Handle> _socket;
+  std::string _logName;
   std::weak_ptr<ITransportHandler> _handler;
   TransportEndpoint _remoteEndpoint;
   TransportEndpoint _localEndpoint;
 
-  // Accumulator for partial datagrams across uvw data_events.
-  std::vector<uint8_t> _readBuffer;
+  // Splits reads into datagrams, partial ones included.
+  StreamFramer _framer;
 
-  // Application-level write queue bounded by kHighWaterBytes.
+  // Application-level write queue bounded by kHighWaterBytes. Datagrams
+  // are framed straight into the newest slab, so everything sent while a
+  // write is in flight goes out together in the next one, up to
+  // kWriteSlabBytes per write. Slabs start at the size of their first
+  // datagram and double as more are framed in, so a connection with a
+  // little traffic never holds a whole kWriteSlabBytes.
   struct PendingWrite {
     // NOLINTNEXTLINE(modernize-avoid-c-arrays): unique_ptr<char[]> for uvw
     std::unique_ptr<char[]> buf;
     size_t size;
+    size_t capacity;
+    // Wrap in compression blocks when it's written.
+    bool encode;
   };
   std::deque<PendingWrite> _writeQueue;
   size_t _queuedBytes = 0;
   static constexpr size_t kHighWaterBytes = size_t{4} * 1024 * 1024;  // 4 MiB
+  static constexpr size_t kWriteSlabBytes = size_t{64} * 1024;
+
+  std::shared_ptr<const CompressionOptions> _compression;
+  std::unique_ptr<DeflateStream> _deflate;
+  std::vector<uint8_t> _compressBuffer;
+
+  std::shared_ptr<const TlsContext> _tlsContext;
+  std::unique_ptr<ws28::TLS> _tls;
 
-  bool _closed = false;
+  StreamCloseState _state;
   bool _isWriting = false;
   bool _socketClosed = false;
 
@@ -62,12 +129,22 @@ class TcpTransportConnection final : public ITransportConnection {
   std::shared_ptr<bool> _alive = std::make_shared<bool>(true);
 };
 
+using TcpTransportConnection = StreamTransportConnection<uvw::tcp_handle>;
+// Same framing over a Unix domain socket, for participants on the MD's own
+// host. Endpoints carry the socket path in `ip` and leave port=0.
+using PipeTransportConnection = StreamTransportConnection<uvw::pipe_handle>;
+
+extern template class StreamTransportConnection<uvw::tcp_handle>;
+extern template class StreamTransportConnection<uvw::pipe_handle>;
+
 // Accepts inbound TCP connections via libuv. On accept, builds a
 // TcpTransportConnection and hands it to the configured factory (which
 // is expected to construct and Init() a ClientParticipant around it).
 class TcpTransportListener final : public ITransportListener {
  public:
-  TcpTransportListener();
+  explicit TcpTransportListener(
+      std::shared_ptr<const CompressionOptions> compression = nullptr,
+      std::shared_ptr<const TlsContext> tls = nullptr);
   ~TcpTransportListener() override = default;
 
   void SetConnectionFactory(ConnectionFactory factory) override;
@@ -76,6 +153,8 @@ class TcpTransportListener final : public ITransportListener {
  private:
   std::shared_ptr<uvw::tcp_handle> _listenHandle;
   ConnectionFactory _factory;
+  std::shared_ptr<const CompressionOptions> _compression;
+  std::shared_ptr<const TlsContext> _tls;
 };
 
 }  // namespace Ardos
@@ -0,0 +1,69 @@
+#include "tls_context.h"
+
+#include <spdlog/spdlog.h>
+#include <ws28/TLS.h>
+
+namespace Ardos {
+
+namespace {
+
+// Identifies our sessions in the cache; any fixed string will do.
+constexpr unsigned char kSessionIdContext[] = "ardos-ca";
+
+}  // namespace
+
+/**
+ * Builds the server context for client connections.
+ * @param certificate
+ * @param privateKey
+ * @param sessionTimeout
+ * @param logName
+ * @return
+ */
+std::shared_ptr<TlsContext> TlsContext::Create(const std::string& certificate,
+                                               const std::string& privateKey,
+                                               long sessionTimeout,
+                                               const std::string& logName) {
+  ws28::TLS::InitSSL();
+
+  SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+  if (!ctx) {
+    spdlog::get(logName)->error("Unable to create SSL context");
+    return nullptr;
+  }
+  // Owns ctx from here on, so early returns free it.
+  std::shared_ptr<TlsContext> context(new TlsContext(ctx));
+
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx, certificate.c_str()) <= 0) {
+    spdlog::get(logName)->error("Failed to load cert file: {}", certificate);
+    return nullptr;
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx, privateKey.c_str(), SSL_FILETYPE_PEM) <=
+      0) {
+    spdlog::get(logName)->error("Failed to load private key file: {}",
+                                privateKey);
+    return nullptr;
+  }
+  if (!SSL_CTX_check_private_key(ctx)) {
+    spdlog::get(logName)->error("Private key {} doesn't match cert {}",
+                                privateKey, certificate);
+    return nullptr;
+  }
+
+  // Resumption: TLS 1.2 clients can come back by session id, and every
+  // client is sent tickets (the OpenSSL default) for stateless resumption.
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, kSessionIdContext,
+                                 sizeof(kSessionIdContext) - 1);
+  SSL_CTX_set_timeout(ctx, sessionTimeout);
+
+  return context;
+}
+
+TlsContext::TlsContext(SSL_CTX* ctx) : _ctx(ctx) {}
+
+TlsContext::~TlsContext() { SSL_CTX_free(_ctx); }
+
+}  // namespace Ardos
@@ -0,0 +1,38 @@
+#ifndef ARDOS_TLS_CONTEXT_H
+#define ARDOS_TLS_CONTEXT_H
+
+#include <openssl/ssl.h>
+
+#include <memory>
+#include <string>
+
+namespace Ardos {
+
+// client-agent.tls: the server SSL_CTX every client connection is created
+// from, on any loop (OpenSSL contexts are safe to share once set up).
+// Sessions are cached server-side and handed out as tickets, so a
+// reconnecting client can resume instead of doing a full handshake.
+class TlsContext {
+ public:
+  // Loads the PEM certificate chain and private key. Returns nullptr if
+  // either can't be loaded (after logging why to `logName`).
+  static std::shared_ptr<TlsContext> Create(const std::string& certificate,
+                                            const std::string& privateKey,
+                                            long sessionTimeout,
+                                            const std::string& logName);
+  ~TlsContext();
+
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  [[nodiscard]] SSL_CTX* Get() const { return _ctx; }
+
+ private:
+  explicit TlsContext(SSL_CTX* ctx);
+
+  SSL_CTX* _ctx;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_TLS_CONTEXT_H
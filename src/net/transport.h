@@ -3,14 +3,18 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
 
+#include "datagram.h"
+
 namespace Ardos {
 
 // Reliability hint for transports that support multiple lanes (currently
-// only meaningful for GameNetworkingSockets in the future). TCP/WS always
+// the udp transport, which sends Unreliable datagrams on a lane that never
+// retransmits or holds later traffic back). The stream transports always
 // deliver reliably and ignore the flag.
 enum class Reliability : std::uint8_t {
   Reliable,
@@ -24,7 +28,8 @@ struct TransportEndpoint {
   std::uint16_t port = 0;
 };
 
-// Receives events from a transport. Implemented by ClientParticipant.
+// Receives events from a transport. Implemented by ClientParticipant and
+// MDParticipant.
 //
 // The connection holds a weak_ptr to its handler so a destroyed handler
 // doesn't strand callbacks on freed memory -- if the handler has been
@@ -39,6 +44,19 @@ class ITransportHandler {
   // protocol message body.
   virtual void OnTransportMessage(const uint8_t* data, size_t len) = 0;
 
+  // Same as OnTransportMessage, for transports that already hold the
+  // payload in its own Datagram (e.g. one handed over from a worker loop).
+  // Handlers that wrap the payload in a Datagram anyway override this to
+  // take ownership instead of copying.
+  virtual void OnTransportDatagram(const std::shared_ptr<Datagram>& dg) {
+    OnTransportMessage(dg->GetData(), dg->Size());
+  }
+
+  // Everything handed to Send has been passed on to the socket. Only
+  // transports that queue writes (see ITransportConnection::QueuedBytes)
+  // report this, so handlers pacing a bulk send can top the queue back up.
+  virtual void OnTransportDrain() {}
+
   // The peer closed the connection or the transport errored out. Called
   // at most once per connection. The handler should treat this as the
   // signal to release any resources tied to the connection.
@@ -46,7 +64,7 @@ class ITransportHandler {
 };
 
 // Per-connection transport handle owned by the per-connection handler
-// (typically ClientParticipant). Sending and closing are routed through
+// (ClientParticipant or MDParticipant). Sending and closing are routed through
 // this; transport-specific framing/encoding lives in the implementation.
 class ITransportConnection {
  public:
@@ -66,6 +84,37 @@ class ITransportConnection {
   virtual void Send(const uint8_t* data, size_t len,
                     Reliability r = Reliability::Reliable) = 0;
 
+  // Send a datagram the caller won't mutate again. Transports that hand
+  // the bytes to another thread override this to share the buffer rather
+  // than copy it; everything else just frames it like Send.
+  virtual void SendDatagram(const std::shared_ptr<Datagram>& dg,
+                            Reliability r = Reliability::Reliable) {
+    Send(dg->GetData(), dg->Size(), r);
+  }
+
+  // Send several datagrams at once, already framed back to back as
+  // [uint16 LE length][payload] (see client-agent.batching). Stream
+  // transports write the bytes as they are and WS sends them as one binary
+  // frame, which the client then splits on the length prefixes; the default
+  // just sends the datagrams one by one.
+  virtual void SendBatch(const uint8_t* data, size_t len) {
+    for (size_t offset = 0; offset + sizeof(uint16_t) <= len;) {
+      uint16_t size;
+      std::memcpy(&size, data + offset, sizeof(uint16_t));
+      offset += sizeof(uint16_t);
+      if (size > len - offset) {
+        return;
+      }
+      Send(data + offset, size);
+      offset += size;
+    }
+  }
+
+  // Bytes accepted by Send that are still queued in the transport, not
+  // counting a write already in flight. Transports that don't queue
+  // report 0 and never call OnTransportDrain.
+  [[nodiscard]] virtual size_t QueuedBytes() const { return 0; }
+
   // Close the connection. Idempotent. Triggers OnTransportDisconnect on
   // the handler (asynchronously, after the underlying socket has been
   // cleanly closed).
@@ -80,7 +129,8 @@ class ITransportConnection {
 
 // Accepts incoming connections on a host:port and dispatches each to a
 // factory that produces the per-connection handler. Concrete impls:
-// TcpTransportListener (libuv TCP) and WsTransportListener (ws28). The
+// TcpTransportListener (libuv TCP), WsTransportListener (ws28) and
+// UdpTransportListener, among others. The
 // listener owns the underlying socket / WS server; its lifetime is
 // bounded by the ClientAgent that created it.
 class ITransportListener {
@@ -0,0 +1,567 @@
+#include "transport_worker.h"
+
+#include <prometheus/counter.h>
+#include <prometheus/gauge.h>
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "../util/globals.h"
+#include "../util/metrics.h"
+#include "tcp_transport.h"
+
+namespace Ardos {
+
+// Worker-side half of an adopted connection: the real stream transport plus
+// the handler that relays its events back to the main loop.
+struct TransportWorker::Connection final : public ITransportHandler {
+  Connection(TransportWorker* worker, uint64_t id) : worker(worker), id(id) {}
+
+  void OnTransportMessage(const uint8_t* data, size_t len) override {
+    worker->PostEvent({.type = Event::Type::Datagram,
+                       .id = id,
+                       .dg = Datagram::Create(data, len)});
+  }
+
+  void OnTransportDisconnect() override {
+    worker->PostEvent({.type = Event::Type::Disconnect, .id = id});
+  }
+
+  TransportWorker* worker;
+  uint64_t id;
+  std::unique_ptr<ITransportConnection> transport;
+};
+
+WorkerTransportConnection::WorkerTransportConnection(TransportWorker* worker,
+                                                     uint64_t id,
+                                                     TransportEndpoint remote,
+                                                     TransportEndpoint local)
+    : _worker(worker),
+      _id(id),
+      _remoteEndpoint(std::move(remote)),
+      _localEndpoint(std::move(local)) {}
+
+WorkerTransportConnection::~WorkerTransportConnection() {
+  // Always tell the worker to drop its half, even if the disconnect came
+  // from the worker side in the first place.
+  Close();
+  _worker->_proxies.erase(_id);
+  _worker->UpdateConnectionsGauge();
+}
+
+void WorkerTransportConnection::SetHandler(std::weak_ptr<ITransportHandler> h) {
+  _handler = std::move(h);
+}
+
+void WorkerTransportConnection::Send(const uint8_t* data, size_t len,
+                                     Reliability r) {
+  // Raw buffers belong to the caller; take a copy to hand across threads.
+  SendDatagram(Datagram::Create(data, len), r);
+}
+
+void WorkerTransportConnection::SendDatagram(
+    const std::shared_ptr<Datagram>& dg, Reliability r) {
+  if (_closed) {
+    return;
+  }
+
+  if (_worker->_datagramsOutCounter) {
+    _worker->_datagramsOutCounter->Increment();
+  }
+
+  // The worker reads the bytes later, on its own thread; a borrowed view
+  // may be gone (or copied out from under it) by then.
+  _worker->Post({.type = TransportWorker::Command::Type::Send,
+                 .id = _id,
+                 .dg = dg->IsBorrowed()
+                           ? Datagram::Create(dg->GetData(), dg->Size())
+                           : dg,
+                 .reliability = r});
+}
+
+void WorkerTransportConnection::SendBatch(const uint8_t* data, size_t len) {
+  if (_closed || len == 0) {
+    return;
+  }
+
+  // One command for the lot; the worker's connection writes it as it is.
+  _worker->Post({.type = TransportWorker::Command::Type::SendBatch,
+                 .id = _id,
+                 .dg = Datagram::Create(data, len)});
+}
+
+void WorkerTransportConnection::Close() {
+  _closed = true;
+  if (_closePosted) {
+    return;
+  }
+  _closePosted = true;
+
+  _worker->Post({.type = TransportWorker::Command::Type::Close, .id = _id});
+}
+
+TransportEndpoint WorkerTransportConnection::RemoteEndpoint() const {
+  return _remoteEndpoint;
+}
+
+TransportEndpoint WorkerTransportConnection::LocalEndpoint() const {
+  return _localEndpoint;
+}
+
+void WorkerTransportConnection::HandleDatagram(
+    const std::shared_ptr<Datagram>& dg) {
+  if (_closed) {
+    return;
+  }
+
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportDatagram(dg);
+  }
+}
+
+void WorkerTransportConnection::HandleDisconnect() {
+  if (_closed) {
+    return;
+  }
+  _closed = true;
+
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportDisconnect();
+  }
+}
+
+TransportWorker::TransportWorker(std::string logName, size_t index)
+    : _logName(std::move(logName)),
+      _index(index),
+      _loop(uvw::loop::create()) {
+  InitMetrics();
+
+  // Both wakeups are created here, before the worker thread exists, so the
+  // worker loop is never touched from two threads at once.
+  _workerWakeup = _loop->resource<uvw::async_handle>();
+  _workerWakeup->on<uvw::async_event>(
+      [this](const uvw::async_event&, uvw::async_handle&) {
+        HandleCommands();
+      });
+
+  _mainWakeup = g_loop->resource<uvw::async_handle>();
+  _mainWakeup->on<uvw::async_event>(
+      [this](const uvw::async_event&, uvw::async_handle&) { HandleEvents(); });
+
+  _thread = std::thread([this]() {
+    spdlog::get(_logName)->debug("Worker loop {} running", _index);
+    _loop->run();
+  });
+}
+
+TransportWorker::~TransportWorker() {
+  _stopping.store(true, std::memory_order_release);
+  _workerWakeup->send();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+
+  _loop->close();
+  _mainWakeup->close();
+}
+
+/**
+ * Hands an accepted socket over to this worker. The descriptor is
+ * duplicated and re-opened on the worker's loop; the main loop's handle is
+ * then closed without ever having been read from.
+ * @param socket
+ * @return
+ */
+std::unique_ptr<ITransportConnection> TransportWorker::Adopt(
+    const std::shared_ptr<uvw::tcp_handle>& socket) {
+  auto remote = socket->peer();
+  auto local = socket->sock();
+  auto proxy = AdoptHandle(
+      reinterpret_cast<const uv_handle_t*>(socket->raw()),
+      {.ip = remote.ip, .port = static_cast<uint16_t>(remote.port)},
+      {.ip = local.ip, .port = static_cast<uint16_t>(local.port)}, false);
+  if (proxy) {
+    socket->close();
+  }
+  return proxy;
+}
+
+/**
+ * Hands an accepted Unix domain socket over to this worker.
+ * @param socket
+ * @return
+ */
+std::unique_ptr<ITransportConnection> TransportWorker::Adopt(
+    const std::shared_ptr<uvw::pipe_handle>& socket) {
+  // Clients usually connect unnamed; report the listener's path instead.
+  std::string local = socket->sock();
+  std::string remote = socket->peer();
+  auto proxy = AdoptHandle(reinterpret_cast<const uv_handle_t*>(socket->raw()),
+                           {.ip = remote.empty() ? local : remote},
+                           {.ip = local}, true);
+  if (proxy) {
+    socket->close();
+  }
+  return proxy;
+}
+
+/**
+ * Duplicates an accepted handle's descriptor for the worker loop and posts
+ * its adoption. Returns nullptr, leaving the handle untouched, on failure.
+ * @param handle
+ * @param remote
+ * @param local
+ * @param pipe
+ * @return
+ */
+std::unique_ptr<ITransportConnection> TransportWorker::AdoptHandle(
+    const uv_handle_t* handle, TransportEndpoint remote,
+    TransportEndpoint local, bool pipe) {
+#ifdef _WIN32
+  // Winsock handles can't be moved between loops by dup(); serve inline.
+  return nullptr;
+#else
+  uv_os_fd_t fd;
+  if (uv_fileno(handle, &fd) != 0) {
+    return nullptr;
+  }
+
+  const int adoptedFd = dup(fd);
+  if (adoptedFd < 0) {
+    spdlog::get(_logName)->warn("Worker {} failed to dup socket: {}", _index,
+                                std::strerror(errno));
+    return nullptr;
+  }
+
+  const uint64_t id = ++_nextId;
+  auto proxy = std::make_unique<WorkerTransportConnection>(
+      this, id, std::move(remote), std::move(local));
+  _proxies[id] = proxy.get();
+  UpdateConnectionsGauge();
+
+  Post({.type = Command::Type::Adopt,
+        .id = id,
+        .fd = adoptedFd,
+        .pipe = pipe});
+  return proxy;
+#endif
+}
+
+/**
+ * Binds a SO_REUSEPORT listening socket on host:port and hands it to the
+ * worker loop, which accepts on it from then on.
+ * @param host
+ * @param port
+ * @param factory
+ * @param compression
+ * @param tls
+ * @return
+ */
+bool TransportWorker::Listen(
+    const std::string& host, int port,
+    ITransportListener::ConnectionFactory factory,
+    std::shared_ptr<const CompressionOptions> compression,
+    std::shared_ptr<const TlsContext> tls) {
+#ifdef _WIN32
+  spdlog::get(_logName)->error(
+      "Worker {} can't listen by itself: SO_REUSEPORT isn't available",
+      _index);
+  return false;
+#else
+  sockaddr_storage addr{};
+  socklen_t addrLen = sizeof(sockaddr_in);
+  if (uv_ip4_addr(host.c_str(), port, reinterpret_cast<sockaddr_in*>(&addr)) !=
+      0) {
+    addrLen = sizeof(sockaddr_in6);
+    if (uv_ip6_addr(host.c_str(), port,
+                    reinterpret_cast<sockaddr_in6*>(&addr)) != 0) {
+      spdlog::get(_logName)->error("Worker {} can't listen on invalid host {}",
+                                   _index, host);
+      return false;
+    }
+  }
+
+  // Every worker binds its own socket to the same address; the kernel then
+  // spreads incoming connections across them.
+  const int on = 1;
+  const int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      bind(fd, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    spdlog::get(_logName)->error("Worker {} failed to listen on {}:{}: {}",
+                                 _index, host, port, std::strerror(errno));
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+
+  _acceptFactory = std::move(factory);
+  _acceptCompression = std::move(compression);
+  _acceptTls = std::move(tls);
+  Post({.type = Command::Type::Listen, .id = 0, .fd = fd});
+  return true;
+#endif
+}
+
+/**
+ * Queues a command for the worker loop. Main thread only.
+ * @param command
+ */
+void TransportWorker::Post(Command command) {
+  _commands.Push(std::move(command));
+  _workerWakeup->send();
+}
+
+/**
+ * Queues an event for the main loop. Worker thread only.
+ * @param event
+ */
+void TransportWorker::PostEvent(Event event) {
+  _events.Push(std::move(event));
+  _mainWakeup->send();
+}
+
+/**
+ * Worker thread: drains commands posted by the main loop.
+ */
+void TransportWorker::HandleCommands() {
+  if (_stopping.load(std::memory_order_acquire)) {
+    // Closing every transport and our wakeup leaves the loop with nothing
+    // active, so run() returns once the socket closes have completed.
+    _connections.clear();
+    if (_listenHandle) {
+      _listenHandle->close();
+    }
+    _workerWakeup->close();
+    return;
+  }
+
+  // The main loop asked us to retry events that didn't fit the ring.
+  if (_events.Spilled()) {
+    _events.Flush();
+    _mainWakeup->send();
+  }
+
+  while (auto command = _commands.Pop()) {
+    switch (command->type) {
+      case Command::Type::Adopt:
+        AdoptSocket(command->id, command->fd, command->pipe);
+        break;
+      case Command::Type::Listen:
+        AdoptListener(command->fd);
+        break;
+      case Command::Type::Send:
+        if (auto it = _connections.find(command->id);
+            it != _connections.end()) {
+          it->second->transport->SendDatagram(command->dg,
+                                              command->reliability);
+        }
+        break;
+      case Command::Type::SendBatch:
+        if (auto it = _connections.find(command->id);
+            it != _connections.end()) {
+          it->second->transport->SendBatch(command->dg->GetData(),
+                                           command->dg->Size());
+        }
+        break;
+      case Command::Type::Close:
+        _connections.erase(command->id);
+        break;
+    }
+  }
+
+  if (_commands.TakeFlushRequest()) {
+    _mainWakeup->send();
+  }
+}
+
+/**
+ * Main thread: replays events posted by the worker loop to their proxies.
+ */
+void TransportWorker::HandleEvents() {
+  // The worker asked us to retry commands that didn't fit the ring.
+  if (_commands.Spilled()) {
+    _commands.Flush();
+    _workerWakeup->send();
+  }
+
+  while (auto event = _events.Pop()) {
+    if (event->type == Event::Type::Accept) {
+      auto proxy = std::make_unique<WorkerTransportConnection>(
+          this, event->id, std::move(event->remote), std::move(event->local));
+      _proxies[event->id] = proxy.get();
+      UpdateConnectionsGauge();
+      // Without a factory the proxy is dropped here, closing the socket.
+      if (_acceptFactory) {
+        _acceptFactory(std::move(proxy));
+      }
+      continue;
+    }
+
+    // Handlers may destroy proxies (and so erase from _proxies), so look
+    // each one up fresh rather than holding an iterator across the call.
+    auto it = _proxies.find(event->id);
+    if (it == _proxies.end()) {
+      continue;
+    }
+
+    switch (event->type) {
+      case Event::Type::Accept:
+        break;
+      case Event::Type::Datagram:
+        if (_datagramsInCounter) {
+          _datagramsInCounter->Increment();
+        }
+        it->second->HandleDatagram(event->dg);
+        break;
+      case Event::Type::Disconnect:
+        it->second->HandleDisconnect();
+        break;
+    }
+  }
+
+  if (_events.TakeFlushRequest()) {
+    _workerWakeup->send();
+  }
+}
+
+/**
+ * Worker thread: opens an adopted descriptor on this loop and wraps it in a
+ * stream transport whose events are relayed back to the main loop.
+ * @param id
+ * @param fd
+ * @param pipe
+ */
+void TransportWorker::AdoptSocket(uint64_t id, int fd, bool pipe) {
+  std::unique_ptr<ITransportConnection> transport;
+  if (pipe) {
+    auto socket = _loop->resource<uvw::pipe_handle>();
+    if (socket && socket->open(fd) == 0) {
+      transport = std::make_unique<PipeTransportConnection>(std::move(socket),
+                                                            _logName);
+    } else if (socket) {
+      socket->close();
+    }
+  } else {
+    auto socket = _loop->resource<uvw::tcp_handle>();
+    if (socket && socket->open(fd) == 0) {
+      transport = std::make_unique<TcpTransportConnection>(std::move(socket),
+                                                           _logName);
+    } else if (socket) {
+      socket->close();
+    }
+  }
+
+  if (!transport) {
+    spdlog::get(_logName)->error("Worker {} failed to adopt socket", _index);
+#ifndef _WIN32
+    ::close(fd);
+#endif
+    PostEvent({.type = Event::Type::Disconnect, .id = id});
+    return;
+  }
+
+  auto connection = std::make_shared<Connection>(this, id);
+  connection->transport = std::move(transport);
+  connection->transport->SetHandler(connection);
+  _connections.emplace(id, std::move(connection));
+}
+
+/**
+ * Worker thread: starts accepting on a listening socket bound by Listen.
+ * @param fd
+ */
+void TransportWorker::AdoptListener(int fd) {
+  _listenHandle = _loop->resource<uvw::tcp_handle>();
+  _listenHandle->on<uvw::listen_event>(
+      [this](const uvw::listen_event&, uvw::tcp_handle& listener) {
+        HandleAccept(listener);
+      });
+  _listenHandle->on<uvw::error_event>(
+      [this](const uvw::error_event& event, uvw::tcp_handle&) {
+        spdlog::get(_logName)->error("Worker {} listener error: {}", _index,
+                                     event.what());
+      });
+
+  if (_listenHandle->open(fd) != 0 || _listenHandle->listen() != 0) {
+    spdlog::get(_logName)->error("Worker {} failed to accept on its listener",
+                                 _index);
+    _listenHandle->close();
+    _listenHandle.reset();
+  }
+}
+
+/**
+ * Worker thread: accepts a connection on this loop's listener, serves it
+ * here and announces it to the main loop.
+ * @param listener
+ */
+void TransportWorker::HandleAccept(uvw::tcp_handle& listener) {
+  auto socket = _loop->resource<uvw::tcp_handle>();
+  if (listener.accept(*socket) != 0) {
+    socket->close();
+    return;
+  }
+
+  const uint64_t id = kAcceptedIdBit | ++_nextAcceptedId;
+  auto connection = std::make_shared<Connection>(this, id);
+  connection->transport = std::make_unique<TcpTransportConnection>(
+      std::move(socket), _logName, _acceptCompression, _acceptTls);
+
+  // Queued ahead of anything the socket reads, which only happens once we
+  // return to the loop.
+  PostEvent({.type = Event::Type::Accept,
+             .id = id,
+             .remote = connection->transport->RemoteEndpoint(),
+             .local = connection->transport->LocalEndpoint()});
+
+  connection->transport->SetHandler(connection);
+  _connections.emplace(id, std::move(connection));
+}
+
+/**
+ * Registers this worker's per-loop metrics, labelled by its index.
+ */
+void TransportWorker::InitMetrics() {
+  if (!Metrics::Instance()->WantMetrics()) {
+    return;
+  }
+
+  auto registry = Metrics::Instance()->GetRegistry();
+  const std::string worker = std::to_string(_index);
+
+  auto& connectionsBuilder =
+      prometheus::BuildGauge()
+          .Name(_logName + "_worker_connections_size")
+          .Help("Number of connections served by each worker loop")
+          .Register(*registry);
+  auto& datagramsBuilder =
+      prometheus::BuildCounter()
+          .Name(_logName + "_worker_datagrams_total")
+          .Help("Number of datagrams carried by each worker loop")
+          .Register(*registry);
+
+  _connectionsGauge = &connectionsBuilder.Add({{"worker", worker}});
+  _datagramsInCounter =
+      &datagramsBuilder.Add({{"worker", worker}, {"direction", "in"}});
+  _datagramsOutCounter =
+      &datagramsBuilder.Add({{"worker", worker}, {"direction", "out"}});
+}
+
+void TransportWorker::UpdateConnectionsGauge() {
+  if (_connectionsGauge) {
+    _connectionsGauge->Set((double)_proxies.size());
+  }
+}
+
+}  // namespace Ardos
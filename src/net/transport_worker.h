@@ -0,0 +1,187 @@
+#ifndef ARDOS_TRANSPORT_WORKER_H
+#define ARDOS_TRANSPORT_WORKER_H
+
+#include <prometheus/counter.h>
+#include <prometheus/gauge.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <uvw.hpp>
+
+#include "../util/spsc_queue.h"
+#include "datagram.h"
+#include "transport.h"
+
+namespace Ardos {
+
+struct CompressionOptions;
+class TlsContext;
+
+class TransportWorker;
+
+// Main-thread stand-in for a connection that lives on a TransportWorker's
+// loop. Sends are queued to the worker (sharing the Datagram, not copying
+// it) and inbound datagrams/disconnects are replayed to the handler on the
+// main loop, so the owning participant can't tell it isn't talking to the
+// socket directly.
+class WorkerTransportConnection final : public ITransportConnection {
+ public:
+  WorkerTransportConnection(TransportWorker* worker, uint64_t id,
+                            TransportEndpoint remote, TransportEndpoint local);
+  ~WorkerTransportConnection() override;
+
+  void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
+  void Send(const uint8_t* data, size_t len,
+            Reliability r = Reliability::Reliable) override;
+  void SendDatagram(const std::shared_ptr<Datagram>& dg,
+                    Reliability r = Reliability::Reliable) override;
+  void SendBatch(const uint8_t* data, size_t len) override;
+  void Close() override;
+  [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
+  [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
+
+ private:
+  friend class TransportWorker;
+
+  void HandleDatagram(const std::shared_ptr<Datagram>& dg);
+  void HandleDisconnect();
+
+  TransportWorker* _worker;
+  uint64_t _id;
+  std::weak_ptr<ITransportHandler> _handler;
+  TransportEndpoint _remoteEndpoint;
+  TransportEndpoint _localEndpoint;
+
+  bool _closed = false;
+  bool _closePosted = false;
+};
+
+// A dedicated event loop on its own thread that owns a share of a role's
+// stream connections. Sockets are accepted on the main loop and then
+// adopted onto the worker, which does all the reading, framing and
+// writing for them. That's all it offloads: routing, dispatch and
+// subscriber state stay on the main loop, which remains the limit on how
+// many datagrams a role can handle.
+// Traffic between the two crosses a pair of lock-free SPSC queues, with a
+// uv_async wakeup on each side.
+class TransportWorker {
+ public:
+  TransportWorker(std::string logName, size_t index);
+  ~TransportWorker();
+
+  TransportWorker(const TransportWorker&) = delete;
+  TransportWorker& operator=(const TransportWorker&) = delete;
+
+  // Main thread only. Moves an accepted socket onto this worker's loop and
+  // returns the proxy to use in its place. Returns nullptr (leaving the
+  // socket untouched) if it couldn't be handed over, in which case the
+  // caller should serve it on the main loop as usual.
+  std::unique_ptr<ITransportConnection> Adopt(
+      const std::shared_ptr<uvw::tcp_handle>& socket);
+  // Same, for a Unix domain socket.
+  std::unique_ptr<ITransportConnection> Adopt(
+      const std::shared_ptr<uvw::pipe_handle>& socket);
+
+  // Main thread only. Opens a SO_REUSEPORT listener on host:port that this
+  // worker accepts on by itself, so several workers listening on the same
+  // address have the kernel shard connections between them. Each accepted
+  // connection is handed to `factory` on the main loop, already proxied.
+  // `compression` and `tls` are passed on to each accepted connection.
+  // Returns false (after logging why) if the socket couldn't be set up.
+  bool Listen(const std::string& host, int port,
+              ITransportListener::ConnectionFactory factory,
+              std::shared_ptr<const CompressionOptions> compression = nullptr,
+              std::shared_ptr<const TlsContext> tls = nullptr);
+
+  // Number of connections currently assigned to this worker. Main thread.
+  [[nodiscard]] size_t GetConnectionCount() const { return _proxies.size(); }
+
+ private:
+  friend class WorkerTransportConnection;
+
+  // Main loop -> worker.
+  struct Command {
+    enum class Type : uint8_t { Adopt, Listen, Send, SendBatch, Close };
+    Type type;
+    uint64_t id;
+    int fd = -1;
+    // Adopt: the descriptor is a Unix domain socket rather than TCP.
+    bool pipe = false;
+    std::shared_ptr<Datagram> dg;
+    Reliability reliability = Reliability::Reliable;
+  };
+
+  // Worker -> main loop.
+  struct Event {
+    enum class Type : uint8_t { Accept, Datagram, Disconnect };
+    Type type;
+    uint64_t id;
+    std::shared_ptr<Datagram> dg;
+    // Accept only.
+    TransportEndpoint remote;
+    TransportEndpoint local;
+  };
+
+  // Ids of connections accepted by the worker itself, as opposed to the
+  // ones the main loop hands over (numbered from 1 by _nextId).
+  static constexpr uint64_t kAcceptedIdBit = uint64_t{1} << 63;
+
+  struct Connection;
+
+  void Post(Command command);
+  void PostEvent(Event event);
+
+  void HandleCommands();
+  void HandleEvents();
+  std::unique_ptr<ITransportConnection> AdoptHandle(const uv_handle_t* handle,
+                                                    TransportEndpoint remote,
+                                                    TransportEndpoint local,
+                                                    bool pipe);
+  void AdoptSocket(uint64_t id, int fd, bool pipe);
+  void AdoptListener(int fd);
+  void HandleAccept(uvw::tcp_handle& listener);
+
+  void InitMetrics();
+  void UpdateConnectionsGauge();
+
+  std::string _logName;
+  size_t _index;
+
+  std::shared_ptr<uvw::loop> _loop;
+  // Lives on _loop; signalled by the main thread after posting commands.
+  std::shared_ptr<uvw::async_handle> _workerWakeup;
+  // Lives on g_loop; signalled by the worker after posting events.
+  std::shared_ptr<uvw::async_handle> _mainWakeup;
+
+  SpscQueue<Command> _commands;
+  SpscQueue<Event> _events;
+
+  std::atomic<bool> _stopping{false};
+  std::thread _thread;
+
+  // Main thread state.
+  std::unordered_map<uint64_t, WorkerTransportConnection*> _proxies;
+  uint64_t _nextId = 0;
+  ITransportListener::ConnectionFactory _acceptFactory;
+
+  // Worker thread state.
+  std::unordered_map<uint64_t, std::shared_ptr<Connection>> _connections;
+  std::shared_ptr<uvw::tcp_handle> _listenHandle;
+  uint64_t _nextAcceptedId = 0;
+  // Set by Listen before the listener is handed over; read-only after.
+  std::shared_ptr<const CompressionOptions> _acceptCompression;
+  std::shared_ptr<const TlsContext> _acceptTls;
+
+  // Per-worker load, labelled by worker index, so balance across loops is
+  // visible. Updated from the main thread.
+  prometheus::Gauge* _connectionsGauge = nullptr;
+  prometheus::Counter* _datagramsInCounter = nullptr;
+  prometheus::Counter* _datagramsOutCounter = nullptr;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_TRANSPORT_WORKER_H
@@ -0,0 +1,776 @@
+#include "udp_transport.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "../util/globals.h"
+
+namespace Ardos {
+
+namespace {
+
+constexpr uint8_t kFlagUnreliable = 1 << 0;
+// More fragments of the same reliable message follow.
+constexpr uint8_t kFlagMore = 1 << 1;
+
+// The largest message a fragmented reliable one can reassemble into.
+constexpr size_t kMaxMessageBytes = 0xFFFF;
+
+constexpr auto kTickInterval = uvw::timer_handle::time{10};
+
+template <typename T>
+T Read(const uint8_t* data) {
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+template <typename T>
+uint8_t* Write(uint8_t* out, T value) {
+  std::memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+// True if packet or lane seq `a` comes after `b`, allowing for wraparound.
+bool SeqNewer(uint16_t a, uint16_t b) {
+  return static_cast<int16_t>(static_cast<uint16_t>(a - b)) > 0;
+}
+
+bool ToAddress(const uvw::socket_address& peer, sockaddr_storage& out) {
+  return uv_ip4_addr(peer.ip.c_str(), static_cast<int>(peer.port),
+                     reinterpret_cast<sockaddr_in*>(&out)) == 0 ||
+         uv_ip6_addr(peer.ip.c_str(), static_cast<int>(peer.port),
+                     reinterpret_cast<sockaddr_in6*>(&out)) == 0;
+}
+
+}  // namespace
+
+UdpSession::UdpSession(UdpTransportListener* listener,
+                       const sockaddr_storage& address,
+                       TransportEndpoint remote, TransportEndpoint local,
+                       uint32_t nonce)
+    : _listener(listener),
+      _address(address),
+      _remoteEndpoint(std::move(remote)),
+      _localEndpoint(std::move(local)),
+      _nonce(nonce),
+      _lastReceived(Clock::now()) {}
+
+void UdpSession::SetHandler(std::weak_ptr<ITransportHandler> handler) {
+  _handler = std::move(handler);
+}
+
+void UdpSession::Send(const uint8_t* data, size_t len, Reliability r) {
+  if (_closing || _finished || _overflowed) {
+    return;
+  }
+
+  // Unreliable messages have to fit in one packet; anything bigger goes
+  // reliably, in fragments.
+  if (r == Reliability::Unreliable && len <= kMaxFragmentBytes) {
+    _unreliable.emplace_back(data, data + len);
+    MarkDirty();
+    return;
+  }
+
+  if (_reliableBytes + len > kHighWaterBytes) {
+    spdlog::get("ca")->warn(
+        "UDP transport: client {}:{} exceeded {}B unacked backlog; "
+        "disconnecting",
+        _remoteEndpoint.ip, _remoteEndpoint.port, kHighWaterBytes);
+    // The handler is likely mid-fanout in here; drop the session on the
+    // next tick instead.
+    _overflowed = true;
+    return;
+  }
+
+  while (len > kMaxFragmentBytes) {
+    QueueReliable(data, kMaxFragmentBytes, kFlagMore);
+    data += kMaxFragmentBytes;
+    len -= kMaxFragmentBytes;
+  }
+  QueueReliable(data, len, 0);
+  MarkDirty();
+}
+
+void UdpSession::Close() {
+  if (_closing) {
+    return;
+  }
+  _closing = true;
+  _handler.reset();
+
+  _unreliable.clear();
+  _closeDeadline = Clock::now() + kLingerTime;
+}
+
+void UdpSession::HandleData(const uint8_t* data, size_t len,
+                            Clock::time_point now) {
+  if (_finished || len < kDataHeaderBytes - 1) {
+    return;
+  }
+
+  const auto seq = Read<uint16_t>(data);
+  HandleAck(data + sizeof(uint16_t), len - sizeof(uint16_t), now);
+
+  // Check the whole packet before taking anything from it: we can only ack
+  // it if every reliable message in it gets buffered.
+  const uint8_t* messages = data + kDataHeaderBytes - 1;
+  const uint8_t* end = data + len;
+  for (const uint8_t* p = messages; p != end;) {
+    if (static_cast<size_t>(end - p) < kMessageHeaderBytes ||
+        static_cast<size_t>(end - p) - kMessageHeaderBytes <
+            Read<uint16_t>(p + 3)) {
+      spdlog::get("ca")->warn("UDP transport: client {}:{} sent a bad packet",
+                              _remoteEndpoint.ip, _remoteEndpoint.port);
+      HandleDisconnect(true);
+      return;
+    }
+
+    const auto ahead = static_cast<uint16_t>(Read<uint16_t>(p + 1) -
+                                             _nextDeliverSeq);
+    if (!(p[0] & kFlagUnreliable) && ahead < 0x8000 &&
+        ahead >= kReliableWindow) {
+      // Too far ahead to buffer; leave it unacked and it'll come again.
+      return;
+    }
+    p += kMessageHeaderBytes + Read<uint16_t>(p + 3);
+  }
+
+  RecordReceived(seq);
+  _ackOwed = true;
+  MarkDirty();
+
+  for (const uint8_t* p = messages; p != end;) {
+    const uint8_t flags = p[0];
+    const auto laneSeq = Read<uint16_t>(p + 1);
+    const auto size = Read<uint16_t>(p + 3);
+    const uint8_t* payload = p + kMessageHeaderBytes;
+    p = payload + size;
+
+    if (flags & kFlagUnreliable) {
+      // Sequenced: anything older than what we've delivered is stale.
+      if (!_receivedUnreliable || SeqNewer(laneSeq, _lastUnreliableSeq)) {
+        _receivedUnreliable = true;
+        _lastUnreliableSeq = laneSeq;
+        Deliver(payload, size);
+      }
+    } else if (laneSeq == _nextDeliverSeq) {
+      ++_nextDeliverSeq;
+      DeliverReliable(flags, payload, size);
+
+      // Then whatever it was holding up.
+      for (auto it = _outOfOrder.find(_nextDeliverSeq);
+           it != _outOfOrder.end() && !_closing && !_finished;
+           it = _outOfOrder.find(_nextDeliverSeq)) {
+        auto [heldFlags, held] = std::move(it->second);
+        _outOfOrder.erase(it);
+        ++_nextDeliverSeq;
+        DeliverReliable(heldFlags, held.data(), held.size());
+      }
+    } else if (SeqNewer(laneSeq, _nextDeliverSeq)) {
+      _outOfOrder.try_emplace(laneSeq, flags,
+                              std::vector<uint8_t>(payload, payload + size));
+    }
+
+    // The handler may have closed us.
+    if (_closing || _finished) {
+      return;
+    }
+  }
+}
+
+void UdpSession::HandleAck(const uint8_t* data, size_t len,
+                           Clock::time_point now) {
+  if (_finished || len < sizeof(uint16_t) + sizeof(uint32_t)) {
+    return;
+  }
+  _lastReceived = now;
+
+  const auto ack = Read<uint16_t>(data);
+  const auto ackBits = Read<uint32_t>(data + sizeof(uint16_t));
+
+  bool progressed = false;
+  for (auto it = _inFlight.begin(); it != _inFlight.end();) {
+    const auto behind = static_cast<uint16_t>(ack - it->seq);
+    if (behind != 0 && (behind > 32 || !((ackBits >> (behind - 1)) & 1))) {
+      ++it;
+      continue;
+    }
+
+    HandlePacketAcked(*it, now);
+    it = _inFlight.erase(it);
+    progressed = true;
+  }
+  if (!progressed) {
+    return;
+  }
+  _backoff = 1;
+
+  // Three later packets got through ahead of these; don't wait out the
+  // timeout to call them lost.
+  bool lost = false;
+  while (!_inFlight.empty() &&
+         SeqNewer(ack, static_cast<uint16_t>(_inFlight.front().seq + 2))) {
+    HandlePacketLost(_inFlight.front());
+    _inFlight.pop_front();
+    lost = true;
+  }
+
+  if (lost || !_reliable.empty() || !_retransmits.empty()) {
+    // The window has moved.
+    MarkDirty();
+  }
+}
+
+void UdpSession::HandleDisconnect(bool notifyPeer) {
+  if (_finished) {
+    return;
+  }
+  _finished = true;
+
+  if (notifyPeer) {
+    const auto type =
+        static_cast<uint8_t>(UdpTransportListener::PacketType::Disconnect);
+    _listener->SendPacket(_address, &type, sizeof(type));
+  }
+
+  _reliable.clear();
+  _reliableUnsent = 0;
+  _reliableBytes = 0;
+  _retransmits.clear();
+  _unreliable.clear();
+  _inFlight.clear();
+  _outOfOrder.clear();
+  _fragments.clear();
+
+  if (auto handler = _handler.lock()) {
+    _handler.reset();
+    handler->OnTransportDisconnect();
+  }
+}
+
+void UdpSession::Flush(Clock::time_point now) {
+  _dirty = false;
+  if (_finished) {
+    return;
+  }
+
+  std::array<uint8_t, kMaxPacketBytes> packet;
+  size_t retransmitted = 0;
+  size_t unreliableSent = 0;
+  while (_inFlight.size() < static_cast<size_t>(_window)) {
+    uint8_t* out = packet.data();
+    *out++ = static_cast<uint8_t>(UdpTransportListener::PacketType::Data);
+    out = Write<uint16_t>(out, _nextPacketSeq);
+    WriteAckHeader(out);
+    out += sizeof(uint16_t) + sizeof(uint32_t);
+
+    SentPacket sent{.seq = _nextPacketSeq, .sentAt = now, .reliable = {}};
+    auto fits = [&](size_t size) {
+      return static_cast<size_t>(packet.data() + packet.size() - out) >=
+             kMessageHeaderBytes + size;
+    };
+    auto append = [&](uint8_t flags, uint16_t laneSeq,
+                      const std::vector<uint8_t>& data) {
+      *out++ = flags;
+      out = Write<uint16_t>(out, laneSeq);
+      out = Write<uint16_t>(out, static_cast<uint16_t>(data.size()));
+      std::memcpy(out, data.data(), data.size());
+      out += data.size();
+    };
+
+    // Re-sends first: every reliable message after them is stuck at the
+    // receiver until they land.
+    for (; retransmitted < _retransmits.size(); ++retransmitted) {
+      const uint16_t laneSeq = _retransmits[retransmitted];
+      const auto index = static_cast<uint16_t>(laneSeq - _reliableBase);
+      if (index >= _reliableUnsent || _reliable[index].acked) {
+        continue;  // acked since it was declared lost
+      }
+      if (!fits(_reliable[index].data.size())) {
+        break;
+      }
+      append(_reliable[index].flags, laneSeq, _reliable[index].data);
+      sent.reliable.push_back(laneSeq);
+    }
+
+    // Then new reliable messages, as far as the receiver will buffer.
+    while (_reliableUnsent < std::min(_reliable.size(), kReliableWindow) &&
+           fits(_reliable[_reliableUnsent].data.size())) {
+      const auto laneSeq =
+          static_cast<uint16_t>(_reliableBase + _reliableUnsent);
+      append(_reliable[_reliableUnsent].flags, laneSeq,
+             _reliable[_reliableUnsent].data);
+      sent.reliable.push_back(laneSeq);
+      ++_reliableUnsent;
+    }
+
+    for (; unreliableSent < _unreliable.size() &&
+           fits(_unreliable[unreliableSent].size());
+         ++unreliableSent) {
+      append(kFlagUnreliable, _nextUnreliableSeq++,
+             _unreliable[unreliableSent]);
+    }
+
+    if (out == packet.data() + kDataHeaderBytes) {
+      break;  // nothing left that we may send
+    }
+
+    if (!_listener->DropSimulated()) {
+      _listener->SendPacket(_address, packet.data(), out - packet.data());
+    }
+    _inFlight.push_back(std::move(sent));
+    ++_nextPacketSeq;
+    _ackOwed = false;
+  }
+
+  _retransmits.erase(_retransmits.begin(),
+                     _retransmits.begin() +
+                         static_cast<ptrdiff_t>(retransmitted));
+  // Whatever didn't fit in the window would only be staler next time
+  // round, and probably superseded.
+  _unreliable.clear();
+
+  if (_ackOwed) {
+    _ackOwed = false;
+    uint8_t* out = packet.data();
+    *out++ = static_cast<uint8_t>(UdpTransportListener::PacketType::Ack);
+    WriteAckHeader(out);
+    if (!_listener->DropSimulated()) {
+      _listener->SendPacket(_address, packet.data(),
+                            1 + sizeof(uint16_t) + sizeof(uint32_t));
+    }
+  }
+}
+
+bool UdpSession::Tick(Clock::time_point now) {
+  if (_finished) {
+    return false;
+  }
+
+  if (_overflowed) {
+    HandleDisconnect(true);
+    return false;
+  }
+
+  if (now - _lastReceived > kIdleTimeout) {
+    spdlog::get("ca")->debug("UDP transport: client {}:{} timed out",
+                             _remoteEndpoint.ip, _remoteEndpoint.port);
+    HandleDisconnect(true);
+    return false;
+  }
+
+  if (_closing && (_reliable.empty() || now >= _closeDeadline)) {
+    HandleDisconnect(true);
+    return false;
+  }
+
+  const auto rto = RetransmitTimeout();
+  bool lost = false;
+  while (!_inFlight.empty() && now - _inFlight.front().sentAt >= rto) {
+    HandlePacketLost(_inFlight.front());
+    _inFlight.pop_front();
+    lost = true;
+  }
+  if (lost) {
+    // Back off until something gets through.
+    _backoff = std::min(_backoff * 2, 8U);
+    MarkDirty();
+  }
+  return true;
+}
+
+void UdpSession::QueueReliable(const uint8_t* data, size_t len,
+                               uint8_t flags) {
+  _reliable.push_back(
+      {.flags = flags, .data = std::vector<uint8_t>(data, data + len)});
+  _reliableBytes += len;
+}
+
+void UdpSession::Deliver(const uint8_t* data, size_t len) {
+  if (_closing || _finished || _overflowed) {
+    return;
+  }
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportMessage(data, len);
+  }
+}
+
+void UdpSession::DeliverReliable(uint8_t flags, const uint8_t* data,
+                                 size_t len) {
+  if (_fragments.size() + len > kMaxMessageBytes) {
+    spdlog::get("ca")->warn(
+        "UDP transport: client {}:{} sent an oversized message",
+        _remoteEndpoint.ip, _remoteEndpoint.port);
+    HandleDisconnect(true);
+    return;
+  }
+
+  if (flags & kFlagMore) {
+    _fragments.insert(_fragments.end(), data, data + len);
+    return;
+  }
+  if (_fragments.empty()) {
+    Deliver(data, len);
+    return;
+  }
+
+  _fragments.insert(_fragments.end(), data, data + len);
+  std::vector<uint8_t> message;
+  message.swap(_fragments);
+  Deliver(message.data(), message.size());
+}
+
+void UdpSession::RecordReceived(uint16_t seq) {
+  if (!_receivedAny) {
+    _receivedAny = true;
+    _remoteSeq = seq;
+    _remoteBits = 0;
+    return;
+  }
+
+  if (SeqNewer(seq, _remoteSeq)) {
+    const auto shift = static_cast<uint16_t>(seq - _remoteSeq);
+    _remoteBits = shift >= 32 ? 0 : _remoteBits << shift;
+    if (shift <= 32) {
+      _remoteBits |= 1U << (shift - 1);  // the previous newest
+    }
+    _remoteSeq = seq;
+  } else if (const auto behind = static_cast<uint16_t>(_remoteSeq - seq);
+             behind >= 1 && behind <= 32) {
+    _remoteBits |= 1U << (behind - 1);
+  }
+}
+
+void UdpSession::HandlePacketAcked(const SentPacket& packet,
+                                   Clock::time_point now) {
+  for (uint16_t laneSeq : packet.reliable) {
+    const auto index = static_cast<uint16_t>(laneSeq - _reliableBase);
+    if (index < _reliableUnsent) {
+      _reliable[index].acked = true;
+    }
+  }
+  while (!_reliable.empty() && _reliable.front().acked) {
+    _reliableBytes -= _reliable.front().data.size();
+    _reliable.pop_front();
+    ++_reliableBase;
+    --_reliableUnsent;
+  }
+
+  const Clock::duration sample = now - packet.sentAt;
+  if (!_haveRtt) {
+    _haveRtt = true;
+    _smoothedRtt = sample;
+    _rttVariance = sample / 2;
+  } else {
+    const auto error =
+        sample > _smoothedRtt ? sample - _smoothedRtt : _smoothedRtt - sample;
+    _rttVariance = (3 * _rttVariance + error) / 4;
+    _smoothedRtt = (7 * _smoothedRtt + sample) / 8;
+  }
+
+  if (_inRecovery && SeqNewer(packet.seq, _recoverySeq)) {
+    _inRecovery = false;
+  }
+  _window += _window < _slowStartThreshold ? 1.0 : 1.0 / _window;
+  _window = std::min(_window, kMaxWindow);
+}
+
+void UdpSession::HandlePacketLost(const SentPacket& packet) {
+  for (uint16_t laneSeq : packet.reliable) {
+    const auto index = static_cast<uint16_t>(laneSeq - _reliableBase);
+    if (index < _reliableUnsent && !_reliable[index].acked) {
+      _retransmits.push_back(laneSeq);
+    }
+  }
+
+  // Halve the window once per round trip, not once per packet lost in it.
+  if (!_inRecovery || SeqNewer(packet.seq, _recoverySeq)) {
+    _slowStartThreshold = std::max(_window / 2, kMinWindow);
+    _window = _slowStartThreshold;
+    _inRecovery = true;
+    _recoverySeq = static_cast<uint16_t>(_nextPacketSeq - 1);
+  }
+}
+
+UdpSession::Clock::duration UdpSession::RetransmitTimeout() const {
+  Clock::duration rto = kInitialRto;
+  if (_haveRtt) {
+    rto = std::clamp<Clock::duration>(_smoothedRtt + 4 * _rttVariance,
+                                      kMinRto, kMaxRto);
+  }
+  return std::min<Clock::duration>(rto * _backoff, kMaxRto);
+}
+
+void UdpSession::WriteAckHeader(uint8_t* out) const {
+  // Acks nothing until something's arrived: 0xFFFF is a seq we won't
+  // have in flight that early.
+  out = Write<uint16_t>(out, _receivedAny ? _remoteSeq : 0xFFFF);
+  Write<uint32_t>(out, _remoteBits);
+}
+
+void UdpSession::MarkDirty() {
+  if (_dirty) {
+    return;
+  }
+  _dirty = true;
+  _listener->QueueFlush(shared_from_this());
+}
+
+UdpTransportConnection::UdpTransportConnection(
+    std::shared_ptr<UdpSession> session)
+    : _session(std::move(session)) {}
+
+UdpTransportConnection::~UdpTransportConnection() { _session->Close(); }
+
+void UdpTransportConnection::SetHandler(
+    std::weak_ptr<ITransportHandler> handler) {
+  _session->SetHandler(std::move(handler));
+}
+
+void UdpTransportConnection::Send(const uint8_t* data, size_t len,
+                                  Reliability r) {
+  _session->Send(data, len, r);
+}
+
+void UdpTransportConnection::Close() { _session->Close(); }
+
+TransportEndpoint UdpTransportConnection::RemoteEndpoint() const {
+  return _session->RemoteEndpoint();
+}
+
+TransportEndpoint UdpTransportConnection::LocalEndpoint() const {
+  return _session->LocalEndpoint();
+}
+
+UdpTransportListener::UdpTransportListener(double simulatedLoss)
+    : _simulatedLoss(simulatedLoss) {
+  std::random_device random;
+  _cookieSecret = (uint64_t{random()} << 32) | random();
+  _lossRng.seed(random());
+}
+
+UdpTransportListener::~UdpTransportListener() {
+  if (_tickTimer) {
+    _tickTimer->stop();
+    _tickTimer->close();
+  }
+  if (_flushHandle) {
+    _flushHandle->stop();
+    _flushHandle->close();
+  }
+  if (_socket) {
+    _socket->close();
+  }
+}
+
+void UdpTransportListener::SetConnectionFactory(ConnectionFactory factory) {
+  _factory = std::move(factory);
+}
+
+bool UdpTransportListener::Listen(const std::string& host, int port) {
+  _socket = g_loop->resource<uvw::udp_handle>();
+  _socket->on<uvw::error_event>(
+      [](const uvw::error_event& event, uvw::udp_handle&) {
+        spdlog::get("ca")->error("UDP transport error: {}", event.what());
+      });
+  _socket->on<uvw::udp_data_event>(
+      [this](const uvw::udp_data_event& event, uvw::udp_handle&) {
+        HandlePacket(event.sender,
+                     reinterpret_cast<const uint8_t*>(event.data.get()),
+                     event.length);
+      });
+
+  if (const int err = _socket->bind(host, static_cast<unsigned int>(port));
+      err != 0) {
+    spdlog::get("ca")->error("UDP transport failed to bind {}:{}: {}", host,
+                             port, uv_strerror(err));
+    return false;
+  }
+  _socket->recv();
+
+  const auto local = _socket->sock();
+  _localEndpoint = {.ip = local.ip, .port = static_cast<uint16_t>(local.port)};
+
+  // Everything sent during a loop iteration goes out together, coalesced
+  // into as few packets as it fits in.
+  _flushHandle = g_loop->resource<uvw::prepare_handle>();
+  _flushHandle->on<uvw::prepare_event>(
+      [this](const uvw::prepare_event&, uvw::prepare_handle&) { Flush(); });
+  _flushHandle->start();
+
+  _tickTimer = g_loop->resource<uvw::timer_handle>();
+  _tickTimer->on<uvw::timer_event>(
+      [this](const uvw::timer_event&, uvw::timer_handle&) { Tick(); });
+  _tickTimer->start(kTickInterval, kTickInterval);
+  return true;
+}
+
+void UdpTransportListener::HandlePacket(const uvw::socket_address& sender,
+                                        const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  const auto type = static_cast<PacketType>(data[0]);
+  const std::string key = sender.ip + ":" + std::to_string(sender.port);
+  if (type == PacketType::Connect) {
+    HandleConnect(sender, key, data + 1, len - 1);
+    return;
+  }
+
+  auto it = _sessions.find(key);
+  if (it == _sessions.end()) {
+    // Most likely one we've already dropped; tell the peer so it stops.
+    sockaddr_storage address{};
+    if ((type == PacketType::Data || type == PacketType::Ack) &&
+        ToAddress(sender, address)) {
+      const auto reply = static_cast<uint8_t>(PacketType::Disconnect);
+      SendPacket(address, &reply, sizeof(reply));
+    }
+    return;
+  }
+
+  // Handlers may drop their connection while we're in here.
+  const auto session = it->second;
+  const auto now = UdpSession::Clock::now();
+  switch (type) {
+    case PacketType::Data:
+      if (!DropSimulated()) {
+        session->HandleData(data + 1, len - 1, now);
+      }
+      break;
+    case PacketType::Ack:
+      if (!DropSimulated()) {
+        session->HandleAck(data + 1, len - 1, now);
+      }
+      break;
+    case PacketType::Disconnect:
+      session->HandleDisconnect(false);
+      break;
+    default:
+      break;
+  }
+}
+
+void UdpTransportListener::HandleConnect(const uvw::socket_address& sender,
+                                         const std::string& key,
+                                         const uint8_t* data, size_t len) {
+  if (len < 3 * sizeof(uint32_t) || Read<uint32_t>(data) != kMagic) {
+    return;
+  }
+  const auto nonce = Read<uint32_t>(data + sizeof(uint32_t));
+  const auto cookie = Read<uint32_t>(data + 2 * sizeof(uint32_t));
+
+  sockaddr_storage address{};
+  if (!ToAddress(sender, address)) {
+    return;
+  }
+
+  std::array<uint8_t, 1 + 2 * sizeof(uint32_t)> reply{};
+  if (cookie != Cookie(key, nonce)) {
+    // Prove the address is real before we hold any state for it.
+    reply[0] = static_cast<uint8_t>(PacketType::Challenge);
+    Write<uint32_t>(Write<uint32_t>(reply.data() + 1, nonce),
+                    Cookie(key, nonce));
+    SendPacket(address, reply.data(), reply.size());
+    return;
+  }
+
+  reply[0] = static_cast<uint8_t>(PacketType::Accept);
+  Write<uint32_t>(reply.data() + 1, nonce);
+  const size_t acceptBytes = 1 + sizeof(uint32_t);
+
+  if (auto it = _sessions.find(key); it != _sessions.end()) {
+    if (it->second->Nonce() == nonce && !it->second->_finished) {
+      // Our Accept was lost.
+      SendPacket(address, reply.data(), acceptBytes);
+      return;
+    }
+
+    // Same address, new connection: whatever was there is gone.
+    const auto old = it->second;
+    _sessions.erase(it);
+    old->HandleDisconnect(false);
+  }
+
+  if (!_factory) {
+    return;
+  }
+
+  auto session = std::make_shared<UdpSession>(
+      this, address,
+      TransportEndpoint{.ip = sender.ip,
+                        .port = static_cast<uint16_t>(sender.port)},
+      _localEndpoint, nonce);
+  _sessions.emplace(key, session);
+  SendPacket(address, reply.data(), acceptBytes);
+  _factory(std::make_unique<UdpTransportConnection>(std::move(session)));
+}
+
+uint32_t UdpTransportListener::Cookie(const std::string& key,
+                                      uint32_t nonce) const {
+  // Keyed FNV-1a over the address, then a final mix. Only has to be
+  // unguessable by someone who can't see our replies.
+  uint64_t hash = _cookieSecret ^ nonce;
+  for (const char c : key) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+
+  // 0 is what a client sends before it has one.
+  const auto cookie = static_cast<uint32_t>(hash);
+  return cookie == 0 ? 1 : cookie;
+}
+
+void UdpTransportListener::SendPacket(const sockaddr_storage& address,
+                                      const uint8_t* data, size_t len) {
+  // Best effort, like the network: if the socket buffer is full the packet
+  // is lost, and the reliable lane sends it again.
+  _socket->try_send(reinterpret_cast<const sockaddr&>(address),
+                    reinterpret_cast<char*>(const_cast<uint8_t*>(data)),
+                    static_cast<unsigned int>(len));
+}
+
+bool UdpTransportListener::DropSimulated() {
+  return _simulatedLoss > 0 && _lossDistribution(_lossRng) < _simulatedLoss;
+}
+
+void UdpTransportListener::QueueFlush(
+    const std::shared_ptr<UdpSession>& session) {
+  _flushQueue.push_back(session);
+}
+
+void UdpTransportListener::Flush() {
+  if (_flushQueue.empty()) {
+    return;
+  }
+
+  const auto now = UdpSession::Clock::now();
+  auto queue = std::move(_flushQueue);
+  _flushQueue.clear();
+  for (const auto& session : queue) {
+    session->Flush(now);
+  }
+}
+
+void UdpTransportListener::Tick() {
+  const auto now = UdpSession::Clock::now();
+  for (auto it = _sessions.begin(); it != _sessions.end();) {
+    // Timeouts notify the handler, which may drop its connection.
+    const auto session = it->second;
+    if (session->Tick(now)) {
+      ++it;
+    } else {
+      it = _sessions.erase(it);
+    }
+  }
+}
+
+}  // namespace Ardos
@@ -0,0 +1,264 @@
+#ifndef ARDOS_UDP_TRANSPORT_H
+#define ARDOS_UDP_TRANSPORT_H
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <uvw.hpp>
+#include <vector>
+
+#include "transport.h"
+
+namespace Ardos {
+
+class UdpTransportListener;
+
+// One client's end of the udp transport: handshake state, both lanes, acks
+// and congestion control. Owned by the listener rather than the
+// connection, so whatever was queued before Close() (an eject, say) still
+// gets delivered after the handler has dropped its connection.
+//
+// Every packet after the handshake is [uint8 type][...]:
+//   Data:       [uint16 seq][uint16 ack][uint32 ackBits] message*
+//   Ack:        [uint16 ack][uint32 ackBits]
+//   Disconnect: (nothing)
+// where a message is [uint8 flags][uint16 laneSeq][uint16 len][bytes].
+// `ack` is the newest Data seq received from the peer and bit n of
+// `ackBits` stands for seq ack-1-n, so each packet acks the last 33.
+//
+// Reliable messages are kept until a packet carrying them is acked, and
+// re-sent in a fresh packet when that packet is lost (three newer ones
+// acked ahead of it, or no ack within the retransmission timeout). The
+// receiver delivers them strictly in lane order. Unreliable messages are
+// sent once and delivered only if newer than the last one delivered, so
+// a late position update is dropped rather than holding anything up.
+//
+// Data packets in flight are bounded by an AIMD congestion window of at
+// most kMaxWindow packets, which also keeps every one of them within
+// reach of the ack bits. Unreliable messages that don't fit in the window
+// are dropped; reliable ones wait.
+class UdpSession : public std::enable_shared_from_this<UdpSession> {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  UdpSession(UdpTransportListener* listener, const sockaddr_storage& address,
+             TransportEndpoint remote, TransportEndpoint local, uint32_t nonce);
+
+  void SetHandler(std::weak_ptr<ITransportHandler> handler);
+  void Send(const uint8_t* data, size_t len, Reliability r);
+  // Stops delivering to the handler. Reliable messages already queued are
+  // still sent (for up to kLingerTime), then the peer is told we're gone.
+  void Close();
+
+  void HandleData(const uint8_t* data, size_t len, Clock::time_point now);
+  void HandleAck(const uint8_t* data, size_t len, Clock::time_point now);
+  // Ends the session and tells the handler: the peer said goodbye, timed
+  // out or broke the protocol. `notifyPeer` sends it a Disconnect too.
+  void HandleDisconnect(bool notifyPeer);
+
+  // Puts queued messages into packets, as far as the congestion window
+  // allows, and acks whatever arrived since the last packet went out.
+  void Flush(Clock::time_point now);
+  // Retransmission and idle timeouts. Returns false once the session is
+  // over and the listener should forget it.
+  bool Tick(Clock::time_point now);
+
+  [[nodiscard]] uint32_t Nonce() const { return _nonce; }
+  [[nodiscard]] const TransportEndpoint& RemoteEndpoint() const {
+    return _remoteEndpoint;
+  }
+  [[nodiscard]] const TransportEndpoint& LocalEndpoint() const {
+    return _localEndpoint;
+  }
+
+  static constexpr size_t kMaxPacketBytes = 1200;
+  static constexpr size_t kDataHeaderBytes = 9;
+  static constexpr size_t kMessageHeaderBytes = 5;
+  static constexpr size_t kMaxFragmentBytes =
+      kMaxPacketBytes - kDataHeaderBytes - kMessageHeaderBytes;
+
+ private:
+  friend class UdpTransportListener;
+
+  struct OutMessage {
+    uint8_t flags;
+    std::vector<uint8_t> data;
+    bool acked = false;
+  };
+
+  struct SentPacket {
+    uint16_t seq;
+    Clock::time_point sentAt;
+    // Reliable lane seqs it carried.
+    std::vector<uint16_t> reliable;
+  };
+
+  void QueueReliable(const uint8_t* data, size_t len, uint8_t flags);
+  // Hands a message to the handler, unless we've been closed since.
+  void Deliver(const uint8_t* data, size_t len);
+  void DeliverReliable(uint8_t flags, const uint8_t* data, size_t len);
+  void RecordReceived(uint16_t seq);
+  void HandlePacketAcked(const SentPacket& packet, Clock::time_point now);
+  void HandlePacketLost(const SentPacket& packet);
+  [[nodiscard]] Clock::duration RetransmitTimeout() const;
+  void WriteAckHeader(uint8_t* out) const;
+  void MarkDirty();
+
+  UdpTransportListener* _listener;
+  sockaddr_storage _address;
+  TransportEndpoint _remoteEndpoint;
+  TransportEndpoint _localEndpoint;
+  uint32_t _nonce;
+  std::weak_ptr<ITransportHandler> _handler;
+
+  bool _closing = false;
+  bool _finished = false;
+  // Went past kHighWaterBytes; dropped by the next Tick.
+  bool _overflowed = false;
+  // Queued with the listener for the next Flush.
+  bool _dirty = false;
+  Clock::time_point _lastReceived;
+  Clock::time_point _closeDeadline;
+
+  // Send side. _reliable holds every reliable message not yet acked, the
+  // first being lane seq _reliableBase; the ones from _reliableUnsent on
+  // have never been sent.
+  std::deque<OutMessage> _reliable;
+  uint16_t _reliableBase = 0;
+  size_t _reliableUnsent = 0;
+  size_t _reliableBytes = 0;
+  std::vector<uint16_t> _retransmits;
+  std::vector<std::vector<uint8_t>> _unreliable;
+  uint16_t _nextUnreliableSeq = 0;
+  uint16_t _nextPacketSeq = 0;
+  std::deque<SentPacket> _inFlight;
+
+  // Congestion window, in packets.
+  double _window = kInitialWindow;
+  double _slowStartThreshold = kMaxWindow;
+  // Losses of packets older than this don't shrink the window again.
+  uint16_t _recoverySeq = 0;
+  bool _inRecovery = false;
+
+  // RFC 6298 round trip estimate; doubled per consecutive timeout.
+  Clock::duration _smoothedRtt{};
+  Clock::duration _rttVariance{};
+  bool _haveRtt = false;
+  unsigned _backoff = 1;
+
+  // Receive side.
+  uint16_t _remoteSeq = 0;
+  uint32_t _remoteBits = 0;
+  bool _receivedAny = false;
+  bool _ackOwed = false;
+  uint16_t _nextDeliverSeq = 0;
+  std::unordered_map<uint16_t, std::pair<uint8_t, std::vector<uint8_t>>>
+      _outOfOrder;
+  std::vector<uint8_t> _fragments;
+  uint16_t _lastUnreliableSeq = 0;
+  bool _receivedUnreliable = false;
+
+  static constexpr double kInitialWindow = 4;
+  static constexpr double kMinWindow = 2;
+  static constexpr double kMaxWindow = 32;
+  // How far ahead of the next in-order message the receiver buffers.
+  static constexpr size_t kReliableWindow = 1024;
+  // Same bound on unacked reliable bytes as the TCP write queue.
+  static constexpr size_t kHighWaterBytes = size_t{4} * 1024 * 1024;
+  static constexpr auto kInitialRto = std::chrono::milliseconds(250);
+  static constexpr auto kMinRto = std::chrono::milliseconds(50);
+  static constexpr auto kMaxRto = std::chrono::seconds(2);
+  static constexpr auto kIdleTimeout = std::chrono::seconds(10);
+  static constexpr auto kLingerTime = std::chrono::seconds(2);
+};
+
+// Per-connection handle for the udp transport; everything is done by the
+// listener's UdpSession for the peer.
+class UdpTransportConnection final : public ITransportConnection {
+ public:
+  explicit UdpTransportConnection(std::shared_ptr<UdpSession> session);
+  ~UdpTransportConnection() override;
+
+  void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
+  void Send(const uint8_t* data, size_t len,
+            Reliability r = Reliability::Reliable) override;
+  void Close() override;
+  [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
+  [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
+
+ private:
+  std::shared_ptr<UdpSession> _session;
+};
+
+// Serves clients over UDP (client-agent.transport: udp), with a reliable
+// ordered lane for most traffic and an unreliable sequenced one for
+// whatever is sent with Reliability::Unreliable; see UdpSession.
+//
+// Clients connect with a cookie exchange so a spoofed source address can't
+// make us hold state for it:
+//   client: Connect   [uint32 kMagic][uint32 nonce][uint32 cookie = 0]
+//   server: Challenge [uint32 nonce][uint32 cookie]
+//   client: Connect   [uint32 kMagic][uint32 nonce][uint32 cookie]
+//   server: Accept    [uint32 nonce]
+// Clients retry a Connect that gets no answer, and must send something
+// (an Ack will do) at least every few seconds to stay connected.
+class UdpTransportListener final : public ITransportListener {
+ public:
+  // `simulatedLoss` is the fraction of Data and Ack packets to drop in each
+  // direction, to exercise the reliable lane locally. Leave it at 0 in
+  // production.
+  explicit UdpTransportListener(double simulatedLoss = 0.0);
+  ~UdpTransportListener() override;
+
+  void SetConnectionFactory(ConnectionFactory factory) override;
+  bool Listen(const std::string& host, int port) override;
+
+  enum class PacketType : uint8_t {
+    Connect = 1,
+    Challenge,
+    Accept,
+    Data,
+    Ack,
+    Disconnect,
+  };
+  static constexpr uint32_t kMagic = 0x55445241;  // "ARDU"
+
+ private:
+  friend class UdpSession;
+
+  void HandlePacket(const uvw::socket_address& sender, const uint8_t* data,
+                    size_t len);
+  void HandleConnect(const uvw::socket_address& sender, const std::string& key,
+                     const uint8_t* data, size_t len);
+  [[nodiscard]] uint32_t Cookie(const std::string& key, uint32_t nonce) const;
+  void SendPacket(const sockaddr_storage& address, const uint8_t* data,
+                  size_t len);
+  // True if simulated loss says to drop this packet.
+  bool DropSimulated();
+  void QueueFlush(const std::shared_ptr<UdpSession>& session);
+  void Flush();
+  void Tick();
+
+  ConnectionFactory _factory;
+  std::shared_ptr<uvw::udp_handle> _socket;
+  std::shared_ptr<uvw::prepare_handle> _flushHandle;
+  std::shared_ptr<uvw::timer_handle> _tickTimer;
+  TransportEndpoint _localEndpoint;
+
+  // Keyed by the peer's "ip:port".
+  std::unordered_map<std::string, std::shared_ptr<UdpSession>> _sessions;
+  // Sessions with something to send before the loop next blocks.
+  std::vector<std::shared_ptr<UdpSession>> _flushQueue;
+
+  uint64_t _cookieSecret;
+  double _simulatedLoss;
+  std::mt19937 _lossRng;
+  std::uniform_real_distribution<double> _lossDistribution{0.0, 1.0};
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_UDP_TRANSPORT_H
@@ -0,0 +1,216 @@
+#include "uring.h"
+
+#ifdef ARDOS_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace Ardos {
+
+IoUring::~IoUring() {
+  if (_sqes != nullptr) {
+    munmap(_sqes, _sqesBytes);
+  }
+  if (_ring != nullptr) {
+    munmap(_ring, _ringBytes);
+  }
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+}
+
+bool IoUring::Init(unsigned entries, unsigned cqEntries) {
+  io_uring_params params{};
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = cqEntries;
+  _fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (_fd < 0) {
+    return false;
+  }
+
+  // Both have been around since 5.5, well before anything else we use.
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(params.features & IORING_FEAT_NODROP)) {
+    errno = ENOSYS;
+    return false;
+  }
+
+  // The SQ and CQ rings share one mapping.
+  _ringBytes = std::max(
+      params.sq_off.array + params.sq_entries * sizeof(unsigned),
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+  void* ring = mmap(nullptr, _ringBytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED) {
+    return false;
+  }
+  _ring = ring;
+
+  _sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, _sqesBytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  _sqes = static_cast<io_uring_sqe*>(sqes);
+
+  auto* base = static_cast<uint8_t*>(_ring);
+  _sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+  _sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+  _sqFlags = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+  _sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+  _sqEntries = params.sq_entries;
+  _cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+  _cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+  _cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+  _cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+  // SQ slot i always holds SQE i; we hand SQEs out in ring order.
+  auto* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+  for (unsigned i = 0; i < _sqEntries; ++i) {
+    array[i] = i;
+  }
+
+  _sqeTail = _sqeSubmitted = *_sqTail;
+  return true;
+}
+
+bool IoUring::SupportsOps(std::initializer_list<uint8_t> ops) const {
+  static constexpr unsigned kProbeOps = 256;
+  std::vector<uint8_t> buffer(sizeof(io_uring_probe) +
+                              kProbeOps * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+  if (Register(IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+    return false;
+  }
+
+  return std::ranges::all_of(ops, [probe](uint8_t op) {
+    return op <= probe->last_op &&
+           (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  });
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+  const unsigned head =
+      std::atomic_ref<unsigned>(*_sqHead).load(std::memory_order_acquire);
+  if (_sqeTail - head >= _sqEntries) {
+    return nullptr;
+  }
+
+  io_uring_sqe* sqe = &_sqes[_sqeTail & _sqMask];
+  ++_sqeTail;
+  std::memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::Submit() {
+  const unsigned pending = _sqeTail - _sqeSubmitted;
+  if (pending == 0) {
+    return 0;
+  }
+
+  std::atomic_ref<unsigned>(*_sqTail).store(_sqeTail,
+                                            std::memory_order_release);
+  long ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, _fd, pending, 0, 0, nullptr, 0);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    // EAGAIN/EBUSY: the entries stay queued for the next Submit.
+    return -errno;
+  }
+
+  _sqeSubmitted += static_cast<unsigned>(ret);
+  return static_cast<int>(ret);
+}
+
+int IoUring::Register(unsigned opcode, const void* arg,
+                      unsigned count) const {
+  const long ret =
+      syscall(__NR_io_uring_register, _fd, opcode, arg, count);
+  return ret < 0 ? -errno : static_cast<int>(ret);
+}
+
+void IoUring::FlushOverflow() {
+  while (syscall(__NR_io_uring_enter, _fd, 0, 0, IORING_ENTER_GETEVENTS,
+                 nullptr, 0) < 0 &&
+         errno == EINTR) {
+  }
+}
+
+UringBufRing::~UringBufRing() {
+  if (_memory == nullptr) {
+    return;
+  }
+
+  if (_uring != nullptr) {
+    io_uring_buf_reg reg{};
+    reg.bgid = _group;
+    _uring->Register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+  }
+  munmap(_memory, _memoryBytes);
+}
+
+bool UringBufRing::Init(IoUring& ring, uint16_t count, uint32_t size,
+                        uint16_t group) {
+  // The ring of descriptors goes first so it's page aligned, as the kernel
+  // requires; the buffers follow in the same mapping.
+  const size_t ringBytes = size_t{count} * sizeof(io_uring_buf);
+  _memoryBytes = ringBytes + size_t{count} * size;
+  void* memory = mmap(nullptr, _memoryBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  _memory = memory;
+  _ring = static_cast<io_uring_buf*>(memory);
+  _buffers = static_cast<uint8_t*>(memory) + ringBytes;
+  _size = size;
+  _mask = static_cast<uint16_t>(count - 1);
+  _group = group;
+
+  io_uring_buf_reg reg{};
+  reg.ring_addr = reinterpret_cast<uint64_t>(_ring);
+  reg.ring_entries = count;
+  reg.bgid = group;
+  if (const int err = ring.Register(IORING_REGISTER_PBUF_RING, &reg, 1);
+      err < 0) {
+    errno = -err;
+    return false;
+  }
+  _uring = &ring;
+
+  for (uint32_t id = 0; id < count; ++id) {
+    Recycle(static_cast<uint16_t>(id));
+  }
+  Commit();
+  return true;
+}
+
+void UringBufRing::Recycle(uint16_t id) {
+  io_uring_buf& buf = _ring[(_tail + _staged) & _mask];
+  buf.addr = reinterpret_cast<uint64_t>(_buffers + size_t{id} * _size);
+  buf.len = _size;
+  buf.bid = id;
+  ++_staged;
+}
+
+void UringBufRing::Commit() {
+  if (_staged == 0) {
+    return;
+  }
+  _tail = static_cast<uint16_t>(_tail + _staged);
+  _staged = 0;
+  std::atomic_ref<uint16_t>(_ring[0].resv).store(_tail,
+                                                std::memory_order_release);
+}
+
+}  // namespace Ardos
+
+#endif  // ARDOS_HAVE_URING
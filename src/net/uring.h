@@ -0,0 +1,159 @@
+#ifndef ARDOS_URING_H
+#define ARDOS_URING_H
+
+// Minimal io_uring wrapper on the raw kernel ABI, covering what
+// UringTransportListener needs: submission/completion queues, opcode
+// probing, registered buffers, a completion eventfd and provided buffer
+// rings. Not thread-safe: one ring belongs to one event loop.
+//
+// ARDOS_HAVE_URING is only defined where the kernel headers know about
+// multishot recv (Linux 6.0+ headers); everywhere else this is empty and
+// callers fall back to TCP.
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+#define ARDOS_HAVE_URING 1
+#endif
+#endif
+
+#ifdef ARDOS_HAVE_URING
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+namespace Ardos {
+
+class IoUring {
+ public:
+  IoUring() = default;
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // Sets up a ring with `entries` submission and `cqEntries` completion
+  // slots. Returns false, with errno set, on failure.
+  bool Init(unsigned entries, unsigned cqEntries);
+
+  // True if the kernel implements every opcode in `ops`.
+  [[nodiscard]] bool SupportsOps(std::initializer_list<uint8_t> ops) const;
+
+  // Next free submission entry, zeroed, or nullptr if the queue is full
+  // (Submit and try again).
+  io_uring_sqe* GetSqe();
+  // Hands every prepared entry to the kernel in one io_uring_enter.
+  // Returns how many it took, or -errno.
+  int Submit();
+  [[nodiscard]] bool HasUnsubmitted() const {
+    return _sqeTail != _sqeSubmitted;
+  }
+
+  // Calls `onCqe(const io_uring_cqe&)` for every completion posted so far.
+  // `onCqe` may prepare and submit new entries. Returns how many it saw.
+  template <typename F>
+  unsigned ForEachCqe(F&& onCqe);
+
+  // io_uring_register, returning -errno on failure.
+  int Register(unsigned opcode, const void* arg, unsigned count) const;
+
+  [[nodiscard]] int Fd() const { return _fd; }
+
+ private:
+  // Asks the kernel to move completions that overflowed the CQ ring back
+  // into it.
+  void FlushOverflow();
+
+  int _fd = -1;
+
+  void* _ring = nullptr;
+  size_t _ringBytes = 0;
+  io_uring_sqe* _sqes = nullptr;
+  size_t _sqesBytes = 0;
+
+  unsigned* _sqHead = nullptr;
+  unsigned* _sqTail = nullptr;
+  unsigned* _sqFlags = nullptr;
+  unsigned _sqMask = 0;
+  unsigned _sqEntries = 0;
+  // Entries handed out by GetSqe, and the ones the kernel has taken.
+  unsigned _sqeTail = 0;
+  unsigned _sqeSubmitted = 0;
+
+  unsigned* _cqHead = nullptr;
+  unsigned* _cqTail = nullptr;
+  unsigned _cqMask = 0;
+  io_uring_cqe* _cqes = nullptr;
+};
+
+template <typename F>
+unsigned IoUring::ForEachCqe(F&& onCqe) {
+  unsigned seen = 0;
+  unsigned head = *_cqHead;  // only we ever move it
+  while (true) {
+    const unsigned tail =
+        std::atomic_ref<unsigned>(*_cqTail).load(std::memory_order_acquire);
+    if (head == tail) {
+      if (std::atomic_ref<unsigned>(*_sqFlags).load(
+              std::memory_order_relaxed) &
+          IORING_SQ_CQ_OVERFLOW) {
+        FlushOverflow();
+        continue;
+      }
+      return seen;
+    }
+
+    for (; head != tail; ++head, ++seen) {
+      onCqe(_cqes[head & _cqMask]);
+    }
+    std::atomic_ref<unsigned>(*_cqHead).store(head,
+                                              std::memory_order_release);
+  }
+}
+
+// A provided buffer ring: `count` buffers of `size` bytes the kernel picks
+// from when a recv completes, so idle sockets don't each pin a read buffer.
+// Buffers come back through Recycle and reach the kernel on Commit.
+class UringBufRing {
+ public:
+  UringBufRing() = default;
+  ~UringBufRing();
+
+  UringBufRing(const UringBufRing&) = delete;
+  UringBufRing& operator=(const UringBufRing&) = delete;
+
+  // `count` must be a power of two. Returns false, with errno set, if the
+  // kernel doesn't support provided buffer rings.
+  bool Init(IoUring& ring, uint16_t count, uint32_t size, uint16_t group);
+
+  [[nodiscard]] const uint8_t* Buffer(uint16_t id) const {
+    return _buffers + size_t{id} * _size;
+  }
+  void Recycle(uint16_t id);
+  void Commit();
+
+ private:
+  IoUring* _uring = nullptr;
+  void* _memory = nullptr;
+  size_t _memoryBytes = 0;
+  // The ring's descriptors. We index them directly rather than through
+  // io_uring_buf_ring, whose flexible array member sits 8 bytes off under
+  // C++ layout rules; the ring tail overlays bufs[0].resv.
+  io_uring_buf* _ring = nullptr;
+  uint8_t* _buffers = nullptr;
+  uint32_t _size = 0;
+  uint16_t _mask = 0;
+  uint16_t _group = 0;
+  uint16_t _tail = 0;
+  uint16_t _staged = 0;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_HAVE_URING
+
+#endif  // ARDOS_URING_H
@@ -0,0 +1,720 @@
+#include "uring_transport.h"
+
+#ifdef ARDOS_HAVE_URING
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <spdlog/spdlog.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <limits>
+
+#include "../util/globals.h"
+
+namespace Ardos {
+
+namespace {
+
+TransportEndpoint EndpointOf(const sockaddr_storage& addr) {
+  std::array<char, INET6_ADDRSTRLEN> ip{};
+  if (addr.ss_family == AF_INET6) {
+    const auto& in6 = reinterpret_cast<const sockaddr_in6&>(addr);
+    inet_ntop(AF_INET6, &in6.sin6_addr, ip.data(), ip.size());
+    return {.ip = ip.data(), .port = ntohs(in6.sin6_port)};
+  }
+  const auto& in = reinterpret_cast<const sockaddr_in&>(addr);
+  inet_ntop(AF_INET, &in.sin_addr, ip.data(), ip.size());
+  return {.ip = ip.data(), .port = ntohs(in.sin_port)};
+}
+
+}  // namespace
+
+UringTransportConnection::UringTransportConnection(
+    UringTransportListener* listener, uint64_t id, int fd, std::string logName)
+    : _listener(listener), _id(id), _fd(fd), _logName(std::move(logName)) {
+  // Match TcpTransportConnection's socket options.
+  const int on = 1;
+  const int idle = 60;
+  setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  setsockopt(_fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+  setsockopt(_fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+
+  sockaddr_storage addr{};
+  socklen_t addrLen = sizeof(addr);
+  if (getpeername(_fd, reinterpret_cast<sockaddr*>(&addr), &addrLen) == 0) {
+    _remoteEndpoint = EndpointOf(addr);
+  }
+  addrLen = sizeof(addr);
+  if (getsockname(_fd, reinterpret_cast<sockaddr*>(&addr), &addrLen) == 0) {
+    _localEndpoint = EndpointOf(addr);
+  }
+
+  _listener->_connections[_id] = this;
+  _listener->ArmRecv(_id, _fd);
+}
+
+UringTransportConnection::~UringTransportConnection() {
+  Close();
+  _listener->_connections.erase(_id);
+
+  if (_sendSlab >= 0) {
+    // Let the last write (usually an eject) finish; the listener closes the
+    // socket once it has.
+    _listener->_lingering[_id] = {.fd = _fd,
+                                  .offset = _sendOffset,
+                                  .size = _sendSize};
+  } else {
+    Shutdown();
+    _listener->_closeQueue.push_back(_fd);
+  }
+  *_alive = false;
+}
+
+void UringTransportConnection::SetHandler(std::weak_ptr<ITransportHandler> h) {
+  _handler = std::move(h);
+}
+
+void UringTransportConnection::Send(const uint8_t* data, size_t len,
+                                    Reliability /*r*/) {
+  // TCP is always reliable; the hint is ignored.
+  if (_state.Closed()) {
+    return;
+  }
+
+  // Framing prefix is uint16; larger payloads would wrap and corrupt.
+  if (len > std::numeric_limits<uint16_t>::max()) {
+    spdlog::get(_logName)->error(
+        "io_uring transport refusing oversized datagram ({}B > {}B max)", len,
+        std::numeric_limits<uint16_t>::max());
+    return;
+  }
+
+  if (!HasRoomFor(sizeof(uint16_t) + len)) {
+    return;
+  }
+
+  const auto dgSize = static_cast<uint16_t>(len);
+  const auto* prefix = reinterpret_cast<const uint8_t*>(&dgSize);
+  _pending.insert(_pending.end(), prefix, prefix + sizeof(uint16_t));
+  _pending.insert(_pending.end(), data, data + len);
+
+  // Everything sent to us before the loop next blocks goes out together.
+  _listener->QueueFlush(this);
+}
+
+void UringTransportConnection::SendBatch(const uint8_t* data, size_t len) {
+  // Already framed the way we'd frame it.
+  if (_state.Closed() || len == 0 || !HasRoomFor(len)) {
+    return;
+  }
+
+  _pending.insert(_pending.end(), data, data + len);
+  _listener->QueueFlush(this);
+}
+
+bool UringTransportConnection::HasRoomFor(size_t size) {
+  if (_pending.size() - _pendingOffset + size <= kHighWaterBytes) {
+    return true;
+  }
+
+  spdlog::get(_logName)->warn(
+      "io_uring transport: client {}:{} exceeded {}B write backlog; "
+      "disconnecting",
+      _remoteEndpoint.ip, _remoteEndpoint.port, kHighWaterBytes);
+  Fail();
+  return false;
+}
+
+void UringTransportConnection::Close() {
+  if (!_state.Close()) {
+    return;
+  }
+
+  // Writes only go out once per loop iteration, so whatever was sent just
+  // before closing (an eject, say) is likely still pending. Get it into a
+  // slab now; the socket is shut down once that write completes.
+  PumpWrite();
+  if (_sendSlab < 0) {
+    Shutdown();
+  }
+}
+
+TransportEndpoint UringTransportConnection::RemoteEndpoint() const {
+  return _remoteEndpoint;
+}
+
+TransportEndpoint UringTransportConnection::LocalEndpoint() const {
+  return _localEndpoint;
+}
+
+void UringTransportConnection::HandleData(const uint8_t* data, size_t size) {
+  // Handlers may close (or destroy) us mid-read.
+  _framer.Feed(data, size,
+               [this, alive = _alive](const uint8_t* message, size_t len) {
+                 DeliverMessage(message, len);
+                 return *alive && !_state.Closed();
+               });
+}
+
+void UringTransportConnection::DeliverMessage(const uint8_t* data,
+                                              size_t len) {
+  if (_framer.IsNegotiation(len)) {
+    // Compression request; we never compress.
+    const uint8_t none = 0;
+    Send(&none, sizeof(none));
+    return;
+  }
+
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportMessage(data, len);
+  }
+}
+
+void UringTransportConnection::PumpWrite() {
+  if (_sendSlab >= 0 || _shutdown || _pendingOffset == _pending.size()) {
+    return;
+  }
+
+  const int slab = _listener->AcquireSlab();
+  if (slab < 0) {
+    // Every slab is in flight; go again as soon as one comes back.
+    if (!_flushQueued) {
+      _flushQueued = true;
+      _listener->_slabWaiters.push_back(_id);
+    }
+    return;
+  }
+
+  const size_t size = std::min<size_t>(_pending.size() - _pendingOffset,
+                                       UringTransportListener::kSendSlabBytes);
+  std::memcpy(_listener->SlabData(static_cast<uint16_t>(slab)),
+              _pending.data() + _pendingOffset, size);
+  _pendingOffset += size;
+  if (_pendingOffset == _pending.size()) {
+    _pending.clear();
+    _pendingOffset = 0;
+  } else if (_pendingOffset >= _pending.size() / 2) {
+    _pending.erase(_pending.begin(),
+                   _pending.begin() + static_cast<ptrdiff_t>(_pendingOffset));
+    _pendingOffset = 0;
+  }
+
+  _sendSlab = slab;
+  _sendOffset = 0;
+  _sendSize = static_cast<uint32_t>(size);
+  _listener->QueueWrite(_id, _fd, static_cast<uint16_t>(slab), _sendOffset,
+                        _sendSize);
+}
+
+void UringTransportConnection::HandleWriteComplete(int res) {
+  if (res < 0) {
+    _listener->ReleaseSlab(static_cast<uint16_t>(_sendSlab));
+    _sendSlab = -1;
+    HandleClose();
+    return;
+  }
+
+  // Short write: send the rest from the same slab.
+  _sendOffset += static_cast<uint32_t>(res);
+  _sendSize -= static_cast<uint32_t>(res);
+  if (_sendSize > 0) {
+    _listener->QueueWrite(_id, _fd, static_cast<uint16_t>(_sendSlab),
+                          _sendOffset, _sendSize);
+    return;
+  }
+
+  _listener->ReleaseSlab(static_cast<uint16_t>(_sendSlab));
+  _sendSlab = -1;
+  if (_pendingOffset != _pending.size()) {
+    _listener->QueueFlush(this);
+  } else if (_state.Closed()) {
+    Shutdown();
+  }
+}
+
+void UringTransportConnection::Fail() {
+  if (!_state.Fail()) {
+    return;
+  }
+
+  // Unlike Close(), don't wait for the backlog to drain: that's what
+  // failed. The shutdown ends the recv (and any write in flight), and the
+  // completion brings us back to HandleClose from the loop.
+  Shutdown();
+}
+
+void UringTransportConnection::HandleClose() {
+  // Already closed, unless it was Fail() and the handler is still to be
+  // told.
+  if (!_state.Finish()) {
+    return;
+  }
+  Shutdown();
+
+  if (auto handler = _handler.lock()) {
+    handler->OnTransportDisconnect();
+  }
+}
+
+void UringTransportConnection::Shutdown() {
+  if (_shutdown) {
+    return;
+  }
+  _shutdown = true;
+
+  _pending.clear();
+  _pendingOffset = 0;
+
+  // Ends the multishot recv (and any write) with the socket still open;
+  // the descriptor itself is only closed once no queued SQE can refer to
+  // it.
+  ::shutdown(_fd, SHUT_RDWR);
+}
+
+UringTransportListener::UringTransportListener(std::string logName)
+    : _logName(std::move(logName)) {}
+
+UringTransportListener::~UringTransportListener() {
+  // Connections are owned by their participants, which the owning role
+  // tears down first.
+  if (_eventPoll) {
+    _eventPoll->close();
+  }
+  if (_flushHandle) {
+    _flushHandle->close();
+  }
+  for (const auto& [id, lingering] : _lingering) {
+    ::close(lingering.fd);
+  }
+  for (int fd : _closeQueue) {
+    ::close(fd);
+  }
+  // Closing the ring cancels whatever it still has in flight.
+  _recvBuffers.reset();
+  _uring.reset();
+  if (_slabs != nullptr) {
+    munmap(_slabs, size_t{kSendSlabCount} * kSendSlabBytes);
+  }
+  if (_eventFd >= 0) {
+    ::close(_eventFd);
+  }
+  if (_listenFd >= 0) {
+    ::close(_listenFd);
+  }
+}
+
+/**
+ * Checks that the running kernel has everything the io_uring transport
+ * can't do without: the ring itself, the socket opcodes and provided buffer
+ * rings (5.19). Multishot accept/recv and fixed-buffer sends are newer
+ * still, but fall back per operation at runtime.
+ * @param logName
+ * @return
+ */
+bool UringTransportListener::Supported(const std::string& logName) {
+  IoUring ring;
+  if (!ring.Init(8, 16)) {
+    spdlog::get(logName)->warn("io_uring is unavailable: {}",
+                               std::strerror(errno));
+    return false;
+  }
+
+  if (!ring.SupportsOps(
+          {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND})) {
+    spdlog::get(logName)->warn("io_uring lacks the socket opcodes we need");
+    return false;
+  }
+
+  UringBufRing buffers;
+  if (!buffers.Init(ring, 1, kRecvBufferBytes, kRecvBufferGroup)) {
+    spdlog::get(logName)->warn("io_uring provided buffer rings unavailable: {}",
+                               std::strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void UringTransportListener::SetConnectionFactory(ConnectionFactory factory) {
+  _factory = std::move(factory);
+}
+
+bool UringTransportListener::Listen(const std::string& host, int port) {
+  sockaddr_storage addr{};
+  socklen_t addrLen = sizeof(sockaddr_in);
+  if (uv_ip4_addr(host.c_str(), port, reinterpret_cast<sockaddr_in*>(&addr)) !=
+      0) {
+    addrLen = sizeof(sockaddr_in6);
+    if (uv_ip6_addr(host.c_str(), port,
+                    reinterpret_cast<sockaddr_in6*>(&addr)) != 0) {
+      spdlog::get(_logName)->error("Invalid io_uring listen host: {}", host);
+      return false;
+    }
+  }
+
+  const int on = 1;
+  _listenFd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_listenFd < 0 ||
+      setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0 ||
+      listen(_listenFd, SOMAXCONN) != 0) {
+    spdlog::get(_logName)->error("Failed to listen on {}:{}: {}", host, port,
+                                 std::strerror(errno));
+    return false;
+  }
+
+  if (!SetupRing()) {
+    return false;
+  }
+
+  ArmAccept();
+  Flush();
+  return true;
+}
+
+/**
+ * Creates the ring, the shared receive buffers and the send slabs, and
+ * hooks the ring into the main loop.
+ * @return
+ */
+bool UringTransportListener::SetupRing() {
+  _uring = std::make_unique<IoUring>();
+  if (!_uring->Init(kRingEntries, kCompletionEntries)) {
+    spdlog::get(_logName)->error("Failed to set up io_uring: {}",
+                                 std::strerror(errno));
+    return false;
+  }
+
+  _recvBuffers = std::make_unique<UringBufRing>();
+  if (!_recvBuffers->Init(*_uring, kRecvBufferCount, kRecvBufferBytes,
+                          kRecvBufferGroup)) {
+    spdlog::get(_logName)->error("Failed to register io_uring buffers: {}",
+                                 std::strerror(errno));
+    return false;
+  }
+
+  const size_t slabBytes = size_t{kSendSlabCount} * kSendSlabBytes;
+  void* slabs = mmap(nullptr, slabBytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (slabs == MAP_FAILED) {
+    spdlog::get(_logName)->error("Failed to allocate io_uring send slabs");
+    return false;
+  }
+  _slabs = static_cast<uint8_t*>(slabs);
+  _freeSlabs.reserve(kSendSlabCount);
+  for (uint16_t slab = kSendSlabCount; slab > 0; --slab) {
+    _freeSlabs.push_back(slab - 1);
+  }
+
+  // Pinning the slabs can fail under a tight RLIMIT_MEMLOCK on older
+  // kernels; plain sends from the same memory still work.
+  std::vector<iovec> iovs(kSendSlabCount);
+  for (uint16_t slab = 0; slab < kSendSlabCount; ++slab) {
+    iovs[slab] = {.iov_base = SlabData(slab), .iov_len = kSendSlabBytes};
+  }
+  if (const int err =
+          _uring->Register(IORING_REGISTER_BUFFERS, iovs.data(), iovs.size());
+      err < 0) {
+    spdlog::get(_logName)->warn(
+        "Couldn't register io_uring send slabs ({}); using plain sends",
+        std::strerror(-err));
+  } else {
+    _fixedSlabs = _uring->SupportsOps({IORING_OP_WRITE_FIXED});
+  }
+  if (_fixedSlabs) {
+    // WRITE_FIXED has no MSG_NOSIGNAL; a client resetting mid-write must
+    // fail the write, not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+  }
+
+  _eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (_eventFd < 0 ||
+      _uring->Register(IORING_REGISTER_EVENTFD, &_eventFd, 1) < 0) {
+    spdlog::get(_logName)->error("Failed to set up io_uring eventfd");
+    return false;
+  }
+
+  _eventPoll = g_loop->resource<uvw::poll_handle>(_eventFd);
+  _eventPoll->on<uvw::poll_event>(
+      [this](const uvw::poll_event&, uvw::poll_handle&) {
+        HandleCompletions();
+      });
+  _eventPoll->start(uvw::poll_handle::poll_event_flags::READABLE);
+
+  _flushHandle = g_loop->resource<uvw::prepare_handle>();
+  _flushHandle->on<uvw::prepare_event>(
+      [this](const uvw::prepare_event&, uvw::prepare_handle&) { Flush(); });
+  _flushHandle->start();
+  return true;
+}
+
+void UringTransportListener::HandleCompletions() {
+  uint64_t count;
+  while (read(_eventFd, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+
+  _uring->ForEachCqe([this](const io_uring_cqe& cqe) { HandleCqe(cqe); });
+  _recvBuffers->Commit();
+}
+
+void UringTransportListener::HandleCqe(const io_uring_cqe& cqe) {
+  const auto op = static_cast<Op>(cqe.user_data & 0xFF);
+  const auto slab = static_cast<uint16_t>(cqe.user_data >> 8);
+  const uint64_t id = cqe.user_data >> 24;
+
+  switch (op) {
+    case Op::Accept:
+      HandleAccept(cqe.res, cqe.flags);
+      break;
+    case Op::Recv:
+      HandleRecv(id, cqe.res, cqe.flags);
+      break;
+    case Op::Send:
+      HandleSend(id, slab, cqe.res);
+      break;
+  }
+}
+
+void UringTransportListener::HandleAccept(int res, uint32_t flags) {
+  const bool more = flags & IORING_CQE_F_MORE;
+
+  if (res == -EINVAL && _multishotAccept) {
+    // Pre-5.19 kernel: accept one at a time instead.
+    _multishotAccept = false;
+  } else if (res < 0) {
+    if (res != -EAGAIN && res != -EINTR && res != -ECONNABORTED) {
+      spdlog::get(_logName)->warn("io_uring accept failed: {}",
+                                  std::strerror(-res));
+    }
+  } else {
+    auto connection = std::make_unique<UringTransportConnection>(
+        this, ++_nextId, res, _logName);
+    if (_factory) {
+      _factory(std::move(connection));
+    }
+  }
+
+  if (!more) {
+    ArmAccept();
+  }
+}
+
+void UringTransportListener::HandleRecv(uint64_t id, int res,
+                                        uint32_t flags) {
+  const bool more = flags & IORING_CQE_F_MORE;
+
+  auto it = _connections.find(id);
+  if (flags & IORING_CQE_F_BUFFER) {
+    const auto buffer = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    if (it != _connections.end() && res > 0 && !it->second->_state.Closed()) {
+      it->second->HandleData(_recvBuffers->Buffer(buffer),
+                             static_cast<size_t>(res));
+      // The handler may have dropped the connection.
+      it = _connections.find(id);
+    }
+    _recvBuffers->Recycle(buffer);
+  }
+
+  if (it == _connections.end()) {
+    return;
+  }
+  auto* connection = it->second;
+
+  if (res == -EINVAL && _multishotRecv) {
+    // Pre-6.0 kernel: one recv per completion instead.
+    _multishotRecv = false;
+  } else if (res == -ENOBUFS) {
+    // The whole pool is waiting on slow handlers; it's recycled as this
+    // batch of completions finishes, so just go again.
+    spdlog::get(_logName)->debug("io_uring receive buffers exhausted");
+  } else if (res <= 0) {
+    // 0 is EOF. Either way the recv won't fire again.
+    connection->HandleClose();
+    return;
+  }
+
+  if (!more) {
+    if (!connection->_shutdown) {
+      ArmRecv(id, connection->_fd);
+    } else if (connection->_state.Failed()) {
+      // This was the last recv, so it's the last chance to tell the
+      // handler about the failure.
+      connection->HandleClose();
+    }
+  }
+}
+
+void UringTransportListener::HandleSend(uint64_t id, uint16_t slab, int res) {
+  if (res == -EINVAL && _fixedSlabs) {
+    // The kernel won't write to a socket from registered buffers; fall back
+    // to plain sends from the same slabs and retry this one.
+    spdlog::get(_logName)->debug(
+        "io_uring can't write from registered buffers; using plain sends");
+    _fixedSlabs = false;
+    if (auto it = _connections.find(id); it != _connections.end()) {
+      QueueWrite(id, it->second->_fd, slab, it->second->_sendOffset,
+                 it->second->_sendSize);
+      return;
+    }
+    if (auto it = _lingering.find(id); it != _lingering.end()) {
+      QueueWrite(id, it->second.fd, slab, it->second.offset, it->second.size);
+      return;
+    }
+  }
+
+  if (auto it = _connections.find(id); it != _connections.end()) {
+    it->second->HandleWriteComplete(res);
+    return;
+  }
+
+  auto it = _lingering.find(id);
+  if (it == _lingering.end()) {
+    ReleaseSlab(slab);
+    return;
+  }
+
+  auto& lingering = it->second;
+  if (res > 0 && static_cast<uint32_t>(res) < lingering.size) {
+    lingering.offset += static_cast<uint32_t>(res);
+    lingering.size -= static_cast<uint32_t>(res);
+    QueueWrite(id, lingering.fd, slab, lingering.offset, lingering.size);
+    return;
+  }
+
+  ::shutdown(lingering.fd, SHUT_RDWR);
+  _closeQueue.push_back(lingering.fd);
+  _lingering.erase(it);
+  ReleaseSlab(slab);
+}
+
+void UringTransportListener::Flush() {
+  if (!_uring) {
+    return;
+  }
+
+  // Connections that ran out of slabs go first.
+  while (!_slabWaiters.empty() && !_freeSlabs.empty()) {
+    const uint64_t id = _slabWaiters.front();
+    _slabWaiters.pop_front();
+    if (auto it = _connections.find(id); it != _connections.end()) {
+      it->second->_flushQueued = false;
+      it->second->PumpWrite();
+    }
+  }
+
+  for (size_t i = 0; i < _flushQueue.size(); ++i) {
+    if (auto it = _connections.find(_flushQueue[i]);
+        it != _connections.end()) {
+      it->second->_flushQueued = false;
+      it->second->PumpWrite();
+    }
+  }
+  _flushQueue.clear();
+
+  if (_uring->HasUnsubmitted()) {
+    const int res = _uring->Submit();
+    if (res < 0 && res != -EAGAIN && res != -EBUSY) {
+      spdlog::get(_logName)->error("io_uring submit failed: {}",
+                                   std::strerror(-res));
+    }
+  }
+
+  // Only now can no queued SQE still name these descriptors.
+  if (!_uring->HasUnsubmitted()) {
+    for (int fd : _closeQueue) {
+      ::close(fd);
+    }
+    _closeQueue.clear();
+  }
+}
+
+io_uring_sqe* UringTransportListener::GetSqe() {
+  io_uring_sqe* sqe = _uring->GetSqe();
+  while (sqe == nullptr) {
+    // Full of this iteration's work already; let the kernel have it.
+    if (const int res = _uring->Submit(); res < 0 && res != -EINTR &&
+                                          res != -EAGAIN && res != -EBUSY) {
+      spdlog::get(_logName)->error("io_uring submit failed: {}",
+                                   std::strerror(-res));
+    }
+    sqe = _uring->GetSqe();
+  }
+  return sqe;
+}
+
+void UringTransportListener::ArmAccept() {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = _listenFd;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  if (_multishotAccept) {
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  }
+  sqe->user_data = Tag(Op::Accept, 0);
+}
+
+void UringTransportListener::ArmRecv(uint64_t id, int fd) {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kRecvBufferGroup;
+  if (_multishotRecv) {
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+  }
+  sqe->user_data = Tag(Op::Recv, id);
+}
+
+void UringTransportListener::QueueWrite(uint64_t id, int fd, uint16_t slab,
+                                        uint32_t offset, uint32_t size) {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(SlabData(slab) + offset);
+  sqe->len = size;
+  if (_fixedSlabs) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->buf_index = slab;
+  } else {
+    sqe->opcode = IORING_OP_SEND;
+    sqe->msg_flags = MSG_NOSIGNAL;
+  }
+  sqe->user_data = Tag(Op::Send, id, slab);
+}
+
+int UringTransportListener::AcquireSlab() {
+  if (_freeSlabs.empty()) {
+    return -1;
+  }
+  const uint16_t slab = _freeSlabs.back();
+  _freeSlabs.pop_back();
+  return slab;
+}
+
+void UringTransportListener::ReleaseSlab(uint16_t slab) {
+  _freeSlabs.push_back(slab);
+}
+
+uint8_t* UringTransportListener::SlabData(uint16_t slab) const {
+  return _slabs + size_t{slab} * kSendSlabBytes;
+}
+
+void UringTransportListener::QueueFlush(UringTransportConnection* connection) {
+  if (connection->_flushQueued) {
+    return;
+  }
+  connection->_flushQueued = true;
+  _flushQueue.push_back(connection->_id);
+}
+
+}  // namespace Ardos
+
+#endif  // ARDOS_HAVE_URING
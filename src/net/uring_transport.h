@@ -0,0 +1,193 @@
+#ifndef ARDOS_URING_TRANSPORT_H
+#define ARDOS_URING_TRANSPORT_H
+
+#include "uring.h"
+
+#ifdef ARDOS_HAVE_URING
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <uvw.hpp>
+#include <vector>
+
+#include "stream_framing.h"
+#include "transport.h"
+
+namespace Ardos {
+
+class UringTransportListener;
+
+// TCP connection driven through the listener's io_uring rather than libuv.
+// Same [uint16 LE length][payload] framing as TcpTransportConnection, so
+// clients can't tell the two apart. Reads arrive through one multishot
+// recv into the listener's shared buffer pool; writes are framed into a
+// pending buffer and flushed from a registered send slab once per loop
+// iteration, along with every other connection's. A compression request
+// (see TcpTransportConnection) is always answered with 0: uncompressed.
+class UringTransportConnection final : public ITransportConnection {
+ public:
+  UringTransportConnection(UringTransportListener* listener, uint64_t id,
+                           int fd, std::string logName);
+  ~UringTransportConnection() override;
+
+  void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
+  void Send(const uint8_t* data, size_t len,
+            Reliability r = Reliability::Reliable) override;
+  void SendBatch(const uint8_t* data, size_t len) override;
+  void Close() override;
+  [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
+  [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
+
+ private:
+  friend class UringTransportListener;
+
+  void HandleData(const uint8_t* data, size_t size);
+  void DeliverMessage(const uint8_t* data, size_t len);
+  // False (after disconnecting) if `size` more pending bytes would take the
+  // backlog past kHighWaterBytes.
+  bool HasRoomFor(size_t size);
+  // Called by the listener before it submits: moves pending bytes into a
+  // send slab and queues the write, if none is in flight.
+  void PumpWrite();
+  void HandleWriteComplete(int res);
+  // Shuts the socket down after a transport-level failure. The handler is
+  // told by HandleClose once the ring reports the socket done, never from
+  // inside the Send that failed.
+  void Fail();
+  // Shuts the socket down and tells the handler.
+  void HandleClose();
+  // Stops the socket once nothing more is going out on it.
+  void Shutdown();
+
+  UringTransportListener* _listener;
+  uint64_t _id;
+  int _fd;
+  std::string _logName;
+  std::weak_ptr<ITransportHandler> _handler;
+  TransportEndpoint _remoteEndpoint;
+  TransportEndpoint _localEndpoint;
+
+  // Splits recv completions into datagrams, partial ones included.
+  StreamFramer _framer{true};
+
+  // Framed datagrams not yet copied into a send slab, from _pendingOffset
+  // on. Bounded by kHighWaterBytes, like the TCP write queue.
+  std::vector<uint8_t> _pending;
+  size_t _pendingOffset = 0;
+  static constexpr size_t kHighWaterBytes = size_t{4} * 1024 * 1024;  // 4 MiB
+
+  // The send slab in flight (-1: none), and which part of it is left.
+  int _sendSlab = -1;
+  uint32_t _sendOffset = 0;
+  uint32_t _sendSize = 0;
+  // Queued with the listener for a flush or a free slab.
+  bool _flushQueued = false;
+
+  StreamCloseState _state;
+  bool _shutdown = false;
+
+  // Same late-callback guard as TcpTransportConnection.
+  std::shared_ptr<bool> _alive = std::make_shared<bool>(true);
+};
+
+// Accepts TCP clients with io_uring (client-agent.transport: uring, Linux
+// 5.19+). One ring on the main loop carries a multishot accept, a multishot
+// recv per connection reading from a shared provided-buffer pool, and
+// sends from registered slabs. Submissions are batched and handed to
+// the kernel once per loop iteration; completions are signalled through an
+// eventfd that libuv polls. Supported() says whether the running kernel
+// can do all that, so callers can fall back to TcpTransportListener.
+class UringTransportListener final : public ITransportListener {
+ public:
+  explicit UringTransportListener(std::string logName = "ca");
+  ~UringTransportListener() override;
+
+  // Probes the kernel once. Logs why to `logName` if it says no.
+  static bool Supported(const std::string& logName);
+
+  void SetConnectionFactory(ConnectionFactory factory) override;
+  bool Listen(const std::string& host, int port) override;
+
+ private:
+  friend class UringTransportConnection;
+
+  enum class Op : uint8_t { Accept, Recv, Send };
+
+  // user_data layout: [connection id:40][send slab:16][op:8].
+  static uint64_t Tag(Op op, uint64_t id, uint16_t slab = 0) {
+    return (id << 24) | (uint64_t{slab} << 8) | static_cast<uint8_t>(op);
+  }
+
+  bool SetupRing();
+  void HandleCompletions();
+  void HandleCqe(const io_uring_cqe& cqe);
+  void HandleAccept(int res, uint32_t flags);
+  void HandleRecv(uint64_t id, int res, uint32_t flags);
+  void HandleSend(uint64_t id, uint16_t slab, int res);
+  // Runs before the loop blocks: flushes queued writes and submits every
+  // SQE prepared since the last iteration in one syscall.
+  void Flush();
+
+  // Next SQE, submitting first if the queue is full.
+  io_uring_sqe* GetSqe();
+  void ArmAccept();
+  void ArmRecv(uint64_t id, int fd);
+  void QueueWrite(uint64_t id, int fd, uint16_t slab, uint32_t offset,
+                  uint32_t size);
+  int AcquireSlab();
+  void ReleaseSlab(uint16_t slab);
+  [[nodiscard]] uint8_t* SlabData(uint16_t slab) const;
+  void QueueFlush(UringTransportConnection* connection);
+
+  std::string _logName;
+  ConnectionFactory _factory;
+  int _listenFd = -1;
+  bool _multishotAccept = true;
+  bool _multishotRecv = true;
+
+  std::unique_ptr<IoUring> _uring;
+  std::unique_ptr<UringBufRing> _recvBuffers;
+  int _eventFd = -1;
+  std::shared_ptr<uvw::poll_handle> _eventPoll;
+  std::shared_ptr<uvw::prepare_handle> _flushHandle;
+
+  // Send slabs, registered with the kernel as fixed buffers when it lets
+  // us (sends from them then skip the per-write page pinning), otherwise
+  // used for plain sends.
+  uint8_t* _slabs = nullptr;
+  std::vector<uint16_t> _freeSlabs;
+  bool _fixedSlabs = false;
+
+  uint64_t _nextId = 0;
+  std::unordered_map<uint64_t, UringTransportConnection*> _connections;
+  // Connections with bytes to flush, or waiting for a free slab.
+  std::vector<uint64_t> _flushQueue;
+  std::deque<uint64_t> _slabWaiters;
+  // Sockets whose connection is gone but whose last write is still in
+  // flight; closed when it completes.
+  struct Lingering {
+    int fd;
+    uint32_t offset;
+    uint32_t size;
+  };
+  std::unordered_map<uint64_t, Lingering> _lingering;
+  // Descriptors to close once no unsubmitted SQE can refer to them.
+  std::vector<int> _closeQueue;
+
+  static constexpr unsigned kRingEntries = 4096;
+  static constexpr unsigned kCompletionEntries = 4 * kRingEntries;
+  static constexpr uint16_t kRecvBufferCount = 1024;
+  static constexpr uint32_t kRecvBufferBytes = 4096;
+  static constexpr uint16_t kRecvBufferGroup = 0;
+  static constexpr uint16_t kSendSlabCount = 256;
+  // Same size as TcpTransportConnection's write slabs.
+  static constexpr uint32_t kSendSlabBytes = 64 * 1024;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_HAVE_URING
+
+#endif  // ARDOS_URING_TRANSPORT_H
@@ -54,6 +54,12 @@ void OnWsClientData(ws28::Client* client, char* data, size_t len,
   conn->OnWsData(reinterpret_cast<const uint8_t*>(data), len);
 }
 
+void OnWsCompressed(ws28::Server* /*server*/, size_t inLen, size_t outLen,
+                    uint64_t nanos) {
+  CompressionMetrics::Record(CompressionMetrics::Transport::Ws, inLen, outLen,
+                             std::chrono::nanoseconds(nanos));
+}
+
 }  // namespace
 
 WsTransportConnection::WsTransportConnection(ws28::Client* client)
@@ -89,6 +95,13 @@ void WsTransportConnection::Send(const uint8_t* data, size_t len,
   _client->Send(reinterpret_cast<const char*>(data), len, /*opCode=*/2);
 }
 
+void WsTransportConnection::SendBatch(const uint8_t* data, size_t len) {
+  if (_closed || !_client || len == 0) {
+    return;
+  }
+  _client->Send(reinterpret_cast<const char*>(data), len, /*opCode=*/2);
+}
+
 void WsTransportConnection::Close() {
   if (_closed) {
     return;
@@ -130,8 +143,13 @@ void WsTransportConnection::OnWsDisconnect() {
   }
 }
 
-WsTransportListener::WsTransportListener()
-    : _server(std::make_unique<ws28::Server>(g_loop->raw())) {}
+WsTransportListener::WsTransportListener(
+    std::shared_ptr<const CompressionOptions> compression,
+    std::shared_ptr<const TlsContext> tls)
+    : _tls(std::move(tls)),
+      _server(std::make_unique<ws28::Server>(
+          g_loop->raw(), _tls ? _tls->Get() : nullptr)),
+      _compression(std::move(compression)) {}
 
 void WsTransportListener::SetConnectionFactory(ConnectionFactory factory) {
   _factory = std::move(factory);
@@ -150,8 +168,7 @@ bool WsTransportListener::Listen(const std::string& host, int port) {
   _server->SetMaxMessageSize(0xFFFF + 2);
 
   // Disable Origin enforcement -- game clients aren't browsers and
-  // don't carry meaningful Origin headers. (TLS isn't terminated here
-  // anyway; reverse proxy handles cross-origin policy.)
+  // don't carry meaningful Origin headers.
   _server->SetCheckConnectionCallback(
       [](ws28::Client* /*client*/, ws28::HTTPRequest& /*req*/) {
         return true;
@@ -161,6 +178,12 @@ bool WsTransportListener::Listen(const std::string& host, int port) {
   _server->SetClientDisconnectedCallback(&OnWsClientDisconnected);
   _server->SetClientDataCallback(&OnWsClientData);
 
+  if (_compression && _compression->enabled) {
+    _server->SetPerMessageDeflate(true, _compression->threshold,
+                                  _compression->level);
+    _server->SetCompressionStatsCallback(&OnWsCompressed);
+  }
+
   // Stash `this` so the static callbacks above can find the listener
   // via the ws28::Server they're handed.
   _server->SetUserData(this);
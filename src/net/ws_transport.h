@@ -6,6 +6,8 @@
 #include <memory>
 #include <string>
 
+#include "compression.h"
+#include "tls_context.h"
 #include "transport.h"
 
 namespace Ardos {
@@ -22,6 +24,8 @@ class WsTransportConnection final : public ITransportConnection {
   void SetHandler(std::weak_ptr<ITransportHandler> handler) override;
   void Send(const uint8_t* data, size_t len,
             Reliability r = Reliability::Reliable) override;
+  // The whole batch goes out as one binary frame, length prefixes and all.
+  void SendBatch(const uint8_t* data, size_t len) override;
   void Close() override;
   [[nodiscard]] TransportEndpoint RemoteEndpoint() const override;
   [[nodiscard]] TransportEndpoint LocalEndpoint() const override;
@@ -46,7 +50,12 @@ class WsTransportConnection final : public ITransportConnection {
 // WsTransportConnection and hands it to the configured factory.
 class WsTransportListener final : public ITransportListener {
  public:
-  WsTransportListener();
+  // With compression enabled, clients that offer permessage-deflate get
+  // it (RFC 7692). With a `tls` context, ws28 terminates TLS itself
+  // (wss://), still accepting plain ws:// on the same port.
+  explicit WsTransportListener(
+      std::shared_ptr<const CompressionOptions> compression = nullptr,
+      std::shared_ptr<const TlsContext> tls = nullptr);
   ~WsTransportListener() override = default;
 
   void SetConnectionFactory(ConnectionFactory factory) override;
@@ -57,8 +66,11 @@ class WsTransportListener final : public ITransportListener {
   [[nodiscard]] const ConnectionFactory& Factory() const { return _factory; }
 
  private:
+  // Outlives _server, which only borrows the SSL_CTX.
+  std::shared_ptr<const TlsContext> _tls;
   std::unique_ptr<ws28::Server> _server;
   ConnectionFactory _factory;
+  std::shared_ptr<const CompressionOptions> _compression;
 };
 
 }  // namespace Ardos
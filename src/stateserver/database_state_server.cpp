@@ -220,15 +220,13 @@ void DatabaseStateServer::HandleDeleteDisk(DatagramIterator& dgi,
     }
 
     // Send the datagram!
-    auto dg =
-        std::make_shared<Datagram>(targets, sender, DBSS_OBJECT_DELETE_DISK);
+    auto dg = Datagram::Create(targets, sender, DBSS_OBJECT_DELETE_DISK);
     dg->AddUint32(doId);
     PublishDatagram(dg);
   }
 
   // Send delete message to the database.
-  auto dg =
-      std::make_shared<Datagram>(_dbChannel, doId, DBSERVER_OBJECT_DELETE);
+  auto dg = Datagram::Create(_dbChannel, doId, DBSERVER_OBJECT_DELETE);
   dg->AddUint32(doId);
   PublishDatagram(dg);
 }
@@ -272,7 +270,7 @@ void DatabaseStateServer::HandleSetField(DatagramIterator& dgi,
     return;
   }
 
-  auto dg = std::make_shared<Datagram>(_dbChannel, doId, responseType);
+  auto dg = Datagram::Create(_dbChannel, doId, responseType);
   dg->AddUint32(doId);
   if (multiple) {
     dg->AddUint16(objectFields.size());
@@ -306,7 +304,7 @@ void DatabaseStateServer::HandleGetField(DatagramIterator& dgi,
 
     auto* field = g_dc_file->get_field_by_index(fieldId);
     if (!field) {
-      auto dg = std::make_shared<Datagram>(sender, doId, responseType);
+      auto dg = Datagram::Create(sender, doId, responseType);
       dg->AddUint32(ctx);
       dg->AddBool(false);
       PublishDatagram(dg);
@@ -327,7 +325,7 @@ void DatabaseStateServer::HandleGetField(DatagramIterator& dgi,
     auto dbCtx = _nextContext++;
 
     // Prepare response datagram.
-    auto dg = std::make_shared<Datagram>(sender, doId, responseType);
+    auto dg = Datagram::Create(sender, doId, responseType);
     dg->AddUint32(ctx);
     dg->AddBool(true);
     if (multiple) {
@@ -341,7 +339,7 @@ void DatabaseStateServer::HandleGetField(DatagramIterator& dgi,
     _contextDatagrams[dbCtx] = dg;
 
     // Send query off to the database.
-    auto dbDg = std::make_shared<Datagram>(
+    auto dbDg = Datagram::Create(
         _dbChannel, doId,
         multiple ? DBSERVER_OBJECT_GET_FIELDS : DBSERVER_OBJECT_GET_FIELD);
     dbDg->AddUint32(dbCtx);
@@ -355,7 +353,7 @@ void DatabaseStateServer::HandleGetField(DatagramIterator& dgi,
     PublishDatagram(dbDg);
   } else if (!ramFields.empty()) {
     // If no database fields exist, and we have a RAM fields...
-    auto dg = std::make_shared<Datagram>(sender, doId, responseType);
+    auto dg = Datagram::Create(sender, doId, responseType);
     dg->AddUint32(ctx);
     dg->AddBool(true);
     if (multiple) {
@@ -368,7 +366,7 @@ void DatabaseStateServer::HandleGetField(DatagramIterator& dgi,
     PublishDatagram(dg);
   } else {
     // Otherwise, return false.
-    auto dg = std::make_shared<Datagram>(sender, doId, responseType);
+    auto dg = Datagram::Create(sender, doId, responseType);
     dg->AddUint32(ctx);
     dg->AddBool(false);
     PublishDatagram(dg);
@@ -390,8 +388,7 @@ void DatabaseStateServer::HandleGetActivated(DatagramIterator& dgi,
 
   // An object is considered active if it's in memory as a distributed object.
   // If it doesn't exist, or is loading, return false.
-  auto dg =
-      std::make_shared<Datagram>(sender, doId, DBSS_OBJECT_GET_ACTIVATED_RESP);
+  auto dg = Datagram::Create(sender, doId, DBSS_OBJECT_GET_ACTIVATED_RESP);
   dg->AddUint32(ctx);
   dg->AddUint32(doId);
   dg->AddBool(_distObjs.contains(doId));
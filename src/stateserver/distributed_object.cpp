@@ -116,7 +116,7 @@ void DistributedObject::Annihilate(const uint64_t& sender,
   if (_parentId) {
     targets.insert(LocationAsChannel(_parentId, _zoneId));
     if (notifyParent) {
-      auto dg = std::make_shared<Datagram>(
+      auto dg = Datagram::Create(
           _parentId, sender, STATESERVER_OBJECT_CHANGING_LOCATION);
       dg->AddUint32(_doId);
       dg->AddLocation(INVALID_DO_ID, INVALID_DO_ID);
@@ -133,8 +133,7 @@ void DistributedObject::Annihilate(const uint64_t& sender,
     targets.insert(_aiChannel);
   }
 
-  auto dg = std::make_shared<Datagram>(targets, sender,
-                                       STATESERVER_OBJECT_DELETE_RAM);
+  auto dg = Datagram::Create(targets, sender, STATESERVER_OBJECT_DELETE_RAM);
   dg->AddUint32(_doId);
   PublishDatagram(dg);
 
@@ -149,8 +148,8 @@ void DistributedObject::Annihilate(const uint64_t& sender,
 void DistributedObject::DeleteChildren(const uint64_t& sender) {
   if (!_zoneObjects.empty()) {
     // We have at least one child, notify them.
-    auto dg = std::make_shared<Datagram>(ParentToChildren(_doId), sender,
-                                         STATESERVER_OBJECT_DELETE_CHILDREN);
+    auto dg = Datagram::Create(ParentToChildren(_doId), sender,
+                               STATESERVER_OBJECT_DELETE_CHILDREN);
     dg->AddUint32(_doId);
     PublishDatagram(dg);
   }
@@ -248,8 +247,7 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
       spdlog::get("ss")->debug(
           "Distributed Object: '{}' received AI query from: {}", _doId, sender);
 
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_OBJECT_GET_AI_RESP);
+      auto dg = Datagram::Create(sender, _doId, STATESERVER_OBJECT_GET_AI_RESP);
       dg->AddUint32(dgi.GetUint32());  // Get context.
       dg->AddUint32(_doId);
       dg->AddUint64(_aiChannel);
@@ -261,8 +259,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
           "Distributed Object: '{}' received class query from: {}", _doId,
           sender);
 
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_OBJECT_GET_CLASS_RESP);
+      auto dg = Datagram::Create(sender, _doId,
+                                 STATESERVER_OBJECT_GET_CLASS_RESP);
       dg->AddUint32(dgi.GetUint32());
       dg->AddUint32(_doId);
       dg->AddUint16(_dclass->get_number());
@@ -316,8 +314,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
 
         _zoneObjects[newZone].insert(childId);
 
-        auto dg = std::make_shared<Datagram>(childId, _doId,
-                                             STATESERVER_OBJECT_LOCATION_ACK);
+        auto dg = Datagram::Create(childId, _doId,
+                                   STATESERVER_OBJECT_LOCATION_ACK);
         dg->AddUint32(_doId);
         dg->AddUint32(newZone);
         PublishDatagram(dg);
@@ -372,7 +370,7 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
     case STATESERVER_OBJECT_GET_LOCATION: {
       uint32_t context = dgi.GetUint32();
 
-      auto dg = std::make_shared<Datagram>(
+      auto dg = Datagram::Create(
           sender, _doId, STATESERVER_OBJECT_GET_LOCATION_RESP);
       dg->AddUint32(context);
       dg->AddUint32(_doId);
@@ -412,14 +410,13 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
         break;
       }
 
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_OBJECT_GET_ALL_RESP);
-      dg->AddUint32(context);
-      AppendRequiredData(dg);
+      DatagramBuilder builder(sender, _doId, STATESERVER_OBJECT_GET_ALL_RESP);
+      builder.AddUint32(context);
+      AppendRequiredData(builder);
       if (!_ramFields.empty()) {
-        AppendOtherData(dg);
+        AppendOtherData(builder);
       }
-      PublishDatagram(dg);
+      PublishDatagram(builder.Finish());
       break;
     }
     case STATESERVER_OBJECT_GET_FIELD: {
@@ -430,11 +427,11 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
 
       uint16_t fieldId = dgi.GetUint16();
 
-      auto rawField = std::make_shared<Datagram>();
+      auto rawField = Datagram::Create();
       bool success = HandleOneGet(rawField, fieldId);
 
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_OBJECT_GET_FIELD_RESP);
+      auto dg = Datagram::Create(sender, _doId,
+                                 STATESERVER_OBJECT_GET_FIELD_RESP);
       dg->AddUint32(context);
       dg->AddBool(success);
       if (success) {
@@ -469,7 +466,7 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
       // Try to get the values for all the fields.
       bool success = true;
       uint16_t fieldsFound = 0;
-      auto rawFields = std::make_shared<Datagram>();
+      auto rawFields = Datagram::Create();
 
       for (const auto& fieldId : requestedFields) {
         uint16_t length = rawFields->Size();
@@ -484,8 +481,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
       }
 
       // Send get fields response.
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_OBJECT_GET_FIELDS_RESP);
+      auto dg = Datagram::Create(sender, _doId,
+                                 STATESERVER_OBJECT_GET_FIELDS_RESP);
       dg->AddUint32(context);
       dg->AddBool(success);
       if (success) {
@@ -506,8 +503,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
       }
 
       if (_ownerChannel) {
-        auto dg = std::make_shared<Datagram>(_ownerChannel, sender,
-                                             STATESERVER_OBJECT_CHANGING_OWNER);
+        auto dg = Datagram::Create(_ownerChannel, sender,
+                                   STATESERVER_OBJECT_CHANGING_OWNER);
         dg->AddUint32(_doId);
         dg->AddUint64(newOwner);
         dg->AddUint64(_ownerChannel);
@@ -560,9 +557,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
         uint32_t childCount = 0;
 
         // Start datagram relay to children.
-        auto dg =
-            std::make_shared<Datagram>(ParentToChildren(_doId), sender,
-                                       STATESERVER_OBJECT_GET_ZONES_OBJECTS);
+        auto dg = Datagram::Create(ParentToChildren(_doId), sender,
+                                   STATESERVER_OBJECT_GET_ZONES_OBJECTS);
         dg->AddUint32(context);
         dg->AddUint32(queriedParent);
         dg->AddUint16(zoneCount);
@@ -575,7 +571,7 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
         }
 
         // Reply to requestor with count of objects expected.
-        auto countDg = std::make_shared<Datagram>(
+        auto countDg = Datagram::Create(
             sender, _doId, STATESERVER_OBJECT_GET_ZONES_COUNT_RESP);
         countDg->AddUint32(context);
         countDg->AddUint32(childCount);
@@ -597,8 +593,8 @@ void DistributedObject::HandleDatagram(const std::shared_ptr<Datagram>& dgIn) {
         keys.insert(zones.first);
       }
 
-      auto dg = std::make_shared<Datagram>(sender, _doId,
-                                           STATESERVER_GET_ACTIVE_ZONES_RESP);
+      auto dg = Datagram::Create(sender, _doId,
+                                 STATESERVER_GET_ACTIVE_ZONES_RESP);
       dg->AddUint32(context);
       dg->AddUint16(keys.size());
       for (const auto& zoneId : keys) {
@@ -661,8 +657,7 @@ void DistributedObject::HandleLocationChange(const uint32_t& newParent,
 
       if (!_aiExplicitlySet) {
         // Ask the new parent what it's managing AI is.
-        auto dg = std::make_shared<Datagram>(_parentId, _doId,
-                                             STATESERVER_OBJECT_GET_AI);
+        auto dg = Datagram::Create(_parentId, _doId, STATESERVER_OBJECT_GET_AI);
         dg->AddUint32(_nextContext++);
         PublishDatagram(dg);
       }
@@ -687,8 +682,8 @@ void DistributedObject::HandleLocationChange(const uint32_t& newParent,
   _parentSynchronized = false;
 
   // Send changing location message.
-  auto dg = std::make_shared<Datagram>(targets, _doId,
-                                       STATESERVER_OBJECT_CHANGING_LOCATION);
+  auto dg = Datagram::Create(targets, _doId,
+                             STATESERVER_OBJECT_CHANGING_LOCATION);
   dg->AddUint32(_doId);
   dg->AddLocation(newParent, newZone);
   dg->AddLocation(oldParent, oldZone);
@@ -723,8 +718,7 @@ void DistributedObject::HandleAIChange(const uint64_t& newAI,
   _aiChannel = newAI;
   _aiExplicitlySet = channelIsExplicit;
 
-  auto dg = std::make_shared<Datagram>(targets, sender,
-                                       STATESERVER_OBJECT_CHANGING_AI);
+  auto dg = Datagram::Create(targets, sender, STATESERVER_OBJECT_CHANGING_AI);
   dg->AddUint32(_doId);
   dg->AddUint64(newAI);
   dg->AddUint64(oldAI);
@@ -738,74 +732,74 @@ void DistributedObject::HandleAIChange(const uint64_t& newAI,
 }
 
 void DistributedObject::WakeChildren() {
-  auto dg = std::make_shared<Datagram>(ParentToChildren(_doId), _doId,
-                                       STATESERVER_OBJECT_GET_LOCATION);
+  auto dg = Datagram::Create(ParentToChildren(_doId), _doId,
+                             STATESERVER_OBJECT_GET_LOCATION);
   dg->AddUint32(STATESERVER_CONTEXT_WAKE_CHILDREN);
   PublishDatagram(dg);
 }
 
 void DistributedObject::SendLocationEntry(const uint64_t& location) {
-  auto dg = std::make_shared<Datagram>(
+  DatagramBuilder builder(
       location, _doId,
       _ramFields.empty()
           ? STATESERVER_OBJECT_ENTER_LOCATION_WITH_REQUIRED
           : STATESERVER_OBJECT_ENTER_LOCATION_WITH_REQUIRED_OTHER);
 
-  AppendRequiredData(dg, true);
+  AppendRequiredData(builder, true);
   if (!_ramFields.empty()) {
-    AppendOtherData(dg, true);
+    AppendOtherData(builder, true);
   }
 
-  PublishDatagram(dg);
+  PublishDatagram(builder.Finish());
 }
 
 void DistributedObject::SendAIEntry(const uint64_t& location) {
-  auto dg = std::make_shared<Datagram>(
+  DatagramBuilder builder(
       location, _doId,
       _ramFields.empty() ? STATESERVER_OBJECT_ENTER_AI_WITH_REQUIRED
                          : STATESERVER_OBJECT_ENTER_AI_WITH_REQUIRED_OTHER);
 
-  AppendRequiredData(dg);
+  AppendRequiredData(builder);
   if (!_ramFields.empty()) {
-    AppendOtherData(dg);
+    AppendOtherData(builder);
   }
 
-  PublishDatagram(dg);
+  PublishDatagram(builder.Finish());
 }
 
 void DistributedObject::SendOwnerEntry(const uint64_t& location) {
-  auto dg = std::make_shared<Datagram>(
+  DatagramBuilder builder(
       location, _doId,
       _ramFields.empty() ? STATESERVER_OBJECT_ENTER_OWNER_WITH_REQUIRED
                          : STATESERVER_OBJECT_ENTER_OWNER_WITH_REQUIRED_OTHER);
-  AppendRequiredData(dg, true, true);
+  AppendRequiredData(builder, true, true);
   if (!_ramFields.empty()) {
-    AppendOtherData(dg, true, true);
+    AppendOtherData(builder, true, true);
   }
-  PublishDatagram(dg);
+  PublishDatagram(builder.Finish());
 }
 
 void DistributedObject::SendInterestEntry(const uint64_t& location,
                                           const uint32_t& context) {
-  auto dg = std::make_shared<Datagram>(
+  DatagramBuilder builder(
       location, _doId,
       _ramFields.empty()
           ? STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED
           : STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED_OTHER);
-  dg->AddUint32(context);
-  AppendRequiredData(dg, true);
+  builder.AddUint32(context);
+  AppendRequiredData(builder, true);
   if (!_ramFields.empty()) {
-    AppendOtherData(dg, true);
+    AppendOtherData(builder, true);
   }
-  PublishDatagram(dg);
+  PublishDatagram(builder.Finish());
 }
 
-void DistributedObject::AppendRequiredData(const std::shared_ptr<Datagram>& dg,
+void DistributedObject::AppendRequiredData(DatagramBuilder& builder,
                                            const bool& clientOnly,
                                            const bool& alsoOwner) {
-  dg->AddUint32(_doId);
-  dg->AddLocation(_parentId, _zoneId);
-  dg->AddUint16(_dclass->get_number());
+  builder.AddUint32(_doId);
+  builder.AddLocation(_parentId, _zoneId);
+  builder.AddUint16(_dclass->get_number());
 
   int fieldCount = _dclass->get_num_inherited_fields();
   for (int i = 0; i < fieldCount; ++i) {
@@ -813,12 +807,12 @@ void DistributedObject::AppendRequiredData(const std::shared_ptr<Datagram>& dg,
     if (field->is_required() && !field->as_molecular_field() &&
         (!clientOnly || field->is_broadcast() || field->is_clrecv() ||
          (alsoOwner && field->is_ownrecv()))) {
-      dg->AddData(_requiredFields[field]);
+      builder.AddData(_requiredFields[field]);
     }
   }
 }
 
-void DistributedObject::AppendOtherData(const std::shared_ptr<Datagram>& dg,
+void DistributedObject::AppendOtherData(DatagramBuilder& builder,
                                         const bool& clientOnly,
                                         const bool& alsoOwner) {
   if (clientOnly) {
@@ -830,32 +824,33 @@ void DistributedObject::AppendOtherData(const std::shared_ptr<Datagram>& dg,
       }
     }
 
-    dg->AddUint16(broadcastFields.size());
+    builder.AddUint16(broadcastFields.size());
     for (const auto& field : broadcastFields) {
-      dg->AddUint16(field->get_number());
-      dg->AddData(_ramFields[field]);
+      builder.AddUint16(field->get_number());
+      builder.AddData(_ramFields[field]);
     }
   } else {
-    dg->AddUint16(_ramFields.size());
+    builder.AddUint16(_ramFields.size());
     for (const auto& field : _ramFields) {
-      dg->AddUint16(field.first->get_number());
-      dg->AddData(field.second);
+      builder.AddUint16(field.first->get_number());
+      builder.AddData(field.second);
     }
   }
 }
 
-void DistributedObject::SaveField(DCField* field,
-                                  const std::vector<uint8_t>& data) {
+void DistributedObject::SaveField(DCField* field, const uint8_t* data,
+                                  const size_t& size) {
+  // Assigning in place reuses the old value's storage, so an object whose
+  // fields are updated over and over stops allocating for them.
   if (field->is_required()) {
-    _requiredFields[field] = data;
+    _requiredFields[field].assign(data, data + size);
   } else if (field->is_ram()) {
-    _ramFields[field] = data;
+    _ramFields[field].assign(data, data + size);
   }
 }
 
 bool DistributedObject::HandleOneUpdate(DatagramIterator& dgi,
                                         const uint64_t& sender) {
-  std::vector<uint8_t> data;
   uint16_t fieldId = dgi.GetUint16();
 
   DCField* field = _dclass->get_field_by_index(fieldId);
@@ -871,10 +866,10 @@ bool DistributedObject::HandleOneUpdate(DatagramIterator& dgi,
       "Distributed Object: '{}' handling field update for: {}", _doId,
       field->get_name());
 
-  uint16_t fieldStart = dgi.Tell();
+  const size_t fieldStart = dgi.Tell();
 
   try {
-    dgi.UnpackField(field, data);
+    dgi.SkipField(field);
   } catch (const DatagramIteratorEOF&) {
     spdlog::get("ss")->error(
         "Distributed Object: '{}' received truncated field update for: {}",
@@ -882,18 +877,24 @@ bool DistributedObject::HandleOneUpdate(DatagramIterator& dgi,
     return false;
   }
 
+  // The value is stored and forwarded straight out of the update.
+  const size_t fieldEnd = dgi.Tell();
+  dgi.Seek(fieldStart);
+  const DatagramView data = dgi.GetDataView(fieldEnd - fieldStart);
+
   DCMolecularField* molecular = field->as_molecular_field();
   if (molecular) {
     dgi.Seek(fieldStart);
     int n = molecular->get_num_atomics();
     for (int i = 0; i < n; ++i) {
-      std::vector<uint8_t> fieldData;
       DCAtomicField* atomic = molecular->get_atomic(i);
-      dgi.UnpackField(atomic, fieldData);
-      SaveField(atomic, fieldData);
+      const size_t atomicStart = dgi.Tell();
+      dgi.SkipField(atomic);
+      SaveField(atomic, data.GetData() + (atomicStart - fieldStart),
+                dgi.Tell() - atomicStart);
     }
   } else {
-    SaveField(field, data);
+    SaveField(field, data.GetData(), data.Size());
   }
 
   std::unordered_set<uint64_t> targets;
@@ -910,8 +911,10 @@ bool DistributedObject::HandleOneUpdate(DatagramIterator& dgi,
     targets.insert(_ownerChannel);
   }
 
-  auto dg =
-      std::make_shared<Datagram>(targets, sender, STATESERVER_OBJECT_SET_FIELD);
+  // A single payload after a fixed header: sized up front, the value is
+  // copied once without a DatagramBuilder's segment list.
+  auto dg = Datagram::Create(targets, sender, STATESERVER_OBJECT_SET_FIELD);
+  dg->Reserve(dg->Size() + sizeof(uint32_t) + sizeof(uint16_t) + data.Size());
   dg->AddUint32(_doId);
   dg->AddUint16(fieldId);
   dg->AddData(data);
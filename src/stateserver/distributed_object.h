@@ -3,6 +3,7 @@
 
 #include <dcClass.h>
 
+#include "../net/datagram_builder.h"
 #include "../net/message_types.h"
 #include "../util/globals.h"
 #include "state_server.h"
@@ -62,14 +63,14 @@ class DistributedObject final : public ChannelSubscriber {
   void SendOwnerEntry(const uint64_t& location);
   void SendInterestEntry(const uint64_t& location, const uint32_t& context);
 
-  void AppendRequiredData(const std::shared_ptr<Datagram>& dg,
+  void AppendRequiredData(DatagramBuilder& builder,
                           const bool& clientOnly = false,
                           const bool& alsoOwner = false);
-  void AppendOtherData(const std::shared_ptr<Datagram>& dg,
+  void AppendOtherData(DatagramBuilder& builder,
                        const bool& clientOnly = false,
                        const bool& alsoOwner = false);
 
-  void SaveField(DCField* field, const std::vector<uint8_t>& data);
+  void SaveField(DCField* field, const uint8_t* data, const size_t& size);
   bool HandleOneUpdate(DatagramIterator& dgi, const uint64_t& sender);
   bool HandleOneGet(const std::shared_ptr<Datagram>& dg, uint16_t fieldId,
                     const bool& succeedIfUnset = false,
@@ -68,8 +68,8 @@ LoadingObject::LoadingObject(DatabaseStateServer* stateServer,
 void LoadingObject::Start() {
   if (_validContexts.empty()) {
     // Fetch our stored fields from the database.
-    auto dg = std::make_shared<Datagram>(_stateServer->_dbChannel, _doId,
-                                         DBSERVER_OBJECT_GET_ALL);
+    auto dg = Datagram::Create(_stateServer->_dbChannel, _doId,
+                               DBSERVER_OBJECT_GET_ALL);
     dg->AddUint32(_context);
     dg->AddUint32(_doId);
     PublishDatagram(dg);
@@ -129,8 +129,7 @@ void StateServer::HandleDeleteAI(DatagramIterator& dgi,
     }
   }
 
-  auto dg = std::make_shared<Datagram>(targets, sender,
-                                       STATESERVER_DELETE_AI_OBJECTS);
+  auto dg = Datagram::Create(targets, sender, STATESERVER_DELETE_AI_OBJECTS);
   dg->AddUint64(aiChannel);
   PublishDatagram(dg);
 }
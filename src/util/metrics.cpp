@@ -61,4 +61,9 @@ std::shared_ptr<prometheus::Registry> Metrics::GetRegistry() {
   return _registry;
 }
 
+void Metrics::RegisterCollectable(
+    const std::shared_ptr<prometheus::Collectable>& collectable) {
+  _exposer->RegisterCollectable(collectable);
+}
+
 }  // namespace Ardos
@@ -1,6 +1,7 @@
 #ifndef ARDOS_METRICS_H
 #define ARDOS_METRICS_H
 
+#include <prometheus/collectable.h>
 #include <prometheus/exposer.h>
 #include <prometheus/registry.h>
 
@@ -15,6 +16,10 @@ class Metrics {
 
   [[nodiscard]] bool WantMetrics() const;
   std::shared_ptr<prometheus::Registry> GetRegistry();
+  // Exposes metrics a component collects itself rather than through the
+  // registry. The caller keeps `collectable` alive.
+  void RegisterCollectable(
+      const std::shared_ptr<prometheus::Collectable>& collectable);
 
  private:
   Metrics();
@@ -0,0 +1,129 @@
+#ifndef ARDOS_SPSC_QUEUE_H
+#define ARDOS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace Ardos {
+
+/**
+ * Bounded, lock-free single-producer/single-consumer queue.
+ *
+ * Exactly one thread may call Push/Flush and exactly one (other) thread may
+ * call Pop. Head and tail live on separate cache lines so the producer and
+ * consumer don't false-share on every operation.
+ *
+ * Push never fails: if the ring is full the element is parked in a
+ * producer-local overflow deque and retried on the next Push/Flush. This
+ * keeps a slow consumer from dropping messages while still keeping the
+ * steady-state path allocation-free. While anything is parked the queue
+ * raises a flush request; the consumer checks it with TakeFlushRequest()
+ * after draining and wakes the producer so the spill isn't stranded.
+ */
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity = 4096)
+      : _capacity(std::bit_ceil(capacity < 2 ? size_t{2} : capacity)),
+        _mask(_capacity - 1),
+        _slots(std::make_unique<std::optional<T>[]>(_capacity)) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /**
+   * Enqueue an element. Producer thread only.
+   */
+  void Push(T value) {
+    if (!_overflow.empty()) {
+      Flush();
+    }
+    if (!_overflow.empty() || !TryPush(value)) {
+      _overflow.push_back(std::move(value));
+      _flushRequested.store(true, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Move as much of the overflow deque into the ring as fits. Producer
+   * thread only.
+   * @return True if the overflow has been fully drained.
+   */
+  bool Flush() {
+    while (!_overflow.empty()) {
+      if (!TryPush(_overflow.front())) {
+        _flushRequested.store(true, std::memory_order_release);
+        return false;
+      }
+      _overflow.pop_front();
+    }
+    return true;
+  }
+
+  /**
+   * Whether elements are parked in the overflow. Producer thread only.
+   */
+  [[nodiscard]] bool Spilled() const { return !_overflow.empty(); }
+
+  /**
+   * Dequeue an element if one is available. Consumer thread only.
+   */
+  std::optional<T> Pop() {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+
+    std::optional<T> value = std::move(_slots[head & _mask]);
+    _slots[head & _mask].reset();
+    _head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  /**
+   * Consumer thread only. Returns true (once) if the producer has elements
+   * parked in its overflow and needs to be woken to Flush().
+   */
+  bool TakeFlushRequest() {
+    return _flushRequested.exchange(false, std::memory_order_acq_rel);
+  }
+
+  [[nodiscard]] bool Empty() const {
+    return _head.load(std::memory_order_acquire) ==
+           _tail.load(std::memory_order_acquire);
+  }
+
+ private:
+  bool TryPush(T& value) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == _capacity) {
+      return false;
+    }
+
+    _slots[tail & _mask].emplace(std::move(value));
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  const size_t _capacity;
+  const size_t _mask;
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays): fixed-size ring storage.
+  std::unique_ptr<std::optional<T>[]> _slots;
+
+  alignas(64) std::atomic<size_t> _head{0};
+  alignas(64) std::atomic<size_t> _tail{0};
+  std::atomic<bool> _flushRequested{false};
+
+  // Producer-local spill for when the consumer falls a full ring behind.
+  std::deque<T> _overflow;
+};
+
+}  // namespace Ardos
+
+#endif  // ARDOS_SPSC_QUEUE_H
@@ -14,7 +14,8 @@ CA hot path:
 
 Population scaling is the primary axis; ``ACTIVE`` (operations per step) is
 held fixed so that per-step time stays in CodSpeed's useful sampling window
-across the sweep.
+across the sweep. The transport axis compares the libuv TCP transport against
+io_uring (which falls back to TCP on kernels without support).
 
 Implementation notes:
 
@@ -60,6 +61,7 @@ from tests.common.msgtypes import (
 pytestmark = pytest.mark.benchmark(group="ca")
 
 POPULATION_SIZES = [256, 1024, 4096]
+TRANSPORTS = ["tcp", "uring"]
 # Operations per step. Held constant so per-step time scales primarily with
 # population.
 ACTIVE = 4
@@ -193,8 +195,15 @@ def _send_set_location(ai: AIConnection, do_id: int, parent: int, zone: int) ->
     )
 
 
+@pytest.fixture(params=TRANSPORTS, ids=lambda t: f"transport={t}")
+def ca_transport(request):
+    return request.param
+
+
 @pytest.fixture(params=POPULATION_SIZES, ids=lambda n: f"pop={n}")
-def populated_cluster(request, ardos, ai_conn, client_conn, bench_monitor):
+def populated_cluster(
+    request, ardos, ai_conn, client_conn, bench_monitor, ca_transport
+):
     """MD+SS+CA with ``request.param`` connected, authed, interested clients.
 
     Interest covers TEST_ZONE and ALT_ZONE so the location benchmark can
@@ -214,6 +223,7 @@ def populated_cluster(request, ardos, ai_conn, client_conn, bench_monitor):
             # diagnostic runs.
             "log-level": os.environ.get("ARDOS_BENCH_LOG_LEVEL", "warn"),
             "client-agent": {
+                "transport": ca_transport,
                 "channels": {
                     "min": CLIENT_CHANNEL_BASE,
                     "max": CLIENT_CHANNEL_BASE + n_pop - 1,
@@ -1,10 +1,16 @@
 """MD fanout benchmarks.
 
 Measures the cost of broadcasting a single datagram to N subscribers. Covers
-the RabbitMQ routing rework (commit 2948152).
+the RabbitMQ routing rework (commit 2948152). The io-threads axis compares
+serving participant sockets on the main loop (0) against I/O worker loops,
+and the transport axis loopback TCP against Unix domain socket and
+shared-memory listeners. Workers only take reads, framing and writes off the
+main loop; dispatch itself stays there, so the axis shows what offloading
+socket I/O buys rather than dispatch scaling with cores.
 """
 
 import os
+import struct
 
 import pytest
 
@@ -13,25 +19,49 @@ from tests.common.ardos import Datagram, DatagramIterator
 pytestmark = pytest.mark.benchmark(group="md")
 
 N_SUBSCRIBERS = [1, 8, 64]
+N_THREADS = [0, 2, 4]
+TRANSPORTS = ["tcp", "unix", "shm"]
+BURST = 1000
 
 
-@pytest.fixture
-def md(ardos):
+@pytest.fixture(params=N_THREADS, ids=lambda t: f"io-threads={t}")
+def md(ardos, request):
     # warn-level logging by default so per-message trace writes don't skew
     # the measurement. Set ARDOS_BENCH_LOG_LEVEL=trace for diagnostic runs.
-    return ardos(
+    # Abstract sockets: no files to clean up and no sun_path length limit
+    # on pytest's long tmp_path names.
+    listen = {
+        "unix": f"unix:@ardos-bench-md-{os.getpid()}",
+        "shm": f"shm:@ardos-bench-md-shm-{os.getpid()}",
+    }
+    ardos(
         md=True,
-        overrides={"log-level": os.environ.get("ARDOS_BENCH_LOG_LEVEL", "warn")},
+        overrides={
+            "log-level": os.environ.get("ARDOS_BENCH_LOG_LEVEL", "warn"),
+            "message-director": {
+                "io-threads": request.param,
+                "listen": list(listen.values()),
+            },
+        },
     )
+    return listen
+
+
+@pytest.fixture(params=TRANSPORTS)
+def md_conn_factory(md, channel_conn, request):
+    """channel_conn bound to the transport under test."""
+    if request.param in md:
+        return lambda *channels: channel_conn(*channels, host=md[request.param])
+    return channel_conn
 
 
 @pytest.mark.parametrize("n", N_SUBSCRIBERS)
-def test_fanout_latency(md, channel_conn, benchmark, n):
+def test_fanout_latency(md_conn_factory, benchmark, n):
     channel = 2_000_000
-    subs = [channel_conn(channel + i) for i in range(n)]
+    subs = [md_conn_factory(channel + i) for i in range(n)]
     for s in subs:
         s.flush()
-    sender = channel_conn()
+    sender = md_conn_factory()
 
     def step():
         recipients = [channel + i for i in range(n)]
@@ -42,3 +72,22 @@ def test_fanout_latency(md, channel_conn, benchmark, n):
             assert mt == 4242
 
     benchmark(step)
+
+
+def test_single_subscriber_burst(md_conn_factory, benchmark):
+    """Per-datagram dispatch overhead: a burst of small datagrams to one
+    subscriber on one channel. Nothing here is fanout-bound, so the cost is
+    dominated by the per-message index lookup and delivery bookkeeping."""
+    channel = 2_100_000
+    sub = md_conn_factory(channel)
+    sub.flush()
+    sender = md_conn_factory()
+    payload = Datagram.create([channel], sender=0, msgtype=4243).bytes()
+    burst = (struct.pack("<H", len(payload)) + payload) * BURST
+
+    def step():
+        sender.sock.sendall(burst)
+        for _ in range(BURST):
+            sub.recv(timeout=5.0)
+
+    benchmark(step)
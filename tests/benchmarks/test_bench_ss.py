@@ -6,6 +6,11 @@ These pair with the CA-level benchmarks in ``test_bench_ca.py``:
   - ``test_ss_set_field_throughput``     ↔ CA ``test_field_update_throughput``
   - ``test_ss_set_location_throughput``  ↔ CA ``test_location_switch_throughput``
 
+``test_ss_field_size_throughput`` sweeps the size of the broadcast field
+instead, so each step builds, sends and frees datagrams of one size class.
+It tracks the datagram buffer pool (src/net/datagram_pool.h) rather than
+any SS logic.
+
 The CA benchmarks measure end-to-end fanout to N clients. The SS benchmarks
 measure just the SS work — object creation, field broadcast emit, location
 change emit. Comparing the two narrows down where a regression lives: if the
@@ -181,3 +186,38 @@ def test_ss_set_location_throughput(ss, ai_conn, channel_conn, benchmark):
                 break
 
     benchmark(step)
+
+
+@pytest.mark.parametrize("size", [16, 600, 5000, 40000], ids=lambda s: f"size={s}")
+def test_ss_field_size_throughput(ss, ai_conn, channel_conn, benchmark, size):
+    """As test_ss_set_field_throughput, with a ``size``-byte string. Every
+    step builds the SET_FIELD on our side, has the MD decode it, the SS
+    build a broadcast of the same size, and the MD free both."""
+    ai = ai_conn()
+    dclass = class_id("test.dc", "DistributedTestObject1")
+    fid = field_id("test.dc", "DistributedTestObject1", "setBR1")
+    do_id = FIELD_DOID + 100
+
+    ai.create_object(
+        do_id=do_id,
+        parent=SS_PARENT,
+        zone=SS_ZONE,
+        dclass_id=dclass,
+        required=_required_payload(),
+    )
+    ai.wait_object_alive(do_id, timeout=5.0)
+
+    watcher = channel_conn(_location_channel(SS_PARENT, SS_ZONE))
+    watcher.flush()
+
+    payload = Datagram().add_string("x" * size).bytes()
+
+    def step():
+        ai.set_field(do_id, fid, payload)
+        while True:
+            dg = watcher.recv(timeout=5.0)
+            _, _, mt = DatagramIterator(dg).read_header()
+            if mt == STATESERVER_OBJECT_SET_FIELD:
+                break
+
+    benchmark(step)
@@ -0,0 +1,132 @@
+"""Client Agent TLS benchmarks.
+
+Compares the tcp transport with and without ``client-agent.tls``:
+
+  - ``test_handshake_rate``  — HANDSHAKES clients connect, say hello and
+    disconnect per step. ``mode=resumed`` reuses the session from a
+    warm-up connection, so it measures the abbreviated handshake.
+  - ``test_steady_throughput`` — the AI sends MESSAGES datagrams of
+    PAYLOAD_SIZE bytes to each of a small, already connected population
+    per step, which reads them all back.
+
+The cost of encryption shows up as the gap between ``mode=plain`` and
+``mode=tls``; the handshake numbers are dominated by the key exchange,
+the throughput ones by record sealing.
+"""
+
+from __future__ import annotations
+
+import os
+from typing import List
+
+import pytest
+
+from tests.common.ardos import (
+    AUTH_STATE_ESTABLISHED,
+    ClientConnection,
+    Datagram,
+    DatagramIterator,
+)
+from tests.common.dc import dc_hash
+from tests.common.msgtypes import (
+    CLIENT_OBJECT_SET_FIELD,
+    CLIENTAGENT_SEND_DATAGRAM,
+)
+
+pytestmark = pytest.mark.benchmark(group="ca-tls")
+
+# Connections opened (and closed) per handshake step.
+HANDSHAKES = 32
+# Clients kept open for the throughput benchmark.
+POPULATION = 16
+# Datagrams sent to each client per throughput step.
+MESSAGES = 64
+PAYLOAD_SIZE = 512
+
+CLIENT_CHANNEL_BASE = 1_000_000_000
+
+
+def _tls_cluster(ardos, tls_cert, tls: bool, channels: int):
+    cert, key = tls_cert
+    ca_config = {
+        "channels": {
+            "min": CLIENT_CHANNEL_BASE,
+            "max": CLIENT_CHANNEL_BASE + channels - 1,
+        },
+    }
+    if tls:
+        ca_config["tls"] = {"certificate": str(cert), "private-key": str(key)}
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "log-level": os.environ.get("ARDOS_BENCH_LOG_LEVEL", "warn"),
+            "client-agent": ca_config,
+        },
+    )
+
+
+@pytest.mark.parametrize("mode", ["plain", "tls", "resumed"])
+def test_handshake_rate(ardos, tls_cert, benchmark, mode):
+    """Connect, hello and disconnect HANDSHAKES clients one after another."""
+    # Channels are never reused within a run, so leave plenty of room for
+    # however many rounds the benchmark decides on.
+    _tls_cluster(ardos, tls_cert, mode != "plain", channels=1_000_000)
+    host = "127.0.0.1" if mode == "plain" else "tls:127.0.0.1"
+
+    session = None
+    if mode == "resumed":
+        warmup = ClientConnection(host, 6667)
+        warmup.hello(dc_hash("test.dc"), "dev")
+        warmup.expect_hello_resp()
+        session = warmup.sock.session
+        warmup.close()
+
+    def step():
+        for _ in range(HANDSHAKES):
+            c = ClientConnection(host, 6667, tls_session=session)
+            c.hello(dc_hash("test.dc"), "dev")
+            c.expect_hello_resp()
+            c.close()
+
+    benchmark(step)
+
+
+@pytest.mark.parametrize("mode", ["plain", "tls"])
+def test_steady_throughput(ardos, tls_cert, ai_conn, client_conn, benchmark, mode):
+    """AI pushes MESSAGES datagrams to each of POPULATION clients."""
+    _tls_cluster(ardos, tls_cert, mode == "tls", channels=POPULATION)
+    host = "127.0.0.1" if mode == "plain" else "tls:127.0.0.1"
+    ai = ai_conn()
+
+    clients: List[ClientConnection] = []
+    for i in range(POPULATION):
+        c = client_conn(host)
+        c.hello(dc_hash("test.dc"), "dev")
+        c.expect_hello_resp()
+        ai.set_client_state(CLIENT_CHANNEL_BASE + i, AUTH_STATE_ESTABLISHED)
+        clients.append(c)
+
+    payload = (
+        Datagram.create_client(CLIENT_OBJECT_SET_FIELD)
+        .add_raw(os.urandom(PAYLOAD_SIZE))
+        .bytes()
+    )
+
+    def step():
+        for i in range(POPULATION):
+            for _ in range(MESSAGES):
+                ai.send(
+                    Datagram.create(
+                        [CLIENT_CHANNEL_BASE + i],
+                        sender=ai.ai_channel,
+                        msgtype=CLIENTAGENT_SEND_DATAGRAM,
+                    ).add_raw(payload)
+                )
+        for c in clients:
+            for _ in range(MESSAGES):
+                it = DatagramIterator(c.recv(timeout=10.0))
+                assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+
+    benchmark(step)
@@ -0,0 +1,100 @@
+"""Client field validation benchmarks.
+
+Every CLIENT_OBJECT_SET_FIELD is range checked by the CA before it's
+forwarded. These send large ranged integer arrays (``uint8(0-99)[]`` and
+``int16(-500-500)[0-2000]`` on DistributedRangedObject) to an anonymous
+UberDOG, and a watcher on the UberDOG's channel confirms each forward, so the
+per-step time is dominated by the CA's unpack + validate of ``size``
+elements.
+
+To compare against the previous validator (DCPacker's validate_ranges), run
+this file with ``--benchmark-save`` on the parent commit and with
+``--benchmark-compare`` on this one; the small sizes show the fixed cost of
+the round trip, so the difference grows with ``size``.
+"""
+
+from __future__ import annotations
+
+import os
+import struct
+
+import pytest
+
+from tests.common.ardos import Datagram, DatagramIterator
+from tests.common.dc import dc_hash, field_id
+from tests.common.msgtypes import (
+    CLIENT_OBJECT_SET_FIELD,
+    STATESERVER_OBJECT_SET_FIELD,
+)
+
+pytestmark = pytest.mark.benchmark(group="ca-validation")
+
+RANGED_DO_ID = 4668
+
+# Updates per step, so the array work outweighs the Python side.
+ACTIVE = 8
+
+
+@pytest.fixture
+def ca(ardos):
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        uberdogs=[
+            {"id": RANGED_DO_ID, "class": "DistributedRangedObject", "anonymous": True},
+        ],
+        overrides={"log-level": os.environ.get("ARDOS_BENCH_LOG_LEVEL", "warn")},
+    )
+
+
+def _inventory(size: int) -> bytes:
+    return Datagram().add_blob(bytes(i % 100 for i in range(size))).bytes()
+
+
+def _path(size: int) -> bytes:
+    values = [(i * 7) % 1001 - 500 for i in range(size)]
+    return struct.pack(f"<H{size}h", size * 2, *values)
+
+
+@pytest.mark.parametrize(
+    "field,size",
+    [
+        ("setInventory", 64),
+        ("setInventory", 4096),
+        ("setInventory", 30000),
+        ("setPath", 64),
+        ("setPath", 2000),
+    ],
+    ids=lambda v: str(v),
+)
+def test_ca_validate_array_throughput(
+    ca, client_conn, channel_conn, benchmark, field, size
+):
+    """ACTIVE updates of a ``size``-element ranged array per step, each
+    validated by the CA and forwarded to the UberDOG."""
+    watcher = channel_conn(RANGED_DO_ID)
+    c = client_conn()
+    c.hello(dc_hash("test.dc"), "dev")
+    c.expect_hello_resp()
+
+    fid = field_id("test.dc", "DistributedRangedObject", field)
+    payload = _inventory(size) if field == "setInventory" else _path(size)
+    update = (
+        Datagram.create_client(CLIENT_OBJECT_SET_FIELD)
+        .add_uint32(RANGED_DO_ID)
+        .add_uint16(fid)
+        .add_raw(payload)
+    )
+
+    def step():
+        for _ in range(ACTIVE):
+            c.send(update)
+        seen = 0
+        while seen < ACTIVE:
+            it = DatagramIterator(watcher.recv(timeout=5.0))
+            _, _, mt = it.read_header()
+            if mt == STATESERVER_OBJECT_SET_FIELD:
+                seen += 1
+
+    benchmark(step)
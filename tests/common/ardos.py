@@ -2,7 +2,11 @@
 
 Wire format reference:
   - TCP framing:      [uint16 LE length][payload]
-                      (src/net/network_client.cpp:98)
+                      (src/net/tcp_transport.cpp TcpTransportConnection::Send)
+  - TCP compression:  see src/net/tcp_transport.h; InflatingSocket below
+  - TLS:              client-agent.tls wraps the same byte stream; a
+                      ``tls:`` host prefix on MDConnection speaks it
+  - UDP packets:      see src/net/udp_transport.h; UdpSocket below
   - Internal header:  [uint8 n][uint64 ch1]...[uint64 chN][uint64 sender][uint16 msgtype]
                       (src/net/datagram.cpp Datagram ctors)
   - Client header:    [uint16 msgtype][payload]
@@ -14,12 +18,18 @@ Wire format reference:
 
 from __future__ import annotations
 
+import fcntl
+import mmap
 import os
+import select
 import signal
 import socket
+import ssl
 import struct
 import subprocess
+import threading
 import time
+import zlib
 from pathlib import Path
 from typing import Callable, Iterable, List, Optional, Sequence
 
@@ -312,13 +322,509 @@ class DatagramIterator:
         return bytes(self._buf[self._off : self._off + n])
 
 
+class ShmSocket:
+    """Socket-like client end of the MD's shared-memory transport (``shm:``
+    entries in message-director.listen; see src/net/shm_ring.h for the
+    layout). Speaks the same [uint16 length][payload] byte stream as a TCP
+    socket, so MDConnection can use it unchanged.
+
+    Python can't issue the memory fences the ring's wakeup flags rely on, so
+    this wakes the MD on every send and re-checks its inbound ring every few
+    milliseconds instead of trusting it to be woken. Good enough for tests;
+    real AIs should use src/net/shm_client.h.
+    """
+
+    RING_BYTES = 1 << 20
+    MAGIC = 0x41524453
+    VERSION = 1
+    HEADER_SIZE = 320
+    TO_SERVER = 64
+    TO_CLIENT = 192
+    HEAD = 0
+    TAIL = 64
+    WRITER_WAITING = 72
+    WRAP = 0xFFFFFFFF
+    POLL_INTERVAL = 0.005
+
+    def __init__(
+        self, path: str, ring_bytes: int = RING_BYTES, seal: bool = True
+    ) -> None:
+        self.RING_BYTES = ring_bytes
+        size = self.HEADER_SIZE + 2 * self.RING_BYTES
+        self._memfd = os.memfd_create(
+            "ardos-shm-test", os.MFD_CLOEXEC | os.MFD_ALLOW_SEALING
+        )
+        os.ftruncate(self._memfd, size)
+        if seal:
+            # The MD refuses segments that could shrink under its mapping.
+            fcntl.fcntl(self._memfd, fcntl.F_ADD_SEALS, fcntl.F_SEAL_SHRINK)
+        self._mm = mmap.mmap(self._memfd, size)
+        struct.pack_into("<IIQ", self._mm, 0, self.MAGIC, self.VERSION, self.RING_BYTES)
+        self._server_wake = os.eventfd(0, os.EFD_NONBLOCK | os.EFD_CLOEXEC)
+        self._client_wake = os.eventfd(0, os.EFD_NONBLOCK | os.EFD_CLOEXEC)
+        self._ctl = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._ctl.connect(path)
+        socket.send_fds(
+            self._ctl, [b"\0"], [self._memfd, self._server_wake, self._client_wake]
+        )
+        self._timeout: Optional[float] = None
+        self._tx = bytearray()
+        self._rx = bytearray()
+
+    @staticmethod
+    def _record_size(length: int) -> int:
+        return (4 + length + 7) & ~7
+
+    def _u64(self, offset: int) -> int:
+        return struct.unpack_from("<Q", self._mm, offset)[0]
+
+    def settimeout(self, timeout: Optional[float]) -> None:
+        self._timeout = timeout
+
+    def setblocking(self, flag: bool) -> None:
+        self._timeout = None if flag else 0.0
+
+    def sendall(self, data: bytes) -> None:
+        self._tx.extend(data)
+        while len(self._tx) >= 2:
+            length = struct.unpack_from("<H", self._tx)[0]
+            if len(self._tx) < 2 + length:
+                break
+            self._write(bytes(self._tx[2 : 2 + length]))
+            del self._tx[: 2 + length]
+        os.eventfd_write(self._server_wake, 1)
+
+    def _write(self, payload: bytes) -> None:
+        base = self.HEADER_SIZE
+        record = self._record_size(len(payload))
+        while True:
+            head = self._u64(self.TO_SERVER + self.HEAD)
+            tail = self._u64(self.TO_SERVER + self.TAIL)
+            offset = tail % self.RING_BYTES
+            to_end = self.RING_BYTES - offset
+            pad = to_end if to_end < record else 0
+            if self.RING_BYTES - (tail - head) >= pad + record:
+                break
+            os.eventfd_write(self._server_wake, 1)
+            time.sleep(self.POLL_INTERVAL)
+        if pad:
+            struct.pack_into("<I", self._mm, base + offset, self.WRAP)
+            tail += pad
+            offset = 0
+        struct.pack_into("<I", self._mm, base + offset, len(payload))
+        self._mm[base + offset + 4 : base + offset + 4 + len(payload)] = payload
+        struct.pack_into("<Q", self._mm, self.TO_SERVER + self.TAIL, tail + record)
+
+    def _drain(self) -> None:
+        base = self.HEADER_SIZE + self.RING_BYTES
+        head = self._u64(self.TO_CLIENT + self.HEAD)
+        tail = self._u64(self.TO_CLIENT + self.TAIL)
+        if head == tail:
+            return
+        while head != tail:
+            offset = head % self.RING_BYTES
+            length = struct.unpack_from("<I", self._mm, base + offset)[0]
+            if length == self.WRAP:
+                head += self.RING_BYTES - offset
+                continue
+            self._rx.extend(struct.pack("<H", length))
+            self._rx.extend(self._mm[base + offset + 4 : base + offset + 4 + length])
+            head += self._record_size(length)
+        struct.pack_into("<Q", self._mm, self.TO_CLIENT + self.HEAD, head)
+        if struct.unpack_from("<I", self._mm, self.TO_CLIENT + self.WRITER_WAITING)[0]:
+            struct.pack_into("<I", self._mm, self.TO_CLIENT + self.WRITER_WAITING, 0)
+            os.eventfd_write(self._server_wake, 1)
+
+    def recv(self, bufsize: int) -> bytes:
+        deadline = None if self._timeout is None else time.monotonic() + self._timeout
+        poller = select.poll()
+        poller.register(self._client_wake, select.POLLIN)
+        while True:
+            self._drain()
+            if self._rx:
+                break
+            try:
+                if self._ctl.recv(1, socket.MSG_DONTWAIT) == b"":
+                    return b""
+            except BlockingIOError:
+                pass
+            wait = self.POLL_INTERVAL
+            if deadline is not None:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    raise socket.timeout("timed out")
+                wait = min(wait, remaining)
+            if poller.poll(wait * 1000):
+                try:
+                    os.eventfd_read(self._client_wake)
+                except BlockingIOError:
+                    pass
+        out = bytes(self._rx[:bufsize])
+        del self._rx[:bufsize]
+        return out
+
+    def shutdown(self, how: int) -> None:
+        self._ctl.shutdown(how)
+
+    def close(self) -> None:
+        self._ctl.close()
+        self._mm.close()
+        for fd in (self._memfd, self._server_wake, self._client_wake):
+            os.close(fd)
+
+
+class UdpSocket:
+    """Socket-like client end of the CA's udp transport (see
+    src/net/udp_transport.h for the protocol). Speaks the same
+    [uint16 length][payload] byte stream as a TCP socket, so ClientConnection
+    can use it unchanged; everything it sends goes on the reliable lane.
+
+    A background thread acks, retransmits and keeps the session alive.
+    Datagrams that arrived on the unreliable lane are delivered like the
+    rest and also counted in ``unreliable_received``.
+    """
+
+    CONNECT, CHALLENGE, ACCEPT, DATA, ACK, DISCONNECT = range(1, 7)
+    MAGIC = 0x55445241
+    FLAG_UNRELIABLE = 1
+    FLAG_MORE = 2
+    MAX_PACKET = 1200
+    MAX_FRAGMENT = 1200 - 9 - 5
+    # Within the 33 packets one ack covers.
+    MAX_IN_FLIGHT = 32
+    RTO = 0.1
+    KEEPALIVE = 1.0
+    POLL_INTERVAL = 0.005
+
+    def __init__(self, host: str, port: int, timeout: float = 5.0) -> None:
+        self._sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self._sock.connect((host, port))
+        self._cond = threading.Condition()
+        self._timeout: Optional[float] = None
+        self._tx = bytearray()
+        self._rx = bytearray()
+        self._disconnected = False
+        self._stopped = False
+        self.unreliable_received = 0
+
+        self._next_packet = 0
+        self._next_lane = 0
+        self._unacked: dict = {}
+        self._pending: List[int] = []
+        self._in_flight: dict = {}
+        self._last_sent = 0.0
+        self._ack_owed = False
+
+        self._remote_seq: Optional[int] = None
+        self._remote_bits = 0
+        self._next_deliver = 0
+        self._held: dict = {}
+        self._fragments = bytearray()
+        self._last_unreliable: Optional[int] = None
+
+        self._handshake(timeout)
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def _handshake(self, timeout: float) -> None:
+        nonce = int.from_bytes(os.urandom(4), "little")
+        cookie = 0
+        deadline = time.monotonic() + timeout
+        self._sock.settimeout(0.2)
+        while time.monotonic() < deadline:
+            self._sock.send(struct.pack("<BIII", self.CONNECT, self.MAGIC, nonce, cookie))
+            try:
+                packet = self._sock.recv(2048)
+            except socket.timeout:
+                continue
+            if len(packet) >= 9 and packet[0] == self.CHALLENGE:
+                got, cookie = struct.unpack_from("<II", packet, 1)
+                if got != nonce:
+                    cookie = 0
+            elif len(packet) >= 5 and packet[0] == self.ACCEPT:
+                if struct.unpack_from("<I", packet, 1)[0] == nonce:
+                    self._sock.settimeout(self.POLL_INTERVAL)
+                    return
+        raise ConnectionError("udp handshake timed out")
+
+    @staticmethod
+    def _newer(a: int, b: int) -> bool:
+        return 0 < ((a - b) & 0xFFFF) < 0x8000
+
+    def _ack_header(self) -> bytes:
+        if self._remote_seq is None:
+            return struct.pack("<HI", 0xFFFF, 0)
+        return struct.pack("<HI", self._remote_seq, self._remote_bits)
+
+    def _send_raw(self, packet: bytes) -> None:
+        try:
+            self._sock.send(packet)
+        except OSError:
+            pass
+        self._last_sent = time.monotonic()
+
+    def _run(self) -> None:
+        while not self._stopped:
+            try:
+                packet = self._sock.recv(2048)
+            except socket.timeout:
+                packet = None
+            except OSError:
+                packet = None
+                if self._stopped:
+                    return
+            with self._cond:
+                if packet:
+                    self._handle(packet)
+                self._flush()
+                self._cond.notify_all()
+
+    def _handle(self, packet: bytes) -> None:
+        kind = packet[0]
+        if kind == self.DISCONNECT:
+            self._disconnected = True
+        elif kind == self.ACK and len(packet) >= 7:
+            self._handle_ack(*struct.unpack_from("<HI", packet, 1))
+        elif kind == self.DATA and len(packet) >= 9:
+            seq, ack, bits = struct.unpack_from("<HHI", packet, 1)
+            self._handle_ack(ack, bits)
+            self._record(seq)
+            self._ack_owed = True
+            offset = 9
+            while offset + 5 <= len(packet):
+                flags, lane, size = struct.unpack_from("<BHH", packet, offset)
+                payload = packet[offset + 5 : offset + 5 + size]
+                offset += 5 + size
+                self._receive(flags, lane, payload)
+
+    def _handle_ack(self, ack: int, bits: int) -> None:
+        for seq in list(self._in_flight):
+            behind = (ack - seq) & 0xFFFF
+            if behind == 0 or (1 <= behind <= 32 and (bits >> (behind - 1)) & 1):
+                for lane in self._in_flight.pop(seq)[1]:
+                    self._unacked.pop(lane, None)
+
+    def _record(self, seq: int) -> None:
+        if self._remote_seq is None:
+            self._remote_seq, self._remote_bits = seq, 0
+        elif self._newer(seq, self._remote_seq):
+            shift = (seq - self._remote_seq) & 0xFFFF
+            bits = (self._remote_bits << shift) & 0xFFFFFFFF if shift < 32 else 0
+            if shift <= 32:
+                bits |= 1 << (shift - 1)
+            self._remote_seq, self._remote_bits = seq, bits
+        else:
+            behind = (self._remote_seq - seq) & 0xFFFF
+            if 1 <= behind <= 32:
+                self._remote_bits |= 1 << (behind - 1)
+
+    def _deliver(self, message: bytes) -> None:
+        self._rx.extend(struct.pack("<H", len(message)) + message)
+
+    def _receive(self, flags: int, lane: int, payload: bytes) -> None:
+        if flags & self.FLAG_UNRELIABLE:
+            if self._last_unreliable is None or self._newer(lane, self._last_unreliable):
+                self._last_unreliable = lane
+                self.unreliable_received += 1
+                self._deliver(payload)
+            return
+        if lane != self._next_deliver:
+            if self._newer(lane, self._next_deliver):
+                self._held[lane] = (flags, payload)
+            return
+        while True:
+            self._fragments.extend(payload)
+            if not flags & self.FLAG_MORE:
+                self._deliver(bytes(self._fragments))
+                self._fragments.clear()
+            self._next_deliver = (self._next_deliver + 1) & 0xFFFF
+            if self._next_deliver not in self._held:
+                return
+            flags, payload = self._held.pop(self._next_deliver)
+
+    def _flush(self) -> None:
+        now = time.monotonic()
+        lost = []
+        for seq, (sent_at, lanes) in list(self._in_flight.items()):
+            if now - sent_at > self.RTO:
+                del self._in_flight[seq]
+                lost.extend(lane for lane in lanes if lane in self._unacked)
+        self._pending[:0] = lost
+
+        while self._pending and len(self._in_flight) < self.MAX_IN_FLIGHT:
+            seq = self._next_packet
+            packet = bytearray(struct.pack("<BH", self.DATA, seq) + self._ack_header())
+            lanes = []
+            while self._pending:
+                lane = self._pending[0]
+                if lane not in self._unacked:
+                    self._pending.pop(0)
+                    continue
+                flags, payload = self._unacked[lane]
+                if len(packet) + 5 + len(payload) > self.MAX_PACKET:
+                    break
+                packet += struct.pack("<BHH", flags, lane, len(payload)) + payload
+                lanes.append(self._pending.pop(0))
+            if not lanes:
+                break
+            self._send_raw(bytes(packet))
+            self._in_flight[seq] = (now, lanes)
+            self._next_packet = (seq + 1) & 0xFFFF
+            self._ack_owed = False
+
+        if self._ack_owed or now - self._last_sent > self.KEEPALIVE:
+            self._send_raw(struct.pack("<B", self.ACK) + self._ack_header())
+            self._ack_owed = False
+
+    def settimeout(self, timeout: Optional[float]) -> None:
+        self._timeout = timeout
+
+    def setblocking(self, flag: bool) -> None:
+        self._timeout = None if flag else 0.0
+
+    def sendall(self, data: bytes) -> None:
+        with self._cond:
+            self._tx.extend(data)
+            while len(self._tx) >= 2:
+                length = struct.unpack_from("<H", self._tx)[0]
+                if len(self._tx) < 2 + length:
+                    break
+                message = bytes(self._tx[2 : 2 + length])
+                del self._tx[: 2 + length]
+                chunks = [
+                    message[i : i + self.MAX_FRAGMENT]
+                    for i in range(0, len(message), self.MAX_FRAGMENT)
+                ] or [b""]
+                for i, chunk in enumerate(chunks):
+                    flags = self.FLAG_MORE if i < len(chunks) - 1 else 0
+                    self._unacked[self._next_lane] = (flags, chunk)
+                    self._pending.append(self._next_lane)
+                    self._next_lane = (self._next_lane + 1) & 0xFFFF
+            self._flush()
+
+    def recv(self, bufsize: int) -> bytes:
+        deadline = None if self._timeout is None else time.monotonic() + self._timeout
+        with self._cond:
+            while not self._rx:
+                if self._disconnected:
+                    return b""
+                remaining = None
+                if deadline is not None:
+                    remaining = deadline - time.monotonic()
+                    if remaining <= 0:
+                        raise socket.timeout("timed out")
+                self._cond.wait(remaining)
+            out = bytes(self._rx[:bufsize])
+            del self._rx[:bufsize]
+            return out
+
+    def shutdown(self, how: int) -> None:
+        with self._cond:
+            if not self._disconnected:
+                self._send_raw(struct.pack("<B", self.DISCONNECT))
+            self._disconnected = True
+
+    def close(self) -> None:
+        self._stopped = True
+        self._thread.join()
+        self._sock.close()
+
+
+class InflatingSocket:
+    """Socket adapter for a CA connection that negotiated compression (see
+    src/net/tcp_transport.h): unwraps the [uint8 kind][uint16 length]
+    blocks the CA sends and inflates the compressed ones, so ClientConnection
+    reads the usual byte stream. Sends pass through unchanged.
+
+    ``raw_blocks`` and ``compressed_blocks`` count what arrived.
+    """
+
+    RAW, DEFLATE = 0, 1
+
+    def __init__(self, sock, pending: bytes = b"") -> None:
+        self._sock = sock
+        self._raw = bytearray(pending)
+        self._inflater = zlib.decompressobj(-zlib.MAX_WBITS)
+        self.raw_blocks = 0
+        self.compressed_blocks = 0
+
+    def settimeout(self, timeout: Optional[float]) -> None:
+        self._sock.settimeout(timeout)
+
+    def setblocking(self, flag: bool) -> None:
+        self._sock.setblocking(flag)
+
+    def sendall(self, data: bytes) -> None:
+        self._sock.sendall(data)
+
+    def recv(self, bufsize: int) -> bytes:
+        while True:
+            if len(self._raw) >= 3:
+                kind, length = struct.unpack_from("<BH", self._raw)
+                if len(self._raw) >= 3 + length:
+                    block = bytes(self._raw[3 : 3 + length])
+                    del self._raw[: 3 + length]
+                    if kind == self.RAW:
+                        self.raw_blocks += 1
+                        out = block
+                    elif kind == self.DEFLATE:
+                        self.compressed_blocks += 1
+                        out = self._inflater.decompress(block)
+                    else:
+                        raise ConnectionError(f"unknown block kind {kind}")
+                    if out:
+                        return out
+                    continue
+            chunk = self._sock.recv(65536)
+            if not chunk:
+                return b""
+            self._raw.extend(chunk)
+
+    def shutdown(self, how: int) -> None:
+        self._sock.shutdown(how)
+
+    def close(self) -> None:
+        self._sock.close()
+
+
 class MDConnection:
-    """Raw MD-protocol TCP connection."""
+    """Raw MD-protocol connection. TCP by default; a ``host`` of
+    ``unix:/path`` or ``unix:@name`` connects to a Unix domain socket
+    listener instead, and ``shm:/path`` or ``shm:@name`` to a shared-memory
+    one (``port`` is then ignored). ``udp:ip`` connects to a CA's udp
+    transport, and ``tls:ip`` to a CA with client-agent.tls (resuming
+    ``tls_session``, if given)."""
 
     TIMEOUT = 5.0
 
-    def __init__(self, host: str, port: int) -> None:
-        self.sock = socket.create_connection((host, port), timeout=self.TIMEOUT)
+    def __init__(
+        self, host: str, port: int, tls_session: Optional[ssl.SSLSession] = None
+    ) -> None:
+        if host.startswith("tls:"):
+            # Test certificates are self-signed; don't verify them.
+            context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+            context.check_hostname = False
+            context.verify_mode = ssl.CERT_NONE
+            raw = socket.create_connection(
+                (host[len("tls:") :], port), timeout=self.TIMEOUT
+            )
+            self.sock = context.wrap_socket(raw, session=tls_session)
+        elif host.startswith("udp:"):
+            self.sock = UdpSocket(host[len("udp:") :], port, self.TIMEOUT)
+        elif host.startswith("shm:"):
+            path = host[len("shm:") :]
+            if path.startswith("@"):
+                path = "\0" + path[1:]
+            self.sock = ShmSocket(path)
+        elif host.startswith("unix:"):
+            path = host[len("unix:") :]
+            if path.startswith("@"):
+                path = "\0" + path[1:]
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.settimeout(self.TIMEOUT)
+            self.sock.connect(path)
+        else:
+            self.sock = socket.create_connection((host, port), timeout=self.TIMEOUT)
         self.sock.setblocking(True)
         self._rx = bytearray()
 
@@ -556,7 +1062,7 @@ class ChannelConnection(MDConnection):
         Sends a sentinel-msgtype datagram to a channel inside [lo, hi] and
         waits for it to come back through the bus. Replaces a blind sleep
         after ``add_range`` with a wait on an actual signal that the
-        bucket-based RabbitMQ binding is in place.
+        range's RabbitMQ bindings are in place.
 
         Picks ``lo`` as the probe channel. ``sender`` defaults to 0 since
         this connection's subscription is via range only (no explicit
@@ -585,6 +1091,19 @@ class ClientConnection(MDConnection):
         )
         self.send(dg)
 
+    def request_compression(self, method: int = 1, timeout: float = 2.0) -> int:
+        """Ask the CA to compress what it sends us. Has to be the first
+        thing sent; returns the method the CA picked (0: none). From then
+        on recv() unwraps and inflates transparently."""
+        self.sock.sendall(struct.pack("<HB", 1, method))
+        reply = self.recv(timeout=timeout).bytes()
+        if len(reply) != 1:
+            raise AssertionError(f"expected a 1-byte compression reply; got {reply!r}")
+        if reply[0] == InflatingSocket.DEFLATE:
+            self.sock = InflatingSocket(self.sock, bytes(self._rx))
+            self._rx.clear()
+        return reply[0]
+
     def expect_hello_resp(self, timeout: float = 2.0) -> None:
         got = self.recv(timeout=timeout)
         it = DatagramIterator(got)
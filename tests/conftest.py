@@ -6,11 +6,12 @@ import base64
 import json
 import os
 import socket
+import subprocess
 import time
 import urllib.error
 import urllib.request
 from pathlib import Path
-from typing import Callable, Iterator, List, Optional
+from typing import Callable, Iterator, List, Optional, Tuple
 
 import pytest
 
@@ -225,6 +226,24 @@ def bench_monitor(request) -> Iterator[BenchMonitor]:
     mon.stop()
 
 
+@pytest.fixture(scope="session")
+def tls_cert(tmp_path_factory) -> Tuple[Path, Path]:
+    """Self-signed (certificate, private key) pair for client-agent.tls."""
+    out_dir = tmp_path_factory.mktemp("tls")
+    cert, key = out_dir / "cert.pem", out_dir / "key.pem"
+    subprocess.run(
+        [
+            "openssl", "req", "-x509", "-nodes", "-days", "1",
+            "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+            "-subj", "/CN=localhost",
+            "-keyout", str(key), "-out", str(cert),
+        ],
+        check=True,
+        capture_output=True,
+    )  # fmt: skip
+    return cert, key
+
+
 # ---------------------------------------------------------------------------
 # Connection helpers
 # ---------------------------------------------------------------------------
@@ -295,8 +314,10 @@ def ai_conn() -> Iterator[Callable[..., AIConnection]]:
 def client_conn() -> Iterator[Callable[..., ClientConnection]]:
     conns: List[ClientConnection] = []
 
-    def _factory(host: str = "127.0.0.1", port: int = 6667) -> ClientConnection:
-        c = ClientConnection(host, port)
+    def _factory(
+        host: str = "127.0.0.1", port: int = 6667, **kwargs
+    ) -> ClientConnection:
+        c = ClientConnection(host, port, **kwargs)
         conns.append(c)
         return c
 
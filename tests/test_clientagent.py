@@ -1,5 +1,7 @@
 """Client Agent tests — authentication, heartbeat, security boundaries."""
 
+import struct
+
 import pytest
 
 from tests.common.ardos import AUTH_STATE_ESTABLISHED, Datagram, DatagramIterator
@@ -8,6 +10,7 @@ from tests.common.msgtypes import (
     CLIENT_ADD_INTEREST,
     CLIENT_DISCONNECT_BAD_DCHASH,
     CLIENT_DISCONNECT_BAD_VERSION,
+    CLIENT_DISCONNECT_FIELD_CONSTRAINT,
     CLIENT_DISCONNECT_FORBIDDEN_INTEREST,
     CLIENT_DISCONNECT_GENERIC,
     CLIENT_DISCONNECT_NO_HELLO,
@@ -31,6 +34,7 @@ from tests.common.msgtypes import (
     CLIENTAGENT_SET_CLIENT_ID,
     CLIENTAGENT_SET_FIELDS_SENDABLE,
     CLIENTAGENT_UNDECLARE_OBJECT,
+    STATESERVER_OBJECT_SET_FIELD,
 )
 
 # Pinned client channel so the AI knows where to send CLIENTAGENT_SET_STATE.
@@ -155,6 +159,95 @@ class TestAnonymousUberdog:
             assert mt != CLIENT_EJECT
 
 
+RANGED_DO_ID = 4668
+
+
+@pytest.fixture
+def ca_ranged(ardos):
+    """CA with an anonymous UberDOG whose fields carry range constraints."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        uberdogs=[
+            {"id": RANGED_DO_ID, "class": "DistributedRangedObject", "anonymous": True},
+        ],
+    )
+
+
+def _ranged_update(field: str, payload: bytes) -> Datagram:
+    fid = field_id("test.dc", "DistributedRangedObject", field)
+    dg = Datagram.create_client(CLIENT_OBJECT_SET_FIELD)
+    return dg.add_uint32(RANGED_DO_ID).add_uint16(fid).add_raw(payload)
+
+
+def _int16s(values) -> bytes:
+    return struct.pack(f"<H{len(values)}h", len(values) * 2, *values)
+
+
+class TestFieldConstraints:
+    """Client updates are checked against the field's DC ranges before
+    they're forwarded; large integer arrays go through the vectorized
+    min/max checks."""
+
+    @pytest.mark.parametrize(
+        "field,payload",
+        [
+            ("setSlot", bytes([9])),
+            ("setInventory", Datagram().add_blob(bytes(range(100)) * 300).bytes()),
+            ("setPath", _int16s([-500, 0, 500] * 600)),
+            ("setTag", Datagram().add_string("ardos").add_uint32(7).bytes()),
+        ],
+    )
+    def test_in_range_update_forwarded(
+        self, ca_ranged, client_conn, channel_conn, field, payload
+    ):
+        watcher = channel_conn(RANGED_DO_ID)
+        c = client_conn()
+        c.hello(dc_hash("test.dc"), "dev")
+        c.expect_hello_resp()
+
+        c.send(_ranged_update(field, payload))
+
+        it = DatagramIterator(watcher.recv(timeout=2.0))
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_SET_FIELD
+        assert it.read_uint32() == RANGED_DO_ID
+        assert it.read_uint16() == field_id(
+            "test.dc", "DistributedRangedObject", field
+        )
+        assert bytes(it._buf[it._off :]) == payload
+
+    @pytest.mark.parametrize(
+        "field,payload",
+        [
+            ("setSlot", bytes([10])),
+            # One bad element at the very end, past every whole vector.
+            ("setInventory", Datagram().add_blob(bytes(999) + b"\x64").bytes()),
+            ("setInventory", Datagram().add_blob(bytes([99, 100]) * 64).bytes()),
+            ("setPath", _int16s([0] * 100 + [501])),
+            ("setPath", _int16s([-501] + [0] * 100)),
+            ("setPath", _int16s([0] * 2001)),
+            # Half an element.
+            ("setPath", struct.pack("<HhB", 3, 0, 0)),
+            ("setTag", Datagram().add_string("").add_uint32(7).bytes()),
+            ("setTag", Datagram().add_string("ardos" * 2).add_uint32(7).bytes()),
+        ],
+    )
+    def test_out_of_range_update_ejects(
+        self, ca_ranged, client_conn, channel_conn, field, payload
+    ):
+        watcher = channel_conn(RANGED_DO_ID)
+        c = client_conn()
+        c.hello(dc_hash("test.dc"), "dev")
+        c.expect_hello_resp()
+
+        c.send(_ranged_update(field, payload))
+
+        c.expect_eject(reason=CLIENT_DISCONNECT_FIELD_CONSTRAINT)
+        watcher.expect_none()
+
+
 @pytest.fixture
 def ca_admin(ardos):
     """CA cluster pinned to a single CLIENT_CHANNEL for AI-driven control tests."""
@@ -525,3 +618,494 @@ class TestCAAdmin:
             .add_uint32(1)
         )
         ai.wait_channel_drained(CLIENT_CHANNEL)
+
+
+@pytest.fixture
+def ca_fanout(ardos):
+    """CA with room for two pinned clients."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL + 1},
+            },
+        },
+    )
+
+
+class TestFanout:
+    """One server update reaching several clients is encoded once and
+    shared; each client must still get its own correct copy."""
+
+    def test_set_field_reaches_every_client(self, ca_fanout, ai_conn, client_conn):
+        ai = ai_conn()
+        channels = [CLIENT_CHANNEL, CLIENT_CHANNEL + 1]
+        clients = []
+        # One at a time, so they're allocated channels in order.
+        for channel in channels:
+            client = client_conn()
+            client.hello(dc_hash("test.dc"), "dev")
+            client.expect_hello_resp()
+            ai.set_client_state(channel, AUTH_STATE_ESTABLISHED)
+            clients.append(client)
+
+        do_id = 5_001_020
+        for channel in channels:
+            ai.send(
+                Datagram.create(
+                    [channel],
+                    sender=ai.ai_channel,
+                    msgtype=CLIENTAGENT_DECLARE_OBJECT,
+                )
+                .add_uint32(do_id)
+                .add_uint16(class_id("test.dc", "DistributedTestObject1"))
+            )
+            ai.wait_channel_drained(channel)
+
+        field = field_id("test.dc", "DistributedTestObject1", "setB1")
+        for value in (7, 8):
+            ai.send(
+                Datagram.create(
+                    channels,
+                    sender=ai.ai_channel,
+                    msgtype=STATESERVER_OBJECT_SET_FIELD,
+                )
+                .add_uint32(do_id)
+                .add_uint16(field)
+                .add_uint8(value)
+            )
+            for client in clients:
+                it = DatagramIterator(client.recv(timeout=3.0))
+                assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+                assert it.read_uint32() == do_id
+                assert it.read_uint16() == field
+                assert it.read_uint8() == value
+
+
+@pytest.fixture
+def ca_threads(ardos):
+    """CA accepting on two SO_REUSEPORT worker loops."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={"client-agent": {"io-threads": 2}},
+    )
+
+
+@pytest.fixture
+def ca_threads_admin(ardos):
+    """Worker-loop CA pinned to CLIENT_CHANNEL, for AI-driven routing."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "io-threads": 2,
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL},
+            },
+        },
+    )
+
+
+class TestWorkerThreads:
+    """Clients served by client-agent.io-threads loops instead of the main
+    one. The kernel picks the worker, so connect enough clients to land on
+    both."""
+
+    def test_many_clients_handshake(self, ca_threads, client_conn):
+        clients = [client_conn() for _ in range(16)]
+        for c in clients:
+            c.hello(dc_hash("test.dc"), "dev")
+        for c in clients:
+            c.expect_hello_resp()
+
+    def test_bad_hello_ejected(self, ca_threads, client_conn):
+        c = client_conn()
+        c.hello(dc_hash("test.dc") ^ 0xDEADBEEF, "dev")
+        c.expect_eject(reason=CLIENT_DISCONNECT_BAD_DCHASH)
+
+    def test_ai_datagram_reaches_client(self, ca_threads_admin, ai_conn, client_conn):
+        client = client_conn()
+        ai = ai_conn()
+        _hello_and_establish(client, ai)
+
+        ai.send(
+            Datagram.create(
+                [CLIENT_CHANNEL],
+                sender=ai.ai_channel,
+                msgtype=CLIENTAGENT_SEND_DATAGRAM,
+            ).add_raw(Datagram.create_client(CLIENT_HEARTBEAT).bytes())
+        )
+
+        got = client.recv(timeout=3.0)
+        assert DatagramIterator(got).read_client_msgtype() == CLIENT_HEARTBEAT
+
+
+@pytest.fixture
+def ca_batching(ardos):
+    """CA batching client writes, with a cap small enough to hit."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "batching": {"enabled": True, "max-bytes": 256},
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL},
+            },
+        },
+    )
+
+
+class TestBatching:
+    """client-agent.batching only changes how writes are grouped; clients
+    see the same stream."""
+
+    def test_burst_arrives_in_order(self, ca_batching, ai_conn, client_conn):
+        client = client_conn()
+        ai = ai_conn()
+        _hello_and_establish(client, ai)
+
+        # Enough to go over max-bytes a few times, plus one bigger than it.
+        for i in range(100):
+            payload = Datagram.create_client(CLIENT_OBJECT_SET_FIELD).add_uint32(i)
+            if i == 50:
+                payload.add_raw(b"x" * 1000)
+            ai.send(
+                Datagram.create(
+                    [CLIENT_CHANNEL],
+                    sender=ai.ai_channel,
+                    msgtype=CLIENTAGENT_SEND_DATAGRAM,
+                ).add_raw(payload.bytes())
+            )
+
+        for i in range(100):
+            it = DatagramIterator(client.recv(timeout=3.0))
+            assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+            assert it.read_uint32() == i
+
+    def test_eject_delivered_before_close(self, ca_batching, client_conn):
+        c = client_conn()
+        c.hello(dc_hash("test.dc") ^ 0xDEADBEEF, "dev")
+        c.expect_eject(reason=CLIENT_DISCONNECT_BAD_DCHASH)
+
+
+@pytest.fixture
+def ca_uring(ardos):
+    """CA on the io_uring transport (or tcp, where the kernel can't)."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "transport": "uring",
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL + 15},
+            },
+        },
+    )
+
+
+class TestUringTransport:
+    """Same wire protocol as tcp, so the usual client helpers apply."""
+
+    def test_many_clients_handshake(self, ca_uring, client_conn):
+        clients = [client_conn() for _ in range(16)]
+        for c in clients:
+            c.hello(dc_hash("test.dc"), "dev")
+        for c in clients:
+            c.expect_hello_resp()
+
+    def test_eject_delivered_before_close(self, ca_uring, client_conn):
+        # Writes are batched per loop iteration; closing right after the
+        # eject must still flush it.
+        c = client_conn()
+        c.hello(dc_hash("test.dc") ^ 0xDEADBEEF, "dev")
+        c.expect_eject(reason=CLIENT_DISCONNECT_BAD_DCHASH)
+
+    def test_ai_datagram_reaches_client(self, ca_uring, ai_conn, client_conn):
+        client = client_conn()
+        ai = ai_conn()
+        _hello_and_establish(client, ai)
+
+        ai.send(
+            Datagram.create(
+                [CLIENT_CHANNEL],
+                sender=ai.ai_channel,
+                msgtype=CLIENTAGENT_SEND_DATAGRAM,
+            ).add_raw(Datagram.create_client(CLIENT_HEARTBEAT).bytes())
+        )
+
+        got = client.recv(timeout=3.0)
+        assert DatagramIterator(got).read_client_msgtype() == CLIENT_HEARTBEAT
+
+
+@pytest.fixture
+def ca_udp(ardos):
+    """CA on the udp transport, pinned to CLIENT_CHANNEL."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "transport": "udp",
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL},
+            },
+        },
+    )
+
+
+@pytest.fixture
+def ca_udp_lossy(ardos):
+    """As ca_udp, but dropping a fifth of the packets each way."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "transport": "udp",
+                "udp": {"simulated-loss": 0.2},
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL},
+            },
+        },
+    )
+
+
+class TestUdpTransport:
+    """Clients over udp. tests.common.ardos.UdpSocket speaks the protocol
+    behind the usual client helpers."""
+
+    def test_hello_handshake(self, ca_udp, client_conn):
+        c = client_conn("udp:127.0.0.1")
+        c.hello(dc_hash("test.dc"), "dev")
+        c.expect_hello_resp()
+
+    def test_eject_delivered_before_close(self, ca_udp, client_conn):
+        c = client_conn("udp:127.0.0.1")
+        c.hello(dc_hash("test.dc") ^ 0xDEADBEEF, "dev")
+        c.expect_eject(reason=CLIENT_DISCONNECT_BAD_DCHASH)
+
+    def test_reliable_lane_survives_loss(self, ca_udp_lossy, ai_conn, client_conn):
+        client = client_conn("udp:127.0.0.1")
+        ai = ai_conn()
+        _hello_and_establish(client, ai)
+
+        def send(payload):
+            ai.send(
+                Datagram.create(
+                    [CLIENT_CHANNEL],
+                    sender=ai.ai_channel,
+                    msgtype=CLIENTAGENT_SEND_DATAGRAM,
+                ).add_raw(payload)
+            )
+
+        # Numbered updates, with one spanning several packets in the middle.
+        for i in range(200):
+            send(Datagram.create_client(CLIENT_OBJECT_SET_FIELD).add_uint32(i).bytes())
+            if i == 100:
+                send(Datagram.create_client(CLIENT_HEARTBEAT).add_raw(b"x" * 5000).bytes())
+
+        for i in range(200):
+            it = DatagramIterator(client.recv(timeout=10.0))
+            assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+            assert it.read_uint32() == i
+            if i == 100:
+                big = client.recv(timeout=10.0)
+                assert DatagramIterator(big).read_client_msgtype() == CLIENT_HEARTBEAT
+                assert big[2:] == b"x" * 5000
+
+    def test_unreliable_field_uses_unreliable_lane(self, ca_udp, ai_conn, client_conn):
+        client = client_conn("udp:127.0.0.1")
+        ai = ai_conn()
+        _hello_and_establish(client, ai)
+
+        do_id = 5_001_010
+        ai.send(
+            Datagram.create(
+                [CLIENT_CHANNEL],
+                sender=ai.ai_channel,
+                msgtype=CLIENTAGENT_DECLARE_OBJECT,
+            )
+            .add_uint32(do_id)
+            .add_uint16(class_id("test.dc", "DistributedMover"))
+        )
+        ai.wait_channel_drained(CLIENT_CHANNEL)
+
+        position = field_id("test.dc", "DistributedMover", "setPosition")
+        label = field_id("test.dc", "DistributedMover", "setLabel")
+        ai.send(
+            Datagram.create(
+                [CLIENT_CHANNEL],
+                sender=ai.ai_channel,
+                msgtype=STATESERVER_OBJECT_SET_FIELD,
+            )
+            .add_uint32(do_id)
+            .add_uint16(position)
+            .add_int16(3)
+            .add_int16(-4)
+        )
+        ai.send(
+            Datagram.create(
+                [CLIENT_CHANNEL],
+                sender=ai.ai_channel,
+                msgtype=STATESERVER_OBJECT_SET_FIELD,
+            )
+            .add_uint32(do_id)
+            .add_uint16(label)
+            .add_string("hello")
+        )
+
+        # The lanes aren't ordered with respect to each other.
+        fields = set()
+        for _ in range(2):
+            it = DatagramIterator(client.recv(timeout=3.0))
+            assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+            assert it.read_uint32() == do_id
+            fields.add(it.read_uint16())
+        assert fields == {position, label}
+        assert client.sock.unreliable_received == 1
+
+
+@pytest.fixture
+def ca_compression(ardos):
+    """CA agreeing to compress, with a threshold small datagrams stay under."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "compression": {"enabled": True, "threshold": 64},
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL},
+            },
+        },
+    )
+
+
+class TestCompression:
+    """Clients opt in with a 1-byte first message; see
+    src/net/tcp_transport.h."""
+
+    def test_compressed_stream_inflates(self, ca_compression, ai_conn, client_conn):
+        client = client_conn()
+        ai = ai_conn()
+        assert client.request_compression() == 1
+        _hello_and_establish(client, ai)
+
+        for i in range(50):
+            payload = (
+                Datagram.create_client(CLIENT_OBJECT_SET_FIELD)
+                .add_uint32(i)
+                .add_raw(b"ardos" * 100)
+            )
+            ai.send(
+                Datagram.create(
+                    [CLIENT_CHANNEL],
+                    sender=ai.ai_channel,
+                    msgtype=CLIENTAGENT_SEND_DATAGRAM,
+                ).add_raw(payload.bytes())
+            )
+
+        for i in range(50):
+            it = DatagramIterator(client.recv(timeout=3.0))
+            assert it.read_client_msgtype() == CLIENT_OBJECT_SET_FIELD
+            assert it.read_uint32() == i
+            assert it.peek(500) == b"ardos" * 100
+        assert client.sock.compressed_blocks > 0
+
+    def test_small_writes_sent_raw(self, ca_compression, client_conn):
+        client = client_conn()
+        assert client.request_compression() == 1
+        client.hello(dc_hash("test.dc"), "dev")
+        client.expect_hello_resp()
+        assert client.sock.raw_blocks == 1
+        assert client.sock.compressed_blocks == 0
+
+    def test_disabled_answers_none(self, ca, client_conn):
+        client = client_conn()
+        assert client.request_compression() == 0
+        client.hello(dc_hash("test.dc"), "dev")
+        client.expect_hello_resp()
+
+
+@pytest.fixture
+def ca_tls(ardos, tls_cert):
+    """CA terminating TLS on its tcp transport."""
+    cert, key = tls_cert
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "tls": {"certificate": str(cert), "private-key": str(key)},
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL + 15},
+            },
+        },
+    )
+
+
+@pytest.fixture
+def ca_tls_threaded(ardos, tls_cert):
+    """As ca_tls, with the client sockets served by I/O threads."""
+    cert, key = tls_cert
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "tls": {"certificate": str(cert), "private-key": str(key)},
+                "io-threads": 2,
+                "channels": {"min": CLIENT_CHANNEL, "max": CLIENT_CHANNEL + 15},
+            },
+        },
+    )
+
+
+class TestTls:
+    """The usual protocol inside a TLS stream; tls:-prefixed hosts in
+    tests.common.ardos speak it."""
+
+    def test_hello_handshake(self, ca_tls, client_conn):
+        c = client_conn("tls:127.0.0.1")
+        c.hello(dc_hash("test.dc"), "dev")
+        c.expect_hello_resp()
+
+    def test_eject_delivered_before_close(self, ca_tls, client_conn):
+        c = client_conn("tls:127.0.0.1")
+        c.hello(dc_hash("test.dc") ^ 0xDEADBEEF, "dev")
+        c.expect_eject(reason=CLIENT_DISCONNECT_BAD_DCHASH)
+
+    def test_plaintext_client_dropped(self, ca_tls, client_conn):
+        c = client_conn()
+        c.hello(dc_hash("test.dc"), "dev")
+        with pytest.raises(ConnectionError):
+            c.recv(timeout=3.0)
+
+    def test_session_resumed(self, ca_tls, client_conn):
+        first = client_conn("tls:127.0.0.1")
+        first.hello(dc_hash("test.dc"), "dev")
+        first.expect_hello_resp()
+        # TLS 1.3 tickets arrive after the handshake; reading the hello
+        # response has pulled them in.
+        session = first.sock.session
+        first.close()
+
+        second = client_conn("tls:127.0.0.1", tls_session=session)
+        second.hello(dc_hash("test.dc"), "dev")
+        second.expect_hello_resp()
+        assert second.sock.session_reused
+
+    def test_worker_threads(self, ca_tls_threaded, client_conn):
+        clients = [client_conn("tls:127.0.0.1") for _ in range(8)]
+        for c in clients:
+            c.hello(dc_hash("test.dc"), "dev")
+        for c in clients:
+            c.expect_hello_resp()
@@ -14,7 +14,12 @@ each transport implementation, not in the protocol layer.)
 
 from __future__ import annotations
 
+import base64
+import os
+import socket
+import ssl
 import struct
+import zlib
 
 import pytest
 import websocket
@@ -72,3 +77,158 @@ def test_ws_hello_handshake(ca_ws):
         ), f"expected CLIENT_HELLO_RESP ({CLIENT_HELLO_RESP}); got {mt}"
     finally:
         ws.close()
+
+
+@pytest.fixture
+def ca_ws_batching(ardos):
+    """WS CA with client-agent.batching on."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={"client-agent": {"transport": "ws", "batching": {"enabled": True}}},
+    )
+
+
+def test_ws_batched_frame(ca_ws_batching):
+    """With batching on, each frame carries [uint16 length][datagram] pairs
+    rather than one bare datagram."""
+    ws = websocket.create_connection(
+        "ws://127.0.0.1:6667/", subprotocols=[], timeout=5.0
+    )
+    try:
+        ws.send_binary(
+            Datagram()
+            .add_uint16(CLIENT_HELLO)
+            .add_uint32(dc_hash("test.dc"))
+            .add_string("dev")
+            .bytes()
+        )
+
+        resp = bytes(ws.recv())
+        (length,) = struct.unpack_from("<H", resp)
+        assert length == len(resp) - 2, "expected one length-prefixed datagram"
+        assert DatagramIterator(resp[2:]).read_uint16() == CLIENT_HELLO_RESP
+    finally:
+        ws.close()
+
+
+@pytest.fixture
+def ca_ws_deflate(ardos):
+    """WS CA agreeing to permessage-deflate, compressing every message."""
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "transport": "ws",
+                "compression": {"enabled": True, "threshold": 0},
+            },
+        },
+    )
+
+
+def _recv_until(sock: socket.socket, marker: bytes) -> bytes:
+    data = b""
+    while marker not in data:
+        chunk = sock.recv(4096)
+        assert chunk, "server closed the connection"
+        data += chunk
+    return data
+
+
+def test_ws_permessage_deflate(ca_ws_deflate):
+    """A client offering permessage-deflate gets it: its compressed frames
+    are understood and ours come back compressed (RSV1 set). websocket-client
+    can't negotiate the extension, so this speaks the protocol by hand."""
+    sock = socket.create_connection(("127.0.0.1", 6667), timeout=5.0)
+    try:
+        key = base64.b64encode(os.urandom(16)).decode()
+        sock.sendall(
+            (
+                "GET / HTTP/1.1\r\n"
+                "Host: 127.0.0.1:6667\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                f"Sec-WebSocket-Key: {key}\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Sec-WebSocket-Extensions: permessage-deflate; "
+                "client_max_window_bits\r\n\r\n"
+            ).encode()
+        )
+        response = _recv_until(sock, b"\r\n\r\n")
+        headers, rest = response.split(b"\r\n\r\n", 1)
+        assert headers.startswith(b"HTTP/1.1 101")
+        assert b"sec-websocket-extensions: permessage-deflate" in headers.lower()
+
+        # Compressed, masked binary frame: FIN | RSV1 | opcode 2.
+        payload = (
+            Datagram()
+            .add_uint16(CLIENT_HELLO)
+            .add_uint32(dc_hash("test.dc"))
+            .add_string("dev")
+            .bytes()
+        )
+        deflater = zlib.compressobj(wbits=-zlib.MAX_WBITS)
+        body = deflater.compress(payload) + deflater.flush(zlib.Z_SYNC_FLUSH)
+        body = body[:-4]
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(body))
+        assert len(masked) < 126
+        sock.sendall(bytes([0xC2, 0x80 | len(masked)]) + mask + masked)
+
+        data = rest
+        while len(data) < 2 or len(data) < 2 + (data[1] & 0x7F):
+            chunk = sock.recv(4096)
+            assert chunk, "server closed the connection"
+            data += chunk
+        assert data[0] & 0x40, "expected a compressed (RSV1) frame"
+        assert data[0] & 0x0F == 2
+        length = data[1] & 0x7F
+        assert length < 126
+        inflater = zlib.decompressobj(-zlib.MAX_WBITS)
+        resp = inflater.decompress(data[2 : 2 + length] + b"\x00\x00\xff\xff")
+        assert DatagramIterator(resp).read_uint16() == CLIENT_HELLO_RESP
+    finally:
+        sock.close()
+
+
+@pytest.fixture
+def ca_wss(ardos, tls_cert):
+    """WS CA terminating TLS itself."""
+    cert, key = tls_cert
+    return ardos(
+        md=True,
+        ss=True,
+        ca=True,
+        overrides={
+            "client-agent": {
+                "transport": "ws",
+                "tls": {"certificate": str(cert), "private-key": str(key)},
+            },
+        },
+    )
+
+
+@pytest.mark.parametrize("scheme", ["wss", "ws"])
+def test_wss_hello_handshake(ca_wss, scheme):
+    """With tls set, the same port takes wss:// and plain ws:// clients."""
+    ws = websocket.create_connection(
+        f"{scheme}://127.0.0.1:6667/",
+        timeout=5.0,
+        sslopt={"cert_reqs": ssl.CERT_NONE, "check_hostname": False},
+    )
+    try:
+        payload = (
+            Datagram()
+            .add_uint16(CLIENT_HELLO)
+            .add_uint32(dc_hash("test.dc"))
+            .add_string("dev")
+            .bytes()
+        )
+        ws.send_binary(payload)
+        resp = ws.recv()
+        assert DatagramIterator(bytes(resp)).read_uint16() == CLIENT_HELLO_RESP
+    finally:
+        ws.close()
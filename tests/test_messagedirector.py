@@ -5,11 +5,19 @@ multiple subscribers, and post-remove hooks. This is the core of the cluster
 so everything else depends on it being solid.
 """
 
+import os
+import struct
+import time
+
 import pytest
 
-from tests.common.ardos import Datagram, DatagramIterator
+from tests.common.ardos import Datagram, DatagramIterator, ShmSocket
+from tests.common.dc import dc_hash
 from tests.common.msgtypes import (
+    CLIENTAGENT_ADD_POST_REMOVE,
+    CONTROL_ADD_CHANNEL,
     CONTROL_ADD_POST_REMOVE,
+    CONTROL_CHANNEL,
     CONTROL_CLEAR_POST_REMOVES,
     CONTROL_LOG_MESSAGE,
     CONTROL_REMOVE_RANGE,
@@ -61,6 +69,38 @@ class TestRouting:
             assert mt == 2000
             assert it.read_string() == "hi"
 
+    def test_multicast_delivers_once(self, md, channel_conn):
+        """A datagram addressed to several channels reaches each subscriber
+        once, even one listening on more than one of the recipients."""
+        both = channel_conn(CH_A, CH_B)
+        only_c = channel_conn(CH_C)
+        both.flush()
+        only_c.flush()
+        sender = channel_conn()
+        sender.send(Datagram.create([CH_A, CH_B, CH_C], sender=0, msgtype=2001))
+        for sub in (both, only_c):
+            got = sub.recv(timeout=2.0)
+            _, _, mt = DatagramIterator(got).read_header()
+            assert mt == 2001
+        both.expect_none(timeout=0.5)
+
+    def test_interleaved_burst_keeps_order(self, md, channel_conn):
+        """Publishes batched within one loop iteration still arrive in
+        order, including across alternating recipient lists."""
+        sub = channel_conn(CH_A, CH_B)
+        sub.flush()
+        sender = channel_conn()
+        for i in range(200):
+            recipients = [CH_A] if i % 3 else [CH_A, CH_B]
+            sender.send(
+                Datagram.create(recipients, sender=0, msgtype=2002).add_uint32(i)
+            )
+        for i in range(200):
+            it = DatagramIterator(sub.recv(timeout=2.0))
+            _, _, mt = it.read_header()
+            assert mt == 2002
+            assert it.read_uint32() == i
+
     def test_unsubscribe_stops_delivery(self, md, channel_conn):
         sub = channel_conn(CH_A)
         sub.flush()
@@ -74,7 +114,7 @@ class TestRanges:
     def test_range_subscription(self, md, channel_conn):
         sub = channel_conn()
         sub.add_range(CH_A, CH_A + 100)
-        # Wait until the bucket binding is live before publishing the test
+        # Wait until the range bindings are live before publishing the test
         # message — replaces a blind sleep with a self-probe round-trip.
         sub.wait_range_active(CH_A, CH_A + 100)
 
@@ -97,6 +137,44 @@ class TestRanges:
         sender.send(Datagram.create([CH_A + 50], sender=0, msgtype=1234))
         sub.expect_none(timeout=0.5)
 
+    def test_overlapping_range_removal(self, md, channel_conn):
+        """Removing one of two overlapping ranges on the same connection
+        keeps delivery alive for channels the other range still covers."""
+        sub = channel_conn()
+        sub.add_range(CH_A, CH_A + 100)
+        sub.add_range(CH_A + 50, CH_A + 150)
+        sub.wait_range_active(CH_A + 50, CH_A + 150)
+        sub.send(
+            Datagram.create_control(CONTROL_REMOVE_RANGE)
+            .add_channel(CH_A)
+            .add_channel(CH_A + 100)
+        )
+        sender = channel_conn()
+        sender.send(Datagram.create([CH_A + 75], sender=0, msgtype=1235))
+        got = sub.recv(timeout=2.0)
+        _, _, mt = DatagramIterator(got).read_header()
+        assert mt == 1235
+        # Delivered once, not once per matching range.
+        sub.expect_none(timeout=0.5)
+
+    def test_large_range_edges(self, md, channel_conn):
+        """A range spanning hundreds of millions of channels delivers up to
+        its exact bounds and nothing just past them."""
+        lo, hi = CH_A, CH_A + 200_000_000
+        sub = channel_conn()
+        sub.add_range(lo, hi)
+        sub.wait_range_active(lo, hi)
+
+        sender = channel_conn()
+        sender.send(Datagram.create([hi], sender=0, msgtype=1236))
+        got = sub.recv(timeout=2.0)
+        _, _, mt = DatagramIterator(got).read_header()
+        assert mt == 1236
+
+        sender.send(Datagram.create([hi + 1], sender=0, msgtype=1237))
+        sender.send(Datagram.create([lo - 1], sender=0, msgtype=1237))
+        sub.expect_none(timeout=0.5)
+
 
 class TestPostRemove:
     def test_post_remove_fires_on_disconnect(self, md, channel_conn):
@@ -191,3 +269,404 @@ class TestMDControl:
         got = sub.recv(timeout=2.0)
         _, _, mt = DatagramIterator(got).read_header()
         assert mt == 4323
+
+
+class TestWorkerThreads:
+    """Same routing guarantees with participant sockets served from worker
+    loops (message-director.io-threads > 0)."""
+
+    @pytest.fixture
+    def md(self, ardos):
+        return ardos(md=True, overrides={"message-director": {"io-threads": 2}})
+
+    def test_fanout_across_workers(self, md, channel_conn):
+        # Enough subscribers that both workers own at least one.
+        subs = [channel_conn(CH_A) for _ in range(4)]
+        for s in subs:
+            s.flush()
+        sender = channel_conn()
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=2001).add_string("hi"))
+        for sub in subs:
+            it = DatagramIterator(sub.recv(timeout=2.0))
+            _, _, mt = it.read_header()
+            assert mt == 2001
+            assert it.read_string() == "hi"
+
+    def test_post_remove_fires_on_disconnect(self, md, channel_conn):
+        watcher = channel_conn(CH_B)
+        watcher.flush()
+
+        victim = channel_conn()
+        post = Datagram.create([CH_B], sender=0, msgtype=9998)
+        victim.send(
+            Datagram.create_control(CONTROL_ADD_POST_REMOVE)
+            .add_channel(0)
+            .add_blob(post.bytes())
+        )
+        victim.close()
+
+        _, _, mt = DatagramIterator(watcher.recv(timeout=2.0)).read_header()
+        assert mt == 9998
+
+
+class TestUnixSockets:
+    """Participants on a Unix domain socket listener (message-director.listen)
+    route exactly like TCP ones, including to and from TCP participants."""
+
+    @pytest.fixture(params=[0, 2], ids=lambda t: f"io-threads={t}")
+    def unix_md(self, ardos, tmp_path, request):
+        path = f"unix:{tmp_path / 'md.sock'}"
+        ardos(
+            md=True,
+            overrides={
+                "message-director": {
+                    "io-threads": request.param,
+                    "listen": [path, f"unix:@ardos-test-{os.getpid()}"],
+                }
+            },
+        )
+        return path
+
+    def test_unix_to_tcp(self, unix_md, channel_conn):
+        sub = channel_conn(CH_A)
+        sub.flush()
+        sender = channel_conn(host=unix_md)
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=4401))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 4401
+
+    def test_tcp_to_unix(self, unix_md, channel_conn):
+        sub = channel_conn(CH_B, host=unix_md)
+        sub.flush()
+        sender = channel_conn()
+        sender.send(Datagram.create([CH_B], sender=0, msgtype=4402))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 4402
+
+    def test_abstract_socket(self, unix_md, channel_conn):
+        sub = channel_conn(CH_C, host=f"unix:@ardos-test-{os.getpid()}")
+        sub.flush()
+        sender = channel_conn(host=unix_md)
+        sender.send(Datagram.create([CH_C], sender=0, msgtype=4403))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 4403
+
+
+class TestShmTransport:
+    """Participants on a shared-memory listener (shm: in
+    message-director.listen) route like TCP ones, and their post-removes
+    fire when the control socket hangs up."""
+
+    @pytest.fixture
+    def shm_md(self, ardos):
+        path = f"shm:@ardos-test-shm-{os.getpid()}"
+        ardos(md=True, overrides={"message-director": {"listen": [path]}})
+        return path
+
+    def test_shm_to_tcp(self, shm_md, channel_conn):
+        sub = channel_conn(CH_A)
+        sub.flush()
+        sender = channel_conn(host=shm_md)
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=4411))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 4411
+
+    def test_tcp_to_shm(self, shm_md, channel_conn):
+        sub = channel_conn(CH_B, host=shm_md)
+        sub.flush()
+        sender = channel_conn()
+        for i in range(100):
+            sender.send(Datagram.create([CH_B], sender=0, msgtype=4412).add_uint32(i))
+        for i in range(100):
+            it = DatagramIterator(sub.recv(timeout=2.0))
+            _, _, mt = it.read_header()
+            assert mt == 4412
+            assert it.read_uint32() == i
+
+    def test_post_remove_fires_on_disconnect(self, shm_md, channel_conn):
+        watcher = channel_conn(CH_C)
+        watcher.flush()
+
+        victim = channel_conn(host=shm_md)
+        post = Datagram.create([CH_C], sender=0, msgtype=9997)
+        victim.send(
+            Datagram.create_control(CONTROL_ADD_POST_REMOVE)
+            .add_channel(0)
+            .add_blob(post.bytes())
+        )
+        victim.flush()
+        victim.close()
+
+        _, _, mt = DatagramIterator(watcher.recv(timeout=2.0)).read_header()
+        assert mt == 9997
+
+    def test_unsealed_segment_rejected(self, shm_md):
+        """The participant could truncate a segment without F_SEAL_SHRINK
+        under the MD's mapping, so it isn't mapped at all."""
+        path = "\0" + shm_md[len("shm:@") :]
+        sock = ShmSocket(path, seal=False)
+        try:
+            sock.settimeout(2.0)
+            assert sock.recv(1) == b""
+        finally:
+            sock.close()
+
+    def test_small_ring_rejected(self, shm_md):
+        """A ring too small for the largest datagram is refused outright."""
+        path = "\0" + shm_md[len("shm:@") :]
+        sock = ShmSocket(path, ring_bytes=4096)
+        try:
+            sock.settimeout(2.0)
+            assert sock.recv(1) == b""
+        finally:
+            sock.close()
+
+
+class TestRemoteInterest:
+    """Two MDs on one broker with message-director.remote-interest enabled,
+    so each only publishes what the other is actually bound to."""
+
+    @pytest.fixture
+    def md(self, ardos):
+        overrides = {
+            "message-director": {
+                "remote-interest": True,
+                "remote-interest-sync-timeout": 200,
+                "remote-interest-heartbeat": 100,
+            }
+        }
+        ardos(md=True, overrides=overrides)
+        ardos(md=True, md_port=7101, overrides=overrides)
+
+    def test_cross_md_delivery(self, md, channel_conn):
+        sub = channel_conn(CH_A, port=7101)
+        sub.flush()
+        sender = channel_conn()
+
+        # The subscription reaches the other MD asynchronously; keep
+        # probing until it has.
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_A], sender=0, msgtype=2100))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+        sub.flush()
+
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=2101))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2101
+
+    def test_churn_within_a_tick(self, md, channel_conn):
+        """Subscribe, unsubscribe and resubscribe in one burst: the
+        first two cancel out before they're announced, and the other MD
+        still learns about the last."""
+        sub = channel_conn(port=7101)
+        sub.subscribe(CH_C)
+        sub.unsubscribe(CH_C)
+        sub.subscribe(CH_C)
+        sub.flush()
+        sender = channel_conn()
+
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_C], sender=0, msgtype=2103))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+
+    def test_heartbeats_keep_peers(self, md, channel_conn):
+        """Peers that keep sending heartbeats outlive the interest TTL
+        (three heartbeats) with their subscriptions intact."""
+        sub = channel_conn(CH_A, port=7101)
+        sub.flush()
+        sender = channel_conn()
+
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_A], sender=0, msgtype=2104))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+        sub.flush()
+
+        time.sleep(0.6)
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=2105))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2105
+
+    def test_local_only_delivery(self, md, channel_conn):
+        sub = channel_conn(CH_B)
+        sub.flush()
+        sender = channel_conn()
+        sender.send(Datagram.create([CH_B], sender=0, msgtype=2102))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2102
+
+
+class TestMeshBackend:
+    """Two MDs linked directly by message-director.backend: mesh, no broker
+    in the path."""
+
+    @staticmethod
+    def _mesh(port, peer_port):
+        return {
+            "message-director": {
+                "backend": "mesh",
+                "mesh": {
+                    "host": "127.0.0.1",
+                    "port": port,
+                    "redial-interval": 100,
+                    "sync-timeout": 500,
+                    "peers": [{"host": "127.0.0.1", "port": peer_port}],
+                },
+            }
+        }
+
+    @pytest.fixture
+    def md(self, ardos):
+        ardos(md=True, overrides=self._mesh(7200, 7201))
+        ardos(md=True, md_port=7101, overrides=self._mesh(7201, 7200))
+
+    def test_cross_md_delivery(self, md, channel_conn):
+        sub = channel_conn(CH_A, port=7101)
+        sub.flush()
+        sender = channel_conn()
+
+        # The link and the subscription come up asynchronously; keep
+        # probing until the datagram makes it across.
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_A], sender=0, msgtype=2110))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+        sub.flush()
+
+        sender.send(Datagram.create([CH_A, CH_B], sender=0, msgtype=2111))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2111
+        sub.expect_none(timeout=0.3)
+
+    def test_range_delivery(self, md, channel_conn):
+        sub = channel_conn(port=7101)
+        sub.add_range(CH_A, CH_A + 10)
+        sub.flush()
+        sender = channel_conn()
+
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_A + 5], sender=0, msgtype=2112))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+
+    def test_ready_after_peer_sync(self, ardos, channel_conn):
+        """An MD only starts serving once it has its peers' subscriptions,
+        so its first publish already reaches them."""
+        ardos(md=True, overrides=self._mesh(7200, 7201))
+        sub = channel_conn(CH_A)
+        sub.flush()
+
+        ardos(md=True, md_port=7101, overrides=self._mesh(7201, 7200))
+        sender = channel_conn(port=7101)
+        sender.send(Datagram.create([CH_A], sender=0, msgtype=2118))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2118
+
+    def test_large_snapshot(self, ardos, channel_conn):
+        """A peer linking up with an MD bound to 500k channels gets the
+        whole snapshot (over 4 MiB, more than a link will queue at once)
+        paced out over the link, rather than the link dropping on it."""
+        count = 500_000
+        base = 2_000_000_000
+        ardos(md=True, overrides=self._mesh(7200, 7201))
+
+        sub = channel_conn()
+        add = struct.Struct("<HBQHQ")
+        sub.sock.sendall(
+            b"".join(
+                add.pack(add.size - 2, 1, CONTROL_CHANNEL, CONTROL_ADD_CHANNEL, ch)
+                for ch in range(base, base + count)
+            )
+        )
+        # Binds are handled in order; once the last one delivers locally,
+        # they're all in.
+        last = base + count - 1
+        local = channel_conn()
+        local.send(Datagram.create([last], sender=0, msgtype=2115))
+        sub.recv(timeout=10.0)
+
+        ardos(md=True, md_port=7101, overrides=self._mesh(7201, 7200))
+        sender = channel_conn(port=7101)
+        got = None
+        for _ in range(50):
+            sender.send(Datagram.create([last], sender=0, msgtype=2116))
+            got = sub.recv_maybe(timeout=0.2)
+            if got is not None:
+                break
+        assert got is not None
+        sub.flush()
+
+        # Still up several redial intervals later.
+        time.sleep(0.5)
+        sender.send(Datagram.create([base], sender=0, msgtype=2117))
+        _, _, mt = DatagramIterator(sub.recv(timeout=2.0)).read_header()
+        assert mt == 2117
+
+    def test_remote_post_remove_survives_buffer_reuse(
+        self, ardos, channel_conn, client_conn
+    ):
+        """A CA keeps post-removes as slices of the datagram they came in.
+        Coming from another MD, that datagram borrows the link's read
+        buffer; the slice must still hold the original bytes once later
+        frames have reused it."""
+        client_channel = 1_000_000_000
+        ardos(md=True, overrides=self._mesh(7200, 7201))
+        overrides = self._mesh(7201, 7200)
+        overrides["client-agent"] = {
+            "channels": {"min": client_channel, "max": client_channel}
+        }
+        ardos(md=True, ca=True, md_port=7101, overrides=overrides)
+
+        client = client_conn()
+        client.hello(dc_hash("test.dc"), "dev")
+        client.expect_hello_resp()
+
+        sub = channel_conn(CH_A, port=7101)
+        watcher = channel_conn(CH_B, port=7101)
+        sub.flush()
+        watcher.flush()
+        sender = channel_conn()
+        got = None
+        for _ in range(30):
+            sender.send(Datagram.create([CH_A], sender=0, msgtype=2113))
+            got = sub.recv_maybe(timeout=0.1)
+            if got is not None:
+                break
+        assert got is not None
+        sub.flush()
+
+        post = Datagram.create([CH_B], sender=0, msgtype=2114).add_uint32(0xA5A5)
+        sender.send(
+            Datagram.create(
+                [client_channel], sender=0, msgtype=CLIENTAGENT_ADD_POST_REMOVE
+            ).add_blob(post.bytes())
+        )
+        for _ in range(20):
+            sender.send(
+                Datagram.create([CH_A], sender=0, msgtype=2115).add_raw(b"\xff" * 64)
+            )
+        for _ in range(20):
+            sub.recv(timeout=2.0)
+
+        client.close()
+        it = DatagramIterator(watcher.recv(timeout=3.0))
+        _, _, mt = it.read_header()
+        assert mt == 2114
+        assert it.read_uint32() == 0xA5A5
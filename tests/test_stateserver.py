@@ -130,6 +130,157 @@ class TestFieldUpdate:
         assert it.read_uint16() == field
         assert it.read_uint8() == 99
 
+    def test_large_field_broadcast_intact(self, ss, channel_conn):
+        # Far past the inline buffer, so the broadcast is laid out in a
+        # pooled buffer sized up front.
+        sender = channel_conn()
+        sender.send(_create_required())
+
+        loc_ch = (PARENT << 32) | ZONE
+        watcher = channel_conn(loc_ch)
+        watcher.flush()
+
+        field = field_id("test.dc", "DistributedTestObject1", "setBR1")
+        value = "ardos" * 6000
+        dg = Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_SET_FIELD)
+        dg.add_uint32(DO_ID).add_uint16(field).add_string(value)
+        sender.send(dg)
+
+        got = watcher.recv(timeout=2.0)
+        it = DatagramIterator(got)
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_SET_FIELD
+        assert it.read_uint32() == DO_ID
+        assert it.read_uint16() == field
+        assert it.read_string() == value
+
+    def test_molecular_update_stores_atomics(self, ss, channel_conn):
+        # The atomics of a molecular update are stored (and the whole update
+        # forwarded) straight out of the incoming datagram.
+        conn = channel_conn(5)
+        cls = class_id("test.dc", "DistributedTestObject4")
+        create = Datagram.create(
+            [SS_CHANNEL], sender=5, msgtype=STATESERVER_CREATE_OBJECT_WITH_REQUIRED
+        )
+        create.add_uint32(DO_ID).add_uint32(PARENT).add_uint32(ZONE)
+        create.add_uint16(cls)
+        for v in (1, 2, 3, 4):  # setX, setY, setUnrelated, setZ
+            create.add_uint32(v)
+        conn.send(create)
+        conn.wait_object_alive(DO_ID, sender=5)
+
+        loc_ch = (PARENT << 32) | ZONE
+        watcher = channel_conn(loc_ch)
+        watcher.flush()
+
+        xyz = field_id("test.dc", "DistributedTestObject4", "setXyz")
+        dg = Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_SET_FIELD)
+        dg.add_uint32(DO_ID).add_uint16(xyz)
+        dg.add_uint32(10).add_uint32(20).add_uint32(30)
+        conn.send(dg)
+
+        f123 = field_id("test.dc", "DistributedTestObject4", "set123")
+        dg = Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_SET_FIELD)
+        dg.add_uint32(DO_ID).add_uint16(f123)
+        dg.add_uint8(7).add_uint8(8).add_uint8(9)
+        conn.send(dg)
+
+        it = DatagramIterator(watcher.recv(timeout=2.0))
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_SET_FIELD
+        assert it.read_uint32() == DO_ID
+        assert it.read_uint16() == xyz
+        assert [it.read_uint32() for _ in range(3)] == [10, 20, 30]
+
+        req = (
+            Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_GET_ALL)
+            .add_uint32(1)
+            .add_uint32(DO_ID)
+        )
+        conn.send(req)
+        it = DatagramIterator(conn.recv(timeout=3.0))
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_GET_ALL_RESP
+        assert it.read_uint32() == 1  # context
+        assert it.read_uint32() == DO_ID
+        it.read_uint32()  # parent
+        it.read_uint32()  # zone
+        assert it.read_uint16() == cls
+        assert [it.read_uint32() for _ in range(4)] == [10, 20, 3, 30]
+
+        ram = {}
+        for _ in range(it.read_uint16()):
+            ram[it.read_uint16()] = it.read_uint8()
+        assert ram == {
+            field_id("test.dc", "DistributedTestObject4", "setOne"): 7,
+            field_id("test.dc", "DistributedTestObject4", "setTwo"): 8,
+            field_id("test.dc", "DistributedTestObject4", "setThree"): 9,
+        }
+
+    def test_mixed_layout_update_round_trip(self, ss, channel_conn):
+        # Fixed-size parameters around strings and arrays: the stored value,
+        # the broadcast and GET_ALL must all match the wire bytes exactly.
+        def mixed(dg, a, b, c, d, e):
+            dg.add_uint32(a).add_string(b).add_uint16(c).add_blob(d).add_int8(e)
+            return dg
+
+        conn = channel_conn(5)
+        cls = class_id("test.dc", "DistributedMixedObject")
+        create = Datagram.create(
+            [SS_CHANNEL], sender=5, msgtype=STATESERVER_CREATE_OBJECT_WITH_REQUIRED
+        )
+        create.add_uint32(DO_ID).add_uint32(PARENT).add_uint32(ZONE)
+        create.add_uint16(cls)
+        conn.send(mixed(create, 1, "one", 2, b"\x03", -4))
+        conn.wait_object_alive(DO_ID, sender=5)
+
+        loc_ch = (PARENT << 32) | ZONE
+        watcher = channel_conn(loc_ch)
+        watcher.flush()
+
+        field = field_id("test.dc", "DistributedMixedObject", "setMixed")
+        dg = Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_SET_FIELD)
+        dg.add_uint32(DO_ID).add_uint16(field)
+        conn.send(mixed(dg, 0xDEADBEEF, "ardos" * 50, 7, bytes(range(200)), -1))
+
+        # A string that claims more bytes than were sent is dropped, and
+        # leaves the stored value alone.
+        dg = Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_SET_FIELD)
+        dg.add_uint32(DO_ID).add_uint16(field).add_uint32(9).add_uint16(500)
+        conn.send(dg)
+
+        it = DatagramIterator(watcher.recv(timeout=2.0))
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_SET_FIELD
+        assert it.read_uint32() == DO_ID
+        assert it.read_uint16() == field
+        assert it.read_uint32() == 0xDEADBEEF
+        assert it.read_string() == "ardos" * 50
+        assert it.read_uint16() == 7
+        assert it.read_blob() == bytes(range(200))
+        assert it.read_int8() == -1
+        assert watcher.recv_maybe(timeout=0.3) is None
+
+        req = (
+            Datagram.create([DO_ID], sender=5, msgtype=STATESERVER_OBJECT_GET_ALL)
+            .add_uint32(1)
+            .add_uint32(DO_ID)
+        )
+        conn.send(req)
+        it = DatagramIterator(conn.recv(timeout=3.0))
+        _, _, mt = it.read_header()
+        assert mt == STATESERVER_OBJECT_GET_ALL_RESP
+        assert it.read_uint32() == 1  # context
+        assert it.read_uint32() == DO_ID
+        it.read_uint32()  # parent
+        it.read_uint32()  # zone
+        assert it.read_uint16() == cls
+        assert it.read_uint32() == 0xDEADBEEF
+        assert it.read_string() == "ardos" * 50
+        assert it.read_uint16() == 7
+        assert it.read_blob() == bytes(range(200))
+        assert it.read_int8() == -1
+
 
 class TestLocation:
     def test_set_location_moves_object(self, ss, channel_conn):